@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <string>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <iterator>
 
@@ -20,6 +21,31 @@
 #include "BlockMapStream.hpp"
 #include "xercesc/util/XMLString.hpp"
 
+// internal interface
+EXTERN_C const IID IID_IAppxBlockMapInternal;
+#ifndef WIN32
+// {4c7f2a90-d315-4e6b-8f4a-1b93e605c27d}
+interface IAppxBlockMapInternal : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IAppxBlockMapInternal : public IUnknown
+#endif
+{
+public:
+    // Blocks of a file by its block map name, without going through IAppxBlockMapBlock for each one.
+    virtual const std::vector<MSIX::Block>& GetBlocks(const std::string& fileName) = 0;
+
+    // A file by its block map name, without the round trip through a utf16 name.
+    virtual MSIX::ComPtr<IAppxBlockMapFile> GetBlockMapFile(const std::string& fileName) = 0;
+
+    // SHA256 over the hashes of a file's blocks, in order.  Files of the same size with the same digest have the
+    // same content.  Computed the first time it is asked for.
+    virtual const std::vector<std::uint8_t>& GetFileDigest(const std::string& fileName) = 0;
+};
+
+SpecializeUuidOfImpl(IAppxBlockMapInternal);
+
 namespace MSIX {
 
     class AppxBlockMapBlock : public MSIX::ComClass<AppxBlockMapBlock, IAppxBlockMapBlock>
@@ -183,8 +209,11 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE GetCurrent(IAppxBlockMapFile** block) override
         {
             return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (block == nullptr || *block != nullptr), "bad pointer");
                 ThrowErrorIf(Error::Unexpected, (m_cursor >= m_files.size()), "index out of range");
-                ThrowHrIfFailed(m_reader->GetFile(utf8_to_utf16(m_files.at(m_cursor)).c_str(), block));
+                // The names are already utf8, so skip the round trip through IAppxBlockMapReader::GetFile.
+                ComPtr<IStream> stream = m_reader.As<IStorageObject>()->GetFile(m_files.at(m_cursor));
+                *block = stream.As<IAppxBlockMapFile>().Detach();
             });
         }
 
@@ -203,11 +232,15 @@ namespace MSIX {
         }
     };
 
+    class PackageIndex;
+
     // Object backed by AppxBlockMap.xml
-    class AppxBlockMapObject : public MSIX::ComClass<AppxBlockMapObject, IAppxBlockMapReader, IVerifierObject, IStorageObject>
+    class AppxBlockMapObject : public MSIX::ComClass<AppxBlockMapObject, IAppxBlockMapReader, IVerifierObject, IStorageObject, IAppxBlockMapInternal>
     {
     public:
         AppxBlockMapObject(IMSIXFactory* factory, ComPtr<IStream>& stream);
+        // Takes the files and their blocks from the index of the package instead of parsing the stream.
+        AppxBlockMapObject(IMSIXFactory* factory, ComPtr<IStream>& stream, PackageIndex& index);
 
         // IVerifierObject
         const std::string& GetPublisher() override { throw Exception(Error::NotSupported); }
@@ -229,9 +262,18 @@ namespace MSIX {
         IStream*                  OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) override;
         void                      CommitChanges() override;
 
+        // IAppxBlockMapInternal
+        const std::vector<Block>& GetBlocks(const std::string& fileName) override;
+        ComPtr<IAppxBlockMapFile> GetBlockMapFile(const std::string& fileName) override;
+        const std::vector<std::uint8_t>& GetFileDigest(const std::string& fileName) override;
+
     protected:
+        void AddFile(const std::string& name, std::vector<Block>&& blocks, std::uint32_t localFileHeaderSize, std::uint64_t size);
+
         std::map<std::string, std::vector<Block>>        m_blockMap;
         std::map<std::string, ComPtr<IAppxBlockMapFile>> m_blockMapfiles;
+        std::map<std::string, std::vector<std::uint8_t>> m_digests;
+        std::mutex                                       m_digestsLock;
         IMSIXFactory*   m_factory;
         ComPtr<IStream> m_stream;
     };
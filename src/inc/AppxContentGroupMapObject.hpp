@@ -0,0 +1,146 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "Exceptions.hpp"
+#include "AppxFactory.hpp"
+
+namespace MSIX {
+
+    // names of the content group map, as the block map and the container have it.
+    #define APPXCONTENTGROUPMAP_XML_BLOCKMAP_NAME "AppxMetadata\\AppxContentGroupMap.xml"
+    #define APPXCONTENTGROUPMAP_XML               "AppxMetadata/AppxContentGroupMap.xml"
+
+    struct ContentGroup
+    {
+        std::string              name;
+        std::vector<std::string> files;     // as the block map names them
+    };
+
+    class AppxContentGroupFilesEnumerator : public MSIX::ComClass<AppxContentGroupFilesEnumerator, IAppxContentGroupFilesEnumerator>
+    {
+    protected:
+        ComPtr<IMSIXFactory>                m_factory;
+        std::shared_ptr<const ContentGroup> m_group;
+        std::size_t                         m_cursor = 0;
+
+    public:
+        AppxContentGroupFilesEnumerator(IMSIXFactory* factory, std::shared_ptr<const ContentGroup> group) :
+            m_factory(factory),
+            m_group(std::move(group))
+        {}
+
+        // IAppxContentGroupFilesEnumerator
+        HRESULT STDMETHODCALLTYPE GetCurrent(LPWSTR* file) override
+        {   return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (file == nullptr || *file != nullptr), "bad pointer");
+                ThrowErrorIf(Error::Unexpected, (m_cursor >= m_group->files.size()), "index out of range");
+                ThrowHrIfFailed(m_factory->MarshalOutString(m_group->files[m_cursor], file));
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetHasCurrent(BOOL* hasCurrent) override
+        {   return ResultOf([&]{
+                ThrowErrorIfNot(Error::InvalidParameter, (hasCurrent), "bad pointer");
+                *hasCurrent = (m_cursor != m_group->files.size()) ? TRUE : FALSE;
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE MoveNext(BOOL* hasNext) override
+        {   return ResultOf([&]{
+                ThrowErrorIfNot(Error::InvalidParameter, (hasNext), "bad pointer");
+                *hasNext = (++m_cursor != m_group->files.size()) ? TRUE : FALSE;
+            });
+        }
+    };
+
+    class AppxContentGroup : public MSIX::ComClass<AppxContentGroup, IAppxContentGroup>
+    {
+    protected:
+        ComPtr<IMSIXFactory>                m_factory;
+        std::shared_ptr<const ContentGroup> m_group;
+
+    public:
+        AppxContentGroup(IMSIXFactory* factory, std::shared_ptr<const ContentGroup> group) :
+            m_factory(factory),
+            m_group(std::move(group))
+        {}
+
+        // IAppxContentGroup
+        HRESULT STDMETHODCALLTYPE GetName(LPWSTR* groupName) override
+        {   return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (groupName == nullptr || *groupName != nullptr), "bad pointer");
+                ThrowHrIfFailed(m_factory->MarshalOutString(m_group->name, groupName));
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetFiles(IAppxContentGroupFilesEnumerator** enumerator) override
+        {   return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (enumerator == nullptr || *enumerator != nullptr), "bad pointer");
+                *enumerator = ComPtr<IAppxContentGroupFilesEnumerator>::Make<AppxContentGroupFilesEnumerator>(m_factory.Get(), m_group).Detach();
+            });
+        }
+    };
+
+    class AppxContentGroupsEnumerator : public MSIX::ComClass<AppxContentGroupsEnumerator, IAppxContentGroupsEnumerator>
+    {
+    protected:
+        ComPtr<IMSIXFactory>                             m_factory;
+        std::vector<std::shared_ptr<const ContentGroup>> m_groups;
+        std::size_t                                      m_cursor = 0;
+
+    public:
+        AppxContentGroupsEnumerator(IMSIXFactory* factory, std::vector<std::shared_ptr<const ContentGroup>> groups) :
+            m_factory(factory),
+            m_groups(std::move(groups))
+        {}
+
+        // IAppxContentGroupsEnumerator
+        HRESULT STDMETHODCALLTYPE GetCurrent(IAppxContentGroup** group) override
+        {   return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (group == nullptr || *group != nullptr), "bad pointer");
+                ThrowErrorIf(Error::Unexpected, (m_cursor >= m_groups.size()), "index out of range");
+                *group = ComPtr<IAppxContentGroup>::Make<AppxContentGroup>(m_factory.Get(), m_groups[m_cursor]).Detach();
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetHasCurrent(BOOL* hasCurrent) override
+        {   return ResultOf([&]{
+                ThrowErrorIfNot(Error::InvalidParameter, (hasCurrent), "bad pointer");
+                *hasCurrent = (m_cursor != m_groups.size()) ? TRUE : FALSE;
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE MoveNext(BOOL* hasNext) override
+        {   return ResultOf([&]{
+                ThrowErrorIfNot(Error::InvalidParameter, (hasNext), "bad pointer");
+                *hasNext = (++m_cursor != m_groups.size()) ? TRUE : FALSE;
+            });
+        }
+    };
+
+    // Object backed by AppxMetadata/AppxContentGroupMap.xml.  The required group comes first in GetGroups, then the
+    // automatic groups in the order the map has them.
+    class AppxContentGroupMapObject : public MSIX::ComClass<AppxContentGroupMapObject, IAppxContentGroupMapReader>
+    {
+    public:
+        AppxContentGroupMapObject(IMSIXFactory* factory, IStream* stream);
+
+        // IAppxContentGroupMapReader
+        HRESULT STDMETHODCALLTYPE GetRequiredGroup(IAppxContentGroup** requiredGroup) override;
+        HRESULT STDMETHODCALLTYPE GetAutomaticGroups(IAppxContentGroupsEnumerator** automaticGroupsEnumerator) override;
+
+        const std::vector<std::shared_ptr<const ContentGroup>>& GetGroups() { return m_groups; }
+
+    protected:
+        ComPtr<IMSIXFactory>                             m_factory;
+        std::vector<std::shared_ptr<const ContentGroup>> m_groups;
+    };
+}
@@ -9,6 +9,7 @@
 #include "ComHelper.hpp"
 #include "xercesc/util/PlatformUtils.hpp"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -24,7 +25,7 @@ class IMSIXFactory : public IUnknown
 #endif
 {
 public:
-    virtual HRESULT MarshalOutString(std::string& internal, LPWSTR *result) = 0;
+    virtual HRESULT MarshalOutString(const std::string& internal, LPWSTR *result) = 0;
     virtual HRESULT MarshalOutBytes(std::vector<std::uint8_t>& data, UINT32* size, BYTE** buffer) = 0;
     virtual MSIX_VALIDATION_OPTION GetValidationOptions() = 0;
 };
@@ -32,25 +33,20 @@ public:
 SpecializeUuidOfImpl(IMSIXFactory);
 
 namespace MSIX {
-    class AppxFactory : public ComClass<AppxFactory, IMSIXFactory, IAppxFactory>
+    class HmacKey;
+    class ReaderCache;
+    class ValidatedStore;
+
+    class AppxFactory : public ComClass<AppxFactory, IMSIXFactory, IAppxFactory, IAppxFactory2, IMSIXFactoryOptions>
     {
     public:
-        AppxFactory(MSIX_VALIDATION_OPTION validationOptions, COTASKMEMALLOC* memalloc, COTASKMEMFREE* memfree ) : 
-            m_validationOptions(validationOptions), m_memalloc(memalloc), m_memfree(memfree)
-        {
-            ThrowErrorIf(Error::InvalidParameter, (m_memalloc == nullptr || m_memfree == nullptr), "allocator/deallocator pair not specified.")
-            XERCES_CPP_NAMESPACE::XMLPlatformUtils::Initialize();
-        }
-
-        ~AppxFactory()
-        {
-            XERCES_CPP_NAMESPACE::XMLPlatformUtils::Terminate();
-        }
+        AppxFactory(MSIX_VALIDATION_OPTION validationOptions, COTASKMEMALLOC* memalloc, COTASKMEMFREE* memfree );
+        ~AppxFactory();
 
         // IAppxFactory
         HRESULT STDMETHODCALLTYPE CreatePackageWriter (
             IStream* outputStream,
-            APPX_PACKAGE_SETTINGS* ,//settings, TODO: plumb this through
+            APPX_PACKAGE_SETTINGS* settings,
             IAppxPackageWriter** packageWriter) override;           
 
         HRESULT STDMETHODCALLTYPE CreatePackageReader (IStream* inputStream, IAppxPackageReader** packageReader) override;
@@ -62,13 +58,27 @@ namespace MSIX {
             LPCWSTR signatureFileName,
             IAppxBlockMapReader** blockMapReader) override;
 
+        // IAppxFactory2
+        HRESULT STDMETHODCALLTYPE CreateContentGroupMapReader(IStream* inputStream, IAppxContentGroupMapReader** contentGroupMapReader) override;
+        HRESULT STDMETHODCALLTYPE CreateSourceContentGroupMapReader(IStream* inputStream, IAppxSourceContentGroupMapReader** reader) override;
+        HRESULT STDMETHODCALLTYPE CreateContentGroupMapWriter(IStream* stream, IAppxContentGroupMapWriter** contentGroupMapWriter) override;
+
         // IMSIXFactory
-        HRESULT MarshalOutString(std::string& internal, LPWSTR *result) override;
+        HRESULT MarshalOutString(const std::string& internal, LPWSTR *result) override;
         HRESULT MarshalOutBytes(std::vector<std::uint8_t>& data, UINT32* size, BYTE** buffer) override;
         MSIX_VALIDATION_OPTION GetValidationOptions() override { return m_validationOptions; }
 
+        // IMSIXFactoryOptions
+        HRESULT STDMETHODCALLTYPE SetIndexDirectory(const char* utf8Directory) override;
+        HRESULT STDMETHODCALLTYPE SetReaderCacheBudget(UINT64 budgetBytes) override;
+        HRESULT STDMETHODCALLTYPE SetValidatedStateDirectory(const char* utf8Directory) override;
+
         COTASKMEMALLOC* m_memalloc;
         COTASKMEMFREE*  m_memfree;
         MSIX_VALIDATION_OPTION m_validationOptions;
+        std::string     m_indexDirectory;
+        std::unique_ptr<HmacKey> m_indexKey;            // kept in m_indexDirectory, seals the indexes in it
+        std::unique_ptr<ReaderCache> m_readerCache;     // made when it is first given a budget
+        std::unique_ptr<ValidatedStore> m_validatedStore;
     };
 }
\ No newline at end of file
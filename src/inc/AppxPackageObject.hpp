@@ -8,6 +8,8 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <functional>
 
 #include "AppxPackaging.hpp"
 #include "MSIXWindows.hpp"
@@ -19,8 +21,18 @@
 #include "VerifierObject.hpp"
 #include "XmlObject.hpp"
 #include "AppxBlockMapObject.hpp"
+#include "AppxContentGroupMapObject.hpp"
+#include "BlockReader.hpp"
 #include "AppxSignature.hpp"
 #include "AppxFactory.hpp"
+#include "ContentType.hpp"
+#include "PackageIndex.hpp"
+#include "ValidatedStore.hpp"
+
+namespace MSIX {
+    // Called as unpack completes each content group of the package, see UnpackPackageByContentGroup.
+    using ContentGroupCallback = std::function<void(const std::string& groupName, bool isRequired)>;
+}
 
 // internal interface
 EXTERN_C const IID IID_IPackage;   
@@ -34,13 +46,36 @@ class IPackage : public IUnknown
 #endif
 {
 public:
-    virtual void Unpack(MSIX_PACKUNPACK_OPTION options, IStorageObject* to) = 0;
+    virtual void Unpack(MSIX_PACKUNPACK_OPTION options, IStorageObject* to, const MSIX::ContentGroupCallback& onContentGroup) = 0;
     virtual std::vector<std::string>& GetFootprintFiles() = 0;
+
+    // For copying the files of the package as they are stored: the archive, which throws NoInterface for a package
+    // that is read from a stream, and the content type of a file by its name in the archive.
+    virtual MSIX::ComPtr<IZipReader> GetZipReader() = 0;
+    virtual std::string GetContentType(const std::string& fileName) = 0;
 };
 
 SpecializeUuidOfImpl(IPackage);
 
 namespace MSIX {
+
+    // names of footprint files.
+    #define APPXBLOCKMAP_XML  "AppxBlockMap.xml"
+    #define APPXMANIFEST_XML  "AppxManifest.xml"
+    #define CODEINTEGRITY_CAT "AppxMetadata/CodeIntegrity.cat"
+    #define APPXSIGNATURE_P7X "AppxSignature.p7x"
+    #define CONTENT_TYPES_XML "[Content_Types].xml"
+
+    // Where a content group ends in the order that unpack goes through the files in.
+    struct ContentGroupEnd
+    {
+        std::size_t end;            // how many files come before the end
+        std::string name;
+        bool        isRequired;
+    };
+
+    // Maps a file name as it appears in the block map to its name in the zip archive.
+    std::string EncodeFileName(std::string fileName);
     // The 5-tuple that describes the identity of a package
     struct AppxPackageId
     {
@@ -74,6 +109,8 @@ namespace MSIX {
     {
     public:
         AppxManifestObject(ComPtr<IStream>& stream);
+        // A manifest that was parsed already, over stream instead of the one it was read from.
+        AppxManifestObject(const AppxPackageId& packageId, ComPtr<IStream>& stream);
 
         // IVerifierObject
         const std::string& GetPublisher() override { return GetPackageId()->Publisher; }
@@ -92,15 +129,44 @@ namespace MSIX {
         std::unique_ptr<AppxPackageId> m_packageId;
     };
 
+    // What opening a package validates, beyond its index, without any of the streams it was read from.  None of it
+    // changes once it is made, so readers of the same, unchanged, package can share it over streams of their own.
+    struct AppxPackageParts
+    {
+        ComPtr<AppxSignatureObject>       signature;      // its digests, origin and publisher, without a stream
+        std::shared_ptr<AppxPackageId>    packageId;
+        std::shared_ptr<ContentTypeTable> contentTypes;
+    };
+
     // Storage object representing the entire AppxPackage
-    class AppxPackageObject : public ComClass<AppxPackageObject, IAppxPackageReader, IPackage, IStorageObject>
+    class AppxPackageObject : public ComClass<AppxPackageObject, IAppxPackageReader2, IPackage, IStorageObject, IMSIXReadStatistics>
     {
     public:
-        AppxPackageObject(IMSIXFactory* factory, MSIX_VALIDATION_OPTION validation, IStorageObject* container);
+        // With an index, the block map comes from it and [Content_Types].xml is only checked against the digest it
+        // was validated with.
+        AppxPackageObject(IMSIXFactory* factory, MSIX_VALIDATION_OPTION validation, IStorageObject* container, PackageIndex* index = nullptr);
+        // Reopens a package that another reader of the same, unchanged, file validated, with the block map from its
+        // index.  The footprint files are read from container like any other, and payload files are still checked
+        // against the block map as they are read.
+        AppxPackageObject(IMSIXFactory* factory, MSIX_VALIDATION_OPTION validation, IStorageObject* container, PackageIndex& index,
+            const AppxPackageParts& parts);
         ~AppxPackageObject() {}
 
+        // IAppxPackageReader2 extends IAppxPackageReader, which QIHelper doesn't know about.
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override
+        {
+            if (riid == UuidOfImpl<IAppxPackageReader>::iid && ppvObject != nullptr && *ppvObject == nullptr)
+            {   *ppvObject = static_cast<IAppxPackageReader*>(static_cast<IAppxPackageReader2*>(this));
+                AddRef();
+                return S_OK;
+            }
+            return ComClass<AppxPackageObject, IAppxPackageReader2, IPackage, IStorageObject, IMSIXReadStatistics>::QueryInterface(riid, ppvObject);
+        }
+
         // internal IPackage methods
-        void Unpack(MSIX_PACKUNPACK_OPTION options, IStorageObject* to) override;
+        // Goes through the files in the order of GetUnpackOrder and calls onContentGroup, if it isn't empty, as
+        // each content group is complete.
+        void Unpack(MSIX_PACKUNPACK_OPTION options, IStorageObject* to, const ContentGroupCallback& onContentGroup) override;
 
         // IAppxPackageReader
         HRESULT STDMETHODCALLTYPE GetBlockMap(IAppxBlockMapReader** blockMapReader) override;
@@ -109,8 +175,24 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE GetPayloadFiles(IAppxFilesEnumerator**  filesEnumerator) override;
         HRESULT STDMETHODCALLTYPE GetManifest(IAppxManifestReader**  manifestReader) override;
 
+        // IAppxPackageReader2
+        HRESULT STDMETHODCALLTYPE GetContentGroupMap(IAppxContentGroupMapReader** contentGroupMapReader) override;
+
+        // IMSIXReadStatistics, answered by the container
+        HRESULT STDMETHODCALLTYPE GetStatistics(MSIX_READ_STATISTICS* statistics) override;
+        HRESULT STDMETHODCALLTYPE GetFileStatistics(LPCWSTR fileName, MSIX_READ_STATISTICS* statistics) override;
+
         // returns a list of the footprint files found within this package.
         std::vector<std::string>& GetFootprintFiles() override { return m_footprintFiles; }
+        ComPtr<IZipReader> GetZipReader() override { return m_container.As<IZipReader>(); }
+        std::string GetContentType(const std::string& fileName) override;
+
+        AppxPackageParts GetParts();
+
+        // Once the store says that the package passed this validation before, its blocks are no longer hashed as
+        // they are read.  Otherwise the package is recorded in the store when an unpack has checked all of it.
+        // Only packages whose signature was checked can be trusted, the store is left alone for the others.
+        void SetValidatedStore(ValidatedStore* store, const FileIdentity& package);
 
         // IStorageObject methods
         std::string               GetPathSeparator() override;
@@ -121,6 +203,16 @@ namespace MSIX {
         void                      CommitChanges() override;
 
     protected:
+        void OpenStreams();
+        void UnpackStaged(MSIX_PACKUNPACK_OPTION options, IStagedStorage* staged, IStorageObject* to, const ContentGroupCallback& onContentGroup);
+        // Parsed the first time it is asked for, nullptr when the package has no content group map.
+        AppxContentGroupMapObject* GetContentGroups();
+        // The files to unpack, in the order they are in the package.  With a content group map, the footprint files
+        // and the files of the required group come first, so that the app can be launched before the rest is
+        // unpacked, then those of each automatic group, then the files that are in no group.  groups gets where
+        // each content group ends.
+        std::vector<std::string> GetUnpackOrder(std::vector<ContentGroupEnd>& groups);
+
         std::map<std::string, ComPtr<IStream>>  m_streams;
 
         MSIX_VALIDATION_OPTION      m_validation = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL;
@@ -130,9 +222,17 @@ namespace MSIX {
         ComPtr<IVerifierObject>     m_appxManifest;
         ComPtr<IVerifierObject>     m_contentType;        
         ComPtr<IStorageObject>      m_container;
+        std::shared_ptr<ContentTypeTable> m_contentTypes;
+        std::shared_ptr<BlockWorkers> m_blockWorkers = std::make_shared<BlockWorkers>();
+        std::once_flag              m_contentGroupMapLoaded;
+        ComPtr<IAppxContentGroupMapReader> m_contentGroupMap;
         
         std::vector<std::string>    m_payloadFiles;
         std::vector<std::string>    m_footprintFiles;
+
+        ValidatedStore*             m_validatedStore = nullptr;     // owned by the factory
+        FileIdentity                m_identity = {0};
+        bool                        m_isTrusted = false;
     };
 
     class AppxFilesEnumerator : public MSIX::ComClass<AppxFilesEnumerator, IAppxFilesEnumerator>
@@ -146,7 +246,7 @@ namespace MSIX {
         AppxFilesEnumerator(IStorageObject* storage) : 
             m_storage(storage)
         {
-            m_files = storage->GetFileNames(FileNameOptions::PayloadOnly);            
+            m_files = storage->GetFileNames(FileNameOptions::PayloadOnly | FileNameOptions::StorageOrder);
         }
 
         // IAppxFilesEnumerator
@@ -0,0 +1,86 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "MSIXWindows.hpp"
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+#include "ZipObject.hpp"
+#include "AppxFactory.hpp"
+#include "ThreadPool.hpp"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+
+namespace MSIX {
+
+    // Streams a package to its output as files are added.  Every file is cut into 64KB blocks that are
+    // hashed, and deflated if need be, on a thread pool and then written in order.  Close adds the
+    // manifest, AppxBlockMap.xml, [Content_Types].xml and the central directory.  Files of other packages can
+    // be copied in as they are stored there, blocks and all.
+    // Made with a reader, it edits that package in place instead: it starts out with the files of the package,
+    // the block map and the content types of which are taken from the package, and Commit takes the place of Close.
+    class AppxPackageWriter : public ComClass<AppxPackageWriter, IAppxPackageWriter, IMSIXPackageWriter, IMSIXPackageEditor>
+    {
+    public:
+        AppxPackageWriter(IMSIXFactory* factory, IStream* outputStream);
+        // package is the stream that reader reads, opened with FileStream::Mode::READ_UPDATE.
+        AppxPackageWriter(IMSIXFactory* factory, IStream* package, IAppxPackageReader* reader);
+        ~AppxPackageWriter() {}
+
+        // IAppxPackageWriter
+        HRESULT STDMETHODCALLTYPE AddPayloadFile(LPCWSTR fileName, LPCWSTR contentType,
+            APPX_COMPRESSION_OPTION compressionOption, IStream* inputStream) override;
+        HRESULT STDMETHODCALLTYPE Close(IStream* manifest) override;
+
+        // IMSIXPackageWriter
+        HRESULT STDMETHODCALLTYPE AddPayloadFileFromPackage(IAppxPackageReader* package, LPCWSTR fileName, BOOL verify) override;
+
+        // IMSIXPackageEditor, AddPayloadFile is shared with IAppxPackageWriter
+        HRESULT STDMETHODCALLTYPE RemovePayloadFile(LPCWSTR fileName) override;
+        HRESULT STDMETHODCALLTYPE Commit(BOOL compact) override;
+
+    protected:
+        struct Block
+        {
+            std::vector<std::uint8_t> hash;
+            std::uint64_t             compressedSize;
+        };
+
+        struct File
+        {
+            std::string        name;            // as it appears in the block map
+            std::uint64_t      size;
+            std::uint64_t      localFileHeaderSize;
+            bool               isCompressed;
+            std::vector<Block> blocks;
+        };
+
+        enum class State { Open, Closed, Failed };
+
+        void ThrowIfNotOpen();
+        void AddFileName(const std::string& zipName);
+        void RemoveFile(const std::string& name);
+        void WriteFootprintAndCommit();
+        File WriteFile(const std::string& name, const std::string& zipName, APPX_COMPRESSION_OPTION compressionOption, IStream* stream);
+        void AddContentType(const std::string& name, const std::string& contentType);
+        std::string GetBlockMap();
+        std::string GetContentTypes();
+
+        IMSIXFactory*                      m_factory;
+        ComPtr<IZipWriter>                 m_zip;
+        std::unique_ptr<ThreadPool>        m_threadPool;
+        State                              m_state = State::Open;
+        bool                               m_isEditing = false;
+        std::vector<File>                  m_files;
+        std::set<std::string>              m_fileNames;
+        std::map<std::string, std::string> m_defaultContentTypes;  // by extension
+        std::map<std::string, std::string> m_overrideContentTypes; // by part name
+    };
+}
@@ -2010,6 +2010,9 @@ enum MSIX_PACKUNPACK_OPTION
         MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER  = 0x1
     }   MSIX_PACKUNPACK_OPTION;
 
+// utf8SourcePackage may be "-" to read the package from standard input, see UnpackPackageFromStream.  On platforms
+// that can, stored files are checked and written where the package is mapped into memory: the package must not be
+// truncated while it is unpacked, which makes the process fail with SIGBUS rather than the unpack with an error.
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackage(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
@@ -2017,13 +2020,132 @@ MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackage(
     char* utf8Destination
 );
 
+// Called as each content group of a package is completely unpacked, on a thread of the unpack, while the unpack goes
+// on with the groups after it.  The required group comes first, so the app can be launched from this callback, then
+// the automatic groups in the order that AppxMetadata/AppxContentGroupMap.xml has them.
+typedef void STDMETHODCALLTYPE MSIX_CONTENT_GROUP_CALLBACK(const char* utf8GroupName, BOOL isRequired, void* context);
+
+// UnpackPackage, which goes through a package with a content group map the same way: the footprint files and the
+// required group first, then each automatic group, then any files that are in no group, and calls callback as each
+// group is complete.  callback is never called for a package without a content group map.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageByContentGroup(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    MSIX_CONTENT_GROUP_CALLBACK* callback,
+    void* context
+);
+
+// Unpacks a package that is read front to back, in one pass, from a stream that only needs to support Read,
+// e.g. a pipe or a download in progress.  The files are staged in a directory next to utf8Destination and
+// only moved into it once the whole package has been validated.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination
+);
+
+// Creates a package from every file under utf8SourceDirectory, which must contain an AppxManifest.xml.  The
+// block map and [Content_Types].xml are generated, so those and any signature files in the directory are ignored.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackage(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourceDirectory,
+    char* utf8Destination
+);
+
+// Creates a package from the payload files of utf8SourcePackage, less utf8ExcludedFiles (block map names, e.g.
+// "Assets\\Logo.png"), without inflating and deflating them again: each file is copied as it is stored.  With
+// verify, the data is checked against the source block map as it is copied.  The output isn't signed.
+MSIX_API HRESULT STDMETHODCALLTYPE RepackPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 excludedFilesCount,
+    char** utf8ExcludedFiles,
+    BOOL verify
+);
+
+// Edits the package at utf8Package in place through IMSIXPackageEditor: removes utf8RemovedFiles (block map names),
+// then adds every file under utf8SourceDirectory, if it is set, in place of any file of the same name.  Footprint
+// files in the directory are ignored.  With compact, the space of the files that were removed is given back.
+MSIX_API HRESULT STDMETHODCALLTYPE EditPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8Package,
+    char* utf8SourceDirectory,
+    UINT32 removedFilesCount,
+    char** utf8RemovedFiles,
+    BOOL compact
+);
+
 // A call to called CoCreateAppxFactory is required before start using the factory on non-windows platforms specifying 
 // their allocator/de-allocator pair of preference. Failure to do this will result on E_UNEXPECTED.
 typedef LPVOID STDMETHODCALLTYPE COTASKMEMALLOC(SIZE_T cb);
 typedef void STDMETHODCALLTYPE COTASKMEMFREE(LPVOID pv);
 
+// Returns the messages logged since the last call, one per line, as far as the log still has them: it keeps the
+// most recent few hundred.
 MSIX_API HRESULT STDMETHODCALLTYPE GetLogTextUTF8(COTASKMEMALLOC* memalloc, char** logText);
 
+typedef /* [v1_enum] */
+enum MSIX_LOG_LEVEL
+    {
+        MSIX_LOG_LEVEL_ERROR   = 0,     // the default
+        MSIX_LOG_LEVEL_WARNING = 1,
+        MSIX_LOG_LEVEL_INFO    = 2,
+        MSIX_LOG_LEVEL_VERBOSE = 3      // e.g. where a package reader came from, cheap enough to leave on
+    }   MSIX_LOG_LEVEL;
+
+typedef struct MSIX_LOG_ENTRY
+    {
+        MSIX_LOG_LEVEL level;
+        HRESULT        code;            // 0 when the message isn't about an error
+        UINT64         timestamp;       // nanoseconds on a monotonic clock
+        UINT64         thread;
+        const char*    message;         // UTF8, only valid during the callback
+    }   MSIX_LOG_ENTRY;
+
+typedef void STDMETHODCALLTYPE MSIX_LOG_CALLBACK(const MSIX_LOG_ENTRY* entry, void* context);
+
+// Messages up to level are logged, the rest cost next to nothing.
+MSIX_API HRESULT STDMETHODCALLTYPE SetLogLevel(MSIX_LOG_LEVEL level);
+
+// Calls callback with every message as it is logged, on the thread that logs it, as well as keeping the message for
+// GetLogTextUTF8.  Messages that the callback itself causes are only kept.  A nullptr callback stops the calls.
+// Each call replaces the callback before.  Unless it is called from inside the callback, it waits for the calls in
+// progress on other threads to return, so that once it does the callback and context it replaced are no longer
+// used and the context can be freed.  It must not be called while holding anything those calls wait for.
+MSIX_API HRESULT STDMETHODCALLTYPE SetLogCallback(MSIX_LOG_CALLBACK* callback, void* context);
+
+// Performance instrumentation.  Collection is off by default and costs next to nothing while off.
+typedef /* [v1_enum] */
+enum MSIX_PERFORMANCE_OPTION
+    {
+        MSIX_PERFORMANCE_OPTION_NONE     = 0x0,
+        MSIX_PERFORMANCE_OPTION_COUNTERS = 0x1,
+        MSIX_PERFORMANCE_OPTION_TRACE    = 0x2  // also records every timed event, see GetPerformanceTraceUTF8
+    }   MSIX_PERFORMANCE_OPTION;
+
+typedef struct MSIX_PERFORMANCE_COUNTER
+    {
+        const char* name;           // static string owned by the library, e.g. "inflate"
+        UINT64      count;          // number of events
+        UINT64      bytes;          // bytes processed by those events
+        UINT64      nanoseconds;    // total time spent, 0 for events that are only counted
+    }   MSIX_PERFORMANCE_COUNTER;
+
+// Enables or disables collection and discards everything collected so far.
+MSIX_API HRESULT STDMETHODCALLTYPE SetPerformanceOptions(MSIX_PERFORMANCE_OPTION options);
+
+// On input, countersCount is the number of elements in counters.  On output, it is the number of counters
+// available.  Call with counters set to nullptr to query the number of counters.
+MSIX_API HRESULT STDMETHODCALLTYPE GetPerformanceCounters(UINT32* countersCount, MSIX_PERFORMANCE_COUNTER* counters);
+
+// Returns the events recorded with MSIX_PERFORMANCE_OPTION_TRACE in Chrome trace event JSON format.
+MSIX_API HRESULT STDMETHODCALLTYPE GetPerformanceTraceUTF8(COTASKMEMALLOC* memalloc, char** traceText);
+
 // Call specific for Windows. Default to call CoTaskMemAlloc and CoTaskMemFree
 MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxFactory(
     MSIX_VALIDATION_OPTION validationOption,
@@ -2046,6 +2168,197 @@ MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileUTF16(
     bool forRead,
     IStream** stream);
 
+// I/O accounting for a package, or for one file within it.
+typedef struct MSIX_READ_STATISTICS
+    {
+        UINT64 sourceReads;        // read calls made on the package stream
+        UINT64 sourceSeeks;        // seek calls made on the package stream, including the seeks to its end
+                                   // that opening it takes to find the central directory, one or two for zip64
+        UINT64 sourceBytesRead;    // bytes read from the package stream
+        UINT64 bytesDelivered;     // uncompressed bytes read from the files within the package
+        UINT64 bytesInflated;      // bytes produced by inflate, including bytes inflated more than once
+        UINT64 bytesReinflated;    // bytes inflated again because of a seek backwards in a compressed file
+    }   MSIX_READ_STATISTICS;
+
+// Implemented by package readers created by CoCreateAppxFactory and CoCreateAppxFactoryWithHeap.
+// Query for it on IAppxPackageReader.
+EXTERN_C const IID IID_IMSIXReadStatistics;
+#ifndef WIN32
+// {6e5a9d94-32c9-4c6e-9a1b-7d0b6a3f2e18}
+interface IMSIXReadStatistics : public IUnknown
+#else
+class IMSIXReadStatistics : public IUnknown
+#endif
+{
+public:
+    // Totals for the package since the reader was created.
+    virtual HRESULT STDMETHODCALLTYPE GetStatistics(MSIX_READ_STATISTICS* statistics) = 0;
+
+    // Totals for one file, named as it is stored in the package, e.g. "Assets/Logo.png".  Reads of the
+    // central directory and local file headers are only included in the package totals.
+    virtual HRESULT STDMETHODCALLTYPE GetFileStatistics(LPCWSTR fileName, MSIX_READ_STATISTICS* statistics) = 0;
+};
+
+// Implemented by factories created by CoCreateAppxFactory and CoCreateAppxFactoryWithHeap.  Query for it on
+// IAppxFactory.  Options apply to the readers created after they are set.
+EXTERN_C const IID IID_IMSIXFactoryOptions;
+#ifndef WIN32
+// {d3b71a2e-6f05-4c8e-a1d9-5e28c47b90f3}
+interface IMSIXFactoryOptions : public IUnknown
+#else
+class IMSIXFactoryOptions : public IUnknown
+#endif
+{
+public:
+    // Keeps an index of each package that is read from a file in utf8Directory, which must exist.  The next time
+    // the same, unchanged, file is opened, the central directory and the block map come from the index instead of
+    // the package.  The indexes are sealed with a key that is kept in utf8Directory, which must not be writable, or
+    // the key readable, by anyone who shouldn't be trusted.  nullptr, the default, turns it off.
+    virtual HRESULT STDMETHODCALLTYPE SetIndexDirectory(const char* utf8Directory) = 0;
+
+    // Keeps up to about budgetBytes of packages that were read from a file, validated and ready to be opened
+    // again.  Opening the same, unchanged, file again makes a new reader over the new stream without validating
+    // the package again.  Payload files are still checked against the block map as they are read.  A kept package
+    // holds on to the stream it was first opened from.  0, the default, turns it off.
+    virtual HRESULT STDMETHODCALLTYPE SetReaderCacheBudget(UINT64 budgetBytes) = 0;
+
+    // Records, in utf8Directory, which must exist, each package file that was read from end to end by an unpack
+    // after its signature was checked.  When the same, unchanged, file is read again with the same validation
+    // options, its signature, block map and manifest are still checked but its blocks are no longer hashed.  The
+    // records are sealed with a key that is kept in utf8Directory, which must not be writable, or the key readable,
+    // by anyone who shouldn't be trusted.  nullptr, the default, turns it off.
+    virtual HRESULT STDMETHODCALLTYPE SetValidatedStateDirectory(const char* utf8Directory) = 0;
+};
+
+// The blocks that IMSIXPayloadFile::ReadBlocks returns, inflated and checked against the block map.  The data and
+// hashes stay valid until the object is released, which gives their buffers back to the reader.
+EXTERN_C const IID IID_IMSIXPayloadBlocks;
+#ifndef WIN32
+// {5f0e8b43-9c2d-4d7a-b1e6-3a84c0d9e721}
+interface IMSIXPayloadBlocks : public IUnknown
+#else
+class IMSIXPayloadBlocks : public IUnknown
+#endif
+{
+public:
+    virtual HRESULT STDMETHODCALLTYPE GetCount(UINT32* count) = 0;
+    // The block at position, in the order they were asked for.  index is the block's place in the file, which it
+    // covers from index * 64KB on.  hash is its SHA256 from the block map.
+    virtual HRESULT STDMETHODCALLTYPE GetBlock(UINT32 position, UINT32* index, const BYTE** data, UINT32* size,
+        const BYTE** hash, UINT32* hashSize) = 0;
+};
+
+// Implemented by the payload files of package readers created by CoCreateAppxFactory and
+// CoCreateAppxFactoryWithHeap.  Query for it on the IAppxFile that GetPayloadFile or GetPayloadFiles returns.
+EXTERN_C const IID IID_IMSIXPayloadFile;
+#ifndef WIN32
+// {a23fcc62-1fe9-4efc-9cdf-c5e257520316}
+interface IMSIXPayloadFile : public IUnknown
+#else
+class IMSIXPayloadFile : public IUnknown
+#endif
+{
+public:
+    // Reads up to size bytes of the file, from offset on, into buffer.  *bytesRead is less than size only at the
+    // end of the file.  Unlike the file's stream, it has no position: any number of threads can call it at once.
+    // When the package was opened from a file, that holds even while other threads read it through its streams.
+    // Only the blocks that the range touches are read from the package, each is inflated and checked against the
+    // block map on its own.
+    virtual HRESULT STDMETHODCALLTYPE ReadAt(UINT64 offset, void* buffer, ULONG size, ULONG* bytesRead) = 0;
+    // Reads the count blocks at indices, which can come in any order and more than once.  Adjacent blocks are
+    // read from the package together, and are inflated and checked on as many threads as there are cores.
+    virtual HRESULT STDMETHODCALLTYPE ReadBlocks(UINT32 count, const UINT32* indices, IMSIXPayloadBlocks** blocks) = 0;
+};
+
+// Implemented by package writers created by CoCreateAppxFactory and CoCreateAppxFactoryWithHeap.  Query for it on
+// IAppxPackageWriter.
+EXTERN_C const IID IID_IMSIXPackageWriter;
+#ifndef WIN32
+// {e2c84f17-3b6d-4a92-8d05-71f9ac3e6b40}
+interface IMSIXPackageWriter : public IUnknown
+#else
+class IMSIXPackageWriter : public IUnknown
+#endif
+{
+public:
+    // Adds a file of package, named as in its block map, along with its blocks and its content type.  The file's
+    // data is copied as it is stored in package, deflated or not, without being inflated or deflated again.  With
+    // verify set, every block is still checked against the block map of package as it goes by, which inflates
+    // deflated data on the side.
+    virtual HRESULT STDMETHODCALLTYPE AddPayloadFileFromPackage(IAppxPackageReader* package, LPCWSTR fileName, BOOL verify) = 0;
+};
+
+typedef /* [v1_enum] */
+enum MSIX_FILE_DIFF_KIND
+    {
+        MSIX_FILE_DIFF_KIND_CHANGED = 0,
+        MSIX_FILE_DIFF_KIND_ADDED   = 1,
+        MSIX_FILE_DIFF_KIND_REMOVED = 2
+    }   MSIX_FILE_DIFF_KIND;
+
+// A file that is not the same in two packages, as their block maps have it.
+typedef struct MSIX_FILE_DIFF
+    {
+        const char*         utf8FileName;   // as the block map names it, valid until the diff is released
+        MSIX_FILE_DIFF_KIND kind;
+        UINT64              oldSize;        // uncompressed, 0 for a file that was added
+        UINT64              newSize;        // uncompressed, 0 for a file that was removed
+        UINT32              blocks;         // blocks of the new file
+        UINT32              changedBlocks;  // blocks of the new file whose hash is in no block of the old file
+        UINT64              changedBytes;   // size of those blocks in the new package, about what an update downloads
+    }   MSIX_FILE_DIFF;
+
+// What DiffPackages returns: the files that changed, were added or were removed, ordered by name.
+EXTERN_C const IID IID_IMSIXPackageDiff;
+#ifndef WIN32
+// {b4e1d7a3-58c2-4f19-a06d-2c93f5e8b17a}
+interface IMSIXPackageDiff : public IUnknown
+#else
+class IMSIXPackageDiff : public IUnknown
+#endif
+{
+public:
+    virtual HRESULT STDMETHODCALLTYPE GetCount(UINT32* count) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetFile(UINT32 position, MSIX_FILE_DIFF* file) = 0;
+};
+
+// Compares the block maps of two packages, without reading any of their payload.  Files of the same size with the
+// same block hashes are the same and aren't in the diff.  Both readers must come from CoCreateAppxFactory or
+// CoCreateAppxFactoryWithHeap.
+MSIX_API HRESULT STDMETHODCALLTYPE DiffPackages(
+    IAppxPackageReader* oldPackage,
+    IAppxPackageReader* newPackage,
+    IMSIXPackageDiff** diff);
+
+// Changes a package in place.  Files that are added go after the last file of the package, files that are removed
+// are only left out of its central directory, and Commit writes AppxBlockMap.xml, [Content_Types].xml and the
+// central directory again after them.  The rest of the package is neither read nor written, unless it is compacted.
+// The package isn't signed afterwards, its signature and code integrity catalog are dropped.
+EXTERN_C const IID IID_IMSIXPackageEditor;
+#ifndef WIN32
+// {7a3d91c5-e842-4b6f-9c17-0d5e28f4a6b3}
+interface IMSIXPackageEditor : public IUnknown
+#else
+class IMSIXPackageEditor : public IUnknown
+#endif
+{
+public:
+    // As IAppxPackageWriter::AddPayloadFile, except that it replaces a payload file of the same name.
+    virtual HRESULT STDMETHODCALLTYPE AddPayloadFile(LPCWSTR fileName, LPCWSTR contentType,
+        APPX_COMPRESSION_OPTION compressionOption, IStream* inputStream) = 0;
+    virtual HRESULT STDMETHODCALLTYPE RemovePayloadFile(LPCWSTR fileName) = 0;
+    // With compact set, the files are first moved down over the space that files removed, in this edit or in
+    // earlier ones, took.  That reads and writes everything after the first of them.
+    virtual HRESULT STDMETHODCALLTYPE Commit(BOOL compact) = 0;
+};
+
+// Opens the package at utf8Package to be edited in place.  It is read, and validated, with factory, which must come
+// from CoCreateAppxFactory or CoCreateAppxFactoryWithHeap.
+MSIX_API HRESULT STDMETHODCALLTYPE CreatePackageEditor(
+    IAppxFactory* factory,
+    char* utf8Package,
+    IMSIXPackageEditor** editor);
+
 } // extern "C++" 
 
 // Helper used for QueryInterface defines
@@ -2128,5 +2441,12 @@ SpecializeUuidOfImpl(IAppxEncryptionFactory3);
 SpecializeUuidOfImpl(IAppxEncryptedPackageWriter);
 SpecializeUuidOfImpl(IAppxEncryptedBundleWriter);
 SpecializeUuidOfImpl(IAppxEncryptedBundleWriter2);
+SpecializeUuidOfImpl(IMSIXReadStatistics);
+SpecializeUuidOfImpl(IMSIXFactoryOptions);
+SpecializeUuidOfImpl(IMSIXPayloadBlocks);
+SpecializeUuidOfImpl(IMSIXPayloadFile);
+SpecializeUuidOfImpl(IMSIXPackageDiff);
+SpecializeUuidOfImpl(IMSIXPackageWriter);
+SpecializeUuidOfImpl(IMSIXPackageEditor);
 
 #endif //__appxpackaging_hpp__
\ No newline at end of file
@@ -53,6 +53,9 @@ namespace MSIX {
         };
 
         AppxSignatureObject(MSIX_VALIDATION_OPTION validationOptions, IStream* stream);
+        // A signature that was validated already, over stream, which may be nullptr, instead of the one it was read
+        // from.  Nothing is validated again.
+        AppxSignatureObject(const AppxSignatureObject& validated, IStream* stream);
 
         // IVerifierObject
         const std::string& GetPublisher() override { return m_publisher; }
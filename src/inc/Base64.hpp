@@ -0,0 +1,39 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // Standard alphabet, padded with '=', as the block map has hashes in.
+    inline std::string Base64Encode(const std::vector<std::uint8_t>& data)
+    {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string result;
+        result.reserve((data.size() + 2) / 3 * 4);
+        std::size_t index = 0;
+        for (; index + 2 < data.size(); index += 3)
+        {
+            std::uint32_t value = (data[index] << 16) | (data[index + 1] << 8) | data[index + 2];
+            result += alphabet[(value >> 18) & 0x3F];
+            result += alphabet[(value >> 12) & 0x3F];
+            result += alphabet[(value >> 6) & 0x3F];
+            result += alphabet[value & 0x3F];
+        }
+        if (index < data.size())
+        {
+            std::uint32_t value = data[index] << 16;
+            if (index + 1 < data.size()) { value |= data[index + 1] << 8; }
+            result += alphabet[(value >> 18) & 0x3F];
+            result += alphabet[(value >> 12) & 0x3F];
+            result += (index + 1 < data.size()) ? alphabet[(value >> 6) & 0x3F] : '=';
+            result += '=';
+        }
+        return result;
+    }
+}
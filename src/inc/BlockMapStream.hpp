@@ -12,23 +12,20 @@
 #include "ComHelper.hpp"
 #include "SHA256.hpp"
 #include "AppxFactory.hpp"
+#include "BlockReader.hpp"
+#include "InflateStream.hpp"
+#include "RawFileStream.hpp"
 
 #include <string>
 #include <map>
 #include <functional>
 #include <algorithm>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace MSIX {
   
-    const std::uint64_t BLOCKMAP_BLOCK_SIZE = 65536; // 64KB
-
-    typedef struct Block
-    {
-        std::uint64_t compressedSize;
-        std::vector<std::uint8_t> hash;
-    } Block;
-
     typedef struct BlockPlusStream : Block
     {
         std::uint64_t   size;
@@ -36,12 +33,53 @@ namespace MSIX {
         ComPtr<IStream> stream;
     } BlockPlusStream;
 
-    // This represents a subset of a Stream
+    // What BlockMapStream::ReadBlocks hands back.  Its buffers go back to their pool when it is released.
+    class PayloadBlocks : public MSIX::ComClass<PayloadBlocks, IMSIXPayloadBlocks>
+    {
+    public:
+        struct Entry
+        {
+            UINT32                    index;
+            BufferPool::Buffer        data;
+            std::vector<std::uint8_t> hash;
+        };
+
+        PayloadBlocks(std::vector<Entry>&& blocks) : m_blocks(std::move(blocks)) {}
+
+        // IMSIXPayloadBlocks
+        HRESULT STDMETHODCALLTYPE GetCount(UINT32* count) override
+        {
+            return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (count == nullptr), "bad pointer");
+                *count = static_cast<UINT32>(m_blocks.size());
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetBlock(UINT32 position, UINT32* index, const BYTE** data, UINT32* size,
+            const BYTE** hash, UINT32* hashSize) override
+        {
+            return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (position >= m_blocks.size()), "no such block");
+                const auto& block = m_blocks[position];
+                if (index)    { *index = block.index; }
+                if (data)     { *data = reinterpret_cast<const BYTE*>(block.data->data()); }
+                if (size)     { *size = static_cast<UINT32>(block.data->size()); }
+                if (hash)     { *hash = reinterpret_cast<const BYTE*>(block.hash.data()); }
+                if (hashSize) { *hashSize = static_cast<UINT32>(block.hash.size()); }
+            });
+        }
+
+    protected:
+        std::vector<Entry> m_blocks;
+    };
+
+    // This represents a subset of a Stream.  Unless isHashed is false, each block is checked against its hash
+    // as it is read.
     class BlockMapStream : public StreamBase
     {
     public:
-        BlockMapStream(IMSIXFactory* factory, std::string decodedName, IStream* stream, std::vector<Block>& blocks)
-            : m_factory(factory), m_decodedName(decodedName), m_stream(stream)
+        BlockMapStream(IMSIXFactory* factory, std::string decodedName, IStream* stream, const std::vector<Block>& blocks, bool isHashed = true)
+            : m_factory(factory), m_decodedName(decodedName), m_stream(stream), m_blocks(blocks), m_isHashed(isHashed)
         {
             // Determine overall stream size
             ULARGE_INTEGER uli;
@@ -61,7 +99,7 @@ namespace MSIX {
             for (auto block = blocks.begin(); ((sizeRemaining != 0) && (block != blocks.end())); block++)
             {
                 auto rangeStream = ComPtr<IStream>::Make<RangeStream>(offset, std::min(sizeRemaining, BLOCKMAP_BLOCK_SIZE), stream);                
-                auto hashStream = ComPtr<IStream>::Make<HashStream>(rangeStream.Get(), block->hash);
+                auto hashStream = isHashed ? ComPtr<IStream>::Make<HashStream>(rangeStream.Get(), block->hash) : rangeStream;
                 std::uint64_t blockSize = std::min(sizeRemaining, BLOCKMAP_BLOCK_SIZE);
 
                 BlockPlusStream bs;
@@ -104,10 +142,10 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* actualRead) override
         {
-            std::uint32_t bytesRead = 0;
+            ULONG bytesRead = 0;
             if (m_relativePosition < m_streamSize)
             {
-                std::uint32_t bytesToRead = std::min(static_cast<std::uint32_t>(countBytes), static_cast<std::uint32_t>(m_streamSize - m_relativePosition));
+                ULONG bytesToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_streamSize - m_relativePosition));
                 while (m_currentBlock != m_blockStreams.end() && bytesToRead > 0)
                 {
                     if ((m_currentBlock->offset + m_currentBlock->size) <= m_relativePosition)
@@ -121,7 +159,7 @@ namespace MSIX {
                         li.QuadPart = positionInBlock;
                         ThrowHrIfFailed(m_currentBlock->stream->Seek(li, STREAM_SEEK_SET, nullptr));
 
-                        std::uint32_t count = std::min(bytesToRead, static_cast<std::uint32_t>(m_currentBlock->size - positionInBlock));
+                        ULONG count = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(bytesToRead), m_currentBlock->size - positionInBlock));
                         ULONG actual = 0;
                         ThrowHrIfFailed(m_currentBlock->stream->Read(buffer, count, &actual));
 
@@ -152,15 +190,113 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE GetContentType(LPWSTR* contentType) override
         {
-            return ResultOf([&]{ return m_stream.As<IAppxFile>()->GetContentType(contentType); });
+            return ResultOf([&]{ ThrowHrIfFailed(m_stream.As<IAppxFile>()->GetContentType(contentType)); });
         }
         
         HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) override
         {
             return ResultOf([&]{ if (size) { *size = m_streamSize; }});
         }
+
+        // Where ReadAt and ReadBlocks find the file's blocks, straight in the package, and the workers that
+        // ReadBlocks shares with the package's other files.  When the file's data doesn't line up with its blocks,
+        // they take turns going through a stream of their own over its data.  Without it, they fail.
+        void SetContainer(IZipReader* zip, const std::string& containerFileName, const std::shared_ptr<BlockWorkers>& workers)
+        {
+            m_zip = zip;
+            m_containerFileName = containerFileName;
+            m_workers = workers;
+        }
+
+        HRESULT STDMETHODCALLTYPE ReadAt(UINT64 offset, void* buffer, ULONG size, ULONG* bytesRead) override
+        {
+            return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (buffer == nullptr && size != 0), "bad pointer");
+                ULONG result = 0;
+                if (!TryReader([&]() { result = static_cast<ULONG>(m_reader->ReadAt(offset, buffer, size)); }))
+                {   result = ReadThroughStream(offset, buffer, size);
+                }
+                if (bytesRead) { *bytesRead = result; }
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE ReadBlocks(UINT32 count, const UINT32* indices, IMSIXPayloadBlocks** blocks) override
+        {
+            return ResultOf([&]{
+                ThrowErrorIf(Error::InvalidParameter, (indices == nullptr && count != 0), "bad pointer");
+                ThrowErrorIf(Error::InvalidParameter, (blocks == nullptr || *blocks != nullptr), "bad pointer");
+                std::vector<std::size_t> wanted(indices, indices + count);
+                std::vector<BufferPool::Buffer> buffers;
+                if (!m_workers || !TryReader([&]() { buffers = m_reader->ReadBlocks(wanted, *m_workers); }))
+                {   for (auto index : wanted)
+                    {   ThrowErrorIf(Error::InvalidParameter, (index >= m_blocks.size()), "no such block");
+                        auto buffer = std::make_shared<std::vector<std::uint8_t>>(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+                        buffer->resize(ReadThroughStream(index * BLOCKMAP_BLOCK_SIZE, buffer->data(), static_cast<ULONG>(buffer->size())));
+                        buffers.push_back(std::move(buffer));
+                    }
+                }
+                std::vector<PayloadBlocks::Entry> result;
+                result.reserve(count);
+                for (std::size_t i = 0; i < wanted.size(); i++)
+                {   result.push_back(PayloadBlocks::Entry { indices[i], std::move(buffers[i]), m_blocks[wanted[i]].hash });
+                }
+                *blocks = ComPtr<IMSIXPayloadBlocks>::Make<PayloadBlocks>(std::move(result)).Detach();
+            });
+        }
       
     protected:
+        // The reader, made the first time it is needed.  nullptr when the stream has to be gone through.
+        BlockReader* GetReader()
+        {
+            std::call_once(m_readerLoaded, [&]()
+            {   if (m_zip.Get())
+                {   auto file = m_zip->GetRawFile(m_containerFileName);
+                    if (BlockReader::IsBlocked(file, m_blocks))
+                    {   m_reader = std::make_unique<BlockReader>(m_zip.Get(), file, m_blocks, m_isHashed);
+                    }
+                }
+            });
+            return m_reader.get();
+        }
+
+        // Reads with the reader, unless there is none or the file has a block that refers back further than the
+        // reader goes back for it, in which case it returns false for the caller to go through the stream instead.
+        template <typename Read>
+        bool TryReader(const Read& read)
+        {
+            if (!GetReader()) { return false; }
+            try
+            {   read();
+                return true;
+            }
+            catch (Exception& e)
+            {   if (e.Code() != static_cast<std::uint32_t>(Error::NotSupported)) { throw; }
+            }
+            return false;
+        }
+
+        // Reads from offset on through a stream of the file's own over its data in the package, made the first time
+        // it is needed, so that this stream, which whoever has the file reads through, doesn't move.
+        ULONG ReadThroughStream(std::uint64_t offset, void* buffer, ULONG size)
+        {
+            std::lock_guard<std::mutex> lock(m_readAtLock);
+            if (!m_readAtStream.Get())
+            {   ThrowErrorIfNot(Error::NotSupported, m_zip.Get(), "the file can only be read through its stream");
+                auto file = m_zip->GetRawFile(m_containerFileName);
+                auto data = ComPtr<IStream>::Make<RawFileStream>(m_zip.Get(), file);
+                if (file.isCompressed)
+                {   data = ComPtr<IStream>::Make<InflateStream>(data.Get(), file.uncompressedSize, file.statistics);
+                }
+                m_readAtStream = ComPtr<IStream>::Make<BlockMapStream>(m_factory, m_decodedName, data.Get(), m_blocks, m_isHashed);
+            }
+            LARGE_INTEGER li{0};
+            li.QuadPart = static_cast<std::int64_t>(std::min<std::uint64_t>(offset, m_streamSize));
+            ULONG result = 0;
+            ThrowHrIfFailed(m_readAtStream->Seek(li, StreamBase::Reference::START, nullptr));
+            ThrowHrIfFailed(m_readAtStream->Read(buffer, size, &result));
+            return result;
+        }
+
         std::vector<BlockPlusStream>::iterator m_currentBlock;
         std::vector<BlockPlusStream> m_blockStreams;
         std::uint64_t m_relativePosition;
@@ -168,5 +304,16 @@ namespace MSIX {
         std::string m_decodedName;
         ComPtr<IStream> m_stream;
         IMSIXFactory* m_factory;
+
+        // for ReadAt and ReadBlocks
+        const std::vector<Block>&     m_blocks;
+        bool                          m_isHashed;
+        ComPtr<IZipReader>            m_zip;
+        std::string                   m_containerFileName;
+        std::shared_ptr<BlockWorkers> m_workers;
+        std::once_flag                m_readerLoaded;
+        std::unique_ptr<BlockReader>  m_reader;
+        std::mutex                    m_readAtLock;     // for m_readAtStream
+        ComPtr<IStream>               m_readAtStream;
     };
 }
\ No newline at end of file
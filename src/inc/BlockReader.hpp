@@ -0,0 +1,131 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#pragma once
+
+#include "ComHelper.hpp"
+#include "ZipObject.hpp"
+#include "Pipeline.hpp"
+#include "ThreadPool.hpp"
+
+#ifdef WIN32
+#include "zlib.h"
+#else
+#include <zlib.h>
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    const std::uint64_t BLOCKMAP_BLOCK_SIZE = 65536; // 64KB
+
+    typedef struct Block
+    {
+        std::uint64_t compressedSize;
+        std::vector<std::uint8_t> hash;
+    } Block;
+
+    // One raw inflate stream, reset for every block.  Keep one per thread.
+    class Inflater
+    {
+    public:
+        Inflater();
+        ~Inflater();
+
+        // Inflates a block that was deflated on its own or, given a dictionary, one that refers back into the
+        // previous block.  Returns false unless all of the block inflates to exactly the expected size.
+        bool Inflate(const std::uint8_t* block, std::size_t blockSize, const std::uint8_t* dictionary, std::size_t dictionarySize,
+            std::size_t expected, std::vector<std::uint8_t>& result);
+
+    protected:
+        z_stream m_zstrm;
+    };
+
+    // Throws unless the SHA256 of the data is expected.
+    void VerifyBlock(const std::uint8_t* data, std::size_t size, const std::vector<std::uint8_t>& expected);
+
+    // The threads and buffers that ReadBlocks uses, shared by the payload files of a package and only made the first
+    // time one of them is asked for its blocks.
+    class BlockWorkers
+    {
+    public:
+        ThreadPool& Threads() { Load(); return *m_threads; }
+        // Shared, as the blocks that ReadBlocks returns can outlive the package.
+        const std::shared_ptr<BufferPool>& Buffers() { Load(); return m_buffers; }
+
+    protected:
+        void Load();
+
+        std::once_flag              m_loaded;
+        std::unique_ptr<ThreadPool> m_threads;
+        std::shared_ptr<BufferPool> m_buffers;
+    };
+
+    // Reads the blocks of a payload file from its data in the package, inflating each one and checking it against
+    // the block map on its own.  Unlike the file's stream, it has no position, so any number of threads can use it
+    // at once.
+    class BlockReader
+    {
+    public:
+        // Whether the file's data is its blocks, one after the other, so that each can be found without reading the
+        // ones before it.  Files that aren't go through their streams.
+        static bool IsBlocked(const ZipRawFile& file, const std::vector<Block>& blocks);
+
+        // The blocks belong to the block map, which must outlive the reader.  Unless isHashed is false, each block
+        // is checked against its hash as it is read.
+        BlockReader(IZipReader* zip, const ZipRawFile& file, const std::vector<Block>& blocks, bool isHashed);
+
+        std::size_t   BlockCount() const { return m_blocks.size(); }
+        std::uint64_t Size() const { return m_file.uncompressedSize; }
+
+        // Inflates and checks a block into output, which ends up the size of the block.  A block that refers back
+        // into the ones before it is inflated from the nearest block that doesn't, and throws NotSupported when
+        // that is more than MaxWalkBlocks back.
+        void ReadBlock(std::size_t index, std::vector<std::uint8_t>& output);
+
+        // Returns how much was read, less than size only at the end of the file.
+        std::size_t ReadAt(std::uint64_t offset, void* buffer, std::size_t size);
+
+        // Returns the blocks at indices, in that order, each buffer the size of its block.  Each run of adjacent
+        // blocks is read from the package at once and inflated and checked front to back on one of the workers'
+        // threads, the runs spread over them.
+        std::vector<BufferPool::Buffer> ReadBlocks(const std::vector<std::size_t>& indices, BlockWorkers& workers);
+
+    protected:
+        std::size_t BlockSize(std::size_t index) const;
+        std::size_t DataSize(std::size_t index) const;     // in the package
+        void ReadData(std::size_t index, std::vector<std::uint8_t>& data);
+
+        // Inflates and checks a block from its data in the package.  A block that refers back into the one before
+        // it is inflated with the end of that block, from getWindow when the caller has it at hand and otherwise
+        // from ReadWindow.
+        void DecodeBlock(std::size_t index, const std::uint8_t* data, std::vector<std::uint8_t>& output,
+            const std::function<void(std::vector<std::uint8_t>&)>& getWindow = nullptr);
+
+        // The end of a block, as much of it as the block after it can refer back into.
+        void ReadWindow(std::size_t index, std::vector<std::uint8_t>& window);
+        bool GetCachedWindow(std::size_t index, std::vector<std::uint8_t>& window);
+        void CacheWindow(std::size_t index, const std::vector<std::uint8_t>& block);
+
+        ComPtr<IZipReader>         m_zip;
+        ZipRawFile                 m_file;
+        const std::vector<Block>&  m_blocks;
+        std::vector<std::uint64_t> m_offsets;   // of each block in the file's data
+        bool                       m_isHashed;
+
+        // Once a block of the file turns out to refer back, the window of the last block decoded is kept, so that
+        // reading on from it doesn't go back over the blocks before it.
+        std::atomic<bool>          m_isChained;
+        std::mutex                 m_windowLock;
+        std::size_t                m_windowIndex;
+        std::vector<std::uint8_t>  m_window;
+    };
+}
@@ -0,0 +1,67 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "VerifierObject.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MSIX {
+
+    // returns the content type for a payload file based on its extension, application/octet-stream if it isn't known
+    std::string GetContentTypeByExtension(const std::string& fileName);
+
+    // true for formats that are compressed already, by extension or by content type.  Deflating them costs time
+    // and rarely makes them smaller.
+    bool IsCompressedContent(const std::string& fileName, const std::string& contentType);
+
+    // The content types that [Content_Types].xml gives the files of a package: the Override for the file's part
+    // name, or else the Default for its extension, both matched without regard to case.  The document is gone
+    // through once into two open addressed hash tables, so a lookup hashes the name where it is and doesn't
+    // allocate.  Shared by every file of the package, and by readers of the same package.
+    class ContentTypeTable
+    {
+    public:
+        // From the document, parsed and validated already.
+        ContentTypeTable(IVerifierObject* document);
+        // From the document that only had its digest checked.  Nothing is parsed until a content type is asked for.
+        ContentTypeTable(IStream* stream);
+
+        // fileName is the name of the file in the container, its part name without the leading '/'.  Returns
+        // nullptr when the document has nothing for it.
+        const std::string* Find(const std::string& fileName);
+
+    protected:
+        class Table
+        {
+        public:
+            // When a name is in there twice, the first one counts.
+            void Build(const std::vector<std::pair<std::string, std::string>>& entries);
+            const std::string* Find(const char* name, std::size_t size) const;
+
+        protected:
+            struct Slot
+            {
+                std::uint64_t hash;
+                std::string   name;
+                std::string   contentType;
+            };
+            std::vector<Slot> m_slots;      // a power of two of them, at most half used, empty when name is
+        };
+
+        void Load(IVerifierObject* document);
+
+        std::once_flag            m_loaded;
+        std::vector<std::uint8_t> m_document;     // until it is parsed
+        Table                     m_defaults;     // by extension
+        Table                     m_overrides;    // by part name
+    };
+
+} // namespace MSIX
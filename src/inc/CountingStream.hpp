@@ -0,0 +1,103 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+
+#include <atomic>
+#include <memory>
+
+namespace MSIX {
+
+    // Accumulates the MSIX_READ_STATISTICS of a package or of a single file within it.
+    struct ReadStatistics
+    {
+        std::atomic<std::uint64_t> sourceReads{0};
+        std::atomic<std::uint64_t> sourceSeeks{0};
+        std::atomic<std::uint64_t> sourceBytesRead{0};
+        std::atomic<std::uint64_t> bytesDelivered{0};
+        std::atomic<std::uint64_t> bytesInflated{0};
+        std::atomic<std::uint64_t> bytesReinflated{0};
+
+        void AddTo(MSIX_READ_STATISTICS& statistics, bool includeSource = true) const
+        {
+            if (includeSource)
+            {
+                statistics.sourceReads     += sourceReads.load(std::memory_order_relaxed);
+                statistics.sourceSeeks     += sourceSeeks.load(std::memory_order_relaxed);
+                statistics.sourceBytesRead += sourceBytesRead.load(std::memory_order_relaxed);
+            }
+            statistics.bytesDelivered  += bytesDelivered.load(std::memory_order_relaxed);
+            statistics.bytesInflated   += bytesInflated.load(std::memory_order_relaxed);
+            statistics.bytesReinflated += bytesReinflated.load(std::memory_order_relaxed);
+        }
+    };
+
+    // Pass-through stream that accounts for what is read through it.  A Source stream wraps the
+    // package stream (or a view of it), a Delivered stream wraps what is handed out to readers.
+    class CountingStream : public StreamBase
+    {
+    public:
+        enum class Kind { Source, Delivered };
+
+        CountingStream(IStream* stream, std::shared_ptr<ReadStatistics> statistics, Kind kind) :
+            m_stream(stream), m_statistics(std::move(statistics)), m_kind(kind)
+        {}
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) override
+        {
+            ULONG actual = 0;
+            HRESULT hr = m_stream->Read(buffer, countBytes, &actual);
+            if (m_kind == Kind::Source)
+            {   m_statistics->sourceReads.fetch_add(1, std::memory_order_relaxed);
+                m_statistics->sourceBytesRead.fetch_add(actual, std::memory_order_relaxed);
+            }
+            else
+            {   m_statistics->bytesDelivered.fetch_add(actual, std::memory_order_relaxed);
+            }
+            if (bytesRead) { *bytesRead = actual; }
+            return hr;
+        }
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) override
+        {
+            if (m_kind == Kind::Source) { m_statistics->sourceSeeks.fetch_add(1, std::memory_order_relaxed); }
+            return m_stream->Seek(move, origin, newPosition);
+        }
+
+        HRESULT STDMETHODCALLTYPE Write(const void *buffer, ULONG countBytes, ULONG *bytesWritten) override
+        {
+            return m_stream->Write(buffer, countBytes, bytesWritten);
+        }
+
+        HRESULT STDMETHODCALLTYPE GetCompressionOption(APPX_COMPRESSION_OPTION* compressionOption) override
+        {
+            return ResultOf([&]{ ThrowHrIfFailed(m_stream.As<IAppxFile>()->GetCompressionOption(compressionOption)); });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetName(LPWSTR* fileName) override
+        {
+            return ResultOf([&]{ ThrowHrIfFailed(m_stream.As<IAppxFile>()->GetName(fileName)); });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetContentType(LPWSTR* contentType) override
+        {
+            return ResultOf([&]{ ThrowHrIfFailed(m_stream.As<IAppxFile>()->GetContentType(contentType)); });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) override
+        {
+            return ResultOf([&]{ ThrowHrIfFailed(m_stream.As<IAppxFile>()->GetSize(size)); });
+        }
+
+    protected:
+        ComPtr<IStream>                 m_stream;
+        std::shared_ptr<ReadStatistics> m_statistics;
+        Kind                            m_kind;
+    };
+}
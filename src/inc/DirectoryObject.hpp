@@ -14,13 +14,42 @@
 #include "StorageObject.hpp"
 #include "ComHelper.hpp"
 
+// internal interface
+EXTERN_C const IID IID_IDirectoryObject;
+#ifndef WIN32
+// {a7c3e915-48d2-4f6b-9e01-c25b8d7f3a64}
+interface IDirectoryObject : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IDirectoryObject : public IUnknown
+#endif
+{
+public:
+    virtual const std::string& GetRoot() = 0;
+
+    // Moves a file out of another directory object without copying it, so both have to be on the same volume.
+    // The directories on the way to the new name are created, and a file that is already there is replaced.
+    virtual void MoveFileFrom(IDirectoryObject* from, const std::string& fromName, const std::string& toName) = 0;
+
+    // Deletes everything in the directory and then the directory itself.  A no-op if it doesn't exist.
+    virtual void RemoveAll() = 0;
+};
+
+SpecializeUuidOfImpl(IDirectoryObject);
+
 namespace MSIX {
 
-    class DirectoryObject : public ComClass<DirectoryObject, IStorageObject>
+    class DirectoryObject : public ComClass<DirectoryObject, IStorageObject, IDirectoryObject>
     {
     public:
         DirectoryObject(std::string root) : m_root(std::move(root)) {}
 
+        // Creates a new, empty directory named prefix followed by a random suffix, along with the directories
+        // on the way to it.  Never reuses a directory that is already there, so whoever creates one can remove
+        // it again without the risk of removing something that isn't theirs.
+        static ComPtr<IDirectoryObject> CreateUnique(const std::string& prefix);
+
         // StorageObject methods
         std::string              GetPathSeparator() override;
         std::vector<std::string> GetFileNames(FileNameOptions options) override;
@@ -29,6 +58,11 @@ namespace MSIX {
         IStream*                 OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) override;
         void                     CommitChanges() override;
 
+        // IDirectoryObject
+        const std::string& GetRoot() override { return m_root; }
+        void MoveFileFrom(IDirectoryObject* from, const std::string& fromName, const std::string& toName) override;
+        void RemoveAll() override;
+
     protected:
         std::map<std::string, ComPtr<IStream>> m_streams;
         std::string m_root;
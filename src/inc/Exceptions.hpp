@@ -38,6 +38,7 @@ namespace MSIX {
         OutOfMemory                 = 0x8007000E,
         NotSupported                = 0x80070032,
         InvalidParameter            = 0x80070057,
+        InvalidState                = 0x8007139F,
         Stg_E_Invalidpointer        = 0x80030009,
 
         //
@@ -66,6 +67,10 @@ namespace MSIX {
         InflateRead                 = ERROR_FACILITY + 0x0022,
         InflateCorruptData          = ERROR_FACILITY + 0x0023,
 
+        // Deflate errors
+        DeflateInitialize           = ERROR_FACILITY + 0x0024,
+        DeflateWrite                = ERROR_FACILITY + 0x0025,
+
         // Package format errors
         MissingAppxSignatureP7X     = ERROR_FACILITY + 0x0031,
         MissingContentTypesXML      = ERROR_FACILITY + 0x0032,
@@ -73,6 +78,7 @@ namespace MSIX {
         MissingAppxManifestXML      = ERROR_FACILITY + 0x0034,
         DuplicateFootprintFile      = ERROR_FACILITY + 0x0035,
         UnknownFileNameEncoding     = ERROR_FACILITY + 0x0036,
+        DuplicatePayloadFile        = ERROR_FACILITY + 0x0037,
 
         // Signature errors
         SignatureInvalid            = ERROR_FACILITY + 0x0041,
@@ -85,6 +91,9 @@ namespace MSIX {
         // AppxManifest semantic errors
         AppxManifestSemanticError   = ERROR_FACILITY + 0x0061,
 
+        // AppxContentGroupMap semantic errors
+        ContentGroupMapSemanticError = ERROR_FACILITY + 0x0071,
+
         // XML parsing errors
         XercesWarning               = XERCES_SAX_FACILITY + 0x0001,
         XercesError                 = XERCES_SAX_FACILITY + 0x0002,
@@ -106,28 +115,28 @@ namespace MSIX {
             m_code(static_cast<std::uint32_t>(error)),
             m_message(message)
         {
-            Global::Log::Append(Message());
+            Global::Log::Append(Global::Log::Level::Error, m_code, Message());
         }
 
         Exception(Error error, const char* message) :
             m_code(static_cast<std::uint32_t>(error)),
             m_message(message)
         {
-            Global::Log::Append(Message());
+            Global::Log::Append(Global::Log::Level::Error, m_code, Message());
         }
 
         Exception(HRESULT error, std::string& message) :
             m_code(error),
             m_message(message)
         {
-            Global::Log::Append(Message());
+            Global::Log::Append(Global::Log::Level::Error, m_code, Message());
         }
 
         Exception(HRESULT error, const char* message) :
             m_code(error),
             m_message(message)
         {
-            Global::Log::Append(Message());
+            Global::Log::Append(Global::Log::Level::Error, m_code, Message());
         }
 
         uint32_t            Code() { return m_code; }
@@ -143,15 +152,11 @@ namespace MSIX {
     public:
         Win32Exception(DWORD error, std::string& message) :
             Exception(0x80070000 + error, message)
-        {
-            Global::Log::Append(Message());
-        }
+        {}
 
         Win32Exception(DWORD error, const char* message) :
             Exception(0x80070000 + error, message)
-        {
-            Global::Log::Append(Message());
-        }
+        {}
     };
 
     class NtStatusException : public Exception
@@ -159,15 +164,11 @@ namespace MSIX {
     public:
         NtStatusException(NTSTATUS error, std::string& message) :
             Exception(static_cast<std::uint32_t>(error), message)
-        {
-            Global::Log::Append(Message());
-        }
+        {}
 
         NtStatusException(NTSTATUS error, const char* message) :
             Exception(static_cast<std::uint32_t>(error), message)
-        {
-            Global::Log::Append(Message());
-        }
+        {}
     };
 
     class ParsingException : public XERCES_CPP_NAMESPACE::ErrorHandler
@@ -0,0 +1,58 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+namespace MSIX {
+
+    // Read-only view of part of a file mapped into memory, so that it can be hashed in place.  It is the file
+    // itself, not a copy of it: writes to the file show through, and a read of a page that the file has since
+    // been cut short to leave out kills the process with SIGBUS.  Only map files that nothing truncates while
+    // the view is in use, like a package that is being read.
+    class FileView
+    {
+    public:
+        // Returns nullptr when the platform can't map the file, or when the range isn't all in the file.
+        static std::unique_ptr<FileView> Map(FILE* file, std::uint64_t offset, std::uint64_t size);
+        ~FileView();
+
+        const std::uint8_t* Data() const { return m_data; }
+
+    protected:
+        FileView() {}
+
+        void*               m_address = nullptr;
+        std::size_t         m_length = 0;
+        const std::uint8_t* m_data = nullptr;
+    };
+
+    // What tells one file, and one version of its content, from another without reading it.
+    struct FileIdentity
+    {
+        std::uint64_t device;
+        std::uint64_t inode;
+        std::uint64_t size;
+        std::uint64_t modified;     // last write time, in the platform's own units
+    };
+
+    // Returns false when the platform can't tell.
+    bool GetFileIdentity(FILE* file, FileIdentity& identity);
+
+    // Copies size bytes from offset in source to the current position in target without them passing
+    // through user space.  Returns false, having copied nothing, when neither the platform nor the file
+    // systems involved can do that and the caller has to write the bytes itself.
+    bool CopyFileRange(FILE* source, std::uint64_t offset, FILE* target, std::uint64_t size);
+
+    // Reads size bytes from offset in file without going through, or moving, its stdio position, so that any
+    // number of threads can read the same file at once.  Returns false, having read nothing, when the platform
+    // can't.  Throws when the file ends first.
+    bool ReadFileAt(FILE* file, std::uint64_t offset, void* buffer, std::size_t size);
+
+    // Cuts file off, or extends it with zeros, to size bytes.  Throws when it can't.
+    void TruncateFile(FILE* file, std::uint64_t size);
+}
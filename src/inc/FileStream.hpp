@@ -10,6 +10,8 @@
 
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
+#include "FileCopy.hpp"
+#include "Perf.hpp"
 
 namespace MSIX {
     class FileStream : public StreamBase
@@ -29,6 +31,9 @@ namespace MSIX {
             #endif            
         }
 
+        // Over a file that was opened elsewhere, e.g. stdin, which stays open.
+        FileStream(FILE* handle) : file(handle), isOwner(false) {}
+
         virtual ~FileStream() override
         {
             Close();
@@ -36,7 +41,7 @@ namespace MSIX {
 
         void Close()
         {
-            if (file)
+            if (file && isOwner)
             {   // the most we would ever do w.r.t. a failure from fclose is *maybe* log something...
                 std::fclose(file);
                 file = nullptr;
@@ -46,7 +51,8 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) override
         {
             return ResultOf([&] {
-                int rc = std::fseek(file, (long)move.QuadPart, origin);
+                Global::Perf::Count(Global::Perf::Counter::StreamSeek);
+                int rc = Fseek(move.QuadPart, origin);
                 ThrowErrorIfNot(Error::FileSeek, (rc == 0), "seek failed");
                 offset = Ftell();
                 if (newPosition) { newPosition->QuadPart = offset; }
@@ -57,7 +63,9 @@ namespace MSIX {
         {
             if (bytesRead) { *bytesRead = 0; }
             return ResultOf([&] {
+                Global::Perf::Scope scope(Global::Perf::Counter::StreamRead);
                 ULONG result = static_cast<ULONG>(std::fread(buffer, sizeof(std::uint8_t), countBytes, file));
+                scope.AddBytes(result);
                 ThrowErrorIfNot(Error::FileRead, (result == countBytes || Feof()), "read failed");
                 offset = Ftell();
                 if (bytesRead) { *bytesRead = result; }
@@ -68,26 +76,56 @@ namespace MSIX {
         {
             if (bytesWritten) { *bytesWritten = 0; }
             return ResultOf([&] {
+                Global::Perf::Scope scope(Global::Perf::Counter::Write);
                 ULONG result = static_cast<ULONG>(std::fwrite(buffer, sizeof(std::uint8_t), countBytes, file));
+                scope.AddBytes(result);
                 ThrowErrorIfNot(Error::FileWrite, (result == countBytes), "write failed");
                 offset = Ftell();
                 if (bytesWritten) { *bytesWritten = result; }
             });
         }
 
+        HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER size) override
+        {
+            return ResultOf([&] {
+                TruncateFile(file, size.QuadPart);
+            });
+        }
+
+        FILE* GetFileHandle() override
+        {
+            Flush();
+            return file;
+        }
+
     protected:
         inline int Ferror() { return std::ferror(file); }
         inline bool Feof()  { return 0 != std::feof(file); }
         inline void Flush() { std::fflush(file); }
 
+        // fseek/ftell traffic in long, which is 32 bits on Windows and on 32-bit POSIX builds.
+        inline int Fseek(std::int64_t offset, int origin)
+        {
+            #ifdef WIN32
+            return _fseeki64(file, offset, origin);
+            #else
+            return fseeko(file, static_cast<off_t>(offset), origin);
+            #endif
+        }
+
         inline std::uint64_t Ftell()
         {
-            auto result = ftell(file);
+            #ifdef WIN32
+            auto result = _ftelli64(file);
+            #else
+            auto result = ftello(file);
+            #endif
             return static_cast<std::uint64_t>(result);
         }
 
         std::uint64_t offset = 0;
         std::string name;
         FILE* file;
+        bool isOwner = true;
     };
 }
@@ -9,6 +9,7 @@
 #include "StreamBase.hpp"
 #include "ComHelper.hpp"
 #include "SHA256.hpp"
+#include "Perf.hpp"
 
 #include <string>
 #include <map>
@@ -17,24 +18,34 @@
 
 namespace MSIX {
   
-    // This represents a subset of a Stream
+    // Validates a stream against its expected digest before the first byte is handed out.  Streams up to
+    // MaxCacheSize are read once into a cache and served from it; larger ones are hashed in pieces and
+    // then read again from the underlying stream, so their size is not bounded by memory.  Because the
+    // underlying stream could change between the two reads, what is served from it is hashed again as it
+    // goes out, and the read that serves the last byte fails if that doesn't match the digest too.
     class HashStream : public StreamBase
     {
     protected:
+        static const std::uint64_t MaxCacheSize = 4 * 1024 * 1024;
+        static const ULONG HashChunkSize = 64 * 1024;
+
         bool m_validated;
         ComPtr<IStream> m_stream;
-        std::vector<std::uint8_t>& m_expectedHash;
+        const std::vector<std::uint8_t>& m_expectedHash;
         std::unique_ptr<std::vector<std::uint8_t>> m_cacheBuffer;
         std::uint64_t m_relativePosition;
-        size_t m_streamSize;
+        std::uint64_t m_streamSize;
+        std::unique_ptr<SHA256> m_servedHash;
+        std::uint64_t m_servedHashed; // bytes from the start of the stream that m_servedHash covers
 
     public:
-        HashStream(IStream* stream, std::vector<std::uint8_t>& expectedHash) :
+        HashStream(IStream* stream, const std::vector<std::uint8_t>& expectedHash) :
             m_validated(false),
             m_stream(stream),
             m_expectedHash(expectedHash),
             m_relativePosition(0),
-            m_streamSize(0)
+            m_streamSize(0),
+            m_servedHashed(0)
         {
             ULARGE_INTEGER uli;
             LARGE_INTEGER li;
@@ -42,24 +53,57 @@ namespace MSIX {
             
             ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::END, &uli));
             ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
-            m_streamSize = static_cast<size_t>(uli.u.LowPart);
+            m_streamSize = uli.QuadPart;
         }
 
         void Validate()
         {
             if (m_validated) { return; }
 
-            // read stream into cache buffer
-            m_cacheBuffer = std::make_unique<std::vector<std::uint8_t>>(m_streamSize);            
-            ULONG bytesRead = 0;
-            ThrowHrIfFailed(m_stream->Read(m_cacheBuffer->data(), m_cacheBuffer->size(), &bytesRead));
-            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, bytesRead == m_streamSize, "read failed");
-            
-            // compute digest and compare against expected digest
+            // the digest covers the whole stream, wherever the caller has seeked to.
+            LARGE_INTEGER li = { 0 };
+            if (m_relativePosition != 0)
+            {   ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
+            }
+
             std::vector<std::uint8_t> hash;
-            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, 
-                MSIX::SHA256::ComputeHash(m_cacheBuffer->data(), m_cacheBuffer->size(), hash), 
-                "Invalid signature");
+            if (m_streamSize <= MaxCacheSize)
+            {
+                // read stream into cache buffer
+                m_cacheBuffer = std::make_unique<std::vector<std::uint8_t>>(static_cast<size_t>(m_streamSize));
+                Global::Perf::Count(Global::Perf::Counter::StreamAllocation, m_streamSize);
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(m_stream->Read(m_cacheBuffer->data(), static_cast<ULONG>(m_cacheBuffer->size()), &bytesRead));
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid, bytesRead == m_streamSize, "read failed");
+
+                // compute digest
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid,
+                    MSIX::SHA256::ComputeHash(m_cacheBuffer->data(), m_cacheBuffer->size(), hash),
+                    "Invalid signature");
+            }
+            else
+            {
+                // hash the stream a piece at a time, then put the underlying stream back where the caller left it.
+                std::vector<std::uint8_t> buffer(HashChunkSize);
+                SHA256 hasher;
+                std::uint64_t total = 0;
+                while (total < m_streamSize)
+                {
+                    ULONG bytesRead = 0;
+                    ULONG count = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(HashChunkSize), m_streamSize - total));
+                    ThrowHrIfFailed(m_stream->Read(buffer.data(), count, &bytesRead));
+                    if (bytesRead == 0) { break; }
+                    hasher.HashData(buffer.data(), bytesRead);
+                    total += bytesRead;
+                }
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid, total == m_streamSize, "read failed");
+                hasher.FinalizeAndGetHashValue(hash);
+
+                li.QuadPart = static_cast<LONGLONG>(m_relativePosition);
+                ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
+            }
+
+            // compare against expected digest
             ThrowErrorIfNot(MSIX::Error::SignatureInvalid, m_expectedHash.size() == hash.size(), "Signature is corrupt");
             ThrowErrorIfNot(
                 MSIX::Error::SignatureInvalid,
@@ -69,23 +113,75 @@ namespace MSIX {
             m_validated = true;
         }
 
+        // Brings m_servedHash up to the current position.  A read behind what has been hashed starts over from
+        // the start of the stream, and one ahead of it hashes what was skipped, so that the hash always covers
+        // exactly the bytes from the start of the stream up to the next one served.
+        void CatchUpServedHash()
+        {
+            if (m_servedHash && m_servedHashed == m_relativePosition) { return; }
+            LARGE_INTEGER li = { 0 };
+            if (!m_servedHash || m_servedHashed > m_relativePosition)
+            {   m_servedHash = std::make_unique<SHA256>();
+                m_servedHashed = 0;
+                ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
+            }
+            else
+            {   li.QuadPart = static_cast<LONGLONG>(m_servedHashed);
+                ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
+            }
+            std::vector<std::uint8_t> buffer(HashChunkSize);
+            while (m_servedHashed < m_relativePosition)
+            {
+                ULONG bytesRead = 0;
+                ULONG count = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(HashChunkSize), m_relativePosition - m_servedHashed));
+                ThrowHrIfFailed(m_stream->Read(buffer.data(), count, &bytesRead));
+                ThrowErrorIf(MSIX::Error::SignatureInvalid, (bytesRead == 0), "read failed");
+                m_servedHash->HashData(buffer.data(), bytesRead);
+                m_servedHashed += bytesRead;
+            }
+        }
+
+        // Reads from the underlying stream, hashing what is served, and checks the digest once the last byte is.
+        void ServeRead(void* buffer, ULONG countBytes, ULONG* actualRead)
+        {
+            if (m_relativePosition >= m_streamSize)
+            {   if (actualRead) { *actualRead = 0; }
+                return;
+            }
+            CatchUpServedHash();
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(m_stream->Read(buffer, countBytes, &bytesRead));
+            m_servedHash->HashData(reinterpret_cast<const std::uint8_t*>(buffer), bytesRead);
+            m_servedHashed += bytesRead;
+            m_relativePosition += bytesRead;
+            if (bytesRead != 0 && m_servedHashed == m_streamSize)
+            {   std::vector<std::uint8_t> hash;
+                m_servedHash->FinalizeAndGetHashValue(hash);
+                m_servedHash.reset();
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid,
+                    hash.size() == m_expectedHash.size() && memcmp(m_expectedHash.data(), hash.data(), hash.size()) == 0,
+                    "Stream changed after it was validated");
+            }
+            if (actualRead) { *actualRead = bytesRead; }
+        }
+
         void CacheSeek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition)
         {
-            LARGE_INTEGER newPos = { 0 };
+            std::int64_t newPos = 0;
             switch (origin)
             {
                 case Reference::CURRENT:
-                    m_relativePosition += move.u.LowPart;
+                    newPos = static_cast<std::int64_t>(m_relativePosition) + move.QuadPart;
                     break;
                 case Reference::START:
-                    m_relativePosition = move.u.LowPart;
+                    newPos = move.QuadPart;
                     break;
                 case Reference::END:
-                    m_relativePosition = m_streamSize;
+                    newPos = static_cast<std::int64_t>(m_streamSize) + move.QuadPart;
                     break;
             }
-            m_relativePosition = std::max((std::uint64_t)0, std::min(m_relativePosition, static_cast<std::uint64_t>(m_streamSize)));
-            if (newPosition) { newPosition->QuadPart = (std::uint64_t)m_relativePosition; }
+            m_relativePosition = std::min(static_cast<std::uint64_t>(std::max(newPos, static_cast<std::int64_t>(0))), m_streamSize);
+            if (newPosition) { newPosition->QuadPart = m_relativePosition; }
         }        
 
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) override
@@ -102,7 +198,7 @@ namespace MSIX {
         void CacheRead(void* buffer, ULONG countBytes, ULONG* actualRead)
         {
             ThrowErrorIf(Error::Stg_E_Invalidpointer, (buffer == nullptr), "bad input");
-            ULONG bytesToRead = std::min((std::uint32_t)countBytes, static_cast<std::uint32_t>((std::uint64_t)m_cacheBuffer->size() - m_relativePosition));
+            ULONG bytesToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_streamSize - m_relativePosition));
             if (bytesToRead)
             {
                 memcpy(buffer, reinterpret_cast<BYTE*>(m_cacheBuffer->data()) + m_relativePosition, bytesToRead);
@@ -118,7 +214,7 @@ namespace MSIX {
             return ResultOf([&]{
                 Validate();
                 if (m_cacheBuffer.get() == nullptr)
-                {   ThrowHrIfFailed(m_stream->Read(buffer, countBytes, actualRead));
+                {   ServeRead(buffer, countBytes, actualRead);
                 }
                 else
                 {   CacheRead(buffer, countBytes, actualRead);
@@ -138,7 +234,7 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE GetContentType(LPWSTR* contentType) override
         {
-            return ResultOf([&]{ return m_stream.As<IAppxFile>()->GetContentType(contentType); });
+            return ResultOf([&]{ ThrowHrIfFailed(m_stream.As<IAppxFile>()->GetContentType(contentType)); });
         }
         
         HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) override
@@ -0,0 +1,32 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // A secret key kept in a file, and HMAC-SHA256 (RFC 2104) under it, to seal what is written next to the key
+    // so that it can be told apart from what someone else wrote there.  Whoever can read the key can forge what
+    // it seals.
+    class HmacKey
+    {
+    public:
+        // Makes the key the first time the file at path, whose directory must exist, is used, readable by the
+        // current user only.  Throws if the key there is a link, belongs to another user or others can read it.
+        HmacKey(const std::string& path);
+
+        std::vector<std::uint8_t> GetMac(const std::uint8_t* data, std::size_t size);
+
+        // Compares in the same time whatever the content, so that a forger can't find a mac a byte at a time.
+        static bool IsEqual(const std::uint8_t* a, const std::uint8_t* b, std::size_t size);
+
+    protected:
+        std::vector<std::uint8_t> m_key;
+    };
+}
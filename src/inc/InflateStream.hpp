@@ -12,6 +12,7 @@
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
 #include "ComHelper.hpp"
+#include "CountingStream.hpp"
 
 // Windows.h defines max and min... 
 #undef max
@@ -19,6 +20,7 @@
 #include <string>
 #include <map>
 #include <functional>
+#include <memory>
 
 namespace MSIX {
 
@@ -26,7 +28,7 @@ namespace MSIX {
     class InflateStream : public StreamBase
     {
     public:
-        InflateStream(IStream* stream, std::uint64_t uncompressedSize);
+        InflateStream(IStream* stream, std::uint64_t uncompressedSize, std::shared_ptr<ReadStatistics> statistics = nullptr);
         ~InflateStream();
 
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) override;
@@ -54,7 +56,7 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE GetContentType(LPWSTR* contentType) override
         {   // The underlying ZipFileStream object knows, so go ask it.
-            return ResultOf([&]{ return m_stream.As<IAppxFile>()->GetContentType(contentType); });
+            return ResultOf([&]{ ThrowHrIfFailed(m_stream.As<IAppxFile>()->GetContentType(contentType)); });
         }
 
     protected:
@@ -70,6 +72,12 @@ namespace MSIX {
             CLEANUP
         };
 
+        // zlib can consume all of its input and still hold output that did not fit in the window,
+        // so more input is only needed when the last inflate did not fill the window.
+        State NextInflateState()
+        {   return ((m_zstrm.avail_in == 0) && (m_zstrm.avail_out != 0)) ? State::READY_TO_READ : State::READY_TO_INFLATE;
+        }
+
         State m_previous = State::UNINITIALIZED;
         State m_state    = State::UNINITIALIZED;
         std::map<State, std::function<std::tuple<bool, State>(void* buffer, ULONG countBytes)>> m_stateMachine;
@@ -82,6 +90,8 @@ namespace MSIX {
         ULONG           m_inflateWindowPosition = 0;
         ULONGLONG       m_fileCurrentWindowPositionEnd = 0;
         ULONGLONG       m_fileCurrentPosition = 0;
+        ULONGLONG       m_inflatedHighWaterMark = 0;   // end of the furthest window inflated so far
+        std::shared_ptr<ReadStatistics> m_statistics;
         z_stream        m_zstrm;
         int             m_zret;
 
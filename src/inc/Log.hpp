@@ -1,16 +1,68 @@
 //
 //  Copyright (C) 2017 Microsoft.  All rights reserved.
 //  See LICENSE file in the project root for full license information.
-// 
+//
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace MSIX {
-    namespace Global { 
+    namespace Global {
+        // The most recent messages, kept in a fixed ring that any number of threads append to without taking a
+        // lock.  A message that is not going to be kept costs one relaxed atomic load.
         namespace Log {
-            void Append(const std::string& comment);
-            const std::string& Text();
+            // Same values as MSIX_LOG_LEVEL
+            enum class Level : std::uint32_t
+            {
+                Error   = 0,
+                Warning = 1,
+                Info    = 2,
+                Verbose = 3,
+            };
+
+            struct Entry
+            {
+                Level         level;
+                std::uint32_t code;         // 0 when the message isn't about an error
+                std::uint64_t timestamp;    // nanoseconds on a monotonic clock
+                std::uint64_t thread;
+                std::string   message;
+            };
+
+            extern std::atomic<std::uint32_t> g_level;
+
+            inline bool IsEnabled(Level level)
+            {   return static_cast<std::uint32_t>(level) <= g_level.load(std::memory_order_relaxed);
+            }
+
+            void SetLevel(Level level);
+
+            // Messages longer than the ring keeps are cut short in it, the sink gets all of them.
+            void Append(Level level, std::uint32_t code, const std::string& message);
+            inline void Append(const std::string& comment) { Append(Level::Error, 0, comment); }
+
+            // For messages that aren't worth building unless they are going to be kept.
+            inline void Verbose(const char* message)
+            {   if (IsEnabled(Level::Verbose)) { Append(Level::Verbose, 0, message); }
+            }
+
+            // The entries still in the ring, oldest first.
+            std::vector<Entry> Entries();
+            // Their messages, one per line.
+            std::string Text();
+            // Text, and starts over after what it returned.
+            std::string Take();
             void Clear();
+
+            // Called with every entry that is appended, on the thread that appends it, in addition to keeping it.
+            // Messages that the sink itself logs only go to the ring.  An empty sink stops it.  The log owns its
+            // copy of the sink until SetSink replaces it, and SetSink waits for the calls to the one it replaces,
+            // on other threads, to return, unless it is called from inside that sink.
+            using Sink = std::function<void(const Entry& entry)>;
+            void SetSink(Sink sink);
         }
     }
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+#include <string>
+#include <vector>
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "AppxBlockMapObject.hpp"
+
+namespace MSIX {
+
+    // The files that differ between two packages, from nothing but their block maps.
+    class PackageDiff : public MSIX::ComClass<PackageDiff, IMSIXPackageDiff>
+    {
+    public:
+        PackageDiff(IAppxBlockMapInternal* oldBlockMap, IAppxBlockMapInternal* newBlockMap);
+
+        // IMSIXPackageDiff
+        HRESULT STDMETHODCALLTYPE GetCount(UINT32* count) override;
+        HRESULT STDMETHODCALLTYPE GetFile(UINT32 position, MSIX_FILE_DIFF* file) override;
+
+    protected:
+        struct File
+        {
+            std::string    name;
+            MSIX_FILE_DIFF diff{};
+        };
+
+        std::vector<File> m_files;
+    };
+}
@@ -0,0 +1,116 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "StorageObject.hpp"
+#include "FileCopy.hpp"
+#include "HmacKey.hpp"
+#include "SHA256.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // Everything that opening a package works out from its central directory and block map, written to a file
+    // after the first open so that the next open of the same, unchanged, package can skip that work.  The file is
+    // laid out the way it is used: a header, fixed size records and the names they point into, all in native byte
+    // order and at natural alignment.  Loading it checks that it is whole, was sealed with the key kept in the
+    // index directory and belongs to the package, nothing is parsed.  An index is only used when the package's
+    // AppxBlockMap.xml, which the signature vouches for if there is one, is the one it was made from.
+    class PackageIndex
+    {
+    public:
+        static const std::uint32_t Magic   = 0x4958534D; // MSXI
+        static const std::uint32_t Version = 3;
+
+        struct Header
+        {
+            std::uint32_t magic;
+            std::uint32_t version;
+            std::uint64_t fileSize;                             // of the index
+            std::uint8_t  mac[HASH_BYTES];                      // HMAC-SHA256 of everything after it
+            FileIdentity  package;
+            std::uint8_t  blockMapDigest[HASH_BYTES];           // AppxBlockMap.xml, as the signature's AXBM
+            std::uint8_t  contentTypesDigest[HASH_BYTES];       // [Content_Types].xml, as it was validated
+            std::uint64_t entryCount;
+            std::uint64_t entriesOffset;
+            std::uint64_t blockMapFileCount;
+            std::uint64_t blockMapFilesOffset;
+            std::uint64_t blockCount;
+            std::uint64_t blocksOffset;
+            std::uint64_t namesOffset;
+            std::uint64_t namesSize;
+        };
+
+        // A file in the archive, in storage order.
+        struct Entry
+        {
+            std::uint64_t nameOffset;
+            std::uint32_t nameSize;
+            std::uint32_t isCompressed;
+            std::uint64_t dataOffset;
+            std::uint64_t compressedSize;
+            std::uint64_t uncompressedSize;
+            std::uint32_t crc;
+            std::uint32_t reserved;     // 0, keeps the record 8 byte aligned
+        };
+
+        // A file in the block map, its blocks are blockCount records from firstBlock on.
+        struct BlockMapFile
+        {
+            std::uint64_t nameOffset;
+            std::uint32_t nameSize;
+            std::uint32_t localFileHeaderSize;
+            std::uint64_t uncompressedSize;
+            std::uint64_t firstBlock;
+            std::uint64_t blockCount;
+        };
+
+        struct Block
+        {
+            std::uint64_t compressedSize;
+            std::uint8_t  hash[HASH_BYTES];
+        };
+
+        // Returns nullptr when there is no index at path, or it is damaged, or wasn't sealed with key, or it was
+        // made from another version of the package.
+        static std::unique_ptr<PackageIndex> Load(const std::string& path, const FileIdentity& package, HmacKey& key);
+
+        // Indexes a package that was just opened and validated.
+        static std::unique_ptr<PackageIndex> Create(const FileIdentity& package, IStorageObject* container, IAppxPackageReader* reader);
+
+        // Seals the index with key and replaces the file at path with it in one step, so that a reader never sees
+        // half of it.
+        void Save(const std::string& path, HmacKey& key);
+
+        // Where the index of a package goes in directory.  Named after the file rather than its content, so that
+        // the index of the previous version is overwritten.
+        static std::string GetPath(const std::string& directory, const FileIdentity& package);
+
+        // Where the key that seals the indexes in directory is kept.
+        static std::string GetKeyPath(const std::string& directory);
+
+        const Header&       GetHeader()             { return *m_header; }
+        std::uint64_t       Size()                  { return m_header->fileSize; }
+        const Entry*        GetEntries()            { return reinterpret_cast<const Entry*>(m_data + m_header->entriesOffset); }
+        const BlockMapFile* GetBlockMapFiles()      { return reinterpret_cast<const BlockMapFile*>(m_data + m_header->blockMapFilesOffset); }
+        const Block*        GetBlocks()             { return reinterpret_cast<const Block*>(m_data + m_header->blocksOffset); }
+        std::string         GetName(std::uint64_t offset, std::uint32_t size)
+        {   return std::string(reinterpret_cast<const char*>(m_data + m_header->namesOffset + offset), size);
+        }
+
+    protected:
+        PackageIndex() {}
+
+        std::unique_ptr<FileView> m_view;       // when the platform can map it
+        std::vector<std::uint8_t> m_buffer;     // when it can't
+        const std::uint8_t*       m_data = nullptr;
+        const Header*             m_header = nullptr;
+    };
+}
@@ -0,0 +1,104 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace MSIX {
+    namespace Global {
+        // Always compiled in.  While disabled, instrumented code pays for one relaxed atomic load.
+        namespace Perf {
+            enum class Counter : std::uint32_t
+            {
+                SignatureValidation = 0,
+                ContentTypesParse,
+                BlockMapParse,
+                ManifestParse,
+                CentralDirectoryParse,
+                Inflate,
+                Deflate,
+                Hash,
+                Write,
+                StreamRead,
+                StreamSeek,
+                StreamAllocation,
+                PackageRead,
+                PackageSeek,
+                PackageDelivered,
+                PackageReinflated,
+                DirectoryEnumerate,
+                PackStoredFile,
+                PackStoredBlock,
+                PackCopiedFile,
+                PackCompactedFile,
+                FileCopyRange,
+                IndexLoad,
+                IndexWrite,
+                ReaderCacheHit,
+                ReaderCacheEvict,
+                Max         // must be last
+            };
+
+            enum Option : std::uint32_t
+            {
+                None     = 0x0,
+                Counters = 0x1,
+                Trace    = 0x2,
+            };
+
+            struct Data
+            {
+                std::uint64_t count;
+                std::uint64_t bytes;
+                std::uint64_t nanoseconds;
+            };
+
+            extern std::atomic<std::uint32_t> g_options;
+
+            inline bool IsEnabled() { return g_options.load(std::memory_order_relaxed) != Option::None; }
+
+            // Sets the options and discards everything collected so far.
+            void SetOptions(std::uint32_t options);
+            const char* Name(Counter counter);
+            Data Get(Counter counter);
+            // Chrome trace event format, load it with chrome://tracing
+            std::string TraceText();
+
+            void Record(Counter counter, std::uint64_t bytes, std::chrono::steady_clock::time_point start);
+
+            // Adds totals that were accounted for elsewhere.
+            void Add(Counter counter, std::uint64_t count, std::uint64_t bytes);
+
+            // Counts an event that isn't worth timing.
+            inline void Count(Counter counter, std::uint64_t bytes = 0)
+            {   if (IsEnabled()) { Record(counter, bytes, std::chrono::steady_clock::time_point()); }
+            }
+
+            // Times its own lifetime and records it against a counter when it goes out of scope.
+            class Scope
+            {
+            public:
+                Scope(Counter counter) : m_counter(counter), m_enabled(IsEnabled())
+                {   if (m_enabled) { m_start = std::chrono::steady_clock::now(); }
+                }
+
+                ~Scope()
+                {   if (m_enabled) { Record(m_counter, m_bytes, m_start); }
+                }
+
+                void AddBytes(std::uint64_t bytes) { m_bytes += bytes; }
+
+            protected:
+                Counter       m_counter;
+                bool          m_enabled;
+                std::uint64_t m_bytes = 0;
+                std::chrono::steady_clock::time_point m_start;
+            };
+        }
+    }
+}
@@ -0,0 +1,109 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace MSIX {
+
+    // Fixed capacity FIFO that links two stages of a pipeline.  Push blocks while the queue is full, which
+    // keeps a fast producer from running ahead of a slow consumer, and Pop blocks while it is empty.
+    template <class T>
+    class BoundedQueue
+    {
+    public:
+        BoundedQueue(std::size_t capacity) : m_capacity(std::max<std::size_t>(capacity, 1)) {}
+
+        void Push(T item)
+        {
+            {   std::unique_lock<std::mutex> lock(m_lock);
+                m_notFull.wait(lock, [this]() { return m_items.size() < m_capacity; });
+                m_items.push_back(std::move(item));
+            }
+            m_notEmpty.notify_one();
+        }
+
+        T Pop()
+        {
+            T item;
+            {   std::unique_lock<std::mutex> lock(m_lock);
+                m_notEmpty.wait(lock, [this]() { return !m_items.empty(); });
+                item = std::move(m_items.front());
+                m_items.pop_front();
+            }
+            m_notFull.notify_one();
+            return item;
+        }
+
+    protected:
+        std::mutex              m_lock;
+        std::condition_variable m_notFull;
+        std::condition_variable m_notEmpty;
+        std::deque<T>           m_items;
+        std::size_t             m_capacity;
+    };
+
+    // Set of buffers that are handed out by Acquire and come back to the pool when the last reference to
+    // them goes away.  Acquire blocks while every buffer is in use.  The pool must outlive its buffers.
+    class BufferPool
+    {
+    public:
+        using Buffer = std::shared_ptr<std::vector<std::uint8_t>>;
+
+        BufferPool(std::size_t count, std::size_t size) : m_size(size)
+        {
+            for (std::size_t i = 0; i < std::max<std::size_t>(count, 1); i++)
+            {   m_buffers.emplace_back(std::make_unique<std::vector<std::uint8_t>>(size));
+                m_free.push_back(m_buffers.back().get());
+            }
+        }
+
+        Buffer Acquire()
+        {
+            std::vector<std::uint8_t>* buffer = nullptr;
+            {   std::unique_lock<std::mutex> lock(m_lock);
+                m_available.wait(lock, [this]() { return !m_free.empty(); });
+                buffer = m_free.back();
+                m_free.pop_back();
+            }
+            return Buffer(buffer, [this](std::vector<std::uint8_t>* released) { Release(released); });
+        }
+
+        // For holders that can't promise to give their buffers back in time, nor before the pool is gone: rather
+        // than wait, makes a buffer that isn't the pool's while every buffer is in use, and the pool's buffers
+        // keep it alive.
+        static Buffer AcquireOrMake(const std::shared_ptr<BufferPool>& pool)
+        {
+            std::vector<std::uint8_t>* buffer = nullptr;
+            {   std::lock_guard<std::mutex> lock(pool->m_lock);
+                if (pool->m_free.empty()) { return std::make_shared<std::vector<std::uint8_t>>(pool->m_size); }
+                buffer = pool->m_free.back();
+                pool->m_free.pop_back();
+            }
+            return Buffer(buffer, [pool](std::vector<std::uint8_t>* released) { pool->Release(released); });
+        }
+
+    protected:
+        void Release(std::vector<std::uint8_t>* buffer)
+        {
+            {   std::lock_guard<std::mutex> lock(m_lock);
+                m_free.push_back(buffer);
+            }
+            m_available.notify_one();
+        }
+
+        std::mutex                                              m_lock;
+        std::condition_variable                                 m_available;
+        std::vector<std::unique_ptr<std::vector<std::uint8_t>>> m_buffers;
+        std::vector<std::vector<std::uint8_t>*>                 m_free;
+        std::size_t                                             m_size;
+    };
+}
@@ -55,7 +55,7 @@ namespace MSIX {
                 LARGE_INTEGER offset = {0};
                 offset.QuadPart = m_relativePosition + m_offset;
                 ThrowHrIfFailed(m_stream->Seek(offset, StreamBase::START, nullptr));
-                ULONG amountToRead = std::min(countBytes, static_cast<ULONG>(m_size - m_relativePosition));
+                ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - m_relativePosition));
                 ULONG amountRead = 0;
                 ThrowHrIfFailed(m_stream->Read(buffer, amountToRead, &amountRead));
                 ThrowErrorIf(Error::FileRead, (amountToRead != amountRead), "Did not read as much as requesteed.");
@@ -0,0 +1,66 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#pragma once
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+#include "ZipObject.hpp"
+
+#include <algorithm>
+
+namespace MSIX {
+
+    // A file's data as it is stored in the archive, read with IZipReader::ReadRawFile from a position of its own,
+    // so that it doesn't move the streams that the archive hands out for the file.
+    class RawFileStream : public StreamBase
+    {
+    public:
+        RawFileStream(IZipReader* zip, const ZipRawFile& file) : m_zip(zip), m_file(file) {}
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) override
+        {
+            return ResultOf([&] {
+                std::int64_t position = 0;
+                switch (origin)
+                {
+                case Reference::CURRENT:
+                    position = static_cast<std::int64_t>(m_position) + move.QuadPart;
+                    break;
+                case Reference::START:
+                    position = move.QuadPart;
+                    break;
+                case Reference::END:
+                    position = static_cast<std::int64_t>(m_file.compressedSize) + move.QuadPart;
+                    break;
+                }
+                ThrowErrorIf(Error::FileSeekOutOfRange, (position < 0), "seek pointer out of bounds.");
+                m_position = std::min(static_cast<std::uint64_t>(position), m_file.compressedSize);
+                if (newPosition) { newPosition->QuadPart = m_position; }
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) override
+        {
+            return ResultOf([&] {
+                auto count = static_cast<ULONG>(std::min<std::uint64_t>(countBytes, m_file.compressedSize - m_position));
+                m_zip->ReadRawFile(m_file, m_position, buffer, count);
+                m_position += count;
+                if (bytesRead) { *bytesRead = count; }
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) override
+        {
+            return ResultOf([&]{
+                if (size) { *size = m_file.compressedSize; }
+            });
+        }
+
+    protected:
+        ComPtr<IZipReader> m_zip;
+        ZipRawFile         m_file;
+        std::uint64_t      m_position = 0;
+    };
+}
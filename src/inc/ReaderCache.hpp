@@ -0,0 +1,65 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "FileCopy.hpp"
+#include "PackageIndex.hpp"
+#include "AppxPackageObject.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace MSIX {
+
+    // Packages that were opened and validated, kept by file identity so that opening the same, unchanged, file
+    // again only makes new streams over it, and the objects that read the footprint files through them.  Entries
+    // hold no streams, or files, of the reader that validated them.  When the cache grows past its budget, the
+    // packages that were opened least recently go first.  Entries are shared, so one that is evicted while a
+    // reader is made from it stays whole until that is done.
+    class ReaderCache
+    {
+    public:
+        struct Entry
+        {
+            std::unique_ptr<PackageIndex> index;
+            AppxPackageParts              parts;
+            std::uint64_t                 size;     // roughly what keeping it costs
+        };
+
+        // 0, the default, keeps nothing.  Lowering it evicts right away.
+        void SetBudget(std::uint64_t bytes);
+        bool IsEnabled() { return m_budget.load(std::memory_order_relaxed) != 0; }
+
+        // Returns nullptr when the package isn't in the cache.
+        std::shared_ptr<Entry> Find(const FileIdentity& package);
+        void Add(const FileIdentity& package, std::unique_ptr<PackageIndex> index, const AppxPackageParts& parts);
+
+    protected:
+        struct Hash
+        {   std::size_t operator()(const FileIdentity& package) const;
+        };
+
+        struct Equal
+        {   bool operator()(const FileIdentity& a, const FileIdentity& b) const
+            {   return a.device == b.device && a.inode == b.inode && a.size == b.size && a.modified == b.modified;
+            }
+        };
+
+        using List = std::list<std::pair<FileIdentity, std::shared_ptr<Entry>>>;
+
+        // Evicts until the cache fits its budget, with m_lock held.
+        void Trim();
+
+        std::atomic<std::uint64_t> m_budget { 0 };
+        std::mutex                 m_lock;
+        std::uint64_t              m_size = 0;
+        List                       m_entries;   // most recently opened first
+        std::unordered_map<FileIdentity, List::iterator, Hash, Equal> m_find;
+    };
+}
@@ -4,6 +4,8 @@
 // 
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace MSIX {
@@ -13,6 +15,16 @@ namespace MSIX {
     class SHA256
     {
     public:
-        static bool ComputeHash(/*in*/ std::uint8_t *buffer, /*in*/ std::uint32_t cbBuffer, /*inout*/ std::vector<uint8_t>& hash);
+        static bool ComputeHash(/*in*/ const std::uint8_t *buffer, /*in*/ std::size_t cbBuffer, /*inout*/ std::vector<uint8_t>& hash);
+
+        // Incremental form, for content that is hashed as it streams by rather than held in memory.
+        SHA256();
+        ~SHA256();
+        void HashData(/*in*/ const std::uint8_t *buffer, /*in*/ std::size_t cbBuffer);
+        void FinalizeAndGetHashValue(/*inout*/ std::vector<uint8_t>& hash);
+
+    protected:
+        struct Context;
+        std::unique_ptr<Context> m_context;
     };
 }
\ No newline at end of file
@@ -18,6 +18,9 @@ enum class FileNameOptions : std::uint16_t
     FootPrintOnly = 0x1,
     PayloadOnly = 0x2,
     All = 0x3,
+    // In the order the files are stored in, e.g. by offset in an archive, instead of by name.  Storage
+    // objects without a meaningful order ignore it.
+    StorageOrder = 0x4,
 };
 
 inline constexpr FileNameOptions operator &(FileNameOptions a, FileNameOptions b)
@@ -15,8 +15,29 @@
 #include "Exceptions.hpp"
 #include "ComHelper.hpp"
 
+#include <cstdio>
+
+// internal interface
+EXTERN_C const IID IID_IFileBackedStream;
+#ifndef WIN32
+// {5b9e3c71-2f84-4d0a-9c6e-7a1d48b2f093}
+interface IFileBackedStream : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IFileBackedStream : public IUnknown
+#endif
+{
+public:
+    // The file the stream reads and writes, flushed, so that platform code can map it or copy it in the kernel.
+    // nullptr for streams that aren't simply a file.
+    virtual FILE* GetFileHandle() = 0;
+};
+
+SpecializeUuidOfImpl(IFileBackedStream);
+
 namespace MSIX {
-    class StreamBase : public MSIX::ComClass<StreamBase, IAppxFile, IStream>
+    class StreamBase : public MSIX::ComClass<StreamBase, IAppxFile, IStream, IFileBackedStream, IMSIXPayloadFile>
     {
     public:
         // These are the same values as STREAM_SEEK. See 
@@ -136,6 +157,24 @@ namespace MSIX {
             return QueryInterface(UuidOfImpl<IStream>::iid, reinterpret_cast<void**>(stream));
         }
 
+        //
+        // IFileBackedStream methods
+        //
+        virtual FILE* GetFileHandle() override { return nullptr; }
+
+        //
+        // IMSIXPayloadFile methods
+        //
+        virtual HRESULT STDMETHODCALLTYPE ReadAt(UINT64, void*, ULONG, ULONG*) override
+        {
+            return static_cast<HRESULT>(Error::NotImplemented);
+        }
+
+        virtual HRESULT STDMETHODCALLTYPE ReadBlocks(UINT32, const UINT32*, IMSIXPayloadBlocks**) override
+        {
+            return static_cast<HRESULT>(Error::NotImplemented);
+        }
+
         template <class T>
         static ULONG Read(IStream* stream, T* value)
         {
@@ -156,7 +195,7 @@ namespace MSIX {
             ThrowHrIfFailed(stream->Write(
                 reinterpret_cast<void*>(value),
                 static_cast<ULONG>(sizeof(T)),
-                nullptr                            
+                &result
             ));
             ThrowErrorIf(Error::FileWrite, (result != sizeof(T)), "Entire object wasn't written!");
         }
@@ -0,0 +1,78 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MSIX {
+
+    // Fixed set of worker threads that run tasks in the order they were submitted.  Results, and
+    // exceptions, come back through the std::future returned by Submit.
+    class ThreadPool
+    {
+    public:
+        ThreadPool(std::size_t threads = std::thread::hardware_concurrency())
+        {
+            threads = std::max<std::size_t>(threads, 1);
+            for (std::size_t i = 0; i < threads; i++)
+            {   m_threads.emplace_back([this]() { Run(); });
+            }
+        }
+
+        ~ThreadPool()
+        {
+            {   std::lock_guard<std::mutex> lock(m_lock);
+                m_stopping = true;
+            }
+            m_signal.notify_all();
+            for (auto& thread : m_threads) { thread.join(); }
+        }
+
+        std::size_t Size() const { return m_threads.size(); }
+
+        template <class Function>
+        auto Submit(Function&& function) -> std::future<decltype(function())>
+        {
+            using Result = decltype(function());
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+            auto result = task->get_future();
+            {   std::lock_guard<std::mutex> lock(m_lock);
+                m_tasks.emplace_back([task]() { (*task)(); });
+            }
+            m_signal.notify_one();
+            return result;
+        }
+
+    protected:
+        void Run()
+        {
+            for (;;)
+            {
+                std::function<void()> task;
+                {   std::unique_lock<std::mutex> lock(m_lock);
+                    m_signal.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+                    if (m_tasks.empty()) { return; }
+                    task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+        std::mutex                        m_lock;
+        std::condition_variable           m_signal;
+        std::deque<std::function<void()>> m_tasks;
+        std::vector<std::thread>          m_threads;
+        bool                              m_stopping = false;
+    };
+}
@@ -11,7 +11,14 @@ namespace MSIX {
     // converts an input utf8 formatted string into a utf16 formatted string
     std::wstring utf8_to_utf16(const std::string& utf8string);
 
+    // converts an input utf8 formatted string into a caller allocated buffer, without a terminator, and returns the
+    // number of code units written.  A utf8 string never needs more code units than it has bytes.
+    std::size_t utf8_to_utf16(const std::string& utf8string, wchar_t* utf16string);
+
     // converts an input utf16 formatted string into a utf8 formatted string
     std::string utf16_to_utf8(const std::wstring& utf16string);
 
+    // converts a null terminated utf16 formatted string into a utf8 formatted string
+    std::string utf16_to_utf8(const wchar_t* utf16string);
+
 } // namespace MSIX
\ No newline at end of file
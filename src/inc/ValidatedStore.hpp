@@ -0,0 +1,52 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "FileCopy.hpp"
+#include "HmacKey.hpp"
+#include "SHA256.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // Remembers which package files passed full validation, so that reading one of them again can skip hashing
+    // its blocks.  A record holds the file's identity, the block map digest its signature vouched for and the
+    // validation options it passed with, sealed with an HMAC-SHA256 under a key that is kept in the store's
+    // directory.  A record that was changed, or copied over another file's, doesn't verify.  The store is only as
+    // trustworthy as its directory: whoever can read the key can forge records.
+    class ValidatedStore
+    {
+    public:
+        // Makes the key the first time directory, which must exist, is used.
+        ValidatedStore(const std::string& directory);
+
+        // Whether the package, as it is now, passed the same validation before.  Never throws.
+        bool IsValidated(const FileIdentity& package, MSIX_VALIDATION_OPTION validation, const std::vector<std::uint8_t>& blockMapDigest);
+
+        // Called once every block of the package was checked against its block map.
+        void Record(const FileIdentity& package, MSIX_VALIDATION_OPTION validation, const std::vector<std::uint8_t>& blockMapDigest);
+
+    protected:
+        struct Entry
+        {
+            std::uint32_t magic;
+            std::uint32_t version;
+            FileIdentity  package;
+            std::uint32_t validation;
+            std::uint32_t reserved;
+            std::uint8_t  blockMapDigest[HASH_BYTES];
+            std::uint8_t  mac[HASH_BYTES];                  // of everything before it
+        };
+
+        std::string GetPath(const FileIdentity& package);
+
+        std::string m_directory;
+        HmacKey     m_key;
+    };
+}
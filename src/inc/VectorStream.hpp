@@ -8,6 +8,7 @@
 #include "ComHelper.hpp"
 #include <vector>
 #include <algorithm>
+#include <memory>
 
 namespace MSIX {
 
@@ -15,17 +16,29 @@ namespace MSIX {
     {
     public:
         VectorStream(std::vector<std::uint8_t>* data) : m_data(data) {}
+        // Shares ownership of the data, for streams that outlive whoever filled it.
+        VectorStream(std::shared_ptr<std::vector<std::uint8_t>> data) : m_owner(std::move(data)), m_data(m_owner.get()) {}
 
         HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) override
         {
             return ResultOf([&]{
-                ULONG amountToRead = std::min(countBytes, static_cast<ULONG>(m_data->size() - m_offset));
+                ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_data->size() - m_offset));
                 if (amountToRead > 0) { memcpy(buffer, &(m_data->at(m_offset)), amountToRead); }                
                 m_offset += amountToRead;
                 if (bytesRead) { *bytesRead = amountToRead; }
             });
         }
 
+        HRESULT STDMETHODCALLTYPE Write(const void *buffer, ULONG countBytes, ULONG *bytesWritten) override
+        {
+            return ResultOf([&]{
+                if (m_data->size() < m_offset + countBytes) { m_data->resize(m_offset + countBytes); }
+                if (countBytes > 0) { memcpy(&(m_data->at(m_offset)), buffer, countBytes); }
+                m_offset += countBytes;
+                if (bytesWritten) { *bytesWritten = countBytes; }
+            });
+        }
+
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) override
         {
             return ResultOf([&]{
@@ -42,13 +55,14 @@ namespace MSIX {
                     newPos.QuadPart = static_cast<std::uint64_t>(m_data->size()) + move.QuadPart;
                     break;
                 }
-                m_offset = std::min(newPos.u.LowPart, static_cast<ULONG>(m_data->size()));
+                m_offset = std::min(static_cast<std::uint64_t>(std::max(newPos.QuadPart, static_cast<LONGLONG>(0))), static_cast<std::uint64_t>(m_data->size()));
                 if (newPosition) { newPosition->QuadPart = newPos.QuadPart; }
             });
         }
 
     protected:
-        ULONG m_offset = 0;
+        std::uint64_t m_offset = 0;
+        std::shared_ptr<std::vector<std::uint8_t>> m_owner;
         std::vector<std::uint8_t>* m_data;
     };
 } // namespace MSIX
\ No newline at end of file
@@ -3,6 +3,9 @@
 //  See LICENSE file in the project root for full license information.
 // 
 #pragma once
+#include <algorithm>
+#include <limits>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -35,6 +38,8 @@ class IXmlObject : public IUnknown
 public:
     virtual void Write() = 0;
     virtual XERCES_CPP_NAMESPACE::DOMDocument* Document() = 0;
+    // Bytes of the document that was parsed, for accounting without seeking the stream again.
+    virtual std::uint64_t Size() = 0;
 };
 
 SpecializeUuidOfImpl(IXmlObject);
@@ -54,15 +59,23 @@ namespace MSIX {
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
 
-            std::uint32_t streamSize = end.u.LowPart;
-            std::vector<std::uint8_t> buffer(streamSize);
-            ULONG actualRead = 0;
-            ThrowHrIfFailed(stream->Read(buffer.data(), streamSize, &actualRead));
-            ThrowErrorIf(Error::FileRead, (actualRead != streamSize), "read error");
+            // the parser wants the whole document in memory; Read takes a ULONG so large documents take several.
+            ThrowErrorIf(Error::FileRead, (end.QuadPart > static_cast<std::uint64_t>(std::numeric_limits<std::size_t>::max())), "xml file too large");
+            std::vector<std::uint8_t> buffer(static_cast<std::size_t>(end.QuadPart));
+            std::size_t actualRead = 0;
+            while (actualRead < buffer.size())
+            {
+                ULONG count = static_cast<ULONG>(std::min<std::size_t>(buffer.size() - actualRead, std::numeric_limits<ULONG>::max()));
+                ULONG read = 0;
+                ThrowHrIfFailed(stream->Read(buffer.data() + actualRead, count, &read));
+                ThrowErrorIf(Error::FileRead, (read == 0), "read error");
+                actualRead += read;
+            }
 
             // move the underlying stream back to the begginning.
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
 
+            m_size = actualRead;
             std::unique_ptr<XERCES_CPP_NAMESPACE::MemBufInputSource> source = std::make_unique<XERCES_CPP_NAMESPACE::MemBufInputSource>(
                 reinterpret_cast<const XMLByte*>(&buffer[0]), actualRead, "XML File");
 
@@ -108,6 +121,7 @@ namespace MSIX {
         // IXmlObject
         void Write() override { throw Exception(Error::NotImplemented); }
         XERCES_CPP_NAMESPACE::DOMDocument* Document() override { return m_parser->getDocument();}
+        std::uint64_t Size() override { return m_size; }
 
         // IVerifierObject
         const std::string& GetPublisher() override { throw Exception(Error::NotSupported); }
@@ -121,6 +135,7 @@ namespace MSIX {
     protected:
         std::unique_ptr<XERCES_CPP_NAMESPACE::XercesDOMParser> m_parser;
         ComPtr<IStream> m_stream;
+        std::uint64_t   m_size = 0;
     };
 
 } // namespace MSIX
\ No newline at end of file
@@ -8,7 +8,9 @@
 #include "StreamBase.hpp"
 #include "RangeStream.hpp"
 #include "AppxFactory.hpp"
+#include "ContentType.hpp"
 
+#include <memory>
 #include <string>
 
 namespace MSIX {
@@ -20,16 +22,18 @@ namespace MSIX {
         // TODO: define what streams to pass in on the .ctor
         ZipFileStream(
             std::string name,
-            std::string contentType,
             IMSIXFactory* factory,
             bool isCompressed,
             std::uint64_t offset,
             std::uint64_t size,
             IStream* stream
-        ) : m_isCompressed(isCompressed), RangeStream(offset, size, stream), m_name(name), m_contentType(contentType), m_factory(factory)
+        ) : m_isCompressed(isCompressed), RangeStream(offset, size, stream), m_name(name), m_factory(factory)
         {
         }
 
+        // Until the package sets them, content types go by extension.
+        void SetContentTypes(std::shared_ptr<ContentTypeTable> contentTypes) { m_contentTypes = std::move(contentTypes); }
+
         HRESULT STDMETHODCALLTYPE GetName(LPWSTR* fileName) override
         {
             return m_factory->MarshalOutString(m_name, fileName);
@@ -37,7 +41,10 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE GetContentType(LPWSTR* contentType) override
         {
-            return m_factory->MarshalOutString(m_contentType, contentType);
+            return ResultOf([&]{
+                auto found = m_contentTypes ? m_contentTypes->Find(m_name) : nullptr;
+                ThrowHrIfFailed(m_factory->MarshalOutString(found ? *found : GetContentTypeByExtension(m_name), contentType));
+            });
         }
 
         HRESULT STDMETHODCALLTYPE GetCompressionOption(APPX_COMPRESSION_OPTION* compressionOption) override
@@ -51,7 +58,7 @@ namespace MSIX {
     protected:
         IMSIXFactory*  m_factory;
         std::string     m_name;
-        std::string     m_contentType;
         bool            m_isCompressed = false;
+        std::shared_ptr<ContentTypeTable> m_contentTypes;
     };
 }
\ No newline at end of file
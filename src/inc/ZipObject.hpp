@@ -9,17 +9,130 @@
 #include "StreamBase.hpp"
 #include "StorageObject.hpp"
 #include "AppxFactory.hpp"
+#include "CountingStream.hpp"
+#include "DirectoryObject.hpp"
 
+#include <cstdio>
+#include <functional>
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#ifndef WIN32
+interface IZipReader;
+#else
+class IZipReader;
+#endif
+
+// internal interface
+EXTERN_C const IID IID_IZipWriter;
+#ifndef WIN32
+// {3a8f6c1d-5e27-4b90-a4d3-96c2e0b7f815}
+interface IZipWriter : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IZipWriter : public IUnknown
+#endif
+{
+public:
+    // Writes the local file header of the next file and returns its size.  The crc and sizes of the
+    // file are not known up front, they are written after its data in a data descriptor by EndFile.
+    virtual std::uint64_t BeginFile(const std::string& fileName, APPX_COMPRESSION_OPTION compressionOption) = 0;
+
+    // Appends data, deflated if the file is compressed, to the current file.
+    virtual void WriteFileData(const void* data, ULONG size) = 0;
+
+    virtual void EndFile(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize) = 0;
+
+    // Copies a file of another archive, under the same name, as it is stored there, deflated or not.  Nothing is
+    // inflated, the crc and sizes come with the data.  onData, if set, sees the data as it goes by.  Otherwise the
+    // copy stays in the kernel when both archives are files and the platform can.  Returns the size of the local
+    // file header, as BeginFile does.
+    virtual std::uint64_t CopyFile(IZipReader* source, const std::string& fileName,
+        const std::function<void(const std::uint8_t* data, std::size_t size)>& onData) = 0;
+
+    // Only for an archive that is updated in place: moves the files in the central directory down over the space
+    // that files left out of it take, so that the archive is no larger than its files.  Files added afterwards go
+    // after them.
+    virtual void Compact() = 0;
+};
+
+SpecializeUuidOfImpl(IZipWriter);
+
+namespace MSIX {
+    class ContentTypeTable;
+
+    // A file's data as it is stored in the archive, before it is inflated.
+    struct ZipRawFile
+    {
+        ComPtr<IStream>                 stream;
+        bool                            isCompressed;
+        std::uint64_t                   uncompressedSize;
+        std::uint32_t                   crc;            // of the uncompressed data
+        std::shared_ptr<ReadStatistics> statistics;     // shared with the file's regular stream
+
+        // Where the data is in the package, for readers that go around the streams.  Not set for data that
+        // was read along with its neighbours, which is already in memory.
+        ComPtr<IStream>                 archive;
+        std::uint64_t                   archiveOffset;
+        std::shared_ptr<ReadStatistics> archiveStatistics;
+        std::uint64_t                   compressedSize;
+
+        // Where the data is in memory, for data that was read along with its neighbours.
+        std::shared_ptr<const std::vector<std::uint8_t>> memory;
+        std::uint64_t                   memoryOffset;
+    };
+}
+
+// internal interface
+EXTERN_C const IID IID_IZipReader;
+#ifndef WIN32
+// {8d1e4b27-6c3a-4f95-b0e2-5a7d9c14e36b}
+interface IZipReader : public IUnknown
+#else
+class IZipReader : public IUnknown
+#endif
+{
+public:
+    // For readers that inflate and account for the data themselves, e.g. one block at a time on several threads.
+    virtual MSIX::ZipRawFile GetRawFile(const std::string& fileName) = 0;
+
+    // Reads size bytes of a file's data as it is stored, from offset on, into buffer.  Any number of threads can
+    // call it at once.  When the package is a file, or the data is in memory, they read it side by side.
+    // Otherwise they take turns, and mustn't be mixed with reads through the streams on other threads.
+    virtual void ReadRawFile(const MSIX::ZipRawFile& file, std::uint64_t offset, void* buffer, std::size_t size) = 0;
+
+    // Copies a file's data as it is stored to the current position of target without it passing through user
+    // space.  Returns false, having copied nothing, when the package isn't a file or the platform can't.
+    virtual bool CopyRawFile(const MSIX::ZipRawFile& file, FILE* target) = 0;
+
+    // What the files answer to GetContentType, from the package's [Content_Types].xml.
+    virtual void SetContentTypes(const std::shared_ptr<MSIX::ContentTypeTable>& contentTypes) = 0;
+};
+
+SpecializeUuidOfImpl(IZipReader);
 
 namespace MSIX {
+    class CentralDirectoryFileHeader;
+    class PackageIndex;
+
     // This represents a raw stream over a.zip file.
-    class ZipObject : public ComClass<ZipObject, IStorageObject>
+    class ZipObject : public ComClass<ZipObject, IStorageObject, IMSIXReadStatistics, IZipWriter, IZipReader>
     {
     public:
         ZipObject(IMSIXFactory* factory, IStream* stream);
+        // Takes the files from the index of the package, so that nothing is read until a file is.
+        ZipObject(IMSIXFactory* factory, IStream* stream, PackageIndex& index);
+        // Creates a new, empty, archive with FileStream::Mode::WRITE, or updates one in place with
+        // FileStream::Mode::READ_UPDATE.  Files are added through IZipWriter and the central directory is written
+        // by CommitChanges.  An archive that is updated keeps its files where they are, new files go where its
+        // central directory was, and RemoveFile only leaves a file out of the central directory.  CommitChanges
+        // then cuts the archive off after the new central directory.
+        ZipObject(IMSIXFactory* factory, IStream* stream, FileStream::Mode mode);
 
         // StorageObject methods
         std::string                 GetPathSeparator() override;
@@ -29,9 +142,132 @@ namespace MSIX {
         IStream*                    OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) override;
         void                        CommitChanges() override;
 
+        // IMSIXReadStatistics
+        HRESULT STDMETHODCALLTYPE GetStatistics(MSIX_READ_STATISTICS* statistics) override;
+        HRESULT STDMETHODCALLTYPE GetFileStatistics(LPCWSTR fileName, MSIX_READ_STATISTICS* statistics) override;
+
+        // IZipWriter
+        std::uint64_t BeginFile(const std::string& fileName, APPX_COMPRESSION_OPTION compressionOption) override;
+        void WriteFileData(const void* data, ULONG size) override;
+        void EndFile(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize) override;
+        std::uint64_t CopyFile(IZipReader* source, const std::string& fileName,
+            const std::function<void(const std::uint8_t* data, std::size_t size)>& onData) override;
+        void Compact() override;
+
+        // IZipReader
+        ZipRawFile GetRawFile(const std::string& fileName) override;
+        void ReadRawFile(const ZipRawFile& file, std::uint64_t offset, void* buffer, std::size_t size) override;
+        bool CopyRawFile(const ZipRawFile& file, FILE* target) override;
+        void SetContentTypes(const std::shared_ptr<ContentTypeTable>& contentTypes) override;
+
     protected:
+        // Adds a file whose data is at sourceOffset in source, which is either the package or a run of it
+        // that was read into memory.  archive is the package in the first case and nullptr in the second,
+        // run is the memory in the second case and nullptr in the first.
+        void AddFile(const std::string& fileName, bool isCompressed, std::uint64_t dataOffset, std::uint64_t compressedSize,
+            std::uint64_t uncompressedSize, std::uint32_t crc, IStream* source, std::uint64_t sourceOffset, IStream* archive,
+            const std::shared_ptr<std::vector<std::uint8_t>>& run);
+
         IMSIXFactory*                          m_factory;
         ComPtr<IStream>                        m_stream;
         std::map<std::string, ComPtr<IStream>> m_streams;
+        std::map<std::string, ZipRawFile>      m_rawFiles;
+        std::vector<std::string>               m_storageOrder;     // by local file header offset
+        std::shared_ptr<ReadStatistics>        m_statistics;
+        std::map<std::string, std::shared_ptr<ReadStatistics>> m_fileStatistics;
+
+        // for ReadRawFile and CopyRawFile
+        FILE* GetArchiveFile(const ZipRawFile& file);
+
+        std::once_flag                         m_archiveLoaded;
+        FILE*                                  m_archiveFile = nullptr;    // when the package is a file
+        std::mutex                             m_readLock;                 // when it isn't
+
+        // used only while writing
+        void WriteBytes(const void* data, ULONG size);
+        // used only while updating
+        std::uint64_t GetFileEnd(const std::shared_ptr<CentralDirectoryFileHeader>& file);
+        void MoveBytes(std::uint64_t from, std::uint64_t to, std::uint64_t size);
+        void SeekToPosition();
+
+        bool                                                     m_isWriting = false;
+        bool                                                     m_isUpdating = false;
+        std::set<std::uint64_t>                                  m_fileStarts;   // of every file seen while updating, removed or not
+        std::uint64_t                                            m_position  = 0;
+        std::shared_ptr<CentralDirectoryFileHeader>              m_currentFile;
+        std::vector<std::shared_ptr<CentralDirectoryFileHeader>> m_centralDirectory;
     };//class ZipObject
 }
+
+// internal interface
+EXTERN_C const IID IID_IStagedStorage;
+#ifndef WIN32
+// {2e64b0d8-9a17-4c35-b86f-03d941e75ca2}
+interface IStagedStorage : public IUnknown
+#else
+class IStagedStorage : public IUnknown
+#endif
+{
+public:
+    // The SHA256 hash of each 64KB block of the file, taken while it was being staged.
+    virtual const std::vector<std::vector<std::uint8_t>>& GetBlockHashes(const std::string& fileName) = 0;
+
+    // Moves a file from where it is staged to its place in the target, once it has been verified.
+    virtual void CommitFile(const std::string& fileName, IStorageObject* to, const std::string& targetName) = 0;
+};
+
+SpecializeUuidOfImpl(IStagedStorage);
+
+namespace MSIX {
+    class ForwardReader;
+
+    // Reads an archive front to back without seeking, e.g. as it arrives through a pipe.  The central directory
+    // is at the end, so until then the local file headers are all there is to go by.  Every file is inflated
+    // into the staging directory and hashed on the way, and stays there until it is committed.  The staging
+    // directory belongs to this object, so it has to be a new one (see DirectoryObject::CreateUnique), and it
+    // is removed along with whatever is left in it when this object goes away.
+    class ZipStreamObject : public ComClass<ZipStreamObject, IStorageObject, IMSIXReadStatistics, IStagedStorage>
+    {
+    public:
+        ZipStreamObject(IMSIXFactory* factory, IStream* stream, IDirectoryObject* staging);
+        ~ZipStreamObject();
+
+        // StorageObject methods
+        std::string                 GetPathSeparator() override;
+        std::vector<std::string>    GetFileNames(FileNameOptions options) override;
+        IStream*                    GetFile(const std::string& fileName) override;
+        void                        RemoveFile(const std::string& fileName) override;
+        IStream*                    OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) override;
+        void                        CommitChanges() override;
+
+        // IMSIXReadStatistics
+        HRESULT STDMETHODCALLTYPE GetStatistics(MSIX_READ_STATISTICS* statistics) override;
+        HRESULT STDMETHODCALLTYPE GetFileStatistics(LPCWSTR fileName, MSIX_READ_STATISTICS* statistics) override;
+
+        // IStagedStorage
+        const std::vector<std::vector<std::uint8_t>>& GetBlockHashes(const std::string& fileName) override;
+        void CommitFile(const std::string& fileName, IStorageObject* to, const std::string& targetName) override;
+
+    protected:
+        struct StagedFile
+        {
+            std::string                            stagedName;
+            std::vector<std::vector<std::uint8_t>> blockHashes;
+            std::shared_ptr<ReadStatistics>        statistics;
+            // What the local file header, or the data descriptor after it, says, to check the central directory against.
+            std::uint32_t                          crc = 0;
+            std::uint64_t                          compressedSize = 0;
+            std::uint64_t                          uncompressedSize = 0;
+            bool                                   inCentralDirectory = false;
+        };
+
+        void ReadFile(ForwardReader& reader);
+        void ReadCentralDirectory(ForwardReader& reader);
+
+        IMSIXFactory*                       m_factory;
+        ComPtr<IDirectoryObject>            m_staging;
+        std::map<std::string, StagedFile>   m_files;
+        std::vector<std::string>            m_storageOrder;
+        std::shared_ptr<ReadStatistics>     m_statistics;
+    };//class ZipStreamObject
+}
@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <functional>
 #include <vector>
 #include <map>
@@ -18,7 +19,11 @@ enum class UserSpecified
 {
     Nothing,
     Help,
-    Unpack
+    Unpack,
+    Pack,
+    Diff,
+    Repack,
+    Edit
 };
 
 // Tracks the state of the current parse operation as well as implements input validation
@@ -66,6 +71,13 @@ struct State
         return true;
     }
 
+    bool SetBaseName(const std::string& name)
+    {
+        if (!baseName.empty() || name.empty()) { return false; }
+        baseName = name;
+        return true;
+    }
+
     bool SetDirectoryName(const std::string& name)
     {
         if (!directoryName.empty() || name.empty()) { return false; }
@@ -73,12 +85,58 @@ struct State
         return true;
     }
 
+    bool AddExcludedFile(const std::string& name)
+    {
+        if (name.empty()) { return false; }
+        excludedFiles.push_back(name);
+        return true;
+    }
+
+    bool VerifyBlocks()
+    {
+        verify = true;
+        return true;
+    }
+
+    bool UnpackByContentGroup()
+    {
+        byContentGroup = true;
+        return true;
+    }
+
+    bool CompactPackage()
+    {
+        compact = true;
+        return true;
+    }
+
+    bool EnableStatistics()
+    {
+        performanceOptions = static_cast<MSIX_PERFORMANCE_OPTION>(performanceOptions | MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_COUNTERS);
+        return true;
+    }
+
+    bool SetTraceFileName(const std::string& name)
+    {
+        if (!traceFileName.empty() || name.empty()) { return false; }
+        traceFileName = name;
+        performanceOptions = static_cast<MSIX_PERFORMANCE_OPTION>(performanceOptions | MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_TRACE);
+        return true;
+    }
+
     std::string packageName;
+    std::string baseName;
     std::string certName;
     std::string directoryName;
+    std::string traceFileName;
+    std::vector<std::string> excludedFiles;
+    bool byContentGroup                      = false;
+    bool verify                              = false;
+    bool compact                             = false;
     UserSpecified specified                  = UserSpecified::Nothing;
     MSIX_VALIDATION_OPTION validationOptions = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL;
     MSIX_PACKUNPACK_OPTION unpackOptions     = MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE;
+    MSIX_PERFORMANCE_OPTION performanceOptions = MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_NONE;
 };
 
 // describes an option to a command that the user may specify
@@ -144,6 +202,47 @@ int Help(char* toolName, std::map<std::string, Command>& commands, State& state)
         std::cout << "    specified output <directory>.  The output has the same directory structure " << std::endl;
         std::cout << "    as the package." << std::endl;
         break;
+    case UserSpecified::Pack:
+        command = commands.find("pack");
+        std::cout << "    " << toolName << " pack -d <directory> -p <package> [options] " << std::endl;
+        std::cout << std::endl;
+        std::cout << "Description:" << std::endl;
+        std::cout << "------------" << std::endl;
+        std::cout << "    Creates an app package at the output <package> name from all the files under" << std::endl;
+        std::cout << "    the input <directory>, which must contain an AppxManifest.xml.  The block map" << std::endl;
+        std::cout << "    and [Content_Types].xml are generated, and the package is not signed." << std::endl;
+        break;
+    case UserSpecified::Diff:
+        command = commands.find("diff");
+        std::cout << "    " << toolName << " diff -b <package> -p <package> [options] " << std::endl;
+        std::cout << std::endl;
+        std::cout << "Description:" << std::endl;
+        std::cout << "------------" << std::endl;
+        std::cout << "    Lists the files that were changed, added or removed from the base <package> to" << std::endl;
+        std::cout << "    the other <package>, with how many of their blocks changed and about how many" << std::endl;
+        std::cout << "    bytes those take.  Only the block maps are compared, no payload is read." << std::endl;
+        break;
+    case UserSpecified::Repack:
+        command = commands.find("repack");
+        std::cout << "    " << toolName << " repack -s <package> -p <package> [-x <file>]... [options] " << std::endl;
+        std::cout << std::endl;
+        std::cout << "Description:" << std::endl;
+        std::cout << "------------" << std::endl;
+        std::cout << "    Creates an app package at the output <package> name from the payload files of the" << std::endl;
+        std::cout << "    input <package>, less the excluded files.  The files are copied as they are stored," << std::endl;
+        std::cout << "    without being inflated and deflated again, and the package is not signed." << std::endl;
+        break;
+    case UserSpecified::Edit:
+        command = commands.find("edit");
+        std::cout << "    " << toolName << " edit -p <package> [-d <directory>] [-r <file>]... [options] " << std::endl;
+        std::cout << std::endl;
+        std::cout << "Description:" << std::endl;
+        std::cout << "------------" << std::endl;
+        std::cout << "    Changes the <package> in place: removes the files given, then adds the files under" << std::endl;
+        std::cout << "    the <directory>, in place of any files of the same name.  Only the files that are" << std::endl;
+        std::cout << "    added, the block map and the central directory are written, unless the package" << std::endl;
+        std::cout << "    is compacted, and the package is no longer signed." << std::endl;
+        break;
     }
     std::cout << std::endl;
     std::cout << "Options:" << std::endl;
@@ -157,6 +256,125 @@ int Help(char* toolName, std::map<std::string, Command>& commands, State& state)
     return 0;
 }
 
+LPVOID STDMETHODCALLTYPE MyAllocate(SIZE_T cb)  { return std::malloc(cb); }
+void STDMETHODCALLTYPE MyFree(LPVOID pv)        { std::free(pv); }
+
+class Text
+{
+public:
+    char** operator&() { return &content; }
+    ~Text() { Cleanup(); }
+
+    char* content = nullptr;
+    protected:    
+    void Cleanup() { if (content) { std::free(content); content = nullptr; } }
+};
+
+// Displays the performance counters collected during the last operation.
+void PrintStatistics()
+{
+    UINT32 count = 0;
+    if (0 != GetPerformanceCounters(&count, nullptr)) { return; }
+    std::vector<MSIX_PERFORMANCE_COUNTER> counters(count);
+    if (0 != GetPerformanceCounters(&count, counters.data())) { return; }
+
+    std::cout << std::endl;
+    std::cout << "Statistics:" << std::endl;
+    std::cout << "-----------" << std::endl;
+    std::cout << "    " << std::left << std::setw(24) << "counter" << std::right << std::setw(12) << "count"
+              << std::setw(16) << "bytes" << std::setw(12) << "ms" << std::endl;
+    for (const auto& counter : counters)
+    {
+        std::cout << "    " << std::left << std::setw(24) << counter.name << std::right << std::setw(12) << counter.count
+                  << std::setw(16) << counter.bytes << std::setw(12) << std::fixed << std::setprecision(3)
+                  << (counter.nanoseconds / 1000000.0) << std::endl;
+    }
+    std::cout << "    Note: package.seek includes the seeks to the end of the package that finding its central directory takes." << std::endl;
+}
+
+// Writes the events recorded during the last operation to a file that chrome://tracing can load.
+bool WriteTrace(const std::string& fileName)
+{
+    Text text;
+    if (0 != GetPerformanceTraceUTF8(MyAllocate, &text)) { return false; }
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    file << text.content;
+    return static_cast<bool>(file);
+}
+
+// Tells the user about each content group as soon as it is unpacked.
+void STDMETHODCALLTYPE ContentGroupUnpacked(const char* utf8GroupName, BOOL isRequired, void* context)
+{
+    std::cout << "Content group " << utf8GroupName << (isRequired ? " (required)" : "") << " unpacked" << std::endl;
+}
+
+// Releases the interface it holds.
+template<typename T>
+class Ptr
+{
+public:
+    T** operator&() { return &content; }
+    T* operator->() { return content; }
+    ~Ptr() { if (content) { content->Release(); } }
+
+    T* content = nullptr;
+};
+
+HRESULT OpenPackage(IAppxFactory* factory, const std::string& name, IAppxPackageReader** reader)
+{
+    Ptr<IStream> stream;
+    auto result = CreateStreamOnFile(const_cast<char*>(name.c_str()), true, &stream);
+    if (result != 0) { return result; }
+    return factory->CreatePackageReader(stream.content, reader);
+}
+
+// Displays the files that differ between the two packages.
+HRESULT Diff(State& state)
+{
+    Ptr<IAppxFactory> factory;
+    Ptr<IAppxPackageReader> oldPackage;
+    Ptr<IAppxPackageReader> newPackage;
+    Ptr<IMSIXPackageDiff> diff;
+    auto result = CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, state.validationOptions, &factory);
+    if (result == 0) { result = OpenPackage(factory.content, state.baseName, &oldPackage); }
+    if (result == 0) { result = OpenPackage(factory.content, state.packageName, &newPackage); }
+    if (result == 0) { result = DiffPackages(oldPackage.content, newPackage.content, &diff); }
+    UINT32 count = 0;
+    if (result == 0) { result = diff->GetCount(&count); }
+    if (result != 0) { return result; }
+
+    const char* kinds[] = { "Changed", "Added", "Removed" };
+    UINT32 changed[3] = {};
+    UINT64 changedBytes = 0;
+    std::cout << std::endl;
+    for (UINT32 i = 0; i < count; i++)
+    {
+        MSIX_FILE_DIFF file;
+        result = diff->GetFile(i, &file);
+        if (result != 0) { return result; }
+        changed[file.kind]++;
+        changedBytes += file.changedBytes;
+        std::cout << "    " << std::left << std::setw(9) << kinds[file.kind] << file.utf8FileName << "  ";
+        switch (file.kind)
+        {
+        case MSIX_FILE_DIFF_KIND_CHANGED:
+            std::cout << file.oldSize << " -> " << file.newSize << " bytes, " << file.changedBlocks << " of "
+                      << file.blocks << " blocks changed, " << file.changedBytes << " bytes" << std::endl;
+            break;
+        case MSIX_FILE_DIFF_KIND_ADDED:
+            std::cout << file.newSize << " bytes, " << file.blocks << " blocks, " << file.changedBytes << " bytes" << std::endl;
+            break;
+        case MSIX_FILE_DIFF_KIND_REMOVED:
+            std::cout << file.oldSize << " bytes" << std::endl;
+            break;
+        }
+    }
+    std::cout << std::endl;
+    std::cout << changed[MSIX_FILE_DIFF_KIND_CHANGED] << " changed, " << changed[MSIX_FILE_DIFF_KIND_ADDED] << " added, "
+              << changed[MSIX_FILE_DIFF_KIND_REMOVED] << " removed, about " << changedBytes << " bytes to download" << std::endl;
+    return 0;
+}
+
 // error text if the user provided underspecified input
 void Error(char* toolName)
 {
@@ -203,33 +421,93 @@ int ParseAndRun(std::map<std::string, Command>& commands, State& state, int argc
     case UserSpecified::Nothing:
         return Help(argv[0], commands, state);
 
+    case UserSpecified::Diff:
+        if (state.packageName.empty() || state.baseName.empty())
+        {
+            Error(argv[0]);
+            return -1;
+        }
+        return Diff(state);
+
+    case UserSpecified::Repack:
+    {
+        if (state.packageName.empty() || state.baseName.empty())
+        {
+            Error(argv[0]);
+            return -1;
+        }
+        if (state.performanceOptions != MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_NONE)
+        {   SetPerformanceOptions(state.performanceOptions);
+        }
+        std::vector<char*> excludedFiles;
+        for (auto& name : state.excludedFiles) { excludedFiles.push_back(const_cast<char*>(name.c_str())); }
+        auto result = RepackPackage(state.validationOptions,
+            const_cast<char*>(state.baseName.c_str()),
+            const_cast<char*>(state.packageName.c_str()),
+            static_cast<UINT32>(excludedFiles.size()), excludedFiles.data(),
+            state.verify ? TRUE : FALSE);
+        if (state.performanceOptions & MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_COUNTERS)
+        {   PrintStatistics();
+        }
+        return result;
+    }
+
+    case UserSpecified::Edit:
+    {
+        if (state.packageName.empty() || (state.directoryName.empty() && state.excludedFiles.empty() && !state.compact))
+        {
+            Error(argv[0]);
+            return -1;
+        }
+        if (state.performanceOptions != MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_NONE)
+        {   SetPerformanceOptions(state.performanceOptions);
+        }
+        std::vector<char*> removedFiles;
+        for (auto& name : state.excludedFiles) { removedFiles.push_back(const_cast<char*>(name.c_str())); }
+        auto result = EditPackage(state.validationOptions,
+            const_cast<char*>(state.packageName.c_str()),
+            state.directoryName.empty() ? nullptr : const_cast<char*>(state.directoryName.c_str()),
+            static_cast<UINT32>(removedFiles.size()), removedFiles.data(),
+            state.compact ? TRUE : FALSE);
+        if (state.performanceOptions & MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_COUNTERS)
+        {   PrintStatistics();
+        }
+        return result;
+    }
+
     case UserSpecified::Unpack:
+    case UserSpecified::Pack:
         if (state.packageName.empty() || state.directoryName.empty())
         {
             Error(argv[0]);
             return -1;
         }
-        return UnpackPackage(state.unpackOptions, state.validationOptions,
-            const_cast<char*>(state.packageName.c_str()),
-            const_cast<char*>(state.directoryName.c_str())
-        );
+        if (state.performanceOptions != MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_NONE)
+        {   SetPerformanceOptions(state.performanceOptions);
+        }
+        auto result = (state.specified == UserSpecified::Unpack) ?
+            (state.byContentGroup ?
+                UnpackPackageByContentGroup(state.unpackOptions, state.validationOptions,
+                    const_cast<char*>(state.packageName.c_str()),
+                    const_cast<char*>(state.directoryName.c_str()),
+                    ContentGroupUnpacked, nullptr) :
+                UnpackPackage(state.unpackOptions, state.validationOptions,
+                    const_cast<char*>(state.packageName.c_str()),
+                    const_cast<char*>(state.directoryName.c_str()))) :
+            PackPackage(state.unpackOptions, state.validationOptions,
+                const_cast<char*>(state.directoryName.c_str()),
+                const_cast<char*>(state.packageName.c_str()));
+        if (state.performanceOptions & MSIX_PERFORMANCE_OPTION::MSIX_PERFORMANCE_OPTION_COUNTERS)
+        {   PrintStatistics();
+        }
+        if (!state.traceFileName.empty() && !WriteTrace(state.traceFileName))
+        {   std::cout << argv[0] << ": error : Unable to write " << state.traceFileName << std::endl;
+        }
+        return result;
     }
     return -1; // should never end up here.
 }
 
-LPVOID STDMETHODCALLTYPE MyAllocate(SIZE_T cb)  { return std::malloc(cb); }
-
-class Text
-{
-public:
-    char** operator&() { return &content; }
-    ~Text() { Cleanup(); }
-
-    char* content = nullptr;
-    protected:    
-    void Cleanup() { if (content) { std::free(content); content = nullptr; } }
-};
-
 // Defines the grammar of commands and each command's associated options,
 int main(int argc, char* argv[])
 {
@@ -238,9 +516,28 @@ int main(int argc, char* argv[])
 
     State state;
     std::map<std::string, Command> commands = {
-        { "unpack", Command("Create a new package from files on disk", [&]() { return state.Specify(UserSpecified::Unpack); },
+        { "pack", Command("Create a new package from files on disk", [&]() { return state.Specify(UserSpecified::Pack); },
             {
-                { "-p", Option(true, "REQUIRED, specify input package name.",
+                { "-d", Option(true, "REQUIRED, specify input directory name.",
+                    [&](const std::string& name) { return state.SetDirectoryName(name); })
+                },
+                { "-p", Option(true, "REQUIRED, specify output package name.",
+                    [&](const std::string& name) { return state.SetPackageName(name); })
+                },
+                { "-stats", Option(false, "Displays time, bytes and event counts for each phase of the operation.",
+                    [&](const std::string&) { return state.EnableStatistics(); })
+                },
+                { "-trace", Option(true, "Writes a Chrome trace event file (chrome://tracing) of the operation.",
+                    [&](const std::string& name) { return state.SetTraceFileName(name); })
+                },
+                { "-?", Option(false, "Displays this help text.",
+                    [&](const std::string&) { return false; })
+                }
+            })
+        },
+        { "unpack", Command("Extract all files from a package to disk", [&]() { return state.Specify(UserSpecified::Unpack); },
+            {
+                { "-p", Option(true, "REQUIRED, specify input package name, or - to read the package from standard input.",
                 [&](const std::string& name) { return state.SetPackageName(name); })
                 },
                 { "-d", Option(true, "REQUIRED, specify output directory name.",
@@ -258,6 +555,99 @@ int main(int argc, char* argv[])
                 { "-ss", Option(false, "Skips enforcement of signed packages.  By default packages must be signed.",
                     [&](const std::string&) { return state.SkipSignature(); })
                 },
+                { "-cg", Option(false, "Unpacks the required content group first and displays each content group as it is unpacked.",
+                    [&](const std::string&) { return state.UnpackByContentGroup(); })
+                },
+                { "-stats", Option(false, "Displays time, bytes and event counts for each phase of the operation.",
+                    [&](const std::string&) { return state.EnableStatistics(); })
+                },
+                { "-trace", Option(true, "Writes a Chrome trace event file (chrome://tracing) of the operation.",
+                    [&](const std::string& name) { return state.SetTraceFileName(name); })
+                },
+                { "-?", Option(false, "Displays this help text.",
+                    [&](const std::string&) { return false; })
+                }
+            })
+        },
+        { "diff", Command("Compare the block maps of two packages", [&]() { return state.Specify(UserSpecified::Diff); },
+            {
+                { "-b", Option(true, "REQUIRED, specify the base package name.",
+                    [&](const std::string& name) { return state.SetBaseName(name); })
+                },
+                { "-p", Option(true, "REQUIRED, specify the package name to compare with the base package.",
+                    [&](const std::string& name) { return state.SetPackageName(name); })
+                },
+                { "-mv", Option(false, "Skips manifest validation.  By default manifest validation is enabled.",
+                    [&](const std::string&) { return state.SkipManifestValidation(); })
+                },
+                { "-sv", Option(false, "Skips signature validation.  By default signature validation is enabled.",
+                    [&](const std::string&) { return state.AllowSignatureOriginUnknown(); })
+                },
+                { "-ss", Option(false, "Skips enforcement of signed packages.  By default packages must be signed.",
+                    [&](const std::string&) { return state.SkipSignature(); })
+                },
+                { "-?", Option(false, "Displays this help text.",
+                    [&](const std::string&) { return false; })
+                }
+            })
+        },
+        { "repack", Command("Create a new package from the files of another package", [&]() { return state.Specify(UserSpecified::Repack); },
+            {
+                { "-s", Option(true, "REQUIRED, specify input package name.",
+                    [&](const std::string& name) { return state.SetBaseName(name); })
+                },
+                { "-p", Option(true, "REQUIRED, specify output package name.",
+                    [&](const std::string& name) { return state.SetPackageName(name); })
+                },
+                { "-x", Option(true, "Leaves a file out, named as in the block map.  May be given more than once.",
+                    [&](const std::string& name) { return state.AddExcludedFile(name); })
+                },
+                { "-v", Option(false, "Checks each file against the block map of the input package as it is copied.",
+                    [&](const std::string&) { return state.VerifyBlocks(); })
+                },
+                { "-mv", Option(false, "Skips manifest validation.  By default manifest validation is enabled.",
+                    [&](const std::string&) { return state.SkipManifestValidation(); })
+                },
+                { "-sv", Option(false, "Skips signature validation.  By default signature validation is enabled.",
+                    [&](const std::string&) { return state.AllowSignatureOriginUnknown(); })
+                },
+                { "-ss", Option(false, "Skips enforcement of signed packages.  By default packages must be signed.",
+                    [&](const std::string&) { return state.SkipSignature(); })
+                },
+                { "-stats", Option(false, "Displays time, bytes and event counts for each phase of the operation.",
+                    [&](const std::string&) { return state.EnableStatistics(); })
+                },
+                { "-?", Option(false, "Displays this help text.",
+                    [&](const std::string&) { return false; })
+                }
+            })
+        },
+        { "edit", Command("Change a package in place", [&]() { return state.Specify(UserSpecified::Edit); },
+            {
+                { "-p", Option(true, "REQUIRED, specify package name.",
+                    [&](const std::string& name) { return state.SetPackageName(name); })
+                },
+                { "-d", Option(true, "Specify a directory of files to add, or to replace files of the same name with.",
+                    [&](const std::string& name) { return state.SetDirectoryName(name); })
+                },
+                { "-r", Option(true, "Removes a file, named as in the block map.  May be given more than once.",
+                    [&](const std::string& name) { return state.AddExcludedFile(name); })
+                },
+                { "-compact", Option(false, "Moves the files down over the space of removed and replaced files.",
+                    [&](const std::string&) { return state.CompactPackage(); })
+                },
+                { "-mv", Option(false, "Skips manifest validation.  By default manifest validation is enabled.",
+                    [&](const std::string&) { return state.SkipManifestValidation(); })
+                },
+                { "-sv", Option(false, "Skips signature validation.  By default signature validation is enabled.",
+                    [&](const std::string&) { return state.AllowSignatureOriginUnknown(); })
+                },
+                { "-ss", Option(false, "Skips enforcement of signed packages.  By default packages must be signed.",
+                    [&](const std::string&) { return state.SkipSignature(); })
+                },
+                { "-stats", Option(false, "Displays time, bytes and event counts for each phase of the operation.",
+                    [&](const std::string&) { return state.EnableStatistics(); })
+                },
                 { "-?", Option(false, "Displays this help text.",
                     [&](const std::string&) { return false; })
                 }
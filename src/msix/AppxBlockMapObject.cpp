@@ -10,6 +10,9 @@
 #include <algorithm>
 #include <iterator>
 #include "BlockMapStream.hpp"
+#include "PackageIndex.hpp"
+#include "Perf.hpp"
+#include "SHA256.hpp"
 
 /* Example XML:
 <?xml version="1.0" encoding="UTF-8"?>
@@ -88,7 +91,9 @@ namespace MSIX {
 
     AppxBlockMapObject::AppxBlockMapObject(IMSIXFactory* factory, ComPtr<IStream>& stream) : m_factory(factory), m_stream(stream)
     {
+        Global::Perf::Scope scope(Global::Perf::Counter::BlockMapParse);
         auto dom = ComPtr<IXmlObject>::Make<XmlObject>(stream, &blockMapSchema);
+        scope.AddBytes(dom->Size());
         // Create xPath query over blockmap file.
         XercesXMLChPtr fileXPath(XMLString::transcode("/BlockMap/File"));
         XercesPtr<DOMXPathNSResolver> resolver(dom->Document()->createNSResolver(dom->Document()->getDocumentElement()));
@@ -128,17 +133,40 @@ namespace MSIX {
                 blocks[j] = GetBlock(blockNode);
             }
 
-            m_blockMap.insert(std::make_pair(name, std::move(blocks)));
-            m_blockMapfiles.insert(std::make_pair(name,
-                ComPtr<IAppxBlockMapFile>::Make<AppxBlockMapFile>(
-                    factory,
-                    &(m_blockMap[name]),
-                    GetLocalFileHeaderSize(fileNode),
-                    name,
-                    GetSize(fileNode))));
+            AddFile(name, std::move(blocks), GetLocalFileHeaderSize(fileNode), GetSize(fileNode));
         }
     }
 
+    AppxBlockMapObject::AppxBlockMapObject(IMSIXFactory* factory, ComPtr<IStream>& stream, PackageIndex& index) :
+        m_factory(factory), m_stream(stream)
+    {
+        const auto& header = index.GetHeader();
+        const auto indexBlocks = index.GetBlocks();
+        for (std::uint64_t i = 0; i < header.blockMapFileCount; i++)
+        {
+            const auto& file = index.GetBlockMapFiles()[i];
+            std::vector<Block> blocks(static_cast<std::size_t>(file.blockCount));
+            for (std::size_t j = 0; j < blocks.size(); j++)
+            {   const auto& block = indexBlocks[file.firstBlock + j];
+                blocks[j].compressedSize = block.compressedSize;
+                blocks[j].hash.assign(block.hash, block.hash + HASH_BYTES);
+            }
+            AddFile(index.GetName(file.nameOffset, file.nameSize), std::move(blocks), file.localFileHeaderSize, file.uncompressedSize);
+        }
+    }
+
+    void AppxBlockMapObject::AddFile(const std::string& name, std::vector<Block>&& blocks, std::uint32_t localFileHeaderSize, std::uint64_t size)
+    {
+        m_blockMap.insert(std::make_pair(name, std::move(blocks)));
+        m_blockMapfiles.insert(std::make_pair(name,
+            ComPtr<IAppxBlockMapFile>::Make<AppxBlockMapFile>(
+                m_factory,
+                &(m_blockMap[name]),
+                localFileHeaderSize,
+                name,
+                size)));
+    }
+
     MSIX::ComPtr<IStream> AppxBlockMapObject::GetValidationStream(const std::string& part, IStream* stream)
     {
         ThrowErrorIf(Error::InvalidParameter, (part.empty() || stream == nullptr), "bad input");
@@ -147,6 +175,36 @@ namespace MSIX {
         return ComPtr<IStream>::Make<BlockMapStream>(m_factory, part, stream, item->second);
     }
 
+    const std::vector<Block>& AppxBlockMapObject::GetBlocks(const std::string& fileName)
+    {
+        auto item = m_blockMap.find(fileName);
+        ThrowErrorIf(Error::BlockMapSemanticError, item == m_blockMap.end(), "file not tracked by blockmap");
+        return item->second;
+    }
+
+    ComPtr<IAppxBlockMapFile> AppxBlockMapObject::GetBlockMapFile(const std::string& fileName)
+    {
+        auto item = m_blockMapfiles.find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (item == m_blockMapfiles.end()), "named file not in blockmap");
+        return item->second;
+    }
+
+    const std::vector<std::uint8_t>& AppxBlockMapObject::GetFileDigest(const std::string& fileName)
+    {
+        const auto& blocks = GetBlocks(fileName);
+        std::lock_guard<std::mutex> lock(m_digestsLock);
+        auto digest = m_digests.find(fileName);
+        if (digest == m_digests.end())
+        {   SHA256 hasher;
+            for (const auto& block : blocks)
+            {   hasher.HashData(block.hash.data(), block.hash.size());
+            }
+            digest = m_digests.insert(std::make_pair(fileName, std::vector<std::uint8_t>())).first;
+            hasher.FinalizeAndGetHashValue(digest->second);
+        }
+        return digest->second;
+    }
+
     HRESULT STDMETHODCALLTYPE AppxBlockMapObject::GetFile(LPCWSTR filename, IAppxBlockMapFile **file)
     {
         return ResultOf([&]{
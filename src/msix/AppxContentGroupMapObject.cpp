@@ -0,0 +1,103 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "AppxContentGroupMapObject.hpp"
+#include "XmlObject.hpp"
+
+#include <algorithm>
+#include <set>
+
+XERCES_CPP_NAMESPACE_USE
+
+namespace MSIX {
+
+    // The document is parsed without a schema, so without namespaces, and an element's name may come with a prefix.
+    static bool IsElement(DOMElement* element, const char* name)
+    {
+        XercesCharPtr nodeName(XMLString::transcode(element->getNodeName()));
+        std::string value(nodeName.Get());
+        auto separator = value.find(':');
+        return value.compare((separator == std::string::npos) ? 0 : separator + 1, std::string::npos, name) == 0;
+    }
+
+    static std::string GetAttribute(DOMElement* element, const char* name)
+    {
+        XercesXMLChPtr nameAttr(XMLString::transcode(name));
+        XercesCharPtr value(XMLString::transcode(element->getAttribute(nameAttr.Get())));
+        return std::string(value.Get());
+    }
+
+    // The ContentGroup elements under element, e.g. <Required> or <Automatic>.
+    static std::vector<std::shared_ptr<const ContentGroup>> GetContentGroups(DOMElement* element, std::set<std::string>& names)
+    {
+        std::vector<std::shared_ptr<const ContentGroup>> result;
+        for (auto child = element->getFirstElementChild(); child != nullptr; child = child->getNextElementSibling())
+        {
+            ThrowErrorIfNot(Error::ContentGroupMapSemanticError, (IsElement(child, "ContentGroup")), "unexpected element in content group map");
+            auto group = std::make_shared<ContentGroup>();
+            group->name = GetAttribute(child, "Name");
+            ThrowErrorIf(Error::ContentGroupMapSemanticError, (group->name.empty()), "content group without a name");
+            ThrowErrorIfNot(Error::ContentGroupMapSemanticError, (names.insert(group->name).second), "content group name is not unique");
+            for (auto file = child->getFirstElementChild(); file != nullptr; file = file->getNextElementSibling())
+            {
+                ThrowErrorIfNot(Error::ContentGroupMapSemanticError, (IsElement(file, "File")), "unexpected element in content group");
+                auto name = GetAttribute(file, "Name");
+                ThrowErrorIf(Error::ContentGroupMapSemanticError, (name.empty()), "content group file without a name");
+                // Same separator as the block map.
+                std::replace(name.begin(), name.end(), '/', '\\');
+                group->files.push_back(std::move(name));
+            }
+            result.push_back(std::move(group));
+        }
+        return result;
+    }
+
+    AppxContentGroupMapObject::AppxContentGroupMapObject(IMSIXFactory* factory, IStream* stream) : m_factory(factory)
+    {
+        ComPtr<IStream> input(stream);
+        auto dom = ComPtr<IXmlObject>::Make<XmlObject>(input);
+        auto root = dom->Document()->getDocumentElement();
+        ThrowErrorIf(Error::ContentGroupMapSemanticError, (root == nullptr || !IsElement(root, "ContentGroupMap")), "not a content group map");
+
+        std::set<std::string> names;
+        std::vector<std::shared_ptr<const ContentGroup>> required;
+        std::vector<std::shared_ptr<const ContentGroup>> automatic;
+        bool hasAutomatic = false;
+        for (auto element = root->getFirstElementChild(); element != nullptr; element = element->getNextElementSibling())
+        {   if (IsElement(element, "Required"))
+            {   ThrowErrorIfNot(Error::ContentGroupMapSemanticError, (required.empty()), "more than one Required element in content group map");
+                required = GetContentGroups(element, names);
+                ThrowErrorIfNot(Error::ContentGroupMapSemanticError, (required.size() == 1), "there must be exactly one required content group");
+            }
+            else if (IsElement(element, "Automatic"))
+            {   ThrowErrorIf(Error::ContentGroupMapSemanticError, (hasAutomatic), "more than one Automatic element in content group map");
+                hasAutomatic = true;
+                automatic = GetContentGroups(element, names);
+            }
+            else
+            {   throw Exception(Error::ContentGroupMapSemanticError, "unexpected element in content group map");
+            }
+        }
+        ThrowErrorIf(Error::ContentGroupMapSemanticError, (required.empty()), "no required content group in content group map");
+        m_groups = std::move(required);
+        m_groups.insert(m_groups.end(), automatic.begin(), automatic.end());
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxContentGroupMapObject::GetRequiredGroup(IAppxContentGroup** requiredGroup)
+    {
+        return ResultOf([&]{
+            ThrowErrorIf(Error::InvalidParameter, (requiredGroup == nullptr || *requiredGroup != nullptr), "bad pointer");
+            *requiredGroup = ComPtr<IAppxContentGroup>::Make<AppxContentGroup>(m_factory.Get(), m_groups.front()).Detach();
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxContentGroupMapObject::GetAutomaticGroups(IAppxContentGroupsEnumerator** automaticGroupsEnumerator)
+    {
+        return ResultOf([&]{
+            ThrowErrorIf(Error::InvalidParameter, (automaticGroupsEnumerator == nullptr || *automaticGroupsEnumerator != nullptr), "bad pointer");
+            std::vector<std::shared_ptr<const ContentGroup>> automatic(m_groups.begin() + 1, m_groups.end());
+            *automaticGroupsEnumerator = ComPtr<IAppxContentGroupsEnumerator>::Make<AppxContentGroupsEnumerator>(m_factory.Get(), std::move(automatic)).Detach();
+        });
+    }
+}
@@ -7,15 +7,46 @@
 #include "Exceptions.hpp"
 #include "ZipObject.hpp"
 #include "AppxPackageObject.hpp"
+#include "AppxPackageWriter.hpp"
+#include "AppxContentGroupMapObject.hpp"
+#include "PackageIndex.hpp"
+#include "ReaderCache.hpp"
+#include "ValidatedStore.hpp"
+#include "FileCopy.hpp"
 
 namespace MSIX {
+    AppxFactory::AppxFactory(MSIX_VALIDATION_OPTION validationOptions, COTASKMEMALLOC* memalloc, COTASKMEMFREE* memfree ) : 
+        m_validationOptions(validationOptions), m_memalloc(memalloc), m_memfree(memfree)
+    {
+        ThrowErrorIf(Error::InvalidParameter, (m_memalloc == nullptr || m_memfree == nullptr), "allocator/deallocator pair not specified.")
+        XERCES_CPP_NAMESPACE::XMLPlatformUtils::Initialize();
+    }
+
+    AppxFactory::~AppxFactory()
+    {
+        m_readerCache.reset();
+        m_validatedStore.reset();
+        XERCES_CPP_NAMESPACE::XMLPlatformUtils::Terminate();
+    }
+
     // IAppxFactory
     HRESULT STDMETHODCALLTYPE AppxFactory::CreatePackageWriter (
         IStream* outputStream,
-        APPX_PACKAGE_SETTINGS* ,//settings, TODO: plumb this through
+        APPX_PACKAGE_SETTINGS* settings,
         IAppxPackageWriter** packageWriter)
     {
-        return static_cast<HRESULT>(Error::NotImplemented);
+        return ResultOf([&]() {
+            ThrowErrorIf(Error::InvalidParameter, (
+                outputStream == nullptr ||
+                packageWriter == nullptr ||
+                *packageWriter != nullptr
+            ), "bad pointer.");
+            // Packages are always written as zip64 and hashed with SHA256.
+            ThrowErrorIf(Error::NotImplemented, (settings != nullptr && settings->forceZip32), "zip32 packages are not supported");
+            ComPtr<IMSIXFactory> self;
+            ThrowHrIfFailed(QueryInterface(UuidOfImpl<IMSIXFactory>::iid, reinterpret_cast<void**>(&self)));
+            *packageWriter = ComPtr<IAppxPackageWriter>::Make<AppxPackageWriter>(self.Get(), outputStream).Detach();
+        });
     }
 
     HRESULT STDMETHODCALLTYPE AppxFactory::CreatePackageReader (
@@ -26,8 +57,59 @@ namespace MSIX {
             ThrowErrorIf(Error::InvalidParameter, (packageReader == nullptr || *packageReader != nullptr), "Invalid parameter");
             ComPtr<IMSIXFactory> self;
             ThrowHrIfFailed(QueryInterface(UuidOfImpl<IMSIXFactory>::iid, reinterpret_cast<void**>(&self)));
-            auto zip = ComPtr<IStorageObject>::Make<ZipObject>(self.Get(), inputStream);
-            auto result = ComPtr<IAppxPackageReader>::Make<AppxPackageObject>(self.Get(), m_validationOptions, zip.Get());
+
+            // Only a package that is a file has an identity to keep an index, a reader or a record under.
+            bool isCached = m_readerCache && m_readerCache->IsEnabled();
+            FileIdentity identity = {0};
+            ComPtr<IFileBackedStream> file;
+            bool hasIdentity = (!m_indexDirectory.empty() || isCached || m_validatedStore) && inputStream != nullptr &&
+                SUCCEEDED(inputStream->QueryInterface(UuidOfImpl<IFileBackedStream>::iid, reinterpret_cast<void**>(&file))) &&
+                file->GetFileHandle() != nullptr && GetFileIdentity(file->GetFileHandle(), identity);
+            std::string indexPath = (hasIdentity && !m_indexDirectory.empty()) ? PackageIndex::GetPath(m_indexDirectory, identity) : "";
+
+            ComPtr<AppxPackageObject> result;
+            auto cached = (hasIdentity && isCached) ? m_readerCache->Find(identity) : nullptr;
+            if (cached)
+            {   auto zip = ComPtr<IStorageObject>::Make<ZipObject>(self.Get(), inputStream, *cached->index);
+                result = ComPtr<AppxPackageObject>::Make<AppxPackageObject>(self.Get(), m_validationOptions, zip.Get(), *cached->index, cached->parts);
+                Global::Log::Verbose("package reader: reused from the reader cache");
+            }
+
+            if (!result.Get() && !indexPath.empty())
+            {   auto index = PackageIndex::Load(indexPath, identity, *m_indexKey);
+                if (index)
+                {   try
+                    {   auto zip = ComPtr<IStorageObject>::Make<ZipObject>(self.Get(), inputStream, *index);
+                        result = ComPtr<AppxPackageObject>::Make<AppxPackageObject>(self.Get(), m_validationOptions, zip.Get(), index.get());
+                        if (isCached) { m_readerCache->Add(identity, std::move(index), result->GetParts()); }
+                        Global::Log::Verbose("package reader: opened from its index");
+                    }
+                    catch (Exception&)
+                    {   // The package or the index is not what it was, open it the long way, which also says which.
+                        Global::Log::Verbose("package reader: index doesn't match the package");
+                    }
+                }
+            }
+
+            if (!result.Get())
+            {   auto zip = ComPtr<IStorageObject>::Make<ZipObject>(self.Get(), inputStream);
+                result = ComPtr<AppxPackageObject>::Make<AppxPackageObject>(self.Get(), m_validationOptions, zip.Get());
+                Global::Log::Verbose("package reader: opened in full");
+                if (hasIdentity && (!indexPath.empty() || isCached))
+                {   try
+                    {   auto index = PackageIndex::Create(identity, zip.Get(), result.Get());
+                        if (!indexPath.empty()) { index->Save(indexPath, *m_indexKey); }
+                        if (isCached) { m_readerCache->Add(identity, std::move(index), result->GetParts()); }
+                    }
+                    catch (Exception&)
+                    {   // Not having an index only costs the next open its time.
+                    }
+                }
+            }
+
+            if (hasIdentity && m_validatedStore)
+            {   result->SetValidatedStore(m_validatedStore.get(), identity);
+            }
             *packageReader = result.Detach();
         });
     }
@@ -83,18 +165,89 @@ namespace MSIX {
         });
     }
 
-    HRESULT AppxFactory::MarshalOutString(std::string& internal, LPWSTR *result)
+    // IAppxFactory2
+    HRESULT STDMETHODCALLTYPE AppxFactory::CreateContentGroupMapReader(
+        IStream* inputStream,
+        IAppxContentGroupMapReader** contentGroupMapReader)
+    {
+        return ResultOf([&]() {
+            ThrowErrorIf(Error::InvalidParameter, (
+                inputStream == nullptr ||
+                contentGroupMapReader == nullptr ||
+                *contentGroupMapReader != nullptr
+            ),"bad pointer.");
+
+            ComPtr<IMSIXFactory> self;
+            ThrowHrIfFailed(QueryInterface(UuidOfImpl<IMSIXFactory>::iid, reinterpret_cast<void**>(&self)));
+            *contentGroupMapReader = ComPtr<IAppxContentGroupMapReader>::Make<AppxContentGroupMapObject>(self.Get(), inputStream).Detach();
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxFactory::CreateSourceContentGroupMapReader(
+        IStream* inputStream,
+        IAppxSourceContentGroupMapReader** reader)
+    {
+        return ResultOf([&]() {
+            // TODO: Implement
+            throw Exception(Error::NotImplemented);
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxFactory::CreateContentGroupMapWriter(
+        IStream* stream,
+        IAppxContentGroupMapWriter** contentGroupMapWriter)
+    {
+        return ResultOf([&]() {
+            // TODO: Implement
+            throw Exception(Error::NotImplemented);
+        });
+    }
+
+    // IMSIXFactoryOptions
+    HRESULT STDMETHODCALLTYPE AppxFactory::SetIndexDirectory(const char* utf8Directory)
+    {
+        return ResultOf([&]() {
+            m_indexKey.reset();
+            m_indexDirectory.clear();
+            if (utf8Directory != nullptr && *utf8Directory != '\0')
+            {   m_indexKey = std::make_unique<HmacKey>(PackageIndex::GetKeyPath(utf8Directory));
+                m_indexDirectory = utf8Directory;
+            }
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxFactory::SetValidatedStateDirectory(const char* utf8Directory)
+    {
+        return ResultOf([&]() {
+            m_validatedStore.reset();
+            if (utf8Directory != nullptr) { m_validatedStore = std::make_unique<ValidatedStore>(utf8Directory); }
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxFactory::SetReaderCacheBudget(UINT64 budgetBytes)
+    {
+        return ResultOf([&]() {
+            if (!m_readerCache) { m_readerCache = std::make_unique<ReaderCache>(); }
+            m_readerCache->SetBudget(budgetBytes);
+        });
+    }
+
+    HRESULT AppxFactory::MarshalOutString(const std::string& internal, LPWSTR *result)
     {
         return ResultOf([&]() {
             ThrowErrorIf(Error::InvalidParameter, (result == nullptr || *result != nullptr), "bad pointer" );
-            auto intermediate = utf8_to_utf16(internal);
+            // Converts straight into the caller's buffer, which can't need more code units than there are bytes.
             std::size_t countBytes = sizeof(wchar_t)*(internal.size()+1);
             *result = reinterpret_cast<LPWSTR>(m_memalloc(countBytes));
             ThrowErrorIfNot(Error::OutOfMemory, (*result), "Allocation failed!");
-            std::memset(reinterpret_cast<void*>(*result), 0, countBytes);
-            std::memcpy(reinterpret_cast<void*>(*result),
-                        reinterpret_cast<void*>(const_cast<wchar_t*>(intermediate.c_str())),
-                        countBytes - sizeof(wchar_t));
+            try
+            {   (*result)[utf8_to_utf16(internal, *result)] = L'\0';
+            }
+            catch (...)
+            {   m_memfree(*result);
+                *result = nullptr;
+                throw;
+            }
         });
     }
 
@@ -10,6 +10,19 @@
 #include "AppxPackageObject.hpp"
 #include "UnicodeConversion.hpp"
 #include "ContentTypesSchemas.hpp"
+#include "HashStream.hpp"
+#include "BlockReader.hpp"
+#include "Pipeline.hpp"
+#include "ThreadPool.hpp"
+#include "SHA256.hpp"
+#include "FileCopy.hpp"
+#include "Perf.hpp"
+
+#ifdef WIN32
+#include "zlib.h"
+#else
+#include <zlib.h>
+#endif
 
 #include "xercesc/util/XMLString.hpp"
 #include "xercesc/parsers/XercesDOMParser.hpp"
@@ -20,24 +33,24 @@
 #include <memory>
 #include <functional>
 #include <limits>
+#include <set>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <thread>
+#include <cstring>
 
 XERCES_CPP_NAMESPACE_USE
 
 namespace MSIX {
 
-    // names of footprint files.
-    #define APPXBLOCKMAP_XML  "AppxBlockMap.xml"
-    #define APPXMANIFEST_XML  "AppxManifest.xml"
-    #define CODEINTEGRITY_CAT "AppxMetadata/CodeIntegrity.cat"
-    #define APPXSIGNATURE_P7X "AppxSignature.p7x"
-    #define CONTENT_TYPES_XML "[Content_Types].xml"
-
     static const std::map<APPX_FOOTPRINT_FILE_TYPE, std::string> footprintFiles = 
     {
         {APPX_FOOTPRINT_FILE_TYPE_MANIFEST,         APPXMANIFEST_XML},
         {APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP,         APPXBLOCKMAP_XML},
         {APPX_FOOTPRINT_FILE_TYPE_SIGNATURE,        APPXSIGNATURE_P7X},
         {APPX_FOOTPRINT_FILE_TYPE_CODEINTEGRITY,    CODEINTEGRITY_CAT},
+        {APPX_FOOTPRINT_FILE_TYPE_CONTENTGROUPMAP,  APPXCONTENTGROUPMAP_XML},
     };
 
     static const std::uint8_t PercentangeEncodingTableSize = 0x5E;
@@ -64,7 +77,7 @@ namespace MSIX {
         {"5D", ']'}
     };
 
-    static std::string EncodeFileName(std::string fileName)
+    std::string EncodeFileName(std::string fileName)
     {
         std::string result;
         for (std::uint32_t position = 0; position < fileName.length(); ++position)
@@ -128,8 +141,10 @@ namespace MSIX {
 
     AppxManifestObject::AppxManifestObject(ComPtr<IStream>& stream) : m_stream(stream)
     {
+        Global::Perf::Scope scope(Global::Perf::Counter::ManifestParse);
         // TODO: pass schemas to validate AppxManifest. This only validates that is a well-formed xml
         auto dom = ComPtr<IXmlObject>::Make<XmlObject>(stream);
+        scope.AddBytes(dom->Size());
 
         // Get Identity
         XercesXMLChPtr identityXPath(XMLString::transcode("/Package/Identity"));
@@ -154,7 +169,13 @@ namespace MSIX {
         m_packageId = std::make_unique<AppxPackageId>(name, version, resourceId, architecture, publisher);
     }
 
-    AppxPackageObject::AppxPackageObject(IMSIXFactory* factory, MSIX_VALIDATION_OPTION validation, IStorageObject* container) :
+    AppxManifestObject::AppxManifestObject(const AppxPackageId& packageId, ComPtr<IStream>& stream) :
+        m_stream(stream),
+        m_packageId(std::make_unique<AppxPackageId>(packageId))
+    {
+    }
+
+    AppxPackageObject::AppxPackageObject(IMSIXFactory* factory, MSIX_VALIDATION_OPTION validation, IStorageObject* container, PackageIndex* index) :
         m_factory(factory),
         m_validation(validation),
         m_container(container)
@@ -172,12 +193,38 @@ namespace MSIX {
         // 2. Get content type using signature object for validation
         // TODO: switch underlying type of m_contentType to something more specific.
         auto temp = m_appxSignature->GetValidationStream(CONTENT_TYPES_XML, m_container->GetFile(CONTENT_TYPES_XML));
-        m_contentType = ComPtr<IVerifierObject>::Make<XmlObject>(temp, &contentTypesSchema);
-        ThrowErrorIfNot(Error::MissingContentTypesXML, (m_contentType->HasStream()), "[Content_Types].xml not in archive!");
+        if (index)
+        {   std::vector<std::uint8_t> digest(index->GetHeader().contentTypesDigest, index->GetHeader().contentTypesDigest + HASH_BYTES);
+            auto hashStream = ComPtr<HashStream>::Make<HashStream>(temp.Get(), digest);
+            hashStream->Validate();
+            m_contentTypes = std::make_shared<ContentTypeTable>(temp.Get());
+        }
+        else
+        {   Global::Perf::Scope scope(Global::Perf::Counter::ContentTypesParse);
+            m_contentType = ComPtr<IVerifierObject>::Make<XmlObject>(temp, &contentTypesSchema);
+            scope.AddBytes(m_contentType.As<IXmlObject>()->Size());
+            ThrowErrorIfNot(Error::MissingContentTypesXML, (m_contentType->HasStream()), "[Content_Types].xml not in archive!");
+            m_contentTypes = std::make_shared<ContentTypeTable>(m_contentType.Get());
+        }
 
         // 3. Get blockmap object using signature object for validation
         temp = m_appxSignature->GetValidationStream(APPXBLOCKMAP_XML, m_container->GetFile(APPXBLOCKMAP_XML));
-        m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, temp);
+        if (index)
+        {   // Only the block map that the signature vouches for, if there is one, is as good as the one in the index.
+            auto& digest = static_cast<AppxSignatureObject*>(m_appxSignature.Get())->GetAppxBlockMapDigest();
+            ThrowErrorIf(Error::SignatureInvalid,
+                (!digest.empty() && (digest.size() != HASH_BYTES || std::memcmp(digest.data(), index->GetHeader().blockMapDigest, HASH_BYTES) != 0)),
+                "index is not for the signed block map");
+            // And the block map in the package has to be that one, which is cheap to hash next to parsing it.
+            std::vector<std::uint8_t> blockMapDigest(index->GetHeader().blockMapDigest, index->GetHeader().blockMapDigest + HASH_BYTES);
+            ComPtr<HashStream>::Make<HashStream>(temp.Get(), blockMapDigest)->Validate();
+            LARGE_INTEGER start = {0};
+            ThrowHrIfFailed(temp->Seek(start, StreamBase::Reference::START, nullptr));
+            m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, temp, *index);
+        }
+        else
+        {   m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, temp);
+        }
         ThrowErrorIfNot(Error::MissingAppxBlockMapXML, (m_appxBlockMap->HasStream()), "AppxBlockMap.xml not in archive!");
 
         // 4. Get manifest object using blockmap object for validation
@@ -191,6 +238,39 @@ namespace MSIX {
             ThrowErrorIfNot(Error::PublisherMismatch,
                 (0 == m_appxManifest->GetPublisher().compare(m_appxSignature->GetPublisher())), reason);
         }
+        OpenStreams();
+    }
+
+    AppxPackageObject::AppxPackageObject(IMSIXFactory* factory, MSIX_VALIDATION_OPTION validation, IStorageObject* container, PackageIndex& index,
+        const AppxPackageParts& parts) :
+        m_factory(factory),
+        m_validation(validation),
+        m_container(container),
+        m_contentTypes(parts.contentTypes)
+    {
+        // The same steps as above, with what they found the first time instead of checking and parsing it again.
+        m_appxSignature = ComPtr<IVerifierObject>::Make<AppxSignatureObject>(*parts.signature.Get(),
+            ((validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) == 0) ? m_container->GetFile(APPXSIGNATURE_P7X) : nullptr);
+        auto temp = m_appxSignature->GetValidationStream(APPXBLOCKMAP_XML, m_container->GetFile(APPXBLOCKMAP_XML));
+        m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, temp, index);
+        temp = m_appxBlockMap->GetValidationStream(APPXMANIFEST_XML, m_container->GetFile(APPXMANIFEST_XML));
+        m_appxManifest = ComPtr<IVerifierObject>::Make<AppxManifestObject>(*parts.packageId, temp);
+        OpenStreams();
+    }
+
+    AppxPackageParts AppxPackageObject::GetParts()
+    {
+        auto signature = ComPtr<AppxSignatureObject>::Make<AppxSignatureObject>(*static_cast<AppxSignatureObject*>(m_appxSignature.Get()), nullptr);
+        auto packageId = std::make_shared<AppxPackageId>(*static_cast<AppxManifestObject*>(m_appxManifest.Get())->GetPackageId());
+        return AppxPackageParts { signature, packageId, m_contentTypes };
+    }
+
+    void AppxPackageObject::OpenStreams()
+    {
+        ComPtr<IZipReader> zip;
+        if (SUCCEEDED(m_container->QueryInterface(UuidOfImpl<IZipReader>::iid, reinterpret_cast<void**>(&zip))))
+        {   zip->SetContentTypes(m_contentTypes);
+        }
 
         struct Config
         {
@@ -222,10 +302,19 @@ namespace MSIX {
         auto blockMapStorage = m_appxBlockMap.As<IStorageObject>();
         for (const auto& fileName : blockMapStorage->GetFileNames(FileNameOptions::PayloadOnly))
         {   auto footPrintFile = footPrintFileNames.find(fileName);
-            if (footPrintFile == footPrintFileNames.end())
+            if (fileName == APPXCONTENTGROUPMAP_XML_BLOCKMAP_NAME)
+            {   // A footprint file, that the block map has like a payload file.
+                m_footprintFiles.push_back(APPXCONTENTGROUPMAP_XML);
+                m_streams[APPXCONTENTGROUPMAP_XML] = m_appxBlockMap->GetValidationStream(fileName, m_container->GetFile(APPXCONTENTGROUPMAP_XML));
+                filesToProcess.erase(std::remove(filesToProcess.begin(), filesToProcess.end(), APPXCONTENTGROUPMAP_XML), filesToProcess.end());
+            }
+            else if (footPrintFile == footPrintFileNames.end())
             {   std::string containerFileName = EncodeFileName(fileName);
                 m_payloadFiles.push_back(containerFileName);
                 m_streams[containerFileName] = m_appxBlockMap->GetValidationStream(fileName, m_container->GetFile(containerFileName));
+                if (zip.Get())
+                {   static_cast<BlockMapStream*>(m_streams[containerFileName].Get())->SetContainer(zip.Get(), containerFileName, m_blockWorkers);
+                }
                 filesToProcess.erase(std::remove(filesToProcess.begin(), filesToProcess.end(), containerFileName), filesToProcess.end());
             }
         }
@@ -234,27 +323,423 @@ namespace MSIX {
         ThrowErrorIfNot(Error::BlockMapSemanticError, (filesToProcess.empty()), "Package not valid!");
     }
 
-    void AppxPackageObject::Unpack(MSIX_PACKUNPACK_OPTION options, IStorageObject* to)
+    void AppxPackageObject::SetValidatedStore(ValidatedStore* store, const FileIdentity& package)
     {
-        auto fileNames = GetFileNames(FileNameOptions::All);
-        for (const auto& fileName : fileNames)
+        const auto& digest = static_cast<AppxSignatureObject*>(m_appxSignature.Get())->GetAppxBlockMapDigest();
+        if ((m_validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) || (digest.size() != HASH_BYTES)) { return; }
+        m_validatedStore = store;
+        m_identity = package;
+        m_isTrusted = store->IsValidated(package, m_validation, digest);
+        if (m_isTrusted)
+        {   Global::Log::Verbose("package reader: validated before, payload blocks aren't hashed");
+            ComPtr<IZipReader> zip;
+            if (FAILED(m_container->QueryInterface(UuidOfImpl<IZipReader>::iid, reinterpret_cast<void**>(&zip)))) { zip = nullptr; }
+            auto blockMap = m_appxBlockMap.As<IAppxBlockMapInternal>();
+            for (const auto& fileName : m_appxBlockMap.As<IStorageObject>()->GetFileNames(FileNameOptions::PayloadOnly))
+            {   std::string containerFileName = EncodeFileName(fileName);
+                if (std::find(m_payloadFiles.begin(), m_payloadFiles.end(), containerFileName) != m_payloadFiles.end())
+                {   auto stream = ComPtr<BlockMapStream>::Make<BlockMapStream>(m_factory.Get(), fileName,
+                        m_container->GetFile(containerFileName), blockMap->GetBlocks(fileName), false);
+                    if (zip.Get()) { stream->SetContainer(zip.Get(), containerFileName, m_blockWorkers); }
+                    m_streams[containerFileName] = stream.As<IStream>();
+                }
+            }
+        }
+    }
+
+    AppxContentGroupMapObject* AppxPackageObject::GetContentGroups()
+    {
+        std::call_once(m_contentGroupMapLoaded, [&]()
+        {   auto stream = m_streams.find(APPXCONTENTGROUPMAP_XML);
+            if (stream == m_streams.end()) { return; }
+            LARGE_INTEGER li{0};
+            ThrowHrIfFailed(stream->second->Seek(li, StreamBase::Reference::START, nullptr));
+            auto map = ComPtr<IAppxContentGroupMapReader>::Make<AppxContentGroupMapObject>(m_factory.Get(), stream->second.Get());
+            for (const auto& group : static_cast<AppxContentGroupMapObject*>(map.Get())->GetGroups())
+            {   for (const auto& fileName : group->files)
+                {   auto containerFileName = EncodeFileName(fileName);
+                    ThrowErrorIf(Error::ContentGroupMapSemanticError, (
+                        std::find(m_payloadFiles.begin(), m_payloadFiles.end(), containerFileName) == m_payloadFiles.end() &&
+                        std::find(m_footprintFiles.begin(), m_footprintFiles.end(), containerFileName) == m_footprintFiles.end()),
+                        "content group map has a file that isn't in the package");
+                }
+            }
+            m_contentGroupMap = std::move(map);
+        });
+        return static_cast<AppxContentGroupMapObject*>(m_contentGroupMap.Get());
+    }
+
+    std::vector<std::string> AppxPackageObject::GetUnpackOrder(std::vector<ContentGroupEnd>& groups)
+    {
+        groups.clear();
+        auto files = GetFileNames(FileNameOptions::All | FileNameOptions::StorageOrder);
+        auto map = GetContentGroups();
+        if (map == nullptr) { return files; }
+
+        std::map<std::string, std::size_t> positions;
+        for (std::size_t position = 0; position < files.size(); position++) { positions[files[position]] = position; }
+        std::vector<bool> isTaken(files.size(), false);
+        std::vector<std::size_t> group;
+        auto Take = [&](const std::string& fileName)
+        {   auto position = positions.at(fileName);
+            if (!isTaken[position])
+            {   isTaken[position] = true;
+                group.push_back(position);
+            }
+        };
+
+        // A file that is in more than one group is unpacked with the first of them.
+        std::vector<std::string> result;
+        for (const auto& fileName : m_footprintFiles) { Take(fileName); }
+        for (const auto& contentGroup : map->GetGroups())
+        {   for (const auto& fileName : contentGroup->files) { Take(EncodeFileName(fileName)); }
+            std::sort(group.begin(), group.end());
+            for (auto position : group) { result.push_back(files[position]); }
+            group.clear();
+            groups.push_back(ContentGroupEnd { result.size(), contentGroup->name, groups.empty() });
+        }
+        for (std::size_t position = 0; position < files.size(); position++)
+        {   if (!isTaken[position]) { result.push_back(files[position]); }
+        }
+        return result;
+    }
+
+    // Calls onContentGroup for each of the groups that are complete once the first done files are unpacked.
+    static void OnContentGroups(const std::vector<ContentGroupEnd>& groups, std::size_t& next, std::size_t done, const ContentGroupCallback& onContentGroup)
+    {
+        for (; next < groups.size() && groups[next].end <= done; next++)
+        {   if (onContentGroup) { onContentGroup(groups[next].name, groups[next].isRequired); }
+        }
+    }
+
+    // How many blocks the reader can get ahead of the writer.
+    static const std::size_t UnpackQueueSize = 32;
+
+    // What the writer gets for each piece of a file, in package order.  Every file ends with a chunk
+    // without data, which is when it gets closed.
+    struct UnpackChunk
+    {
+        std::size_t               file;             // index into the plan, npos ends the unpack
+        BufferPool::Buffer        data;
+        std::size_t               size;
+        bool                      isLast;
+        // Instead of data, a stored file that was verified where it is mapped and is written from there as a whole.
+        std::shared_ptr<FileView> view = nullptr;
+    };
+
+    static std::shared_future<UnpackChunk> ReadyChunk(UnpackChunk chunk)
+    {
+        std::promise<UnpackChunk> promise;
+        promise.set_value(std::move(chunk));
+        return promise.get_future().share();
+    }
+
+    // Fills the buffer unless the stream ends first.  Returns how much was read.
+    static std::size_t ReadChunk(IStream* stream, std::vector<std::uint8_t>& buffer)
+    {
+        std::size_t total = 0;
+        while (total < buffer.size())
+        {
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(stream->Read(buffer.data() + total, static_cast<ULONG>(buffer.size() - total), &bytesRead));
+            if (bytesRead == 0) { break; }
+            total += bytesRead;
+        }
+        return total;
+    }
+
+    static void WriteAll(IStream* stream, const std::uint8_t* data, std::uint64_t size)
+    {
+        while (size != 0)
         {
-            std::string targetName;
+            auto count = static_cast<ULONG>(std::min<std::uint64_t>(size, std::numeric_limits<ULONG>::max()));
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(stream->Write(data, count, &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == count), "incomplete write");
+            data += count;
+            size -= count;
+        }
+    }
+
+    static FILE* GetFileHandle(IStream* stream)
+    {
+        ComPtr<IFileBackedStream> file;
+        if (FAILED(stream->QueryInterface(UuidOfImpl<IFileBackedStream>::iid, reinterpret_cast<void**>(&file)))) { return nullptr; }
+        return file->GetFileHandle();
+    }
+
+    // Unpack is a pipeline.  This thread reads the package in order and hands the blocks of payload files to
+    // a thread pool that inflates them and checks them against the block map.  A writer thread takes the
+    // blocks back in order and writes them out.  The queue to the writer and the buffer pool bound how far
+    // ahead of the writer the reader gets.  Files that can't be taken apart into independent blocks, like
+    // the footprint files, go through their regular streams on this thread instead.  Stored files that are in
+    // a file on disk are hashed where they are mapped, and the writer writes them from the same mapping, so what
+    // ends up in the target is what was checked.
+    void AppxPackageObject::Unpack(MSIX_PACKUNPACK_OPTION options, IStorageObject* to, const ContentGroupCallback& onContentGroup)
+    {
+        ComPtr<IStagedStorage> staged;
+        if (SUCCEEDED(m_container->QueryInterface(UuidOfImpl<IStagedStorage>::iid, reinterpret_cast<void**>(&staged))))
+        {   UnpackStaged(options, staged.Get(), to, onContentGroup);
+            return;
+        }
+
+        struct PlannedFile
+        {
+            std::string               name;
+            std::string               targetName;
+            ZipRawFile                raw;
+            const std::vector<Block>* blocks = nullptr;     // null when the file goes through its regular stream
+            FILE*                     source = nullptr;     // the package file, for stored files that can be mapped
+        };
+
+        ComPtr<IZipReader> zip;
+        if (FAILED(m_container->QueryInterface(UuidOfImpl<IZipReader>::iid, reinterpret_cast<void**>(&zip)))) { zip = nullptr; }
+        auto blockMap = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        std::map<std::string, std::string> blockMapNames;    // by container file name
+        for (const auto& fileName : m_appxBlockMap.As<IStorageObject>()->GetFileNames(FileNameOptions::PayloadOnly))
+        {   blockMapNames[EncodeFileName(fileName)] = fileName;
+        }
+
+        // Going through the files in the order they are in the package makes reading it one forward sweep.  A
+        // package with content groups is usually laid out in their order already.
+        std::vector<ContentGroupEnd> groups;
+        std::vector<PlannedFile> plan;
+        for (const auto& fileName : GetUnpackOrder(groups))
+        {
+            bool isPayload = std::find(m_footprintFiles.begin(), m_footprintFiles.end(), fileName) == m_footprintFiles.end();
+            PlannedFile file;
+            file.name = fileName;
             if (options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER)
             {   throw Exception(Error::NotImplemented);
-                //targetName = GetAppxManifest()->GetPackageFullName() + to->GetPathSeparator() + fileName;
+                //file.targetName = GetAppxManifest()->GetPackageFullName() + to->GetPathSeparator() + fileName;
             }
             else
-            {   targetName = DecodeFileName(fileName);
+            {   file.targetName = DecodeFileName(fileName);
+            }
+
+            if (zip.Get() && isPayload)
+            {
+                file.raw = zip->GetRawFile(fileName);
+                const auto& blocks = blockMap->GetBlocks(blockMapNames.at(fileName));
+                if (BlockReader::IsBlocked(file.raw, blocks))
+                {   file.blocks = &blocks;
+                    if (!file.raw.isCompressed && (file.raw.uncompressedSize != 0) && file.raw.archive.Get())
+                    {   file.source = GetFileHandle(file.raw.archive.Get());
+                    }
+                }
+            }
+            plan.push_back(std::move(file));
+        }
+
+        const std::size_t fileEnd = std::numeric_limits<std::size_t>::max();
+        const bool isHashed = !m_isTrusted;
+        // Declared in this order so that the tasks are done with their buffers before the pool goes away.
+        ThreadPool threadPool;
+        BufferPool buffers(2 * (UnpackQueueSize + threadPool.Size()) + 2, static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+        BoundedQueue<std::shared_future<UnpackChunk>> queue(UnpackQueueSize);
+        std::atomic<bool> failed(false);
+        std::exception_ptr writerError;
+
+        std::thread writer([&]()
+        {
+            IStream* target = nullptr;
+            std::size_t nextGroup = 0;
+            for (;;)
+            {
+                auto next = queue.Pop();
+                try
+                {
+                    const auto& chunk = next.get();
+                    if (chunk.file == fileEnd) { break; }
+                    if (failed) { continue; }
+                    if (target == nullptr)
+                    {   target = to->OpenFile(plan[chunk.file].targetName, MSIX::FileStream::Mode::WRITE_UPDATE);
+                    }
+                    if (chunk.view)
+                    {   WriteAll(target, chunk.view->Data(), chunk.size);
+                    }
+                    else if (chunk.size != 0)
+                    {   WriteAll(target, chunk.data->data(), chunk.size);
+                    }
+                    if (chunk.isLast)
+                    {   // Closes the file, otherwise every file in the package stays open until the end.
+                        to->CommitChanges();
+                        target = nullptr;
+                        OnContentGroups(groups, nextGroup, chunk.file + 1, onContentGroup);
+                    }
+                }
+                catch (...)
+                {   // keep draining the queue, so that the reader doesn't block on it, until the end.
+                    if (!failed) { writerError = std::current_exception(); }
+                    failed = true;
+                }
+            }
+        });
+
+        std::exception_ptr readerError;
+        try
+        {
+            for (std::size_t index = 0; (index < plan.size()) && !failed; index++)
+            {
+                const auto& file = plan[index];
+                std::shared_ptr<FileView> view;
+                if (file.source != nullptr)
+                {   view = FileView::Map(file.source, file.raw.archiveOffset, file.raw.uncompressedSize);
+                }
+
+                if (view)
+                {
+                    std::uint64_t size = file.raw.uncompressedSize;
+                    for (const auto& statistics : { file.raw.statistics, file.raw.archiveStatistics })
+                    {   statistics->sourceReads.fetch_add(1, std::memory_order_relaxed);
+                        statistics->sourceBytesRead.fetch_add(size, std::memory_order_relaxed);
+                    }
+                    std::uint64_t offset = 0;
+                    for (const auto& block : *file.blocks)
+                    {
+                        std::size_t expected = static_cast<std::size_t>(std::min(size - offset, BLOCKMAP_BLOCK_SIZE));
+                        const std::uint8_t* data = view->Data() + offset;
+                        auto statistics = file.raw.statistics;
+                        const auto* hash = &block.hash;
+                        queue.Push(threadPool.Submit([index, view, data, expected, statistics, hash, isHashed]()
+                        {
+                            if (isHashed) { VerifyBlock(data, expected, *hash); }
+                            statistics->bytesDelivered.fetch_add(expected, std::memory_order_relaxed);
+                            return UnpackChunk { index, nullptr, 0, false };
+                        }).share());
+                        offset += expected;
+                        if (failed) { break; }
+                    }
+                    queue.Push(ReadyChunk(UnpackChunk { index, nullptr, static_cast<std::size_t>(size), false, view }));
+                }
+                else if (file.blocks == nullptr)
+                {
+                    auto sourceFile = GetFile(file.name);
+                    LARGE_INTEGER li{0};
+                    ThrowHrIfFailed(sourceFile->Seek(li, StreamBase::Reference::START, nullptr));
+                    for (;;)
+                    {
+                        auto buffer = buffers.Acquire();
+                        buffer->resize(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+                        std::size_t size = ReadChunk(sourceFile, *buffer);
+                        if (size == 0) { break; }
+                        queue.Push(ReadyChunk(UnpackChunk { index, std::move(buffer), size, false }));
+                    }
+                }
+                else
+                {
+                    LARGE_INTEGER li{0};
+                    ThrowHrIfFailed(file.raw.stream->Seek(li, StreamBase::Reference::START, nullptr));
+                    std::uint64_t remaining = file.raw.uncompressedSize;
+                    std::shared_future<UnpackChunk> previous;
+                    for (const auto& block : *file.blocks)
+                    {
+                        std::size_t expected = static_cast<std::size_t>(std::min(remaining, BLOCKMAP_BLOCK_SIZE));
+                        remaining -= expected;
+                        auto input = buffers.Acquire();
+                        input->resize(file.raw.isCompressed ? static_cast<std::size_t>(block.compressedSize) : expected);
+                        ThrowErrorIfNot(Error::FileRead, (ReadChunk(file.raw.stream.Get(), *input) == input->size()), "file truncated");
+                        BufferPool::Buffer output = file.raw.isCompressed ? buffers.Acquire() : input;
+
+                        bool isCompressed = file.raw.isCompressed;
+                        auto statistics = file.raw.statistics;
+                        const auto* hash = &block.hash;
+                        auto result = threadPool.Submit([index, input, output, expected, isCompressed, statistics, hash, previous, isHashed]() mutable
+                        {
+                            // The task lives as long as its future does, let go of the input and of the previous
+                            // block as soon as it is done, or every block of a file would hold on to the one before.
+                            auto compressed = std::move(input);
+                            auto before = std::move(previous);
+                            if (isCompressed)
+                            {
+                                static thread_local Inflater inflater;
+                                if (!inflater.Inflate(compressed->data(), compressed->size(), nullptr, 0, expected, *output))
+                                {   // not deflated on its own, try again with the end of the previous block as the window.
+                                    // A hashed block that doesn't inflate isn't the block that was hashed.
+                                    auto error = isHashed ? Error::SignatureInvalid : Error::InflateCorruptData;
+                                    ThrowErrorIfNot(error, before.valid(), "inflate failed unexpectedly.");
+                                    const auto& prior = before.get();
+                                    std::size_t window = std::min<std::size_t>(prior.size, 1 << MAX_WBITS);
+                                    ThrowErrorIfNot(error,
+                                        inflater.Inflate(compressed->data(), compressed->size(), prior.data->data() + prior.size - window, window, expected, *output),
+                                        "inflate failed unexpectedly.");
+                                }
+                                statistics->bytesInflated.fetch_add(expected, std::memory_order_relaxed);
+                            }
+                            if (isHashed) { VerifyBlock(output->data(), expected, *hash); }
+                            statistics->bytesDelivered.fetch_add(expected, std::memory_order_relaxed);
+                            return UnpackChunk { index, std::move(output), expected, false };
+                        }).share();
+                        if (isCompressed) { previous = result; }
+                        queue.Push(std::move(result));
+                        if (failed) { break; }
+                    }
+                }
+                queue.Push(ReadyChunk(UnpackChunk { index, nullptr, 0, true }));
+            }
+        }
+        catch (...)
+        {   readerError = std::current_exception();
+        }
+        queue.Push(ReadyChunk(UnpackChunk { fileEnd, nullptr, 0, true }));
+        writer.join();
+        if (readerError) { std::rethrow_exception(readerError); }
+        if (writerError) { std::rethrow_exception(writerError); }
+
+        // Every block of every file was just checked.
+        if (m_validatedStore && !m_isTrusted)
+        {   try
+            {   m_validatedStore->Record(m_identity, m_validation,
+                    static_cast<AppxSignatureObject*>(m_appxSignature.Get())->GetAppxBlockMapDigest());
             }
+            catch (Exception&)
+            {   // Not having a record only costs the next read its hashing.
+            }
+        }
+    }
 
-            auto targetFile = to->OpenFile(targetName, MSIX::FileStream::Mode::WRITE_UPDATE);
-            auto sourceFile = GetFile(fileName);
+    // A staged container has already read all of the package, and hashed its files on the way.  Every payload file
+    // is checked against the block map before the first one is moved to the target.
+    void AppxPackageObject::UnpackStaged(MSIX_PACKUNPACK_OPTION options, IStagedStorage* staged, IStorageObject* to, const ContentGroupCallback& onContentGroup)
+    {
+        ThrowErrorIf(Error::NotImplemented, (options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER), "package subfolder is not supported");
+        auto blockMap = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        std::map<std::string, std::string> blockMapNames;    // by container file name
+        for (const auto& fileName : m_appxBlockMap.As<IStorageObject>()->GetFileNames(FileNameOptions::PayloadOnly))
+        {   blockMapNames[EncodeFileName(fileName)] = fileName;
+        }
+        for (const auto& fileName : m_payloadFiles)
+        {
+            const auto& blocks = blockMap->GetBlocks(blockMapNames.at(fileName));
+            const auto& hashes = staged->GetBlockHashes(fileName);
+            ThrowErrorIfNot(Error::BlockMapSemanticError, (blocks.size() == hashes.size()), "file size doesn't match the block map");
+            for (std::size_t index = 0; index < blocks.size(); index++)
+            {   ThrowErrorIfNot(Error::SignatureInvalid, (blocks[index].hash == hashes[index]), "Signature hash doesn't match digest hash");
+            }
+        }
 
-            ULARGE_INTEGER bytesCount = {0};
-            bytesCount.QuadPart = std::numeric_limits<std::uint64_t>::max();
-            ThrowHrIfFailed(sourceFile->CopyTo(targetFile, bytesCount, nullptr, nullptr));
+        std::vector<ContentGroupEnd> groups;
+        std::size_t nextGroup = 0;
+        std::size_t done = 0;
+        for (const auto& fileName : GetUnpackOrder(groups))
+        {
+            OnContentGroups(groups, nextGroup, done++, onContentGroup);
+            if (std::find(m_footprintFiles.begin(), m_footprintFiles.end(), fileName) == m_footprintFiles.end())
+            {   staged->CommitFile(fileName, to, DecodeFileName(fileName));
+                continue;
+            }
+            // Footprint files go through their validation streams like they always do.
+            auto source = GetFile(fileName);
+            LARGE_INTEGER li{0};
+            ThrowHrIfFailed(source->Seek(li, StreamBase::Reference::START, nullptr));
+            auto target = to->OpenFile(DecodeFileName(fileName), MSIX::FileStream::Mode::WRITE_UPDATE);
+            std::vector<std::uint8_t> buffer(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+            for (std::size_t size = ReadChunk(source, buffer); size != 0; size = ReadChunk(source, buffer))
+            {   WriteAll(target, buffer.data(), size);
+            }
+            to->CommitChanges();
         }
+        OnContentGroups(groups, nextGroup, done, onContentGroup);
     }
 
     std::string AppxPackageObject::GetPathSeparator() { return "/"; }
@@ -271,6 +756,15 @@ namespace MSIX {
         {
             result.insert(result.end(), m_payloadFiles.begin(), m_payloadFiles.end());
         }
+        if ((options & FileNameOptions::StorageOrder) == FileNameOptions::StorageOrder)
+        {   // The container knows where its files are, keep the ones that were asked for in its order.
+            std::set<std::string> requested(result.begin(), result.end());
+            result.clear();
+            for (auto& fileName : m_container->GetFileNames(FileNameOptions::All | FileNameOptions::StorageOrder))
+            {   if (requested.erase(fileName) != 0) { result.push_back(std::move(fileName)); }
+            }
+            result.insert(result.end(), requested.begin(), requested.end());
+        }
         return result;
     }
 
@@ -298,12 +792,18 @@ namespace MSIX {
         throw Exception(Error::NotImplemented);
     }
 
+    std::string AppxPackageObject::GetContentType(const std::string& fileName)
+    {
+        auto found = m_contentTypes ? m_contentTypes->Find(fileName) : nullptr;
+        return found ? *found : GetContentTypeByExtension(fileName);
+    }
+
     // IAppxPackageReader
     HRESULT STDMETHODCALLTYPE AppxPackageObject::GetBlockMap(IAppxBlockMapReader** blockMapReader)
     {
         return MSIX::ResultOf([&]() {
-            // TODO: Implement
-            throw Exception(Error::NotImplemented);
+            ThrowErrorIf(Error::InvalidParameter, (blockMapReader == nullptr || *blockMapReader != nullptr), "bad pointer");
+            *blockMapReader = m_appxBlockMap.As<IAppxBlockMapReader>().Detach();
         });
     }
    
@@ -355,4 +855,28 @@ namespace MSIX {
             throw Exception(Error::NotImplemented);
         });
     }
+
+    // IAppxPackageReader2
+    HRESULT STDMETHODCALLTYPE AppxPackageObject::GetContentGroupMap(IAppxContentGroupMapReader** contentGroupMapReader)
+    {
+        return MSIX::ResultOf([&]() {
+            ThrowErrorIf(Error::InvalidParameter, (contentGroupMapReader == nullptr || *contentGroupMapReader != nullptr), "bad pointer");
+            ThrowErrorIf(Error::FileNotFound, (GetContentGroups() == nullptr), "package has no content group map");
+            *contentGroupMapReader = ComPtr<IAppxContentGroupMapReader>(m_contentGroupMap).Detach();
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxPackageObject::GetStatistics(MSIX_READ_STATISTICS* statistics)
+    {
+        return MSIX::ResultOf([&]() {
+            ThrowHrIfFailed(m_container.As<IMSIXReadStatistics>()->GetStatistics(statistics));
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxPackageObject::GetFileStatistics(LPCWSTR fileName, MSIX_READ_STATISTICS* statistics)
+    {
+        return MSIX::ResultOf([&]() {
+            ThrowHrIfFailed(m_container.As<IMSIXReadStatistics>()->GetFileStatistics(fileName, statistics));
+        });
+    }
 }
\ No newline at end of file
@@ -0,0 +1,632 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "AppxPackageWriter.hpp"
+#include "AppxPackageObject.hpp"
+#include "Base64.hpp"
+#include "BlockMapStream.hpp"
+#include "BlockReader.hpp"
+#include "ContentType.hpp"
+#include "UnicodeConversion.hpp"
+#include "VectorStream.hpp"
+#include "SHA256.hpp"
+#include "Perf.hpp"
+
+#ifdef WIN32
+#include "zlib.h"
+#else
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <sstream>
+
+namespace MSIX {
+
+    static const int StoreLevel = -2; // not a zlib level, the block is written as-is
+
+    // A block that samples at or above this many bits per byte is taken to be compressed already.
+    static const double IncompressibleEntropy = 7.9;
+    // Deflated blocks that save less than 1/32 of their size are stored instead.
+    static const std::size_t MinimumGainShift = 5;
+
+    static int GetCompressionLevel(APPX_COMPRESSION_OPTION compressionOption)
+    {
+        switch (compressionOption)
+        {
+        case APPX_COMPRESSION_OPTION_NONE:      return StoreLevel;
+        case APPX_COMPRESSION_OPTION_NORMAL:    return Z_DEFAULT_COMPRESSION;
+        case APPX_COMPRESSION_OPTION_MAXIMUM:   return Z_BEST_COMPRESSION;
+        case APPX_COMPRESSION_OPTION_FAST:      return 3;
+        case APPX_COMPRESSION_OPTION_SUPERFAST: return Z_BEST_SPEED;
+        }
+        throw Exception(Error::InvalidParameter, "unknown compression option");
+    }
+
+    // One raw deflate stream per worker thread, reset for every block, as deflateInit2 allocates
+    // a few hundred KB of state and would otherwise be paid for every 64KB.
+    class Deflater
+    {
+    public:
+        Deflater()
+        {
+            m_zstrm = {0};
+            ThrowErrorIfNot(Error::DeflateInitialize,
+                (deflateInit2(&m_zstrm, m_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK),
+                "deflateInit2 failed");
+        }
+
+        ~Deflater() { deflateEnd(&m_zstrm); }
+
+        // Every block starts a fresh stream and ends on a byte boundary, with a full flush, or with the final
+        // deflate block for the last one.  Blocks can then be deflated independently and simply concatenated.
+        void Deflate(const std::vector<std::uint8_t>& block, int level, bool isLast, std::vector<std::uint8_t>& result)
+        {
+            Global::Perf::Scope scope(Global::Perf::Counter::Deflate);
+            scope.AddBytes(block.size());
+            ThrowErrorIfNot(Error::DeflateInitialize, (deflateReset(&m_zstrm) == Z_OK), "deflateReset failed");
+            if (level != m_level)
+            {   ThrowErrorIfNot(Error::DeflateInitialize, (deflateParams(&m_zstrm, level, Z_DEFAULT_STRATEGY) == Z_OK), "deflateParams failed");
+                m_level = level;
+            }
+
+            result.resize(deflateBound(&m_zstrm, static_cast<uLong>(block.size())) + 16);
+            m_zstrm.next_in   = const_cast<Bytef*>(block.data());
+            m_zstrm.avail_in  = static_cast<uInt>(block.size());
+            m_zstrm.next_out  = result.data();
+            m_zstrm.avail_out = static_cast<uInt>(result.size());
+            int flush = isLast ? Z_FINISH : Z_FULL_FLUSH;
+            for (;;)
+            {
+                int ret = deflate(&m_zstrm, flush);
+                ThrowErrorIf(Error::DeflateWrite, (ret == Z_STREAM_ERROR), "deflate failed");
+                if (m_zstrm.avail_out != 0 && (ret == Z_STREAM_END || (!isLast && m_zstrm.avail_in == 0))) { break; }
+                // ran out of room, which deflateBound should have prevented.
+                std::size_t produced = result.size() - m_zstrm.avail_out;
+                result.resize(result.size() + 1024);
+                m_zstrm.next_out  = result.data() + produced;
+                m_zstrm.avail_out = static_cast<uInt>(result.size() - produced);
+            }
+            result.resize(result.size() - m_zstrm.avail_out);
+        }
+
+    protected:
+        z_stream m_zstrm;
+        int      m_level = Z_DEFAULT_COMPRESSION;
+    };
+
+    // Estimates the Shannon entropy of a block, in bits per byte, from every 13th byte.  An odd stride keeps
+    // it from lining up with fixed size records.  Small blocks aren't worth guessing about and return 0.
+    static double SampleEntropy(const std::vector<std::uint8_t>& block)
+    {
+        static const std::size_t Stride = 13;
+        if (block.size() < 4096) { return 0.0; }
+        std::array<std::uint32_t, 256> histogram = {};
+        std::uint32_t samples = 0;
+        for (std::size_t index = 0; index < block.size(); index += Stride)
+        {   histogram[block[index]]++;
+            samples++;
+        }
+        double entropy = 0.0;
+        for (auto count : histogram)
+        {   if (count == 0) { continue; }
+            double probability = static_cast<double>(count) / samples;
+            entropy -= probability * std::log2(probability);
+        }
+        return entropy;
+    }
+
+    // What a worker hands back for one block of a file.
+    struct ProcessedBlock
+    {
+        std::vector<std::uint8_t> data;     // as written to the archive
+        std::vector<std::uint8_t> hash;     // of the uncompressed block
+        std::uint32_t             crc;      // of the uncompressed block
+        std::uint32_t             size;     // uncompressed
+    };
+
+    static ProcessedBlock ProcessBlock(std::shared_ptr<std::vector<std::uint8_t>> block, int level, bool isLast)
+    {
+        ProcessedBlock result;
+        result.size = static_cast<std::uint32_t>(block->size());
+        result.crc = crc32(0, block->data(), result.size);
+        ThrowErrorIfNot(Error::Unexpected, SHA256::ComputeHash(block->data(), result.size, result.hash), "failed computing hash");
+        if (level == StoreLevel)
+        {   result.data = std::move(*block);
+        }
+        else
+        {   // Incompressible blocks still go through deflate, as stored deflate blocks, because the file has
+            // already been declared as deflated in its local file header.
+            static thread_local Deflater deflater;
+            bool store = (SampleEntropy(*block) >= IncompressibleEntropy);
+            if (!store)
+            {   deflater.Deflate(*block, level, isLast, result.data);
+                store = (result.data.size() + (block->size() >> MinimumGainShift) > block->size());
+            }
+            if (store)
+            {   deflater.Deflate(*block, Z_NO_COMPRESSION, isLast, result.data);
+                Global::Perf::Count(Global::Perf::Counter::PackStoredBlock, block->size());
+            }
+        }
+        return result;
+    }
+
+    // Fills the block unless the stream ends first.  Returns how much was read.
+    static ULONG ReadBlock(IStream* stream, std::vector<std::uint8_t>& block)
+    {
+        ULONG total = 0;
+        while (total < block.size())
+        {
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(stream->Read(block.data() + total, static_cast<ULONG>(block.size()) - total, &bytesRead));
+            if (bytesRead == 0) { break; }
+            total += bytesRead;
+        }
+        block.resize(total);
+        return total;
+    }
+
+    // Checks the data of a file, as it is stored in a package and as it goes by, against the file's blocks in the
+    // block map.  Deflated data is inflated on the side to be hashed, stored data is hashed as it is.
+    class BlockChecker
+    {
+    public:
+        BlockChecker(const std::vector<MSIX::Block>& blocks, bool isCompressed, std::uint64_t size) :
+            m_blocks(blocks), m_isCompressed(isCompressed), m_size(size), m_block(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE))
+        {
+            ThrowErrorIf(Error::BlockMapSemanticError, (blocks.size() != (size + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE),
+                "blocks don't cover the file");
+            if (m_isCompressed)
+            {   m_zstrm = {0};
+                ThrowErrorIfNot(Error::InflateInitialize, (inflateInit2(&m_zstrm, -MAX_WBITS) == Z_OK), "inflateInit2 failed");
+            }
+        }
+
+        ~BlockChecker() { if (m_isCompressed) { inflateEnd(&m_zstrm); } }
+
+        void Add(const std::uint8_t* data, std::size_t size)
+        {
+            if (!m_isCompressed)
+            {   while (size != 0)
+                {   auto count = std::min(size, m_block.size() - m_filled);
+                    std::memcpy(m_block.data() + m_filled, data, count);
+                    m_filled += count;
+                    data += count;
+                    size -= count;
+                    if (m_filled == m_block.size()) { CheckBlock(); }
+                }
+                return;
+            }
+
+            ThrowErrorIf(Error::InflateCorruptData, (m_isEnd && size != 0), "data after the end of the deflate stream");
+            Global::Perf::Scope scope(Global::Perf::Counter::Inflate);
+            m_zstrm.next_in  = const_cast<Bytef*>(data);
+            m_zstrm.avail_in = static_cast<uInt>(size);
+            while (!m_isEnd)
+            {
+                m_zstrm.next_out  = m_block.data() + m_filled;
+                m_zstrm.avail_out = static_cast<uInt>(m_block.size() - m_filled);
+                int ret = inflate(&m_zstrm, Z_NO_FLUSH);
+                ThrowErrorIf(Error::InflateCorruptData, (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR), "inflate failed");
+                scope.AddBytes(m_block.size() - m_filled - m_zstrm.avail_out);
+                m_filled = m_block.size() - m_zstrm.avail_out;
+                m_isEnd = (ret == Z_STREAM_END);
+                ThrowErrorIf(Error::InflateCorruptData, (m_isEnd && m_zstrm.avail_in != 0), "data after the end of the deflate stream");
+                bool isFull = (m_zstrm.avail_out == 0);
+                if (isFull) { CheckBlock(); }
+                // A full block may have left output behind, even once all of the input is in.
+                if (!isFull && m_zstrm.avail_in == 0) { break; }
+            }
+        }
+
+        // Throws unless all of the file went by.
+        void End()
+        {
+            if (m_filled != 0) { CheckBlock(); }
+            ThrowErrorIf(Error::InflateCorruptData, (m_isCompressed && !m_isEnd), "deflate stream ends early");
+            ThrowErrorIfNot(Error::BlockMapSemanticError, (m_checked == m_size && m_index == m_blocks.size()), "file size doesn't match the block map");
+        }
+
+    protected:
+        void CheckBlock()
+        {
+            ThrowErrorIf(Error::BlockMapSemanticError, (m_index >= m_blocks.size()), "file is larger than the block map says");
+            VerifyBlock(m_block.data(), m_filled, m_blocks[m_index++].hash);
+            m_checked += m_filled;
+            m_filled = 0;
+        }
+
+        const std::vector<MSIX::Block>& m_blocks;
+        bool                            m_isCompressed;
+        std::uint64_t                   m_size;
+        std::vector<std::uint8_t>       m_block;
+        std::size_t                     m_filled = 0;
+        std::size_t                     m_index = 0;
+        std::uint64_t                   m_checked = 0;
+        z_stream                        m_zstrm;
+        bool                            m_isEnd = false;
+    };
+
+    static std::string XmlEscape(const std::string& value)
+    {
+        std::string result;
+        for (auto c : value)
+        {
+            switch (c)
+            {
+            case '&':  result += "&amp;";  break;
+            case '<':  result += "&lt;";   break;
+            case '>':  result += "&gt;";   break;
+            case '"':  result += "&quot;"; break;
+            case '\'': result += "&apos;"; break;
+            default:   result += c;
+            }
+        }
+        return result;
+    }
+
+    static std::string ToLower(std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return value;
+    }
+
+    AppxPackageWriter::AppxPackageWriter(IMSIXFactory* factory, IStream* outputStream) : m_factory(factory)
+    {
+        auto zip = ComPtr<IStorageObject>::Make<ZipObject>(factory, outputStream, FileStream::Mode::WRITE);
+        m_zip = zip.As<IZipWriter>();
+        m_threadPool = std::make_unique<ThreadPool>();
+    }
+
+    AppxPackageWriter::AppxPackageWriter(IMSIXFactory* factory, IStream* package, IAppxPackageReader* reader) : m_factory(factory)
+    {
+        m_isEditing = true;
+        ComPtr<IAppxPackageReader> packageReader(reader);
+        auto source = packageReader.As<IPackage>();
+        auto zip = source->GetZipReader();
+        ComPtr<IAppxBlockMapReader> blockMapReader;
+        ThrowHrIfFailed(packageReader->GetBlockMap(&blockMapReader));
+        auto blockMap = blockMapReader.As<IAppxBlockMapInternal>();
+        std::map<std::string, std::string> blockMapNames; // by name in the archive
+        for (const auto& name : blockMapReader.As<IStorageObject>()->GetFileNames(FileNameOptions::All))
+        {   blockMapNames[EncodeFileName(name)] = name;
+        }
+
+        // Everything but the payload and the manifest goes: the block map and the content types are written again
+        // by Commit, the signature and the code integrity catalog would no longer match.
+        std::vector<std::string> removedFiles;
+        for (const auto& zipName : zip.As<IStorageObject>()->GetFileNames(FileNameOptions::All | FileNameOptions::StorageOrder))
+        {
+            auto blockMapName = blockMapNames.find(zipName);
+            if (blockMapName == blockMapNames.end() || zipName == CODEINTEGRITY_CAT)
+            {   removedFiles.push_back(zipName);
+                continue;
+            }
+            File file;
+            file.name = blockMapName->second;
+            auto blockMapFile = blockMap->GetBlockMapFile(file.name);
+            UINT64 size = 0;
+            ThrowHrIfFailed(blockMapFile->GetUncompressedSize(&size));
+            file.size = size;
+            UINT32 localFileHeaderSize = 0;
+            ThrowHrIfFailed(blockMapFile->GetLocalFileHeaderSize(&localFileHeaderSize));
+            file.localFileHeaderSize = localFileHeaderSize;
+            file.isCompressed = zip->GetRawFile(zipName).isCompressed;
+            for (const auto& block : blockMap->GetBlocks(file.name))
+            {   file.blocks.push_back(Block { block.hash, block.compressedSize });
+            }
+            if (file.name != APPXMANIFEST_XML)
+            {   m_fileNames.insert(ToLower(zipName));
+                AddContentType(file.name, source->GetContentType(zipName));
+            }
+            m_files.push_back(std::move(file));
+        }
+
+        // Only now, as the reader reads the same stream and would move it.
+        auto zipObject = ComPtr<IStorageObject>::Make<ZipObject>(factory, package, FileStream::Mode::READ_UPDATE);
+        for (const auto& zipName : removedFiles) { zipObject->RemoveFile(zipName); }
+        m_zip = zipObject.As<IZipWriter>();
+        m_threadPool = std::make_unique<ThreadPool>();
+    }
+
+    // IAppxPackageWriter
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::AddPayloadFile(LPCWSTR fileName, LPCWSTR contentType,
+        APPX_COMPRESSION_OPTION compressionOption, IStream* inputStream)
+    {
+        return ResultOf([&]{
+            ThrowIfNotOpen();
+            ThrowErrorIf(Error::InvalidParameter, (
+                fileName == nullptr || *fileName == '\0' ||
+                contentType == nullptr || *contentType == '\0' ||
+                inputStream == nullptr
+            ), "bad pointer");
+            GetCompressionLevel(compressionOption);
+
+            // Block map names use '\' as separator, zip names use '/'.
+            auto name = utf16_to_utf8(fileName);
+            std::replace(name.begin(), name.end(), '/', '\\');
+            auto zipName = EncodeFileName(name);
+            AddFileName(zipName);
+
+            // Formats that are compressed already are stored whatever was asked for.
+            auto contentTypeName = utf16_to_utf8(contentType);
+            bool isCompressedContent = (compressionOption != APPX_COMPRESSION_OPTION_NONE) && IsCompressedContent(name, contentTypeName);
+            if (isCompressedContent) { compressionOption = APPX_COMPRESSION_OPTION_NONE; }
+
+            try
+            {
+                m_files.push_back(WriteFile(name, zipName, compressionOption, inputStream));
+                AddContentType(name, contentTypeName);
+            }
+            catch (...)
+            {   // Part of the file may already be in the output.
+                m_state = State::Failed;
+                throw;
+            }
+            if (isCompressedContent) { Global::Perf::Count(Global::Perf::Counter::PackStoredFile, m_files.back().size); }
+        });
+    }
+
+    // IMSIXPackageWriter
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::AddPayloadFileFromPackage(IAppxPackageReader* package, LPCWSTR fileName, BOOL verify)
+    {
+        return ResultOf([&]{
+            ThrowIfNotOpen();
+            ThrowErrorIf(Error::InvalidParameter, (package == nullptr || fileName == nullptr || *fileName == '\0'), "bad pointer");
+            auto name = utf16_to_utf8(fileName);
+            std::replace(name.begin(), name.end(), '/', '\\');
+            auto zipName = EncodeFileName(name);
+
+            ComPtr<IAppxPackageReader> reader(package);
+            auto source = reader.As<IPackage>();
+            auto zip = source->GetZipReader();
+            ComPtr<IAppxBlockMapReader> blockMapReader;
+            ThrowHrIfFailed(reader->GetBlockMap(&blockMapReader));
+            const auto& blocks = blockMapReader.As<IAppxBlockMapInternal>()->GetBlocks(name);
+            auto raw = zip->GetRawFile(zipName);
+            AddFileName(zipName);
+
+            File file;
+            file.name = name;
+            file.size = raw.uncompressedSize;
+            file.isCompressed = raw.isCompressed;
+            for (const auto& block : blocks)
+            {   file.blocks.push_back(Block { block.hash, block.compressedSize });
+            }
+            try
+            {
+                if (verify)
+                {   BlockChecker checker(blocks, raw.isCompressed, raw.uncompressedSize);
+                    file.localFileHeaderSize = m_zip->CopyFile(zip.Get(), zipName,
+                        [&](const std::uint8_t* data, std::size_t size) { checker.Add(data, size); });
+                    checker.End();
+                }
+                else
+                {   file.localFileHeaderSize = m_zip->CopyFile(zip.Get(), zipName, nullptr);
+                }
+                m_files.push_back(std::move(file));
+                AddContentType(name, source->GetContentType(zipName));
+            }
+            catch (...)
+            {   // Part of the file may already be in the output.
+                m_state = State::Failed;
+                throw;
+            }
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::Close(IStream* manifest)
+    {
+        return ResultOf([&]{
+            ThrowIfNotOpen();
+            ThrowErrorIf(Error::InvalidState, (m_isEditing), "a package that is edited is committed, not closed");
+            ThrowErrorIf(Error::InvalidParameter, (manifest == nullptr), "bad pointer");
+            ThrowErrorIf(Error::InvalidState, (m_files.empty()), "a package needs at least one payload file");
+
+            // A package without a readable identity could not be read back.
+            ComPtr<IStream> manifestStream(manifest);
+            LARGE_INTEGER start = {0};
+            ThrowHrIfFailed(manifestStream->Seek(start, StreamBase::Reference::START, nullptr));
+            ComPtr<IVerifierObject>::Make<AppxManifestObject>(manifestStream);
+            ThrowHrIfFailed(manifestStream->Seek(start, StreamBase::Reference::START, nullptr));
+
+            try
+            {
+                m_files.push_back(WriteFile(APPXMANIFEST_XML, APPXMANIFEST_XML, APPX_COMPRESSION_OPTION_NORMAL, manifestStream.Get()));
+                WriteFootprintAndCommit();
+            }
+            catch (...)
+            {   m_state = State::Failed;
+                throw;
+            }
+        });
+    }
+
+    // IMSIXPackageEditor
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::RemovePayloadFile(LPCWSTR fileName)
+    {
+        return ResultOf([&]{
+            ThrowIfNotOpen();
+            ThrowErrorIfNot(Error::InvalidState, (m_isEditing), "files can only be removed from a package that is edited");
+            ThrowErrorIf(Error::InvalidParameter, (fileName == nullptr || *fileName == '\0'), "bad pointer");
+            auto name = utf16_to_utf8(fileName);
+            std::replace(name.begin(), name.end(), '/', '\\');
+            auto zipName = ToLower(EncodeFileName(name));
+            ThrowErrorIf(Error::FileNotFound, (m_fileNames.find(zipName) == m_fileNames.end()), "payload file not in package");
+            RemoveFile(zipName);
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::Commit(BOOL compact)
+    {
+        return ResultOf([&]{
+            ThrowIfNotOpen();
+            ThrowErrorIfNot(Error::InvalidState, (m_isEditing), "only a package that is edited is committed");
+            ThrowErrorIf(Error::InvalidState, (m_fileNames.empty()), "a package needs at least one payload file");
+            try
+            {
+                if (compact) { m_zip->Compact(); }
+                WriteFootprintAndCommit();
+            }
+            catch (...)
+            {   m_state = State::Failed;
+                throw;
+            }
+        });
+    }
+
+    void AppxPackageWriter::ThrowIfNotOpen()
+    {
+        ThrowErrorIf(Error::InvalidState, (m_state == State::Closed), "package writer is closed");
+        ThrowErrorIf(Error::InvalidState, (m_state == State::Failed), "package writer failed earlier and its output is incomplete");
+    }
+
+    // Payload files can't take the name of a footprint file, or of a file that was added already.  When a package
+    // is edited, a file of the same name is replaced instead.
+    void AppxPackageWriter::AddFileName(const std::string& zipName)
+    {
+        for (const auto& footprintFile : { APPXMANIFEST_XML, APPXBLOCKMAP_XML, APPXSIGNATURE_P7X, CODEINTEGRITY_CAT, CONTENT_TYPES_XML })
+        {   ThrowErrorIf(Error::DuplicateFootprintFile, (ToLower(zipName) == ToLower(footprintFile)), "payload file uses a footprint file name");
+        }
+        // Part names are compared case insensitively.
+        if (m_isEditing && m_fileNames.find(ToLower(zipName)) != m_fileNames.end()) { RemoveFile(ToLower(zipName)); }
+        ThrowErrorIfNot(Error::DuplicatePayloadFile, (m_fileNames.insert(ToLower(zipName)).second), "payload file already added");
+    }
+
+    // Takes the payload file with the lower cased archive name out of the block map, the content types and the
+    // central directory.  A default content type that it set is kept.
+    void AppxPackageWriter::RemoveFile(const std::string& name)
+    {
+        auto file = std::find_if(m_files.begin(), m_files.end(), [&](const File& file)
+        {   return ToLower(EncodeFileName(file.name)) == name;
+        });
+        ThrowErrorIf(Error::Unexpected, (file == m_files.end()), "payload file not in block map");
+        auto zipName = EncodeFileName(file->name);
+        m_overrideContentTypes.erase("/" + zipName);
+        m_zip.As<IStorageObject>()->RemoveFile(zipName);
+        m_files.erase(file);
+        m_fileNames.erase(name);
+    }
+
+    // The block map covers the payload and the manifest, but neither itself nor [Content_Types].xml
+    void AppxPackageWriter::WriteFootprintAndCommit()
+    {
+        auto blockMap = GetBlockMap();
+        std::vector<std::uint8_t> blockMapBytes(blockMap.begin(), blockMap.end());
+        auto blockMapStream = ComPtr<IStream>::Make<VectorStream>(&blockMapBytes);
+        WriteFile(APPXBLOCKMAP_XML, APPXBLOCKMAP_XML, APPX_COMPRESSION_OPTION_NORMAL, blockMapStream.Get());
+
+        auto contentTypes = GetContentTypes();
+        std::vector<std::uint8_t> contentTypesBytes(contentTypes.begin(), contentTypes.end());
+        auto contentTypesStream = ComPtr<IStream>::Make<VectorStream>(&contentTypesBytes);
+        WriteFile(CONTENT_TYPES_XML, CONTENT_TYPES_XML, APPX_COMPRESSION_OPTION_NORMAL, contentTypesStream.Get());
+
+        m_zip.As<IStorageObject>()->CommitChanges();
+        m_state = State::Closed;
+    }
+
+    // Reads ahead one block so that the last block is known when it is handed out, and keeps a bounded
+    // number of blocks in flight.  Blocks are written in order as they come back from the pool.
+    AppxPackageWriter::File AppxPackageWriter::WriteFile(const std::string& name, const std::string& zipName, APPX_COMPRESSION_OPTION compressionOption, IStream* stream)
+    {
+        auto next = std::make_shared<std::vector<std::uint8_t>>(BLOCKMAP_BLOCK_SIZE);
+        ULONG nextSize = ReadBlock(stream, *next);
+        // An empty deflated file would still need a final deflate block.  Store it instead, it has no blocks either way.
+        if (nextSize == 0) { compressionOption = APPX_COMPRESSION_OPTION_NONE; }
+
+        File file;
+        file.name = name;
+        file.size = 0;
+        file.isCompressed = (compressionOption != APPX_COMPRESSION_OPTION_NONE);
+        file.localFileHeaderSize = m_zip->BeginFile(zipName, compressionOption);
+
+        int level = GetCompressionLevel(compressionOption);
+        std::uint32_t crc = crc32(0, Z_NULL, 0);
+        std::uint64_t compressedSize = 0;
+        std::deque<std::future<ProcessedBlock>> pending;
+        auto writeOldest = [&]()
+        {
+            auto block = pending.front().get();
+            pending.pop_front();
+            m_zip->WriteFileData(block.data.data(), static_cast<ULONG>(block.data.size()));
+            crc = crc32_combine(crc, block.crc, block.size);
+            compressedSize += block.data.size();
+            file.blocks.push_back(Block { std::move(block.hash), block.data.size() });
+        };
+
+        while (nextSize != 0)
+        {
+            auto current = std::move(next);
+            file.size += nextSize;
+            next = std::make_shared<std::vector<std::uint8_t>>(BLOCKMAP_BLOCK_SIZE);
+            nextSize = ReadBlock(stream, *next);
+            bool isLast = (nextSize == 0);
+            pending.push_back(m_threadPool->Submit([current, level, isLast]() { return ProcessBlock(current, level, isLast); }));
+            if (pending.size() >= 2 * m_threadPool->Size()) { writeOldest(); }
+        }
+        while (!pending.empty()) { writeOldest(); }
+
+        m_zip->EndFile(crc, compressedSize, file.size);
+        return file;
+    }
+
+    // The first content type seen for an extension becomes the default for it, anything that disagrees
+    // with the default gets an override.
+    void AppxPackageWriter::AddContentType(const std::string& name, const std::string& contentType)
+    {
+        auto separator = name.find_last_of("\\.");
+        std::string extension;
+        if (separator != std::string::npos && name[separator] == '.') { extension = ToLower(name.substr(separator + 1)); }
+
+        if (!extension.empty())
+        {   auto result = m_defaultContentTypes.insert(std::make_pair(extension, contentType));
+            if (result.second || result.first->second == contentType) { return; }
+        }
+        m_overrideContentTypes[ "/" + EncodeFileName(name)] = contentType;
+    }
+
+    std::string AppxPackageWriter::GetBlockMap()
+    {
+        std::ostringstream xml;
+        xml << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\r\n";
+        xml << "<BlockMap xmlns=\"http://schemas.microsoft.com/appx/2010/blockmap\" HashMethod=\"http://www.w3.org/2001/04/xmlenc#sha256\">";
+        for (const auto& file : m_files)
+        {
+            xml << "<File Name=\"" << XmlEscape(file.name) << "\" Size=\"" << file.size
+                << "\" LfhSize=\"" << file.localFileHeaderSize << "\">";
+            for (const auto& block : file.blocks)
+            {
+                xml << "<Block Hash=\"" << Base64Encode(block.hash) << "\"";
+                if (file.isCompressed) { xml << " Size=\"" << block.compressedSize << "\""; }
+                xml << "/>";
+            }
+            xml << "</File>";
+        }
+        xml << "</BlockMap>";
+        return xml.str();
+    }
+
+    std::string AppxPackageWriter::GetContentTypes()
+    {
+        std::ostringstream xml;
+        xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+        xml << "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">";
+        for (const auto& contentType : m_defaultContentTypes)
+        {   xml << "<Default Extension=\"" << XmlEscape(contentType.first) << "\" ContentType=\"" << XmlEscape(contentType.second) << "\"/>";
+        }
+        for (const auto& contentType : m_overrideContentTypes)
+        {   xml << "<Override PartName=\"" << XmlEscape(contentType.first) << "\" ContentType=\"" << XmlEscape(contentType.second) << "\"/>";
+        }
+        xml << "<Override PartName=\"/" << APPXMANIFEST_XML << "\" ContentType=\"application/vnd.ms-appx.manifest+xml\"/>";
+        xml << "<Override PartName=\"/" << APPXBLOCKMAP_XML << "\" ContentType=\"application/vnd.ms-appx.blockmap+xml\"/>";
+        xml << "</Types>";
+        return xml.str();
+    }
+}
@@ -99,12 +99,27 @@ MIDL_DEFINE_GUID(IID, IID_IAppxEncryptedBundleWriter2,0xE644BE82,0xF0FA,0x42B8,0
 //MIDL_DEFINE_GUID(IID, IID_IAppxEncryptedBundleWriter3,0x0D34DEB3,0x5CAE,0x4DD3,0x97,0x7C,0x50,0x49,0x32,0xA5,0x1D,0x31);
 //MIDL_DEFINE_GUID(IID, IID_IAppxPackageEditor,0xE2ADB6DC,0x5E71,0x4416,0x86,0xB6,0x86,0xE5,0xF5,0x29,0x1A,0x6B);
 
+// MSIX specific interfaces.
+MIDL_DEFINE_GUID(IID, IID_IMSIXReadStatistics, 0x6e5a9d94,0x32c9,0x4c6e,0x9a,0x1b,0x7d,0x0b,0x6a,0x3f,0x2e,0x18);
+MIDL_DEFINE_GUID(IID, IID_IMSIXFactoryOptions, 0xd3b71a2e,0x6f05,0x4c8e,0xa1,0xd9,0x5e,0x28,0xc4,0x7b,0x90,0xf3);
+MIDL_DEFINE_GUID(IID, IID_IMSIXPayloadFile,    0xa23fcc62,0x1fe9,0x4efc,0x9c,0xdf,0xc5,0xe2,0x57,0x52,0x03,0x16);
+MIDL_DEFINE_GUID(IID, IID_IMSIXPayloadBlocks,  0x5f0e8b43,0x9c2d,0x4d7a,0xb1,0xe6,0x3a,0x84,0xc0,0xd9,0xe7,0x21);
+MIDL_DEFINE_GUID(IID, IID_IMSIXPackageDiff,    0xb4e1d7a3,0x58c2,0x4f19,0xa0,0x6d,0x2c,0x93,0xf5,0xe8,0xb1,0x7a);
+MIDL_DEFINE_GUID(IID, IID_IMSIXPackageWriter,  0xe2c84f17,0x3b6d,0x4a92,0x8d,0x05,0x71,0xf9,0xac,0x3e,0x6b,0x40);
+MIDL_DEFINE_GUID(IID, IID_IMSIXPackageEditor,  0x7a3d91c5,0xe842,0x4b6f,0x9c,0x17,0x0d,0x5e,0x28,0xf4,0xa6,0xb3);
+
 // internal interfaces.
 MIDL_DEFINE_GUID(IID, IID_IPackage,        0x51B2C456,0xAAA9,0x46D6,0x8E,0xC9,0x29,0x82,0x20,0x55,0x91,0x89);
 MIDL_DEFINE_GUID(IID, IID_IStorageObject,  0xEC25B96E,0x0DB1,0x4483,0xBD,0xB1,0xCA,0xB1,0x10,0x9C,0xB7,0x41);
 MIDL_DEFINE_GUID(IID, IID_IMSIXFactory,    0x1f850db4,0x32b8,0x4db6,0x8b,0xf4,0x5a,0x89,0x7e,0xb6,0x11,0xf1);                                           
 MIDL_DEFINE_GUID(IID, IID_IVerifierObject, 0xcb0a105c,0x3a6c,0x4e48,0x93,0x51,0x37,0x7c,0x4d,0xcc,0xd8,0x90);
 MIDL_DEFINE_GUID(IID, IID_IXmlObject,      0x0e7a446e,0xbaf7,0x44c1,0xb3,0x8a,0x21,0x6b,0xfa,0x18,0xa1,0xa8);
+MIDL_DEFINE_GUID(IID, IID_IZipWriter,      0x3a8f6c1d,0x5e27,0x4b90,0xa4,0xd3,0x96,0xc2,0xe0,0xb7,0xf8,0x15);
+MIDL_DEFINE_GUID(IID, IID_IZipReader,      0x8d1e4b27,0x6c3a,0x4f95,0xb0,0xe2,0x5a,0x7d,0x9c,0x14,0xe3,0x6b);
+MIDL_DEFINE_GUID(IID, IID_IAppxBlockMapInternal, 0x4c7f2a90,0xd315,0x4e6b,0x8f,0x4a,0x1b,0x93,0xe6,0x05,0xc2,0x7d);
+MIDL_DEFINE_GUID(IID, IID_IFileBackedStream, 0x5b9e3c71,0x2f84,0x4d0a,0x9c,0x6e,0x7a,0x1d,0x48,0xb2,0xf0,0x93);
+MIDL_DEFINE_GUID(IID, IID_IDirectoryObject, 0xa7c3e915,0x48d2,0x4f6b,0x9e,0x01,0xc2,0x5b,0x8d,0x7f,0x3a,0x64);
+MIDL_DEFINE_GUID(IID, IID_IStagedStorage,   0x2e64b0d8,0x9a17,0x4c35,0xb8,0x6f,0x03,0xd9,0x41,0xe7,0x5c,0xa2);
 #undef MIDL_DEFINE_GUID
 
 }
@@ -12,6 +12,7 @@
 #include "ComHelper.hpp"
 #include "SignatureValidator.hpp"
 #include "BlockMapStream.hpp"
+#include "Perf.hpp"
 
 #include <string>
 #include <vector>
@@ -25,15 +26,35 @@ AppxSignatureObject::AppxSignatureObject(MSIX_VALIDATION_OPTION validationOption
     m_stream(stream), 
     m_validationOptions(validationOptions)
 {
+    Global::Perf::Scope scope(Global::Perf::Counter::SignatureValidation);
     m_hasDigests = SignatureValidator::Validate(validationOptions, stream, m_digests, m_signatureOrigin, m_publisher);
 
     if (0 == (validationOptions & MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE))
     {   // reset the source stream back to the beginning after validating it.
         LARGE_INTEGER li{0};    
+        if (Global::Perf::IsEnabled())
+        {   // Asked of the file rather than found by seeking, so that measuring doesn't add to the seek counts.
+            ComPtr<IAppxFile> file;
+            UINT64 size = 0;
+            if (SUCCEEDED(stream->QueryInterface(UuidOfImpl<IAppxFile>::iid, reinterpret_cast<void**>(&file))) &&
+                SUCCEEDED(file->GetSize(&size)))
+            {   scope.AddBytes(size);
+            }
+        }
         ThrowHrIfFailed(stream->Seek(li, StreamBase::Reference::START, nullptr));
     }
 }
 
+AppxSignatureObject::AppxSignatureObject(const AppxSignatureObject& validated, IStream* stream) :
+    m_hasDigests(validated.m_hasDigests),
+    m_digests(validated.m_digests),
+    m_signatureOrigin(validated.m_signatureOrigin),
+    m_validationOptions(validated.m_validationOptions),
+    m_stream(stream),
+    m_publisher(validated.m_publisher)
+{
+}
+
 MSIX::ComPtr<IStream>  AppxSignatureObject::GetValidationStream(const std::string& part, IStream* stream)
 {
     if (m_hasDigests)
@@ -0,0 +1,289 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#include "BlockReader.hpp"
+#include "Exceptions.hpp"
+#include "SHA256.hpp"
+#include "Perf.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
+
+namespace MSIX {
+
+    // Most blocks that ReadBlocks reads from the package at once.
+    static const std::size_t MaxRunBlocks = 16;
+
+    // Most blocks that are gone back over to find the window that a block refers back into.
+    static const std::size_t MaxWalkBlocks = 64;
+    static const std::size_t WindowSize = 1 << MAX_WBITS;
+
+    static Inflater& ThreadInflater()
+    {
+        static thread_local Inflater inflater;
+        return inflater;
+    }
+
+    static void TakeWindow(const std::vector<std::uint8_t>& block, std::vector<std::uint8_t>& window)
+    {
+        window.assign(block.end() - std::min(block.size(), WindowSize), block.end());
+    }
+
+    Inflater::Inflater()
+    {
+        m_zstrm = {0};
+        ThrowErrorIfNot(Error::InflateInitialize, (inflateInit2(&m_zstrm, -MAX_WBITS) == Z_OK), "inflateInit2 failed");
+    }
+
+    Inflater::~Inflater() { inflateEnd(&m_zstrm); }
+
+    bool Inflater::Inflate(const std::uint8_t* block, std::size_t blockSize, const std::uint8_t* dictionary, std::size_t dictionarySize,
+        std::size_t expected, std::vector<std::uint8_t>& result)
+    {
+        Global::Perf::Scope scope(Global::Perf::Counter::Inflate);
+        scope.AddBytes(expected);
+        ThrowErrorIfNot(Error::InflateInitialize, (inflateReset(&m_zstrm) == Z_OK), "inflateReset failed");
+        if (dictionarySize != 0)
+        {   ThrowErrorIfNot(Error::InflateInitialize,
+                (inflateSetDictionary(&m_zstrm, dictionary, static_cast<uInt>(dictionarySize)) == Z_OK),
+                "inflateSetDictionary failed");
+        }
+
+        // one spare byte to catch blocks that inflate to more than they should.
+        result.resize(expected + 1);
+        m_zstrm.next_in   = const_cast<Bytef*>(block);
+        m_zstrm.avail_in  = static_cast<uInt>(blockSize);
+        m_zstrm.next_out  = result.data();
+        m_zstrm.avail_out = static_cast<uInt>(result.size());
+        int ret = inflate(&m_zstrm, Z_SYNC_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) { return false; }
+        return (m_zstrm.avail_in == 0) && (result.size() - m_zstrm.avail_out == expected);
+    }
+
+    void VerifyBlock(const std::uint8_t* data, std::size_t size, const std::vector<std::uint8_t>& expected)
+    {
+        std::vector<std::uint8_t> digest;
+        ThrowErrorIfNot(Error::SignatureInvalid, SHA256::ComputeHash(data, size, digest), "failed computing hash");
+        ThrowErrorIfNot(Error::SignatureInvalid,
+            (digest.size() == expected.size()) && (memcmp(digest.data(), expected.data(), digest.size()) == 0),
+            "Signature hash doesn't match digest hash");
+    }
+
+    void BlockWorkers::Load()
+    {
+        std::call_once(m_loaded, [this]()
+        {   m_threads = std::make_unique<ThreadPool>();
+            // A block for every thread to work on and one for it to hand back, ReadBlocks makes more as it needs them.
+            m_buffers = std::make_shared<BufferPool>(2 * m_threads->Size(), static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE) + 1);
+        });
+    }
+
+    bool BlockReader::IsBlocked(const ZipRawFile& file, const std::vector<Block>& blocks)
+    {
+        std::uint64_t expectedBlocks = (file.uncompressedSize + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE;
+        std::uint64_t blocksSize = 0;
+        for (const auto& block : blocks) { blocksSize += block.compressedSize; }
+        // A deflated file can end with a final, empty, deflate block that isn't part of any of its blocks.
+        return (blocks.size() == expectedBlocks) &&
+            (file.isCompressed ? (file.compressedSize >= blocksSize) : (file.compressedSize == file.uncompressedSize));
+    }
+
+    BlockReader::BlockReader(IZipReader* zip, const ZipRawFile& file, const std::vector<Block>& blocks, bool isHashed) :
+        m_zip(zip), m_file(file), m_blocks(blocks), m_isHashed(isHashed), m_isChained(false),
+        m_windowIndex(std::numeric_limits<std::size_t>::max())
+    {
+        ThrowErrorIfNot(Error::BlockMapSemanticError, IsBlocked(file, blocks), "file doesn't match its blocks");
+        std::uint64_t offset = 0;
+        m_offsets.reserve(blocks.size());
+        for (const auto& block : blocks)
+        {   m_offsets.push_back(offset);
+            offset += file.isCompressed ? block.compressedSize : BLOCKMAP_BLOCK_SIZE;
+        }
+    }
+
+    std::size_t BlockReader::BlockSize(std::size_t index) const
+    {
+        std::uint64_t blockOffset = static_cast<std::uint64_t>(index) * BLOCKMAP_BLOCK_SIZE;
+        return static_cast<std::size_t>(std::min(m_file.uncompressedSize - blockOffset, BLOCKMAP_BLOCK_SIZE));
+    }
+
+    std::size_t BlockReader::DataSize(std::size_t index) const
+    {
+        return m_file.isCompressed ? static_cast<std::size_t>(m_blocks[index].compressedSize) : BlockSize(index);
+    }
+
+    void BlockReader::ReadData(std::size_t index, std::vector<std::uint8_t>& data)
+    {
+        data.resize(DataSize(index));
+        m_zip->ReadRawFile(m_file, m_offsets[index], data.data(), data.size());
+    }
+
+    void BlockReader::DecodeBlock(std::size_t index, const std::uint8_t* data, std::vector<std::uint8_t>& output,
+        const std::function<void(std::vector<std::uint8_t>&)>& getWindow)
+    {
+        std::size_t expected = BlockSize(index);
+        if (m_file.isCompressed)
+        {
+            auto& inflater = ThreadInflater();
+            if (!inflater.Inflate(data, DataSize(index), nullptr, 0, expected, output))
+            {   // not deflated on its own, try again with the end of the previous block as the window.
+                // A hashed block that doesn't inflate isn't the block that was hashed.
+                auto error = m_isHashed ? Error::SignatureInvalid : Error::InflateCorruptData;
+                ThrowErrorIf(error, (index == 0), "inflate failed unexpectedly.");
+                m_isChained = true;
+                std::vector<std::uint8_t> window;
+                if (getWindow) { getWindow(window); }
+                else { ReadWindow(index - 1, window); }
+                ThrowErrorIfNot(error, inflater.Inflate(data, DataSize(index), window.data(), window.size(), expected, output),
+                    "inflate failed unexpectedly.");
+            }
+            output.resize(expected);
+            m_file.statistics->bytesInflated.fetch_add(expected, std::memory_order_relaxed);
+            if (m_isChained && index + 1 < m_blocks.size()) { CacheWindow(index, output); }
+        }
+        else if (data != output.data())
+        {   output.assign(data, data + expected);
+        }
+        if (m_isHashed) { VerifyBlock(output.data(), expected, m_blocks[index].hash); }
+        m_file.statistics->bytesDelivered.fetch_add(expected, std::memory_order_relaxed);
+    }
+
+    void BlockReader::ReadWindow(std::size_t index, std::vector<std::uint8_t>& window)
+    {
+        if (GetCachedWindow(index, window)) { return; }
+
+        // Walks back to the nearest block that has the window before it cached, or that inflates on its own, and
+        // decodes forward from there, so that a block that refers back into many others is inflated only once.
+        auto error = m_isHashed ? Error::SignatureInvalid : Error::InflateCorruptData;
+        std::vector<std::uint8_t> data;
+        std::vector<std::uint8_t> output;
+        std::size_t first = index;
+        window.clear();
+        while (!(first > 0 && GetCachedWindow(first - 1, window)))
+        {   ReadData(first, data);
+            if (ThreadInflater().Inflate(data.data(), data.size(), nullptr, 0, BlockSize(first), output)) { break; }
+            ThrowErrorIf(error, (first == 0), "inflate failed unexpectedly.");
+            if (index - first + 1 >= MaxWalkBlocks) { throw Exception(Error::NotSupported, "block refers back too far"); }
+            first--;
+        }
+        for (std::size_t i = first; i <= index; i++)
+        {   ReadData(i, data);
+            DecodeBlock(i, data.data(), output, [&](std::vector<std::uint8_t>& before) { before = window; });
+            TakeWindow(output, window);
+        }
+    }
+
+    bool BlockReader::GetCachedWindow(std::size_t index, std::vector<std::uint8_t>& window)
+    {
+        std::lock_guard<std::mutex> lock(m_windowLock);
+        if (m_windowIndex != index) { return false; }
+        window = m_window;
+        return true;
+    }
+
+    void BlockReader::CacheWindow(std::size_t index, const std::vector<std::uint8_t>& block)
+    {
+        std::lock_guard<std::mutex> lock(m_windowLock);
+        TakeWindow(block, m_window);
+        m_windowIndex = index;
+    }
+
+    void BlockReader::ReadBlock(std::size_t index, std::vector<std::uint8_t>& output)
+    {
+        ThrowErrorIf(Error::InvalidParameter, (index >= m_blocks.size()), "no such block");
+        // a stored block is read straight into output.
+        std::vector<std::uint8_t> input;
+        auto& data = m_file.isCompressed ? input : output;
+        ReadData(index, data);
+        DecodeBlock(index, data.data(), output);
+    }
+
+    std::size_t BlockReader::ReadAt(std::uint64_t offset, void* buffer, std::size_t size)
+    {
+        if (offset >= m_file.uncompressedSize) { return 0; }
+        size = static_cast<std::size_t>(std::min<std::uint64_t>(size, m_file.uncompressedSize - offset));
+        std::vector<std::uint8_t> block;
+        std::size_t total = 0;
+        while (total < size)
+        {
+            std::uint64_t position = offset + total;
+            auto index = static_cast<std::size_t>(position / BLOCKMAP_BLOCK_SIZE);
+            auto positionInBlock = static_cast<std::size_t>(position % BLOCKMAP_BLOCK_SIZE);
+            ReadBlock(index, block);
+            std::size_t count = std::min(size - total, block.size() - positionInBlock);
+            std::memcpy(static_cast<std::uint8_t*>(buffer) + total, block.data() + positionInBlock, count);
+            total += count;
+        }
+        return total;
+    }
+
+    std::vector<BufferPool::Buffer> BlockReader::ReadBlocks(const std::vector<std::size_t>& indices, BlockWorkers& workers)
+    {
+        for (auto index : indices)
+        {   ThrowErrorIf(Error::InvalidParameter, (index >= m_blocks.size()), "no such block");
+        }
+        std::vector<std::size_t> order(indices);
+        std::sort(order.begin(), order.end());
+        order.erase(std::unique(order.begin(), order.end()), order.end());
+
+        // Everything is read before anything is handed to the threads, so that a failed read leaves no task behind.
+        struct Run
+        {
+            std::size_t first;
+            std::size_t last;
+            std::shared_ptr<std::vector<std::uint8_t>> data;
+        };
+        std::vector<Run> runs;
+        for (std::size_t start = 0; start < order.size();)
+        {   std::size_t end = start + 1;
+            while (end < order.size() && order[end] == order[end - 1] + 1 && (end - start) < MaxRunBlocks) { end++; }
+            std::uint64_t offset = m_offsets[order[start]];
+            auto data = std::make_shared<std::vector<std::uint8_t>>(
+                static_cast<std::size_t>(m_offsets[order[end - 1]] + DataSize(order[end - 1]) - offset));
+            m_zip->ReadRawFile(m_file, offset, data->data(), data->size());
+            runs.push_back(Run { order[start], order[end - 1], std::move(data) });
+            start = end;
+        }
+
+        // Each run is decoded front to back, so that a block that refers back into the one before it has that
+        // block's window at hand.  The first block of a run right after another one waits for that run only if it
+        // refers back; the threads take tasks in the order they were submitted, so that run is already being
+        // worked on.
+        auto buffers = workers.Buffers();
+        std::vector<std::shared_future<std::vector<BufferPool::Buffer>>> decoded;
+        for (std::size_t i = 0; i < runs.size(); i++)
+        {   std::shared_future<std::vector<BufferPool::Buffer>> previous;
+            if (i > 0 && runs[i].first == runs[i - 1].last + 1) { previous = decoded.back(); }
+            const auto& run = runs[i];
+            decoded.push_back(workers.Threads().Submit([this, run, previous, buffers]()
+            {   std::vector<BufferPool::Buffer> outputs;
+                for (std::size_t index = run.first; index <= run.last; index++)
+                {   auto output = BufferPool::AcquireOrMake(buffers);
+                    DecodeBlock(index, run.data->data() + (m_offsets[index] - m_offsets[run.first]), *output,
+                        [&](std::vector<std::uint8_t>& window)
+                    {   if (!outputs.empty()) { TakeWindow(*outputs.back(), window); }
+                        else if (previous.valid()) { TakeWindow(*previous.get().back(), window); }
+                        else { ReadWindow(index - 1, window); }
+                    });
+                    outputs.push_back(std::move(output));
+                }
+                return outputs;
+            }).share());
+        }
+
+        // Every task is done with this reader before an error goes back.
+        for (const auto& run : decoded) { run.wait(); }
+        std::map<std::size_t, BufferPool::Buffer> blocks;
+        for (std::size_t i = 0; i < runs.size(); i++)
+        {   const auto& outputs = decoded[i].get();
+            for (std::size_t j = 0; j < outputs.size(); j++) { blocks[runs[i].first + j] = outputs[j]; }
+        }
+        std::vector<BufferPool::Buffer> result;
+        result.reserve(indices.size());
+        for (auto index : indices) { result.push_back(blocks[index]); }
+        return result;
+    }
+}
@@ -0,0 +1,224 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#include "ContentType.hpp"
+#include "XmlObject.hpp"
+#include "VectorStream.hpp"
+#include "Perf.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <map>
+#include <set>
+
+namespace MSIX {
+
+    static const std::map<std::string, std::string> contentTypesByExtension = {
+        { "atom",   "application/atom+xml" },
+        { "appx",   "application/vnd.ms-appx" },
+        { "avi",    "video/avi" },
+        { "bmp",    "image/bmp" },
+        { "css",    "text/css" },
+        { "dll",    "application/x-msdownload" },
+        { "exe",    "application/x-msdownload" },
+        { "gif",    "image/gif" },
+        { "htm",    "text/html" },
+        { "html",   "text/html" },
+        { "ico",    "image/vnd.microsoft.icon" },
+        { "jpeg",   "image/jpeg" },
+        { "jpg",    "image/jpeg" },
+        { "js",     "application/x-javascript" },
+        { "json",   "application/json" },
+        { "mp3",    "audio/mpeg" },
+        { "mp4",    "video/mp4" },
+        { "mpeg",   "video/mpeg" },
+        { "msix",   "application/vnd.ms-appx" },
+        { "pdf",    "application/pdf" },
+        { "png",    "image/png" },
+        { "rtf",    "text/richtext" },
+        { "svg",    "image/svg+xml" },
+        { "tif",    "image/tiff" },
+        { "tiff",   "image/tiff" },
+        { "ttf",    "application/x-font-ttf" },
+        { "txt",    "text/plain" },
+        { "wav",    "audio/wav" },
+        { "wma",    "audio/x-ms-wma" },
+        { "wmv",    "video/x-ms-wmv" },
+        { "woff",   "application/font-woff" },
+        { "xaml",   "application/xaml+xml" },
+        { "xml",    "text/xml" },
+        { "zip",    "application/x-zip-compressed" },
+    };
+
+    static const std::set<std::string> compressedExtensions = {
+        "7z", "appx", "appxbundle", "cab", "flac", "gif", "gz", "jpeg", "jpg", "m4a", "m4v", "mkv", "mov", "mp3",
+        "mp4", "mpeg", "mpg", "msix", "msixbundle", "ogg", "png", "rar", "webm", "webp", "wma", "wmv", "woff", "woff2",
+        "xz", "zip",
+    };
+
+    static const std::set<std::string> compressedContentTypes = {
+        "application/font-woff", "application/vnd.ms-appx", "application/x-zip-compressed", "application/zip",
+        "audio/mpeg", "audio/x-ms-wma", "image/gif", "image/jpeg", "image/png", "image/webp", "video/mp4",
+        "video/mpeg", "video/x-ms-wmv",
+    };
+
+    static std::string ToLower(std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return value;
+    }
+
+    static std::string GetExtension(const std::string& fileName)
+    {
+        auto separator = fileName.find_last_of("/\\.");
+        if (separator != std::string::npos && fileName[separator] == '.') { return ToLower(fileName.substr(separator + 1)); }
+        return std::string();
+    }
+
+    std::string GetContentTypeByExtension(const std::string& fileName)
+    {
+        auto contentType = contentTypesByExtension.find(GetExtension(fileName));
+        if (contentType != contentTypesByExtension.end()) { return contentType->second; }
+        return "application/octet-stream";
+    }
+
+    bool IsCompressedContent(const std::string& fileName, const std::string& contentType)
+    {
+        return (compressedExtensions.find(GetExtension(fileName)) != compressedExtensions.end()) ||
+               (compressedContentTypes.find(ToLower(contentType)) != compressedContentTypes.end());
+    }
+
+    static char LowerAscii(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // FNV-1a of the name in lower case.
+    static std::uint64_t HashName(const char* name, std::size_t size)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (std::size_t i = 0; i < size; i++)
+        {   hash ^= static_cast<std::uint8_t>(LowerAscii(name[i]));
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    static bool IsSameName(const std::string& name, const char* other, std::size_t size)
+    {
+        if (name.size() != size) { return false; }
+        for (std::size_t i = 0; i < size; i++)
+        {   if (LowerAscii(name[i]) != LowerAscii(other[i])) { return false; }
+        }
+        return true;
+    }
+
+    void ContentTypeTable::Table::Build(const std::vector<std::pair<std::string, std::string>>& entries)
+    {
+        std::size_t size = 2;
+        while (size < entries.size() * 2) { size *= 2; }
+        m_slots.assign(size, Slot { 0, std::string(), std::string() });
+        for (const auto& entry : entries)
+        {   if (entry.first.empty() || Find(entry.first.data(), entry.first.size()) != nullptr) { continue; }
+            auto hash = HashName(entry.first.data(), entry.first.size());
+            auto index = static_cast<std::size_t>(hash) & (m_slots.size() - 1);
+            while (!m_slots[index].name.empty()) { index = (index + 1) & (m_slots.size() - 1); }
+            m_slots[index] = Slot { hash, entry.first, entry.second };
+        }
+    }
+
+    const std::string* ContentTypeTable::Table::Find(const char* name, std::size_t size) const
+    {
+        if (m_slots.empty()) { return nullptr; }
+        auto hash = HashName(name, size);
+        for (auto index = static_cast<std::size_t>(hash) & (m_slots.size() - 1); !m_slots[index].name.empty();
+             index = (index + 1) & (m_slots.size() - 1))
+        {   const auto& slot = m_slots[index];
+            if (slot.hash == hash && IsSameName(slot.name, name, size)) { return &slot.contentType; }
+        }
+        return nullptr;
+    }
+
+    ContentTypeTable::ContentTypeTable(IVerifierObject* document)
+    {
+        std::call_once(m_loaded, [&]() { Load(document); });
+    }
+
+    ContentTypeTable::ContentTypeTable(IStream* stream)
+    {
+        LARGE_INTEGER start = {0};
+        ULARGE_INTEGER size = {0};
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &size));
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        ThrowErrorIf(Error::FileRead, (size.QuadPart > std::numeric_limits<ULONG>::max()), "xml file too large");
+        m_document.resize(static_cast<std::size_t>(size.QuadPart));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(stream->Read(m_document.data(), static_cast<ULONG>(m_document.size()), &bytesRead));
+        ThrowErrorIfNot(Error::FileRead, (bytesRead == m_document.size()), "read failed");
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+    }
+
+    const std::string* ContentTypeTable::Find(const std::string& fileName)
+    {
+        std::call_once(m_loaded, [&]() { Load(nullptr); });
+        auto result = m_overrides.Find(fileName.data(), fileName.size());
+        if (result == nullptr)
+        {   auto separator = fileName.find_last_of("/.");
+            if (separator != std::string::npos && fileName[separator] == '.')
+            {   result = m_defaults.Find(fileName.data() + separator + 1, fileName.size() - separator - 1);
+            }
+        }
+        return result;
+    }
+
+    // A document that is loaded later is parsed without its schema, it was validated against it before its digest
+    // went into the index.  Without namespaces, an element's name may come with a prefix.
+    static bool IsElement(XERCES_CPP_NAMESPACE::DOMElement* element, const char* name)
+    {
+        XercesCharPtr nodeName(XERCES_CPP_NAMESPACE::XMLString::transcode(element->getNodeName()));
+        std::string value(nodeName.Get());
+        auto separator = value.find(':');
+        return value.compare((separator == std::string::npos) ? 0 : separator + 1, std::string::npos, name) == 0;
+    }
+
+    static std::string GetAttribute(XERCES_CPP_NAMESPACE::DOMElement* element, const char* name)
+    {
+        XercesXMLChPtr nameAttr(XERCES_CPP_NAMESPACE::XMLString::transcode(name));
+        XercesCharPtr value(XERCES_CPP_NAMESPACE::XMLString::transcode(element->getAttribute(nameAttr.Get())));
+        return std::string(value.Get());
+    }
+
+    void ContentTypeTable::Load(IVerifierObject* document)
+    {
+        ComPtr<IXmlObject> xml;
+        if (document)
+        {   xml = ComPtr<IVerifierObject>(document).As<IXmlObject>();
+        }
+        else
+        {   Global::Perf::Scope scope(Global::Perf::Counter::ContentTypesParse);
+            scope.AddBytes(m_document.size());
+            auto stream = ComPtr<IStream>::Make<VectorStream>(&m_document);
+            xml = ComPtr<IXmlObject>::Make<XmlObject>(stream);
+        }
+
+        std::vector<std::pair<std::string, std::string>> defaults;
+        std::vector<std::pair<std::string, std::string>> overrides;
+        for (auto element = xml->Document()->getDocumentElement()->getFirstElementChild(); element != nullptr;
+             element = element->getNextElementSibling())
+        {   if (IsElement(element, "Default"))
+            {   defaults.emplace_back(GetAttribute(element, "Extension"), GetAttribute(element, "ContentType"));
+            }
+            else if (IsElement(element, "Override"))
+            {   auto partName = GetAttribute(element, "PartName");
+                if (!partName.empty() && partName[0] == '/') { partName.erase(0, 1); }
+                overrides.emplace_back(std::move(partName), GetAttribute(element, "ContentType"));
+            }
+        }
+        m_defaults.Build(defaults);
+        m_overrides.Build(overrides);
+        m_document.clear();
+        m_document.shrink_to_fit();
+    }
+} // namespace MSIX
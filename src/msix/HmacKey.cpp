@@ -0,0 +1,217 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "HmacKey.hpp"
+#include "Exceptions.hpp"
+#include "SHA256.hpp"
+
+#include <random>
+
+#ifdef WIN32
+#include "MSIXWindows.hpp"
+#include "UnicodeConversion.hpp"
+#include <memory>
+#include <type_traits>
+#include <aclapi.h>
+#include <sddl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace MSIX {
+
+    static const std::size_t KeySize = HASH_BYTES;
+    static const std::size_t HmacBlockSize = 64;   // of SHA256
+
+    // A key is only made by an exclusive create, with permissions that let nobody but the user who made it read
+    // it, and one that others can read, or that belongs to someone else, is refused rather than used.
+    #ifdef WIN32
+    // Full control for the owner, the system and administrators, and nothing inherited from the directory.
+    static const wchar_t* KeySecurityDescriptor = L"D:P(A;;FA;;;OW)(A;;FA;;;SY)(A;;FA;;;BA)";
+
+    using Handle = std::unique_ptr<std::remove_pointer<HANDLE>::type, decltype(&::CloseHandle)>;
+    using LocalMemory = std::unique_ptr<void, decltype(&::LocalFree)>;
+
+    static bool IsWellKnownSid(PSID sid, std::initializer_list<WELL_KNOWN_SID_TYPE> types)
+    {
+        for (auto type : types)
+        {   BYTE buffer[SECURITY_MAX_SID_SIZE];
+            DWORD size = sizeof(buffer);
+            if (CreateWellKnownSid(type, nullptr, buffer, &size) && EqualSid(sid, buffer)) { return true; }
+        }
+        return false;
+    }
+
+    // Owned by the user this process runs as, and nobody but that user, the system and administrators may read it.
+    static bool IsPrivate(HANDLE file)
+    {
+        HANDLE tokenHandle = nullptr;
+        ThrowWin32ErrorIfNot(GetLastError(), OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &tokenHandle), "OpenProcessToken");
+        Handle token(tokenHandle, &CloseHandle);
+        DWORD size = 0;
+        GetTokenInformation(token.get(), TokenUser, nullptr, 0, &size);
+        std::vector<std::uint8_t> tokenUser(size);
+        ThrowWin32ErrorIfNot(GetLastError(), GetTokenInformation(token.get(), TokenUser, tokenUser.data(), size, &size), "GetTokenInformation");
+        PSID user = reinterpret_cast<TOKEN_USER*>(tokenUser.data())->User.Sid;
+
+        PSID owner = nullptr;
+        PACL dacl = nullptr;
+        PSECURITY_DESCRIPTOR descriptor = nullptr;
+        auto result = GetSecurityInfo(file, SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION,
+            &owner, nullptr, &dacl, nullptr, &descriptor);
+        ThrowWin32ErrorIfNot(result, (result == ERROR_SUCCESS), "GetSecurityInfo");
+        LocalMemory descriptorMemory(descriptor, &LocalFree);
+        if (owner == nullptr || !EqualSid(owner, user) || dacl == nullptr) { return false; }
+        for (DWORD index = 0; index < dacl->AceCount; index++)
+        {
+            ACE_HEADER* ace = nullptr;
+            ThrowWin32ErrorIfNot(GetLastError(), GetAce(dacl, index, reinterpret_cast<void**>(&ace)), "GetAce");
+            if (ace->AceType != ACCESS_ALLOWED_ACE_TYPE) { continue; }
+            auto allowed = reinterpret_cast<ACCESS_ALLOWED_ACE*>(ace);
+            if ((allowed->Mask & (FILE_READ_DATA | GENERIC_READ | GENERIC_ALL)) == 0) { continue; }
+            PSID sid = &allowed->SidStart;
+            if (!EqualSid(sid, user) && !IsWellKnownSid(sid, { WinCreatorOwnerRightsSid, WinLocalSystemSid, WinBuiltinAdministratorsSid }))
+            {   return false;
+            }
+        }
+        return true;
+    }
+
+    static bool ReadKey(const std::string& path, std::vector<std::uint8_t>& key)
+    {
+        Handle file(CreateFile(utf8_to_utf16(path).c_str(), GENERIC_READ | READ_CONTROL, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OPEN_REPARSE_POINT, nullptr), &CloseHandle);
+        if (file.get() == INVALID_HANDLE_VALUE)
+        {   auto lastError = GetLastError();
+            ThrowWin32ErrorIfNot(lastError, (lastError == ERROR_FILE_NOT_FOUND), path.c_str());
+            return false;
+        }
+        ThrowErrorIfNot(Error::FileOpen, IsPrivate(file.get()), "key can be read by other users, or belongs to another");
+        key.resize(KeySize);
+        DWORD bytesRead = 0;
+        std::uint8_t extra = 0;
+        return ReadFile(file.get(), key.data(), static_cast<DWORD>(key.size()), &bytesRead, nullptr) && bytesRead == key.size() &&
+            ReadFile(file.get(), &extra, 1, &bytesRead, nullptr) && bytesRead == 0;
+    }
+
+    // Returns false when the key is already there.
+    static bool CreateKey(const std::string& path, const std::vector<std::uint8_t>& key)
+    {
+        PSECURITY_DESCRIPTOR descriptor = nullptr;
+        ThrowWin32ErrorIfNot(GetLastError(), ConvertStringSecurityDescriptorToSecurityDescriptor(
+            KeySecurityDescriptor, SDDL_REVISION_1, &descriptor, nullptr), "ConvertStringSecurityDescriptorToSecurityDescriptor");
+        LocalMemory descriptorMemory(descriptor, &LocalFree);
+        SECURITY_ATTRIBUTES attributes = { sizeof(SECURITY_ATTRIBUTES), descriptor, FALSE };
+        std::wstring name = utf8_to_utf16(path);
+        Handle file(CreateFile(name.c_str(), GENERIC_WRITE, 0, &attributes, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr), &CloseHandle);
+        if (file.get() == INVALID_HANDLE_VALUE)
+        {   auto lastError = GetLastError();
+            ThrowWin32ErrorIfNot(lastError, (lastError == ERROR_FILE_EXISTS), path.c_str());
+            return false;
+        }
+        DWORD bytesWritten = 0;
+        bool isWritten = WriteFile(file.get(), key.data(), static_cast<DWORD>(key.size()), &bytesWritten, nullptr) && bytesWritten == key.size();
+        isWritten = CloseHandle(file.release()) && isWritten;
+        if (!isWritten) { DeleteFile(name.c_str()); }
+        ThrowErrorIfNot(Error::FileWrite, isWritten, "key not written");
+        return true;
+    }
+    #else
+    // Owned by the user this process runs as, and no permissions for the group or others.
+    static bool IsPrivate(int fd)
+    {
+        struct stat status;
+        return fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && status.st_uid == geteuid() &&
+            (status.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+    }
+
+    static bool ReadKey(const std::string& path, std::vector<std::uint8_t>& key)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd == -1)
+        {   ThrowErrorIf(Error::FileOpen, (errno != ENOENT), path.c_str());
+            return false;
+        }
+        bool isPrivate = IsPrivate(fd);
+        key.resize(KeySize);
+        std::size_t total = 0;
+        while (isPrivate && total < key.size())
+        {   auto count = read(fd, key.data() + total, key.size() - total);
+            if (count == -1 && errno == EINTR) { continue; }
+            if (count <= 0) { break; }
+            total += static_cast<std::size_t>(count);
+        }
+        std::uint8_t extra = 0;
+        bool isRead = isPrivate && total == key.size() && read(fd, &extra, 1) == 0;
+        close(fd);
+        ThrowErrorIfNot(Error::FileOpen, isPrivate, "key can be read by other users, or belongs to another");
+        return isRead;
+    }
+
+    // Returns false when the key is already there.  The mode is only ever narrowed by the umask.
+    static bool CreateKey(const std::string& path, const std::vector<std::uint8_t>& key)
+    {
+        int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC | O_NOFOLLOW, S_IRUSR | S_IWUSR);
+        if (fd == -1)
+        {   ThrowErrorIf(Error::FileWrite, (errno != EEXIST), path.c_str());
+            return false;
+        }
+        std::size_t total = 0;
+        while (total < key.size())
+        {   auto count = write(fd, key.data() + total, key.size() - total);
+            if (count == -1 && errno == EINTR) { continue; }
+            if (count <= 0) { break; }
+            total += static_cast<std::size_t>(count);
+        }
+        bool isWritten = (close(fd) == 0) && total == key.size();
+        if (!isWritten) { unlink(path.c_str()); }
+        ThrowErrorIfNot(Error::FileWrite, isWritten, "key not written");
+        return true;
+    }
+    #endif
+
+    HmacKey::HmacKey(const std::string& path)
+    {
+        if (ReadKey(path, m_key)) { return; }
+
+        std::random_device random;
+        m_key.resize(KeySize);
+        for (auto& byte : m_key) { byte = static_cast<std::uint8_t>(random()); }
+        // Only one of the processes that start on a new directory at the same time gets to make the key.
+        if (CreateKey(path, m_key)) { return; }
+        ThrowErrorIfNot(Error::FileOpen, ReadKey(path, m_key), "key can't be read");
+    }
+
+    std::vector<std::uint8_t> HmacKey::GetMac(const std::uint8_t* data, std::size_t size)
+    {
+        std::vector<std::uint8_t> inner(HmacBlockSize, 0x36);
+        std::vector<std::uint8_t> outer(HmacBlockSize, 0x5c);
+        for (std::size_t i = 0; i < m_key.size(); i++)
+        {   inner[i] ^= m_key[i];
+            outer[i] ^= m_key[i];
+        }
+        std::vector<std::uint8_t> digest;
+        SHA256 innerHash;
+        innerHash.HashData(inner.data(), inner.size());
+        innerHash.HashData(data, size);
+        innerHash.FinalizeAndGetHashValue(digest);
+        ThrowErrorIfNot(Error::Unexpected, (digest.size() == HASH_BYTES), "unexpected digest size");
+        SHA256 outerHash;
+        outerHash.HashData(outer.data(), outer.size());
+        outerHash.HashData(digest.data(), digest.size());
+        outerHash.FinalizeAndGetHashValue(digest);
+        return digest;
+    }
+
+    bool HmacKey::IsEqual(const std::uint8_t* a, const std::uint8_t* b, std::size_t size)
+    {
+        std::uint8_t difference = 0;
+        for (std::size_t i = 0; i < size; i++) { difference |= a[i] ^ b[i]; }
+        return difference == 0;
+    }
+}
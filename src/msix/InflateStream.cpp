@@ -7,6 +7,7 @@
 #include "ZipFileStream.hpp"
 #include "InflateStream.hpp"
 #include "StreamBase.hpp"
+#include "Perf.hpp"
 
 #include <cassert>
 #include <algorithm>
@@ -14,11 +15,13 @@
 
 namespace MSIX {
     InflateStream::InflateStream(
-        IStream* stream, std::uint64_t uncompressedSize
+        IStream* stream, std::uint64_t uncompressedSize, std::shared_ptr<ReadStatistics> statistics
     ) : m_stream(stream),
         m_state(State::UNINITIALIZED),
-        m_uncompressedSize(uncompressedSize)
+        m_uncompressedSize(uncompressedSize),
+        m_statistics(std::move(statistics))
     {
+        Global::Perf::Count(Global::Perf::Counter::StreamAllocation, sizeof(InflateStream));
         m_zstrm = {0};
         m_stateMachine =
         {
@@ -66,7 +69,16 @@ namespace MSIX {
                         ThrowErrorIfNot(Error::InflateCorruptData, false, "inflate failed unexpectedly.");
                     case Z_STREAM_END:
                     default:
+                        ULONGLONG windowStart = m_fileCurrentWindowPositionEnd;
                         m_fileCurrentWindowPositionEnd += (InflateStream::BUFFERSIZE - m_zstrm.avail_out);
+                        if (m_statistics)
+                        {   m_statistics->bytesInflated.fetch_add(m_fileCurrentWindowPositionEnd - windowStart, std::memory_order_relaxed);
+                            if (windowStart < m_inflatedHighWaterMark)
+                            {   m_statistics->bytesReinflated.fetch_add(
+                                    std::min(m_fileCurrentWindowPositionEnd, m_inflatedHighWaterMark) - windowStart, std::memory_order_relaxed);
+                            }
+                        }
+                        m_inflatedHighWaterMark = std::max(m_inflatedHighWaterMark, m_fileCurrentWindowPositionEnd);
                         return std::make_pair(true, State::READY_TO_COPY);
                     }
                 }
@@ -83,21 +95,22 @@ namespace MSIX {
                     // If the end of the current window position is less than the seek position, keep inflating
                     if (m_fileCurrentWindowPositionEnd < m_seekPosition)
                     {
-                        m_fileCurrentPosition += m_zstrm.avail_out;
-                        return std::make_pair(true, (m_zstrm.avail_in == 0) ? State::READY_TO_READ : State::READY_TO_INFLATE);
+                        m_fileCurrentPosition = m_fileCurrentWindowPositionEnd;
+                        return std::make_pair(true, NextInflateState());
                     }
 
                     // now that we're within the window between current file position and seek position
                     // calculate the number of bytes to skip ahead within this window
                     ULONG bytesToSkipInWindow = (ULONG)(m_seekPosition - m_fileCurrentPosition);
                     m_inflateWindowPosition += bytesToSkipInWindow;
+                    m_fileCurrentPosition   += bytesToSkipInWindow;
 
                     // Calculate the difference between the beginning of the window and the seek position.
                     // if there's nothing left in the window to copy, then we need to fetch another window.
                     ULONG bytesRemainingInWindow = (InflateStream::BUFFERSIZE - m_zstrm.avail_out) - m_inflateWindowPosition;
                     if (bytesRemainingInWindow == 0)
                     {
-                        return std::make_pair(true, (m_zstrm.avail_in == 0) ? State::READY_TO_READ : State::READY_TO_INFLATE);
+                        return std::make_pair(true, NextInflateState());
                     }
 
                     ULONG bytesToCopy = std::min(countBytes, bytesRemainingInWindow);
@@ -129,6 +142,7 @@ namespace MSIX {
     HRESULT InflateStream::Read(void* buffer, ULONG countBytes, ULONG* bytesRead)
     {
         return ResultOf([&]{
+            Global::Perf::Scope scope(Global::Perf::Counter::Inflate);
             m_bytesRead = 0;
             m_startCurrentBuffer = reinterpret_cast<std::uint8_t*>(buffer);
             if (m_seekPosition < m_uncompressedSize)
@@ -144,6 +158,7 @@ namespace MSIX {
                 }
             }
             m_startCurrentBuffer = nullptr;
+            scope.AddBytes(m_bytesRead);
             if (bytesRead) { *bytesRead = m_bytesRead; }
         });
     }
@@ -1,34 +1,178 @@
 //
 //  Copyright (C) 2017 Microsoft.  All rights reserved.
 //  See LICENSE file in the project root for full license information.
-// 
+//
 #include "Log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <thread>
 
 namespace MSIX { namespace Global { namespace Log {
 
-static std::string g_content;
+std::atomic<std::uint32_t> g_level(static_cast<std::uint32_t>(Level::Error));
+
+static const std::uint64_t Capacity     = 256;  // entries
+static const std::size_t   MessageWords = 60;   // a message is kept up to 480 bytes long
 
-void Append(const std::string& comment)
+// Every field is a word sized atomic, so that a reader can copy a slot while a writer fills it and find out
+// afterwards, from the sequence, whether what it copied is whole.
+struct Slot
 {
-    if (g_content.empty())
+    std::atomic<std::uint64_t> sequence;        // 2 * ticket + 1 while it is written, 2 * ticket + 2 once it is whole
+    std::atomic<std::uint64_t> levelAndCode;
+    std::atomic<std::uint64_t> timestamp;
+    std::atomic<std::uint64_t> thread;
+    std::atomic<std::uint64_t> size;
+    std::atomic<std::uint64_t> message[MessageWords];
+};
+
+static Slot g_slots[Capacity];
+static std::atomic<std::uint64_t> g_head(0);    // ticket of the next entry
+static std::atomic<std::uint64_t> g_tail(0);    // ticket of the first entry that Text returns
+
+// Only ever read and replaced with atomic_load and atomic_exchange.  Every call holds a reference to the sink it
+// calls, so that SetSink can tell when the calls to the sink it replaced are done.
+static std::shared_ptr<const Sink> g_sink;
+static thread_local bool t_inSink = false;
+
+static std::uint64_t Now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void SetLevel(Level level)
+{
+    g_level.store(static_cast<std::uint32_t>(level), std::memory_order_relaxed);
+}
+
+void Append(Level level, std::uint32_t code, const std::string& message)
+{
+    if (!IsEnabled(level)) { return; }
+    std::uint64_t timestamp = Now();
+    std::uint64_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    // Staged, so that the message goes into the slot a word at a time.
+    static thread_local std::uint64_t staged[MessageWords];
+    std::size_t size = std::min(message.size(), sizeof(staged));
+    std::memcpy(staged, message.data(), size);
+
+    std::uint64_t ticket = g_head.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = g_slots[ticket % Capacity];
+    std::uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    // Rather than wait for a writer that is still in the slot, or that already lapped this one, drop the entry.
+    if (!(sequence & 1) && sequence < 2 * ticket + 1 &&
+        slot.sequence.compare_exchange_strong(sequence, 2 * ticket + 1, std::memory_order_relaxed))
     {
-        g_content = comment;
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.levelAndCode.store((static_cast<std::uint64_t>(level) << 32) | code, std::memory_order_relaxed);
+        slot.timestamp.store(timestamp, std::memory_order_relaxed);
+        slot.thread.store(thread, std::memory_order_relaxed);
+        slot.size.store(size, std::memory_order_relaxed);
+        for (std::size_t word = 0; word < (size + 7) / 8; word++)
+        {   slot.message[word].store(staged[word], std::memory_order_relaxed);
+        }
+        slot.sequence.store(2 * ticket + 2, std::memory_order_release);
     }
-    else
-    {
-        g_content = g_content + "\n" + comment;
+
+    if (t_inSink) { return; }
+    auto sink = std::atomic_load_explicit(&g_sink, std::memory_order_acquire);
+    if (sink)
+    {   t_inSink = true;
+        try { (*sink)(Entry { level, code, timestamp, thread, message }); } catch (...) {}
+        t_inSink = false;
+    }
+}
+
+// Copies the entry with ticket out of its slot, unless it was overwritten or isn't whole yet.
+static bool Read(std::uint64_t ticket, Entry& entry)
+{
+    const auto& slot = g_slots[ticket % Capacity];
+    std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * ticket + 2) { return false; }
+    std::uint64_t levelAndCode = slot.levelAndCode.load(std::memory_order_relaxed);
+    entry.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+    entry.thread = slot.thread.load(std::memory_order_relaxed);
+    auto size = static_cast<std::size_t>(std::min<std::uint64_t>(slot.size.load(std::memory_order_relaxed), MessageWords * 8));
+    std::uint64_t words[MessageWords];
+    for (std::size_t word = 0; word < (size + 7) / 8; word++)
+    {   words[word] = slot.message[word].load(std::memory_order_relaxed);
     }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence) { return false; }
+    entry.level = static_cast<Level>(levelAndCode >> 32);
+    entry.code = static_cast<std::uint32_t>(levelAndCode);
+    entry.message.assign(reinterpret_cast<const char*>(words), size);
+    return true;
 }
 
-const std::string& Text()
+static std::vector<Entry> Entries(std::uint64_t& head)
 {
-    return g_content;
+    head = g_head.load(std::memory_order_acquire);
+    std::uint64_t first = std::max(g_tail.load(std::memory_order_acquire), (head > Capacity) ? head - Capacity : 0);
+    std::vector<Entry> result;
+    Entry entry;
+    for (std::uint64_t ticket = first; ticket < head; ticket++)
+    {   if (Read(ticket, entry)) { result.push_back(entry); }
+    }
+    return result;
+}
+
+static std::string Text(const std::vector<Entry>& entries)
+{
+    std::string text;
+    for (const auto& entry : entries)
+    {   if (!text.empty()) { text += "\n"; }
+        text += entry.message;
+    }
+    return text;
+}
+
+std::vector<Entry> Entries()
+{
+    std::uint64_t head = 0;
+    return Entries(head);
+}
+
+std::string Text()
+{
+    return Text(Entries());
+}
+
+// Only ever moves forward, another thread might have moved it further already.
+static void MoveTail(std::uint64_t head)
+{
+    std::uint64_t tail = g_tail.load(std::memory_order_relaxed);
+    while (tail < head && !g_tail.compare_exchange_weak(tail, head, std::memory_order_release)) {}
+}
+
+std::string Take()
+{
+    std::uint64_t head = 0;
+    auto entries = Entries(head);
+    MoveTail(head);
+    return Text(entries);
 }
 
 void Clear()
 {
-    g_content.clear();
+    MoveTail(g_head.load(std::memory_order_acquire));
+}
+
+void SetSink(Sink sink)
+{
+    std::shared_ptr<const Sink> replacement;
+    if (sink) { replacement = std::make_shared<const Sink>(std::move(sink)); }
+    auto replaced = std::atomic_exchange_explicit(&g_sink, replacement, std::memory_order_acq_rel);
+    // The calls that are still in the replaced sink, on other threads, hold the only other references to it.  One
+    // in it on this thread would never return while this waits, so it is left to free the sink once it does.
+    if (!t_inSink)
+    {   while (replaced.use_count() > 1) { std::this_thread::yield(); }
+    }
 }
 
 } /* log */ } /* Global */ } /* msix */
\ No newline at end of file
@@ -7,23 +7,192 @@
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
 #include "DirectoryObject.hpp"
+#include "ThreadPool.hpp"
+#include "Perf.hpp"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
 #include <fts.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+
 namespace MSIX {
     
+    // A file in the directory that only holds a descriptor while it is being read, so that a caller can
+    // keep thousands of them around.  The descriptor is opened on first use and closed again at the end
+    // of the file, and reads go straight to pread without any buffering of our own.
+    class DirectoryFileStream : public StreamBase
+    {
+    public:
+        DirectoryFileStream(std::string path) : m_path(std::move(path)) {}
+        ~DirectoryFileStream() { Close(); }
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) override
+        {
+            return ResultOf([&] {
+                Global::Perf::Count(Global::Perf::Counter::StreamSeek);
+                std::int64_t position = 0;
+                switch (origin)
+                {
+                case Reference::START:   position = move.QuadPart; break;
+                case Reference::CURRENT: position = static_cast<std::int64_t>(m_offset) + move.QuadPart; break;
+                case Reference::END:     position = static_cast<std::int64_t>(GetFileSize()) + move.QuadPart; break;
+                default: throw Exception(Error::InvalidParameter, "unknown seek origin");
+                }
+                ThrowErrorIf(Error::FileSeekOutOfRange, (position < 0), "seek before start of file");
+                m_offset = static_cast<std::uint64_t>(position);
+                if (newPosition) { newPosition->QuadPart = m_offset; }
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) override
+        {
+            if (bytesRead) { *bytesRead = 0; }
+            return ResultOf([&] {
+                Global::Perf::Scope scope(Global::Perf::Counter::StreamRead);
+                Open();
+                ULONG result = 0;
+                while (result < countBytes)
+                {
+                    auto count = pread(m_fd, static_cast<std::uint8_t*>(buffer) + result, countBytes - result, static_cast<off_t>(m_offset));
+                    if (count == -1 && errno == EINTR) { continue; }
+                    ThrowErrorIf(Error::FileRead, (count == -1), m_path.c_str());
+                    if (count == 0) { break; }
+                    result += static_cast<ULONG>(count);
+                    m_offset += static_cast<std::uint64_t>(count);
+                }
+                // Nothing more to read, give the descriptor back until we're asked for more.
+                if (result < countBytes) { Close(); }
+                scope.AddBytes(result);
+                if (bytesRead) { *bytesRead = result; }
+            });
+        }
+
+        HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) override
+        {
+            return ResultOf([&] {
+                ThrowErrorIf(Error::InvalidParameter, (size == nullptr), "bad pointer");
+                *size = GetFileSize();
+            });
+        }
+
+    protected:
+        void Open()
+        {
+            if (m_fd != -1) { return; }
+            m_fd = open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+            ThrowErrorIf(Error::FileOpen, (m_fd == -1), m_path.c_str());
+            #ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            #endif
+        }
+
+        void Close()
+        {
+            if (m_fd != -1)
+            {   close(m_fd);
+                m_fd = -1;
+            }
+        }
+
+        std::uint64_t GetFileSize()
+        {
+            struct stat status;
+            ThrowErrorIf(Error::FileOpen, (stat(m_path.c_str(), &status) == -1), m_path.c_str());
+            return static_cast<std::uint64_t>(status.st_size);
+        }
+
+        std::string   m_path;
+        std::uint64_t m_offset = 0;
+        int           m_fd = -1;
+    };
+
+    // Walks everything under root/subtree and returns the names of the regular files found, relative to root.
+    // FTS_NOCHDIR keeps the walk from touching the working directory, so several can run at once, and fts only
+    // holds a descriptor for the directory it is reading.  Symbolic links are not followed, as they could lead
+    // out of the tree or around in a cycle, and are left out.
+    static std::vector<std::string> WalkSubtree(const std::string& root, const std::string& subtree)
+    {
+        std::vector<std::string> result;
+        std::string path = root + "/" + subtree;
+        char* paths[] = { const_cast<char*>(path.c_str()), nullptr };
+        std::unique_ptr<FTS, decltype(&fts_close)> fts(fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, nullptr), &fts_close);
+        ThrowErrorIf(Error::FileOpen, (fts.get() == nullptr), path.c_str());
+
+        for (;;)
+        {
+            errno = 0;
+            FTSENT* entry = fts_read(fts.get());
+            if (entry == nullptr) { break; }
+            switch (entry->fts_info)
+            {
+            case FTS_F:
+                result.push_back(std::string(entry->fts_path + root.size() + 1, entry->fts_pathlen - root.size() - 1));
+                break;
+            case FTS_DNR:
+            case FTS_ERR:
+            case FTS_NS:
+                throw Exception(Error::FileRead, entry->fts_path);
+            case FTS_SL:
+            case FTS_SLNONE:
+                break;
+            default:    // directories
+                break;
+            }
+        }
+        ThrowErrorIf(Error::FileRead, (errno != 0), path.c_str());
+        return result;
+    }
+
+    // Each top level directory is walked on its own thread.  The names come back sorted so that the
+    // result does not depend on the order the walks finish in.
     std::vector<std::string> DirectoryObject::GetFileNames(FileNameOptions)
     {
-        // TODO: Implement when standing-up the pack side for test validation purposes
-        throw Exception(Error::NotImplemented);
+        Global::Perf::Scope scope(Global::Perf::Counter::DirectoryEnumerate);
+        auto closeDirectory = [](DIR* directory) { closedir(directory); };
+        std::unique_ptr<DIR, decltype(closeDirectory)> directory(opendir(m_root.c_str()), closeDirectory);
+        ThrowErrorIf(Error::FileOpen, (directory.get() == nullptr), m_root.c_str());
+
+        std::vector<std::string> result;
+        ThreadPool threadPool;
+        std::vector<std::future<std::vector<std::string>>> subtrees;
+        while (struct dirent* entry = readdir(directory.get()))
+        {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") { continue; }
+            struct stat status;
+            std::string path = m_root + "/" + name;
+            // lstat, so that symbolic links at the top are left out as they are further down.
+            ThrowErrorIf(Error::FileOpen, (lstat(path.c_str(), &status) == -1), path.c_str());
+            if (S_ISDIR(status.st_mode))
+            {   subtrees.push_back(threadPool.Submit([this, name]() { return WalkSubtree(m_root, name); }));
+            }
+            else if (S_ISREG(status.st_mode))
+            {   result.push_back(std::move(name));
+            }
+        }
+        for (auto& subtree : subtrees)
+        {   auto names = subtree.get();
+            result.insert(result.end(), std::make_move_iterator(names.begin()), std::make_move_iterator(names.end()));
+        }
+        std::sort(result.begin(), result.end());
+        return result;
     }
     
     IStream* DirectoryObject::GetFile(const std::string& fileName)
     {
-        // TODO: Implement when standing-up the pack side for test validation purposes
-        throw Exception(Error::NotImplemented);
+        auto stream = m_streams.find(fileName);
+        if (stream != m_streams.end()) { return stream->second.Get(); }
+        std::string path = m_root + "/" + fileName;
+        struct stat status;
+        ThrowErrorIf(Error::FileNotFound, (stat(path.c_str(), &status) == -1 || !S_ISREG(status.st_mode)), path.c_str());
+        auto result = m_streams[fileName] = ComPtr<IStream>::Make<DirectoryFileStream>(std::move(path));
+        return result.Get();
     }
     
     void DirectoryObject::RemoveFile(const std::string& fileName)
@@ -51,6 +220,19 @@ namespace MSIX {
         }
     }
     
+    ComPtr<IDirectoryObject> DirectoryObject::CreateUnique(const std::string& prefix)
+    {
+        auto lastSlash = prefix.find_last_of("/");
+        if (lastSlash != std::string::npos && lastSlash != 0)
+        {   std::string parent = prefix.substr(0, lastSlash);
+            mkdirp(parent);
+        }
+        // mkdtemp fails rather than open a directory that already exists.
+        std::string path = prefix + "XXXXXX";
+        ThrowErrorIf(Error::FileCreateDirectory, (mkdtemp(&path[0]) == nullptr), path.c_str());
+        return ComPtr<IDirectoryObject>::Make<DirectoryObject>(std::move(path));
+    }
+
     IStream* DirectoryObject::OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode)
     {
         std::string name = m_root + "/" + fileName;
@@ -61,6 +243,49 @@ namespace MSIX {
         return result.Get();
     }
     
+    void DirectoryObject::MoveFileFrom(IDirectoryObject* from, const std::string& fromName, const std::string& toName)
+    {
+        std::string source = from->GetRoot() + "/" + fromName;
+        std::string target = m_root + "/" + toName;
+        std::string path = target.substr(0, target.find_last_of("/"));
+        mkdirp(path);
+        m_streams.erase(toName);
+        ThrowErrorIf(Error::FileWrite, (rename(source.c_str(), target.c_str()) == -1), target.c_str());
+    }
+
+    void DirectoryObject::RemoveAll()
+    {
+        struct stat status;
+        if (stat(m_root.c_str(), &status) == -1 && errno == ENOENT) { return; }
+        m_streams.clear();
+
+        char* paths[] = { const_cast<char*>(m_root.c_str()), nullptr };
+        std::unique_ptr<FTS, decltype(&fts_close)> fts(fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, nullptr), &fts_close);
+        ThrowErrorIf(Error::FileOpen, (fts.get() == nullptr), m_root.c_str());
+        for (;;)
+        {
+            errno = 0;
+            FTSENT* entry = fts_read(fts.get());
+            if (entry == nullptr) { break; }
+            switch (entry->fts_info)
+            {
+            case FTS_D:     // directories are removed on the way back up, once they are empty
+                break;
+            case FTS_DP:
+                ThrowErrorIf(Error::FileWrite, (rmdir(entry->fts_accpath) == -1), entry->fts_path);
+                break;
+            case FTS_DNR:
+            case FTS_ERR:
+            case FTS_NS:
+                throw Exception(Error::FileRead, entry->fts_path);
+            default:
+                ThrowErrorIf(Error::FileWrite, (unlink(entry->fts_accpath) == -1), entry->fts_path);
+                break;
+            }
+        }
+        ThrowErrorIf(Error::FileRead, (errno != 0), m_root.c_str());
+    }
+
     void DirectoryObject::CommitChanges()
     {
         m_streams.clear();
@@ -0,0 +1,148 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+// ONLY build on platforms other than Win32
+#ifndef WIN32
+#include "Exceptions.hpp"
+#include "FileCopy.hpp"
+#include "Perf.hpp"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <limits>
+
+namespace MSIX {
+
+    // Keeps a single call from running for too long, and within what ssize_t can report back.
+    static const std::uint64_t MaxCopySize = 0x40000000; // 1GB
+
+    std::unique_ptr<FileView> FileView::Map(FILE* file, std::uint64_t offset, std::uint64_t size)
+    {
+        auto pageSize = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+        std::uint64_t start = offset - (offset % pageSize);
+        std::uint64_t length = size + (offset - start);
+        if (size == 0 || length > std::numeric_limits<std::size_t>::max() / 2) { return nullptr; }
+        // Touching a page past the end of the file raises SIGBUS instead of failing a read, leave a file that is
+        // already too short to the callers' streams, which report it.
+        struct stat info;
+        if (fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode) || static_cast<std::uint64_t>(info.st_size) < offset + size)
+        {   return nullptr;
+        }
+        void* address = mmap(nullptr, static_cast<std::size_t>(length), PROT_READ, MAP_SHARED, fileno(file), static_cast<off_t>(start));
+        if (address == MAP_FAILED) { return nullptr; }
+        posix_madvise(address, static_cast<std::size_t>(length), POSIX_MADV_SEQUENTIAL);
+
+        std::unique_ptr<FileView> result(new FileView());
+        result->m_address = address;
+        result->m_length = static_cast<std::size_t>(length);
+        result->m_data = static_cast<const std::uint8_t*>(address) + (offset - start);
+        return result;
+    }
+
+    FileView::~FileView()
+    {
+        if (m_address) { munmap(m_address, m_length); }
+    }
+
+    bool GetFileIdentity(FILE* file, FileIdentity& identity)
+    {
+        struct stat info;
+        if (fstat(fileno(file), &info) != 0 || !S_ISREG(info.st_mode)) { return false; }
+        identity.device = static_cast<std::uint64_t>(info.st_dev);
+        identity.inode  = static_cast<std::uint64_t>(info.st_ino);
+        identity.size   = static_cast<std::uint64_t>(info.st_size);
+        #ifdef __APPLE__
+        const auto& modified = info.st_mtimespec;
+        #else
+        const auto& modified = info.st_mtim;
+        #endif
+        identity.modified = static_cast<std::uint64_t>(modified.tv_sec) * 1000000000 + static_cast<std::uint64_t>(modified.tv_nsec);
+        return true;
+    }
+
+    bool CopyFileRange(FILE* source, std::uint64_t offset, FILE* target, std::uint64_t size)
+    {
+        #ifdef __linux__
+        ThrowErrorIf(Error::FileWrite, (std::fflush(target) != 0), "flush failed");
+        int in = fileno(source);
+        int out = fileno(target);
+        off_t position = lseek(out, 0, SEEK_CUR);
+        ThrowErrorIf(Error::FileSeek, (position == -1), "seek failed");
+
+        Global::Perf::Scope scope(Global::Perf::Counter::FileCopyRange);
+        off_t from = static_cast<off_t>(offset);
+        off_t to = position;
+        std::uint64_t copied = 0;
+        // copy_file_range can share the extents on file systems that support it, sendfile at least keeps the
+        // copy in the kernel.  Both turn some combinations of file systems and kernel versions down.
+        #ifdef SYS_copy_file_range
+        bool useCopyFileRange = true;
+        #else
+        bool useCopyFileRange = false;
+        #endif
+        while (copied < size)
+        {
+            auto count = static_cast<std::size_t>(std::min(size - copied, MaxCopySize));
+            ssize_t result = -1;
+            #ifdef SYS_copy_file_range
+            if (useCopyFileRange) { result = syscall(SYS_copy_file_range, in, &from, out, &to, count, 0); }
+            else
+            #endif
+            {   result = sendfile(out, in, &from, count);
+            }
+
+            if (result == -1 && errno == EINTR) { continue; }
+            if (result == -1 && copied == 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+            {   if (!useCopyFileRange) { return false; }
+                useCopyFileRange = false;
+                continue;
+            }
+            ThrowErrorIf(Error::FileWrite, (result == -1), "copy failed");
+            ThrowErrorIf(Error::FileRead, (result == 0), "source file truncated");
+            copied += static_cast<std::uint64_t>(result);
+            if (!useCopyFileRange) { to += static_cast<off_t>(result); }
+        }
+        // copy_file_range leaves the file offset alone and sendfile moves the descriptor's offset under stdio,
+        // put the stream after what was copied either way.
+        ThrowErrorIf(Error::FileSeek, (fseeko(target, to, SEEK_SET) != 0), "seek failed");
+        scope.AddBytes(size);
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    bool ReadFileAt(FILE* file, std::uint64_t offset, void* buffer, std::size_t size)
+    {
+        int in = fileno(file);
+        std::size_t total = 0;
+        while (total < size)
+        {
+            auto count = static_cast<std::size_t>(std::min<std::uint64_t>(size - total, MaxCopySize));
+            ssize_t result = pread(in, static_cast<std::uint8_t*>(buffer) + total, count, static_cast<off_t>(offset + total));
+            if (result == -1 && errno == EINTR) { continue; }
+            ThrowErrorIf(Error::FileRead, (result == -1), "read failed");
+            ThrowErrorIf(Error::FileRead, (result == 0), "file truncated");
+            total += static_cast<std::size_t>(result);
+        }
+        return true;
+    }
+
+    void TruncateFile(FILE* file, std::uint64_t size)
+    {
+        ThrowErrorIf(Error::FileWrite, (std::fflush(file) != 0), "flush failed");
+        int result = 0;
+        do { result = ftruncate(fileno(file), static_cast<off_t>(size)); } while (result == -1 && errno == EINTR);
+        ThrowErrorIf(Error::FileWrite, (result == -1), "truncate failed");
+    }
+}
+#endif
@@ -8,12 +8,14 @@
 #include "DirectoryObject.hpp"
 #include "FileStream.hpp"
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <locale>
 #include <codecvt>
+#include <random>
 #include "MSIXWindows.hpp"
 #include "UnicodeConversion.hpp"
 
@@ -118,7 +120,8 @@ namespace MSIX {
         throw Exception(Error::NotImplemented);
     }
 
-    IStream* DirectoryObject::OpenFile(const std::string& fileName, FileStream::Mode mode)
+    // Creates the directories on the way to a file and returns the file's full path.
+    static std::string CreateParentDirectories(const std::string& root, const std::string& fileName)
     {
         std::vector<std::string> directories;
         auto PopFirst = [&directories]()
@@ -145,10 +148,10 @@ namespace MSIX {
 
         // Enforce that directory structure exists before creating file at specified location.
         bool found = false;
-        std::string path = m_root;
+        std::string path = root;
         while (directories.size() != 0)
         {
-            WalkDirectory<WalkOptions::Directories>(path + GetPathSeparator() + directories.front(), [&](
+            WalkDirectory<WalkOptions::Directories>(path + "\\" + directories.front(), [&](
                 std::string,
                 WalkOptions option,
                 std::string&& name)
@@ -165,21 +168,99 @@ namespace MSIX {
 
             if (!found)
             {
-                std::wstring utf16Name = utf8_to_utf16(path + GetPathSeparator() + directories.front());
+                std::wstring utf16Name = utf8_to_utf16(path + "\\" + directories.front());
                 if (!CreateDirectory(utf16Name.c_str(), nullptr))
                 {
                     auto lastError = GetLastError();
                     ThrowWin32ErrorIfNot(lastError, (lastError == ERROR_ALREADY_EXISTS), "CreateDirectory");
                 }
             }
-            path = path + GetPathSeparator() + PopFirst();
+            path = path + "\\" + PopFirst();
             found = false;
         }
-        name = path + GetPathSeparator() + name;
+        return path + "\\" + name;
+    }
+
+    ComPtr<IDirectoryObject> DirectoryObject::CreateUnique(const std::string& prefix)
+    {
+        std::string name = prefix;
+        std::replace(name.begin(), name.end(), '/', '\\');
+        for (auto separator = name.find('\\', 1); separator != std::string::npos; separator = name.find('\\', separator + 1))
+        {   if (name[separator - 1] == ':' || name[separator - 1] == '\\') { continue; }
+            if (!CreateDirectory(utf8_to_utf16(name.substr(0, separator)).c_str(), nullptr))
+            {   auto lastError = GetLastError();
+                ThrowWin32ErrorIfNot(lastError, (lastError == ERROR_ALREADY_EXISTS), "CreateDirectory");
+            }
+        }
+        // CreateDirectory fails rather than open a directory that already exists, so try another name when it does.
+        std::random_device random;
+        for (int attempt = 0; attempt < 100; attempt++)
+        {
+            std::ostringstream path;
+            path << name << std::hex << random() << random();
+            if (CreateDirectory(utf8_to_utf16(path.str()).c_str(), nullptr))
+            {   return ComPtr<IDirectoryObject>::Make<DirectoryObject>(path.str());
+            }
+            auto lastError = GetLastError();
+            ThrowWin32ErrorIfNot(lastError, (lastError == ERROR_ALREADY_EXISTS), "CreateDirectory");
+        }
+        throw Exception(Error::FileCreateDirectory, "no unique directory name found");
+    }
+
+    IStream* DirectoryObject::OpenFile(const std::string& fileName, FileStream::Mode mode)
+    {
+        auto name = CreateParentDirectories(m_root, fileName);
         auto result = m_streams[fileName] = ComPtr<IStream>::Make<FileStream>(std::move(name), mode);
         return result.Get();
     }
 
+    void DirectoryObject::MoveFileFrom(IDirectoryObject* from, const std::string& fromName, const std::string& toName)
+    {
+        std::string source = from->GetRoot() + "\\" + fromName;
+        std::replace(source.begin(), source.end(), '/', '\\');
+        auto target = CreateParentDirectories(m_root, toName);
+        m_streams.erase(toName);
+        if (!MoveFileEx(utf8_to_utf16(source).c_str(), utf8_to_utf16(target).c_str(), MOVEFILE_REPLACE_EXISTING))
+        {   ThrowWin32ErrorIfNot(GetLastError(), false, "MoveFileEx");
+        }
+    }
+
+    static void RemoveDirectoryTree(const std::wstring& path)
+    {
+        WIN32_FIND_DATA findFileData = {};
+        std::unique_ptr<std::remove_pointer<HANDLE>::type, decltype(&::FindClose)> find(
+            FindFirstFile((path + L"\\*").c_str(), &findFileData),
+            &FindClose);
+        if (INVALID_HANDLE_VALUE == find.get())
+        {   ThrowWin32ErrorIfNot(GetLastError(), false, "FindFirstFile failed.");
+        }
+        do
+        {
+            std::wstring name = findFileData.cFileName;
+            if (name == L"." || name == L"..") { continue; }
+            std::wstring child = path + L"\\" + name;
+            if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {   RemoveDirectoryTree(child);
+            }
+            else if (!DeleteFile(child.c_str()))
+            {   ThrowWin32ErrorIfNot(GetLastError(), false, "DeleteFile");
+            }
+        }
+        while (FindNextFile(find.get(), &findFileData));
+        find.reset();
+        if (!RemoveDirectory(path.c_str()))
+        {   ThrowWin32ErrorIfNot(GetLastError(), false, "RemoveDirectory");
+        }
+    }
+
+    void DirectoryObject::RemoveAll()
+    {
+        m_streams.clear();
+        std::wstring root = utf8_to_utf16(m_root);
+        if (GetFileAttributes(root.c_str()) == INVALID_FILE_ATTRIBUTES) { return; }
+        RemoveDirectoryTree(root);
+    }
+
     void DirectoryObject::CommitChanges()
     {
         m_streams.clear();
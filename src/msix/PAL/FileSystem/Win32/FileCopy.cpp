@@ -0,0 +1,50 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#include "Exceptions.hpp"
+#include "FileCopy.hpp"
+
+#include <io.h>
+
+namespace MSIX {
+
+    // Not implemented on Win32 yet, callers read and write through the streams instead.
+    std::unique_ptr<FileView> FileView::Map(FILE*, std::uint64_t, std::uint64_t)
+    {
+        return nullptr;
+    }
+
+    FileView::~FileView() {}
+
+    bool GetFileIdentity(FILE* file, FileIdentity& identity)
+    {
+        auto handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)));
+        BY_HANDLE_FILE_INFORMATION info;
+        if (handle == INVALID_HANDLE_VALUE || !GetFileInformationByHandle(handle, &info)) { return false; }
+        if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) { return false; }
+        identity.device   = static_cast<std::uint64_t>(info.dwVolumeSerialNumber);
+        identity.inode    = (static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+        identity.size     = (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+        identity.modified = (static_cast<std::uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+        return true;
+    }
+
+    bool CopyFileRange(FILE*, std::uint64_t, FILE*, std::uint64_t)
+    {
+        return false;
+    }
+
+    // ReadFile with an offset still moves the file pointer of a synchronous handle, under the stdio stream that
+    // owns it.  Callers read through the streams, one at a time, instead.
+    bool ReadFileAt(FILE*, std::uint64_t, void*, std::size_t)
+    {
+        return false;
+    }
+
+    void TruncateFile(FILE* file, std::uint64_t size)
+    {
+        ThrowErrorIf(Error::FileWrite, (std::fflush(file) != 0), "flush failed");
+        ThrowErrorIf(Error::FileWrite, (_chsize_s(_fileno(file), static_cast<__int64>(size)) != 0), "truncate failed");
+    }
+}
@@ -4,15 +4,43 @@
 // 
 #include "Exceptions.hpp"
 #include "SHA256.hpp"
+#include "Perf.hpp"
 
 #include "openssl/sha.h"
 
 namespace MSIX {
+    struct SHA256::Context
+    {
+        SHA256_CTX context;
+    };
+
+    SHA256::SHA256() : m_context(std::make_unique<Context>())
+    {
+        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Init(&m_context->context) == 1, "failed computing SHA256 hash");
+    }
+
+    SHA256::~SHA256() {}
+
+    void SHA256::HashData(const std::uint8_t *buffer, std::size_t cbBuffer)
+    {
+        Global::Perf::Scope scope(Global::Perf::Counter::Hash);
+        scope.AddBytes(cbBuffer);
+        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Update(&m_context->context, buffer, cbBuffer) == 1, "failed computing SHA256 hash");
+    }
+
+    void SHA256::FinalizeAndGetHashValue(std::vector<uint8_t>& hash)
+    {
+        hash.resize(SHA256_DIGEST_LENGTH);
+        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Final(hash.data(), &m_context->context) == 1, "failed computing SHA256 hash");
+    }
+
     bool SHA256::ComputeHash(
-        /*in*/ std::uint8_t *buffer, 
-        /*in*/ std::uint32_t cbBuffer, 
+        /*in*/ const std::uint8_t *buffer, 
+        /*in*/ std::size_t cbBuffer, 
         /*inout*/ std::vector<uint8_t>& hash)
     {
+        Global::Perf::Scope scope(Global::Perf::Counter::Hash);
+        scope.AddBytes(cbBuffer);
         hash.resize(SHA256_DIGEST_LENGTH);
         ::SHA256(buffer, cbBuffer, hash.data());
         return true;
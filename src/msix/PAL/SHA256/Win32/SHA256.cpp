@@ -10,7 +10,10 @@
 #include <winerror.h>
 #include "Exceptions.hpp"
 #include "SHA256.hpp"
+#include "Perf.hpp"
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -31,47 +34,49 @@ typedef std::unique_ptr<void, unique_hash_handle_deleter> unique_hash_handle;
 
 namespace MSIX {
 
-    bool SHA256::ComputeHash(std::uint8_t* buffer, std::uint32_t cbBuffer, std::vector<uint8_t>& hash)
+    struct SHA256::Context
+    {
+        unique_alg_handle  algHandle;
+        unique_hash_handle hashHandle;
+        DWORD              hashLength = 0;
+    };
+
+    SHA256::SHA256() : m_context(std::make_unique<Context>())
     {
         NTSTATUS status = STATUS_SUCCESS;
         BCRYPT_HASH_HANDLE hashHandleT;
         BCRYPT_ALG_HANDLE algHandleT;
-        DWORD hashLength = 0;
         DWORD resultLength = 0;
 
         // Open an algorithm handle
-        // This code passes BCRYPT_HASH_REUSABLE_FLAG with BCryptAlgorithmProvider(...) to load a provider which supports reusable hash
         status = BCryptOpenAlgorithmProvider(
             &algHandleT,                // Alg Handle pointer
             BCRYPT_SHA256_ALGORITHM,    // Cryptographic Algorithm name (null terminated unicode string)
             nullptr,                    // Provider name; if null, the default provider is loaded
-            0);                         // Flags; Loads a provider which supports reusable hash
+            0);                         // Flags
 
         if (!NT_SUCCESS(status))
         {   throw MSIX::NtStatusException(status, "failed computing SHA256 hash");
         }
 
-        unique_alg_handle algHandle(algHandleT);
+        m_context->algHandle.reset(algHandleT);
 
         // Obtain the length of the hash
         status = BCryptGetProperty(
-            algHandle.get(),            // Handle to a CNG object
+            m_context->algHandle.get(), // Handle to a CNG object
             BCRYPT_HASH_LENGTH,         // Property name (null terminated unicode string)
-            (PBYTE)&hashLength,         // Address of the output buffer which recieves the property value
-            sizeof(hashLength),         // Size of the buffer in bytes
+            (PBYTE)&m_context->hashLength, // Address of the output buffer which recieves the property value
+            sizeof(m_context->hashLength), // Size of the buffer in bytes
             &resultLength,              // Number of bytes that were copied into the buffer
             0);                         // Flags
 
-        if (!NT_SUCCESS(status) || resultLength != sizeof(hashLength))
+        if (!NT_SUCCESS(status) || resultLength != sizeof(m_context->hashLength))
         {   throw MSIX::NtStatusException(status, "failed computing SHA256 hash");
         }
 
-        // Size the hash buffer appropriately
-        hash.resize(hashLength);
-
         // Create a hash handle
         status = BCryptCreateHash(
-            algHandle.get(),            // Handle to an algorithm provider                 
+            m_context->algHandle.get(), // Handle to an algorithm provider                 
             &hashHandleT,               // A pointer to a hash handle - can be a hash or hmac object
             nullptr,                    // Pointer to the buffer that recieves the hash/hmac object
             0,                          // Size of the buffer in bytes
@@ -83,30 +88,56 @@ namespace MSIX {
         {   throw MSIX::NtStatusException(status, "failed computing SHA256 hash");
         }
 
-        unique_hash_handle hashHandle(hashHandleT);
+        m_context->hashHandle.reset(hashHandleT);
+    }
 
-        // Hash the message(s)
-        status = BCryptHashData(
-            hashHandle.get(),           // Handle to the hash or MAC object
-            (PBYTE)buffer,              // A pointer to a buffer that contains the data to hash
-            cbBuffer,                   // Size of the buffer in bytes
-            0);                         // Flags
+    SHA256::~SHA256() {}
 
-        if (!NT_SUCCESS(status))
-        {   throw MSIX::NtStatusException(status, "failed computing SHA256 hash");
+    void SHA256::HashData(const std::uint8_t* buffer, std::size_t cbBuffer)
+    {
+        Global::Perf::Scope scope(Global::Perf::Counter::Hash);
+        scope.AddBytes(cbBuffer);
+
+        // BCryptHashData takes a ULONG count, so larger buffers go in pieces.
+        while (cbBuffer > 0)
+        {
+            ULONG count = static_cast<ULONG>((std::min<std::size_t>)(cbBuffer, (std::numeric_limits<ULONG>::max)()));
+            NTSTATUS status = BCryptHashData(
+                m_context->hashHandle.get(), // Handle to the hash or MAC object
+                (PBYTE)buffer,              // A pointer to a buffer that contains the data to hash
+                count,                      // Size of the buffer in bytes
+                0);                         // Flags
+
+            if (!NT_SUCCESS(status))
+            {   throw MSIX::NtStatusException(status, "failed computing SHA256 hash");
+            }
+            buffer += count;
+            cbBuffer -= count;
         }
+    }
+
+    void SHA256::FinalizeAndGetHashValue(std::vector<uint8_t>& hash)
+    {
+        // Size the hash buffer appropriately
+        hash.resize(m_context->hashLength);
 
         // Obtain the hash of the message(s) into the hash buffer
-        status = BCryptFinishHash(
-            hashHandle.get(),           // Handle to the hash or MAC object
+        NTSTATUS status = BCryptFinishHash(
+            m_context->hashHandle.get(), // Handle to the hash or MAC object
             hash.data(),                // A pointer to a buffer that receives the hash or MAC value
-            hashLength,                 // Size of the buffer in bytes
+            m_context->hashLength,      // Size of the buffer in bytes
             0);                         // Flags
 
         if (!NT_SUCCESS(status))
         {   throw MSIX::NtStatusException(status, "failed computing SHA256 hash");
         }
+    }
 
+    bool SHA256::ComputeHash(const std::uint8_t* buffer, std::size_t cbBuffer, std::vector<uint8_t>& hash)
+    {
+        SHA256 hasher;
+        hasher.HashData(buffer, cbBuffer);
+        hasher.FinalizeAndGetHashValue(hash);
         return true;
     }
 }
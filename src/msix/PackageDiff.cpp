@@ -0,0 +1,94 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageDiff.hpp"
+#include "StorageObject.hpp"
+
+#include <algorithm>
+
+namespace MSIX {
+
+    static std::uint64_t GetSize(IAppxBlockMapInternal* blockMap, const std::string& name)
+    {
+        UINT64 size = 0;
+        ThrowHrIfFailed(blockMap->GetBlockMapFile(name)->GetUncompressedSize(&size));
+        return size;
+    }
+
+    // Counts the new blocks whose hash is in none of the old blocks, and how much of the package they take.  A block
+    // that is stored rather than deflated has no size in the block map, so it counts as 64KB, or what is left of the
+    // file for the last one.
+    static void CountChangedBlocks(const std::vector<Block>& oldBlocks, const std::vector<Block>& newBlocks, MSIX_FILE_DIFF& diff)
+    {
+        std::vector<std::vector<std::uint8_t>> oldHashes;
+        oldHashes.reserve(oldBlocks.size());
+        for (const auto& block : oldBlocks) { oldHashes.push_back(block.hash); }
+        std::sort(oldHashes.begin(), oldHashes.end());
+
+        diff.blocks = static_cast<UINT32>(newBlocks.size());
+        for (std::size_t i = 0; i < newBlocks.size(); i++)
+        {   if (!std::binary_search(oldHashes.begin(), oldHashes.end(), newBlocks[i].hash))
+            {   diff.changedBlocks++;
+                diff.changedBytes += std::min<std::uint64_t>(newBlocks[i].compressedSize, diff.newSize - i * BLOCKMAP_BLOCK_SIZE);
+            }
+        }
+    }
+
+    PackageDiff::PackageDiff(IAppxBlockMapInternal* oldBlockMap, IAppxBlockMapInternal* newBlockMap)
+    {
+        ComPtr<IAppxBlockMapInternal> oldMap(oldBlockMap);
+        ComPtr<IAppxBlockMapInternal> newMap(newBlockMap);
+        // Both come ordered by name, so one pass over the two finds every file that is only in one of them.
+        auto oldNames = oldMap.As<IStorageObject>()->GetFileNames(FileNameOptions::All);
+        auto newNames = newMap.As<IStorageObject>()->GetFileNames(FileNameOptions::All);
+        auto oldName = oldNames.begin();
+        auto newName = newNames.begin();
+        while (oldName != oldNames.end() || newName != newNames.end())
+        {
+            File file;
+            if (newName == newNames.end() || (oldName != oldNames.end() && *oldName < *newName))
+            {   file.name = *oldName++;
+                file.diff.kind = MSIX_FILE_DIFF_KIND_REMOVED;
+                file.diff.oldSize = GetSize(oldMap.Get(), file.name);
+            }
+            else if (oldName == oldNames.end() || *newName < *oldName)
+            {   file.name = *newName++;
+                file.diff.kind = MSIX_FILE_DIFF_KIND_ADDED;
+                file.diff.newSize = GetSize(newMap.Get(), file.name);
+                CountChangedBlocks(std::vector<Block>(), newMap->GetBlocks(file.name), file.diff);
+            }
+            else
+            {   file.name = *newName++;
+                oldName++;
+                file.diff.kind = MSIX_FILE_DIFF_KIND_CHANGED;
+                file.diff.oldSize = GetSize(oldMap.Get(), file.name);
+                file.diff.newSize = GetSize(newMap.Get(), file.name);
+                if (file.diff.oldSize == file.diff.newSize &&
+                    oldMap->GetFileDigest(file.name) == newMap->GetFileDigest(file.name))
+                {   continue;
+                }
+                CountChangedBlocks(oldMap->GetBlocks(file.name), newMap->GetBlocks(file.name), file.diff);
+            }
+            m_files.push_back(std::move(file));
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE PackageDiff::GetCount(UINT32* count)
+    {
+        return ResultOf([&]{
+            ThrowErrorIfNot(Error::InvalidParameter, (count), "bad pointer");
+            *count = static_cast<UINT32>(m_files.size());
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE PackageDiff::GetFile(UINT32 position, MSIX_FILE_DIFF* file)
+    {
+        return ResultOf([&]{
+            ThrowErrorIfNot(Error::InvalidParameter, (file), "bad pointer");
+            ThrowErrorIf(Error::InvalidParameter, (position >= m_files.size()), "index out of range");
+            *file = m_files[position].diff;
+            file->utf8FileName = m_files[position].name.c_str();
+        });
+    }
+}
@@ -0,0 +1,250 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageIndex.hpp"
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+#include "StreamBase.hpp"
+#include "ZipObject.hpp"
+#include "AppxBlockMapObject.hpp"
+#include "AppxPackageObject.hpp"
+#include "Perf.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <thread>
+
+namespace MSIX {
+
+    static_assert(sizeof(PackageIndex::Header) % 8 == 0, "records must stay 8 byte aligned");
+    static_assert(sizeof(PackageIndex::Entry) % 8 == 0, "records must stay 8 byte aligned");
+    static_assert(sizeof(PackageIndex::BlockMapFile) % 8 == 0, "records must stay 8 byte aligned");
+    static_assert(sizeof(PackageIndex::Block) % 8 == 0, "records must stay 8 byte aligned");
+
+    static FILE* OpenFile(const std::string& path, const char* mode)
+    {
+        FILE* file = nullptr;
+        #ifdef WIN32
+        if (fopen_s(&file, path.c_str(), mode) != 0) { return nullptr; }
+        #else
+        file = std::fopen(path.c_str(), mode);
+        #endif
+        return file;
+    }
+
+    static bool IsSameFile(const FileIdentity& a, const FileIdentity& b)
+    {
+        return a.device == b.device && a.inode == b.inode && a.size == b.size && a.modified == b.modified;
+    }
+
+    // Whether count records of size bytes each fit at offset in an index of fileSize bytes.
+    static bool Fits(std::uint64_t offset, std::uint64_t count, std::uint64_t size, std::uint64_t fileSize)
+    {
+        return offset <= fileSize && count <= (fileSize - offset) / size && (offset % 8) == 0;
+    }
+
+    static std::vector<std::uint8_t> ReadAll(IStream* stream)
+    {
+        LARGE_INTEGER start = {0};
+        ULARGE_INTEGER size = {0};
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &size));
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        std::vector<std::uint8_t> result(static_cast<std::size_t>(size.QuadPart));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(stream->Read(result.data(), static_cast<ULONG>(result.size()), &bytesRead));
+        ThrowErrorIfNot(Error::FileRead, (bytesRead == result.size()), "read failed");
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        return result;
+    }
+
+    static void CopyDigest(std::uint8_t* to, const std::vector<std::uint8_t>& digest)
+    {
+        ThrowErrorIfNot(Error::Unexpected, (digest.size() == HASH_BYTES), "unexpected digest size");
+        std::memcpy(to, digest.data(), HASH_BYTES);
+    }
+
+    std::string PackageIndex::GetPath(const std::string& directory, const FileIdentity& package)
+    {
+        std::ostringstream name;
+        name << directory;
+        if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') { name << '/'; }
+        name << std::hex << std::setfill('0') << std::setw(16) << package.device << "-" << std::setw(16) << package.inode << ".msixindex";
+        return name.str();
+    }
+
+    std::string PackageIndex::GetKeyPath(const std::string& directory)
+    {
+        if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') { return directory + "/index.key"; }
+        return directory + "index.key";
+    }
+
+    // The mac covers everything after itself, which is all of the index but the magic, version and size.
+    static const std::size_t SealedOffset = offsetof(PackageIndex::Header, mac) + HASH_BYTES;
+
+    std::unique_ptr<PackageIndex> PackageIndex::Load(const std::string& path, const FileIdentity& package, HmacKey& key)
+    {
+        Global::Perf::Scope scope(Global::Perf::Counter::IndexLoad);
+        FILE* file = OpenFile(path, "rb");
+        if (file == nullptr) { return nullptr; }
+
+        std::unique_ptr<PackageIndex> result(new PackageIndex());
+        Header header;
+        bool isRead = (std::fread(&header, sizeof(header), 1, file) == 1) &&
+            header.magic == Magic && header.version == Version && IsSameFile(header.package, package) &&
+            header.fileSize >= sizeof(Header) && header.fileSize <= std::numeric_limits<std::size_t>::max() / 2;
+        // A truncated index still has the header of a whole one.
+        isRead = isRead && (std::fseek(file, 0, SEEK_END) == 0) && (static_cast<std::uint64_t>(std::ftell(file)) == header.fileSize);
+        if (isRead)
+        {   result->m_view = FileView::Map(file, 0, header.fileSize);
+            if (result->m_view)
+            {   result->m_data = result->m_view->Data();
+            }
+            else
+            {   result->m_buffer.resize(static_cast<std::size_t>(header.fileSize));
+                std::size_t size = result->m_buffer.size();
+                isRead = (std::fseek(file, 0, SEEK_SET) == 0) && (std::fread(result->m_buffer.data(), 1, size, file) == size);
+                result->m_data = result->m_buffer.data();
+            }
+        }
+        std::fclose(file);
+        if (!isRead) { return nullptr; }
+        scope.AddBytes(header.fileSize);
+        result->m_header = reinterpret_cast<const Header*>(result->m_data);
+
+        auto mac = key.GetMac(result->m_data + SealedOffset, static_cast<std::size_t>(header.fileSize - SealedOffset));
+        if (mac.size() != HASH_BYTES || !HmacKey::IsEqual(mac.data(), header.mac, HASH_BYTES))
+        {   return nullptr;
+        }
+
+        // Everything the records point at has to be in the file, and in the package.
+        if (!Fits(header.entriesOffset, header.entryCount, sizeof(Entry), header.fileSize) ||
+            !Fits(header.blockMapFilesOffset, header.blockMapFileCount, sizeof(BlockMapFile), header.fileSize) ||
+            !Fits(header.blocksOffset, header.blockCount, sizeof(Block), header.fileSize) ||
+            header.namesOffset > header.fileSize || header.namesSize > header.fileSize - header.namesOffset)
+        {   return nullptr;
+        }
+        for (std::uint64_t index = 0; index < header.entryCount; index++)
+        {   const auto& entry = result->GetEntries()[index];
+            if (entry.nameOffset > header.namesSize || entry.nameSize > header.namesSize - entry.nameOffset ||
+                entry.dataOffset > package.size || entry.compressedSize > package.size - entry.dataOffset)
+            {   return nullptr;
+            }
+        }
+        for (std::uint64_t index = 0; index < header.blockMapFileCount; index++)
+        {   const auto& file = result->GetBlockMapFiles()[index];
+            if (file.nameOffset > header.namesSize || file.nameSize > header.namesSize - file.nameOffset ||
+                file.firstBlock > header.blockCount || file.blockCount > header.blockCount - file.firstBlock)
+            {   return nullptr;
+            }
+        }
+        return result;
+    }
+
+    std::unique_ptr<PackageIndex> PackageIndex::Create(const FileIdentity& package, IStorageObject* container, IAppxPackageReader* reader)
+    {
+        ComPtr<IStorageObject> storage(container);
+        auto zip = storage.As<IZipReader>();
+        ComPtr<IAppxBlockMapReader> blockMapReader;
+        ThrowHrIfFailed(reader->GetBlockMap(&blockMapReader));
+        auto blockMap = blockMapReader.As<IStorageObject>();
+        auto blockMapInternal = blockMapReader.As<IAppxBlockMapInternal>();
+
+        std::string names;
+        std::vector<Entry> entries;
+        for (const auto& fileName : container->GetFileNames(FileNameOptions::StorageOrder))
+        {   auto file = zip->GetRawFile(fileName);
+            entries.push_back(Entry { names.size(), static_cast<std::uint32_t>(fileName.size()), file.isCompressed ? 1u : 0u,
+                file.archiveOffset, file.compressedSize, file.uncompressedSize, file.crc, 0 });
+            names += fileName;
+        }
+
+        std::vector<BlockMapFile> blockMapFiles;
+        std::vector<Block> blocks;
+        for (const auto& fileName : blockMap->GetFileNames(FileNameOptions::All))
+        {   auto file = blockMapInternal->GetBlockMapFile(fileName);
+            UINT32 localFileHeaderSize = 0;
+            UINT64 uncompressedSize = 0;
+            ThrowHrIfFailed(file->GetLocalFileHeaderSize(&localFileHeaderSize));
+            ThrowHrIfFailed(file->GetUncompressedSize(&uncompressedSize));
+            const auto& fileBlocks = blockMapInternal->GetBlocks(fileName);
+            blockMapFiles.push_back(BlockMapFile { names.size(), static_cast<std::uint32_t>(fileName.size()), localFileHeaderSize,
+                uncompressedSize, blocks.size(), fileBlocks.size() });
+            names += fileName;
+            for (const auto& block : fileBlocks)
+            {   blocks.push_back(Block { block.compressedSize, {0} });
+                CopyDigest(blocks.back().hash, block.hash);
+            }
+        }
+
+        Header header = {0};
+        header.magic = Magic;
+        header.version = Version;
+        header.package = package;
+        header.entryCount = entries.size();
+        header.entriesOffset = sizeof(Header);
+        header.blockMapFileCount = blockMapFiles.size();
+        header.blockMapFilesOffset = header.entriesOffset + entries.size() * sizeof(Entry);
+        header.blockCount = blocks.size();
+        header.blocksOffset = header.blockMapFilesOffset + blockMapFiles.size() * sizeof(BlockMapFile);
+        header.namesOffset = header.blocksOffset + blocks.size() * sizeof(Block);
+        header.namesSize = names.size();
+        header.fileSize = header.namesOffset + names.size();
+
+        // The package was just validated through these, so they are the digests the next open compares against.
+        std::vector<std::uint8_t> digest;
+        ComPtr<IStream> blockMapStream;
+        ThrowHrIfFailed(blockMapReader->GetStream(&blockMapStream));
+        auto bytes = ReadAll(blockMapStream.Get());
+        ThrowErrorIfNot(Error::Unexpected, SHA256::ComputeHash(bytes.data(), bytes.size(), digest), "hash failed");
+        CopyDigest(header.blockMapDigest, digest);
+        bytes = ReadAll(container->GetFile(CONTENT_TYPES_XML));
+        ThrowErrorIfNot(Error::Unexpected, SHA256::ComputeHash(bytes.data(), bytes.size(), digest), "hash failed");
+        CopyDigest(header.contentTypesDigest, digest);
+
+        std::unique_ptr<PackageIndex> result(new PackageIndex());
+        result->m_buffer.resize(static_cast<std::size_t>(header.fileSize));
+        auto position = result->m_buffer.data() + sizeof(Header);
+        auto Append = [&](const void* data, std::size_t size)
+        {   if (size != 0) { std::memcpy(position, data, size); }
+            position += size;
+        };
+        Append(entries.data(), entries.size() * sizeof(Entry));
+        Append(blockMapFiles.data(), blockMapFiles.size() * sizeof(BlockMapFile));
+        Append(blocks.data(), blocks.size() * sizeof(Block));
+        Append(names.data(), names.size());
+        std::memcpy(result->m_buffer.data(), &header, sizeof(header));
+        result->m_data = result->m_buffer.data();
+        result->m_header = reinterpret_cast<const Header*>(result->m_data);
+        return result;
+    }
+
+    void PackageIndex::Save(const std::string& path, HmacKey& key)
+    {
+        Global::Perf::Scope scope(Global::Perf::Counter::IndexWrite);
+        scope.AddBytes(m_header->fileSize);
+        Header header = *m_header;
+        auto mac = key.GetMac(m_data + SealedOffset, static_cast<std::size_t>(m_header->fileSize - SealedOffset));
+        CopyDigest(header.mac, mac);
+        std::ostringstream temporary;
+        temporary << path << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+        FILE* file = OpenFile(temporary.str(), "wb");
+        ThrowErrorIfNot(Error::FileOpen, (file), temporary.str().c_str());
+        bool isWritten = (std::fwrite(&header, sizeof(header), 1, file) == 1) &&
+            (m_header->fileSize == sizeof(header) ||
+            std::fwrite(m_data + sizeof(header), static_cast<std::size_t>(m_header->fileSize - sizeof(header)), 1, file) == 1);
+        isWritten = (std::fclose(file) == 0) && isWritten;
+        if (isWritten)
+        {   std::remove(path.c_str()); // rename doesn't replace an existing file on Windows
+            isWritten = (std::rename(temporary.str().c_str(), path.c_str()) == 0);
+        }
+        if (!isWritten)
+        {   std::remove(temporary.str().c_str());
+            throw Exception(Error::FileWrite, "index not written");
+        }
+    }
+}
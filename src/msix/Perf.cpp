@@ -0,0 +1,143 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "Perf.hpp"
+
+#include <array>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace MSIX { namespace Global { namespace Perf {
+
+std::atomic<std::uint32_t> g_options(Option::None);
+
+static const char* const g_names[] = {
+    "signature.validate",
+    "contenttypes.parse",
+    "blockmap.parse",
+    "manifest.parse",
+    "centraldirectory.parse",
+    "inflate",
+    "deflate",
+    "hash",
+    "write",
+    "stream.read",
+    "stream.seek",
+    "stream.allocation",
+    "package.read",
+    "package.seek",
+    "package.delivered",
+    "package.reinflated",
+    "directory.enumerate",
+    "pack.storedfile",
+    "pack.storedblock",
+    "pack.copiedfile",
+    "pack.compactedfile",
+    "file.copyrange",
+    "index.load",
+    "index.write",
+    "readercache.hit",
+    "readercache.evict",
+};
+static_assert(sizeof(g_names)/sizeof(g_names[0]) == static_cast<std::size_t>(Counter::Max), "every counter needs a name");
+
+struct AtomicData
+{
+    std::atomic<std::uint64_t> count;
+    std::atomic<std::uint64_t> bytes;
+    std::atomic<std::uint64_t> nanoseconds;
+};
+
+struct TraceEvent
+{
+    Counter       counter;
+    std::uint64_t bytes;
+    std::uint64_t start;        // nanoseconds since the options were set
+    std::uint64_t duration;     // nanoseconds
+    std::size_t   thread;
+};
+
+static std::array<AtomicData, static_cast<std::size_t>(Counter::Max)> g_counters;
+static std::mutex g_traceLock;
+static std::vector<TraceEvent> g_trace;
+static std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+void SetOptions(std::uint32_t options)
+{
+    std::lock_guard<std::mutex> lock(g_traceLock);
+    g_options.store(Option::None);
+    for (auto& counter : g_counters)
+    {
+        counter.count = 0;
+        counter.bytes = 0;
+        counter.nanoseconds = 0;
+    }
+    g_trace.clear();
+    g_epoch = std::chrono::steady_clock::now();
+    g_options.store(options);
+}
+
+const char* Name(Counter counter)
+{
+    return g_names[static_cast<std::size_t>(counter)];
+}
+
+Data Get(Counter counter)
+{
+    const auto& data = g_counters[static_cast<std::size_t>(counter)];
+    return Data { data.count.load(), data.bytes.load(), data.nanoseconds.load() };
+}
+
+void Add(Counter counter, std::uint64_t count, std::uint64_t bytes)
+{
+    auto& data = g_counters[static_cast<std::size_t>(counter)];
+    data.count.fetch_add(count, std::memory_order_relaxed);
+    data.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Record(Counter counter, std::uint64_t bytes, std::chrono::steady_clock::time_point start)
+{
+    auto options = g_options.load(std::memory_order_relaxed);
+    auto& data = g_counters[static_cast<std::size_t>(counter)];
+    data.count.fetch_add(1, std::memory_order_relaxed);
+    data.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (start == std::chrono::steady_clock::time_point()) { return; }
+
+    auto end = std::chrono::steady_clock::now();
+    auto duration = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    data.nanoseconds.fetch_add(duration, std::memory_order_relaxed);
+    if (options & Option::Trace)
+    {
+        std::lock_guard<std::mutex> lock(g_traceLock);
+        if (start < g_epoch) { return; } // started before the trace was reset
+        g_trace.push_back(TraceEvent { counter, bytes,
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - g_epoch).count()),
+            duration,
+            std::hash<std::thread::id>()(std::this_thread::get_id()) });
+    }
+}
+
+std::string TraceText()
+{
+    std::lock_guard<std::mutex> lock(g_traceLock);
+    std::ostringstream text;
+    text << "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto& event : g_trace)
+    {
+        // trace event timestamps are in microseconds.
+        text << (first ? "" : ",") << "\n{\"name\":\"" << Name(event.counter) << "\",\"cat\":\"msix\",\"ph\":\"X\""
+             << ",\"ts\":" << (event.start / 1000) << "." << (event.start % 1000) / 100
+             << ",\"dur\":" << (event.duration / 1000) << "." << (event.duration % 1000) / 100
+             << ",\"pid\":1,\"tid\":" << (event.thread & 0xFFFFFFFF)
+             << ",\"args\":{\"bytes\":" << event.bytes << "}}";
+        first = false;
+    }
+    text << "\n],\"displayTimeUnit\":\"ms\"}";
+    return text.str();
+}
+
+} /* Perf */ } /* Global */ } /* msix */
@@ -0,0 +1,82 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "ReaderCache.hpp"
+#include "Perf.hpp"
+
+#include <cstring>
+#include <functional>
+
+namespace MSIX {
+
+    // The index, which has the block map in it, and the content type table, which is proportional to the size of
+    // the xml it comes from, are what a package costs to keep.  Its signature's digests and identity are small.
+    static std::uint64_t GetCost(PackageIndex& index)
+    {
+        std::uint64_t result = index.Size();
+        for (std::uint64_t i = 0; i < index.GetHeader().entryCount; i++)
+        {   const auto& entry = index.GetEntries()[i];
+            if (index.GetName(entry.nameOffset, entry.nameSize) == CONTENT_TYPES_XML)
+            {   result += entry.uncompressedSize;
+            }
+        }
+        return result;
+    }
+
+    std::size_t ReaderCache::Hash::operator()(const FileIdentity& package) const
+    {
+        std::hash<std::uint64_t> hash;
+        std::size_t result = hash(package.inode);
+        for (auto value : { package.device, package.size, package.modified })
+        {   result ^= hash(value) + 0x9e3779b9 + (result << 6) + (result >> 2);
+        }
+        return result;
+    }
+
+    void ReaderCache::SetBudget(std::uint64_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_budget = bytes;
+        Trim();
+    }
+
+    std::shared_ptr<ReaderCache::Entry> ReaderCache::Find(const FileIdentity& package)
+    {
+        if (!IsEnabled()) { return nullptr; }
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto found = m_find.find(package);
+        if (found == m_find.end()) { return nullptr; }
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        Global::Perf::Count(Global::Perf::Counter::ReaderCacheHit);
+        return found->second->second;
+    }
+
+    void ReaderCache::Add(const FileIdentity& package, std::unique_ptr<PackageIndex> index, const AppxPackageParts& parts)
+    {
+        if (!IsEnabled()) { return; }
+        auto cost = GetCost(*index);
+        auto entry = std::make_shared<Entry>(Entry { std::move(index), parts, cost });
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto found = m_find.find(package);
+        if (found != m_find.end())
+        {   // Opened twice at once, the first one in wins.
+            return;
+        }
+        m_entries.emplace_front(package, entry);
+        m_find[package] = m_entries.begin();
+        m_size += cost;
+        Trim();
+    }
+
+    void ReaderCache::Trim()
+    {
+        while (!m_entries.empty() && m_size > m_budget)
+        {   auto& last = m_entries.back();
+            m_size -= last.second->size;
+            m_find.erase(last.first);
+            m_entries.pop_back();
+            Global::Perf::Count(Global::Perf::Counter::ReaderCacheEvict);
+        }
+    }
+}
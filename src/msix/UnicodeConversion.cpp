@@ -2,40 +2,201 @@
 //  Copyright (C) 2017 Microsoft.  All rights reserved.
 //  See LICENSE file in the project root for full license information.
 // 
-#include <memory>
-#include <iostream>
-#include <sstream>
-#include <locale>
-#include <codecvt>
 #include "UnicodeConversion.hpp"
+#include "Exceptions.hpp"
 
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MSIX_UNICODE_SSE2
+#endif
+
+// Nearly every name in a package is ASCII, so both directions convert runs of ASCII 16 characters at a time
+// and only drop to one code point at a time for the rest.  wchar_t holds utf16 code units, which means it is
+// 2 bytes on Windows and 4 bytes everywhere else.
 namespace MSIX {
-    std::wstring utf8_to_utf16(const std::string& utf8string)
+
+    // Widens the leading ASCII of input and returns how many bytes it converted.
+    static std::size_t WidenAscii(const std::uint8_t* input, std::size_t length, wchar_t* output)
     {
-        /*
-        from: https://connect.microsoft.com/VisualStudio/feedback/details/1403302/unresolved-external-when-using-codecvt-utf8
-        Posted by Microsoft on 2/16/2016 at 11:49 AM
-        <snip>
-        A workaround is to replace 'char32_t' with 'unsigned int'. In VS2013, char32_t was a typedef of 'unsigned int'.
-        In VS2015, char32_t is a distinct type of it's own. Switching your use of 'char32_t' to 'unsigned int' will get
-        you the old behavior from earlier versions and won't trigger a missing export error.
-
-        There is also a similar error to this one with 'char16_t' that can be worked around using 'unsigned short'.
-        <snip>
-        */
-        #ifdef WIN32
-        auto converted = std::wstring_convert<std::codecvt_utf8_utf16<unsigned short>, unsigned short>{}.from_bytes(utf8string.data());
+        std::size_t index = 0;
+        #ifdef MSIX_UNICODE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; index + 16 <= length; index += 16)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + index));
+            if (_mm_movemask_epi8(bytes) != 0) { break; }
+            __m128i low  = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            if (sizeof(wchar_t) == 2)
+            {   _mm_storeu_si128(reinterpret_cast<__m128i*>(output + index),     low);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output + index + 8), high);
+            }
+            else
+            {   _mm_storeu_si128(reinterpret_cast<__m128i*>(output + index),      _mm_unpacklo_epi16(low, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output + index + 4),  _mm_unpackhi_epi16(low, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output + index + 8),  _mm_unpacklo_epi16(high, zero));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(output + index + 12), _mm_unpackhi_epi16(high, zero));
+            }
+        }
         #else
-        auto converted = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(utf8string.data()); 
+        for (; index + 8 <= length; index += 8)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, input + index, sizeof(word));
+            if ((word & 0x8080808080808080ULL) != 0) { break; }
+            for (std::size_t offset = 0; offset < 8; offset++) { output[index + offset] = static_cast<wchar_t>(input[index + offset]); }
+        }
+        #endif
+        return index;
+    }
+
+    // Narrows the leading ASCII of input and returns how many code units it converted.
+    static std::size_t NarrowAscii(const wchar_t* input, std::size_t length, char* output)
+    {
+        std::size_t index = 0;
+        #ifdef MSIX_UNICODE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; index + 16 <= length; index += 16)
+        {
+            __m128i words[4];
+            __m128i bits = zero;
+            const std::size_t loads = (sizeof(wchar_t) == 2) ? 2 : 4;
+            for (std::size_t load = 0; load < loads; load++)
+            {   words[load] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + index) + load);
+                bits = _mm_or_si128(bits, words[load]);
+            }
+            __m128i bytes;
+            if (sizeof(wchar_t) == 2)
+            {   bits = _mm_and_si128(bits, _mm_set1_epi16(static_cast<short>(0xFF80)));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(bits, zero)) != 0xFFFF) { break; }
+                bytes = _mm_packus_epi16(words[0], words[1]);
+            }
+            else
+            {   bits = _mm_and_si128(bits, _mm_set1_epi32(static_cast<int>(0xFFFFFF80)));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(bits, zero)) != 0xFFFF) { break; }
+                bytes = _mm_packus_epi16(_mm_packs_epi32(words[0], words[1]), _mm_packs_epi32(words[2], words[3]));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(output + index), bytes);
+        }
         #endif
-        std::wstring result(converted.begin(), converted.end());
+        for (; index < length && static_cast<std::uint32_t>(input[index]) < 0x80; index++)
+        {   output[index] = static_cast<char>(input[index]);
+        }
+        return index;
+    }
+
+    std::size_t utf8_to_utf16(const std::string& utf8string, wchar_t* utf16string)
+    {
+        auto input = reinterpret_cast<const std::uint8_t*>(utf8string.data());
+        std::size_t length = utf8string.size();
+        std::size_t in = 0;
+        std::size_t out = 0;
+        while (in < length)
+        {
+            if (input[in] < 0x80)
+            {   std::size_t run = WidenAscii(input + in, length - in, utf16string + out);
+                if (run == 0)
+                {   utf16string[out++] = static_cast<wchar_t>(input[in++]);
+                }
+                in += run;
+                out += run;
+                continue;
+            }
+
+            std::uint32_t lead = input[in];
+            std::size_t   count;
+            std::uint32_t codePoint;
+            std::uint32_t minimum;
+            if      ((lead & 0xE0) == 0xC0) { count = 1; codePoint = lead & 0x1F; minimum = 0x80;    }
+            else if ((lead & 0xF0) == 0xE0) { count = 2; codePoint = lead & 0x0F; minimum = 0x800;   }
+            else if ((lead & 0xF8) == 0xF0) { count = 3; codePoint = lead & 0x07; minimum = 0x10000; }
+            else    { throw Exception(Error::InvalidParameter, "invalid utf8 lead byte"); }
+            ThrowErrorIf(Error::InvalidParameter, (length - in <= count), "truncated utf8 sequence");
+            for (std::size_t index = 1; index <= count; index++)
+            {   std::uint8_t trail = input[in + index];
+                ThrowErrorIf(Error::InvalidParameter, ((trail & 0xC0) != 0x80), "invalid utf8 trail byte");
+                codePoint = (codePoint << 6) | (trail & 0x3F);
+            }
+            ThrowErrorIf(Error::InvalidParameter, (codePoint < minimum || codePoint > 0x10FFFF ||
+                (codePoint >= 0xD800 && codePoint <= 0xDFFF)), "invalid utf8 code point");
+            in += count + 1;
+
+            if (codePoint >= 0x10000)
+            {   codePoint -= 0x10000;
+                utf16string[out++] = static_cast<wchar_t>(0xD800 + (codePoint >> 10));
+                utf16string[out++] = static_cast<wchar_t>(0xDC00 + (codePoint & 0x3FF));
+            }
+            else
+            {   utf16string[out++] = static_cast<wchar_t>(codePoint);
+            }
+        }
+        return out;
+    }
+
+    std::wstring utf8_to_utf16(const std::string& utf8string)
+    {
+        std::wstring result(utf8string.size(), L'\0');
+        result.resize(utf8_to_utf16(utf8string, &result[0]));
         return result;
     }
 
-    std::string utf16_to_utf8(const std::wstring& utf16string)
+    // Code units above 0xFFFF can't come from utf16, but are accepted as code points since that is what a
+    // 4 byte wchar_t literal holds.
+    static std::string Narrow(const wchar_t* input, std::size_t length)
     {
-        auto converted = std::wstring_convert<std::codecvt_utf8<wchar_t>>{}.to_bytes(utf16string.data());
-        std::string result(converted.begin(), converted.end());
+        std::string result(length * ((sizeof(wchar_t) == 2) ? 3 : 4), '\0');
+        char* output = &result[0];
+        std::size_t in = 0;
+        std::size_t out = 0;
+        while (in < length)
+        {
+            std::uint32_t codePoint = static_cast<std::uint32_t>(input[in]);
+            if (codePoint < 0x80)
+            {   std::size_t run = NarrowAscii(input + in, length - in, output + out);
+                in += run;
+                out += run;
+                continue;
+            }
+            in++;
+
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF)
+            {   std::uint32_t low = (in < length) ? static_cast<std::uint32_t>(input[in]) : 0;
+                ThrowErrorIfNot(Error::InvalidParameter, (low >= 0xDC00 && low <= 0xDFFF), "unpaired utf16 surrogate");
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                in++;
+            }
+            ThrowErrorIf(Error::InvalidParameter, ((codePoint >= 0xDC00 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF),
+                "invalid utf16 code unit");
+
+            if (codePoint < 0x800)
+            {   output[out++] = static_cast<char>(0xC0 | (codePoint >> 6));
+            }
+            else if (codePoint < 0x10000)
+            {   output[out++] = static_cast<char>(0xE0 | (codePoint >> 12));
+                output[out++] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            }
+            else
+            {   output[out++] = static_cast<char>(0xF0 | (codePoint >> 18));
+                output[out++] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                output[out++] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            }
+            output[out++] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        result.resize(out);
         return result;
     }
+
+    std::string utf16_to_utf8(const std::wstring& utf16string)
+    {
+        return Narrow(utf16string.data(), utf16string.size());
+    }
+
+    std::string utf16_to_utf8(const wchar_t* utf16string)
+    {
+        return Narrow(utf16string, std::wcslen(utf16string));
+    }
 } // namespace MSIX
\ No newline at end of file
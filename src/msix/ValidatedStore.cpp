@@ -0,0 +1,104 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "ValidatedStore.hpp"
+#include "Exceptions.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace MSIX {
+
+    static const std::uint32_t Magic   = 0x5658534D; // MSXV
+    static const std::uint32_t Version = 1;
+
+    static FILE* OpenFile(const std::string& path, const char* mode)
+    {
+        FILE* file = nullptr;
+        #ifdef WIN32
+        if (fopen_s(&file, path.c_str(), mode) != 0) { return nullptr; }
+        #else
+        file = std::fopen(path.c_str(), mode);
+        #endif
+        return file;
+    }
+
+    static std::string WithSeparator(const std::string& directory)
+    {
+        if (!directory.empty() && directory.back() != '/' && directory.back() != '\\') { return directory + '/'; }
+        return directory;
+    }
+
+    ValidatedStore::ValidatedStore(const std::string& directory) :
+        m_directory(WithSeparator(directory)),
+        m_key(m_directory + "validated.key")
+    {
+    }
+
+    std::string ValidatedStore::GetPath(const FileIdentity& package)
+    {
+        std::ostringstream name;
+        name << m_directory << std::hex << std::setfill('0') << std::setw(16) << package.device << "-" << std::setw(16) << package.inode << ".validated";
+        return name.str();
+    }
+
+    bool ValidatedStore::IsValidated(const FileIdentity& package, MSIX_VALIDATION_OPTION validation, const std::vector<std::uint8_t>& blockMapDigest)
+    {
+        if (blockMapDigest.size() != HASH_BYTES) { return false; }
+        FILE* file = OpenFile(GetPath(package), "rb");
+        if (file == nullptr) { return false; }
+        Entry entry;
+        bool isRead = (std::fread(&entry, sizeof(entry), 1, file) == 1) && (std::fgetc(file) == EOF);
+        std::fclose(file);
+
+        std::vector<std::uint8_t> mac;
+        try
+        {   mac = m_key.GetMac(reinterpret_cast<const std::uint8_t*>(&entry), offsetof(Entry, mac));
+        }
+        catch (Exception&)
+        {   return false;
+        }
+        return isRead && entry.magic == Magic && entry.version == Version &&
+            entry.package.device == package.device && entry.package.inode == package.inode &&
+            entry.package.size == package.size && entry.package.modified == package.modified &&
+            entry.validation == static_cast<std::uint32_t>(validation) &&
+            std::memcmp(entry.blockMapDigest, blockMapDigest.data(), HASH_BYTES) == 0 &&
+            HmacKey::IsEqual(entry.mac, mac.data(), HASH_BYTES);
+    }
+
+    void ValidatedStore::Record(const FileIdentity& package, MSIX_VALIDATION_OPTION validation, const std::vector<std::uint8_t>& blockMapDigest)
+    {
+        ThrowErrorIfNot(Error::InvalidParameter, (blockMapDigest.size() == HASH_BYTES), "unexpected digest size");
+        Entry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.magic = Magic;
+        entry.version = Version;
+        entry.package = package;
+        entry.validation = static_cast<std::uint32_t>(validation);
+        std::memcpy(entry.blockMapDigest, blockMapDigest.data(), HASH_BYTES);
+        auto mac = m_key.GetMac(reinterpret_cast<const std::uint8_t*>(&entry), offsetof(Entry, mac));
+        std::memcpy(entry.mac, mac.data(), HASH_BYTES);
+
+        // Written next to its place and renamed into it, so that a reader never sees half of it.
+        std::string path = GetPath(package);
+        std::ostringstream temporary;
+        temporary << path << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+        FILE* file = OpenFile(temporary.str(), "wb");
+        ThrowErrorIfNot(Error::FileOpen, (file), temporary.str().c_str());
+        bool isWritten = (std::fwrite(&entry, sizeof(entry), 1, file) == 1);
+        isWritten = (std::fclose(file) == 0) && isWritten;
+        if (isWritten)
+        {   std::remove(path.c_str()); // rename doesn't replace an existing file on Windows
+            isWritten = (std::rename(temporary.str().c_str(), path.c_str()) == 0);
+        }
+        if (!isWritten)
+        {   std::remove(temporary.str().c_str());
+            throw Exception(Error::FileWrite, "validated store record not written");
+        }
+    }
+}
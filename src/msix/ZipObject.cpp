@@ -9,12 +9,21 @@
 #include "ZipFileStream.hpp"
 #include "InflateStream.hpp"
 #include "VectorStream.hpp"
+#include "CountingStream.hpp"
+#include "BlockMapStream.hpp"
+#include "SHA256.hpp"
+#include "PackageIndex.hpp"
+#include "UnicodeConversion.hpp"
+#include "FileCopy.hpp"
+#include "Perf.hpp"
 
 #include <memory>
 #include <string>
 #include <limits>
 #include <functional>
 #include <algorithm>
+#include <cstring>
+#include <iterator>
 
 namespace MSIX {
 
@@ -139,33 +148,35 @@ namespace MSIX {
         GeneralPurposeBitFlags::UNSUPPORTED_14 |
         GeneralPurposeBitFlags::UNSUPPORTED_15;
 
-    /*
-    class DataDescriptor : public Meta::StructuredObject
+    // Local file headers are read in archive order, and headers that are close together are fetched with
+    // one read.  The file data between them comes along, so those files are served from that read as well.
+    const std::uint64_t LocalFileHeaderFixedSize = 30;
+    const std::uint64_t CoalesceGap              = 16 * 1024;        // most file data read through to reach the next header
+    const std::uint64_t CoalesceReadSize         = 1024 * 1024;      // largest single read
+    const std::uint64_t CoalesceRetainedSize     = 64 * 1024 * 1024; // past this much held file data, only headers are coalesced
+    const std::uint64_t CopyBufferSize           = 1024 * 1024;      // read at once when a file is copied through user space
+
+    /*  FROM APPNOTE.TXT section 4.3.9:
+        Follows the file data when bit 3 of the general purpose bit flag is set.  Only written, never
+        read; the sizes that the reader uses come from the central directory.  Always in its zip64
+        form, as the sizes are not known when the local file header is written.
+    */
+    class Zip64DataDescriptor : public Meta::StructuredObject<
+        Meta::Field4Bytes,  // 0 - data descriptor signature       4 bytes(0x08074b50)
+        Meta::Field4Bytes,  // 1 - crc - 32                        4 bytes
+        Meta::Field8Bytes,  // 2 - compressed size                 8 bytes
+        Meta::Field8Bytes   // 3 - uncompressed size               8 bytes
+    >
     {
     public:
-        std::uint32_t GetCrc32() { return *Meta::Object::GetValue<std::uint32_t>(Field(0)); }
-        void SetCrc32(std::uint32_t value) { Meta::Object::SetValue(Field(0), value); }
-
-        std::uint32_t GetCompressedSize() { return *Meta::Object::GetValue<std::uint32_t>(Field(1)); }
-        void SetCompressedSize(std::uint32_t value) { Meta::Object::SetValue(Field(1), value); }
-
-        std::uint32_t GetUncompressedSize() { return *Meta::Object::GetValue<std::uint32_t>(Field(2)); }
-        void SetUncompressedSize(std::uint32_t value) { Meta::Object::SetValue(Field(2), value); }
-
-        DataDescriptor() : Meta::StructuredObject(
-        {
-            // 0 - crc - 32                          4 bytes    
-            std::make_shared<Meta::Field4Bytes>([](std::uint32_t& v) {}),
-            // 1 - compressed size                 4 bytes
-            std::make_shared<Meta::Field4Bytes>([](std::uint32_t& v) {}),
-            // 2 - uncompressed size               4 bytes
-            std::make_shared<Meta::Field4Bytes>([](std::uint32_t& v) {})
-
-        })
+        Zip64DataDescriptor(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize)
         {
+            Field<0>().value = static_cast<std::uint32_t>(Signatures::DataDescriptor);
+            Field<1>().value = crc;
+            Field<2>().value = compressedSize;
+            Field<3>().value = uncompressedSize;
         }
-    };//class DataDescriptor
-    */
+    };//class Zip64DataDescriptor
 
     /*  FROM APPNOTE.TXT section 4.5.3:
         If one of the size or offset fields in the Local or Central directory
@@ -189,6 +200,8 @@ namespace MSIX {
     public:
         Zip64ExtendedInformation(ULARGE_INTEGER start, IStream* stream) : m_start(start), m_stream(stream)
         {
+            Field<0>().value = static_cast<std::uint16_t>(HeaderIDs::Zip64ExtendedInfo);
+            Field<1>().value = 24;
             Field<0>().validation = [](std::uint16_t& v)
             {   ThrowErrorIfNot(Error::ZipBadExtendedData,
                     (v == static_cast<std::uint16_t>(HeaderIDs::Zip64ExtendedInfo)),
@@ -411,10 +424,17 @@ namespace MSIX {
             if (!m_extendedInfo.get()) { return static_cast<std::uint64_t>(Field<8>().value); }
             return m_extendedInfo->GetCompressedSize();
         }
-        void SetCompressedSize(std::uint32_t value)
+        void SetCompressedSize(std::uint64_t value)
         {
-            // TODO: on-demand create m_extendedInfo?
-            Field<8>().value = value;
+            if (m_isZip64)
+            {   GetExtendedInfo()->SetCompressedSize(value);
+                Field<8>().value = std::numeric_limits<std::uint32_t>::max();
+                UpdateExtraField();
+            }
+            else
+            {   ThrowErrorIf(Error::ZipCentralDirectoryHeader, (value >= std::numeric_limits<std::uint32_t>::max()), "compressed size needs zip64");
+                Field<8>().value = static_cast<std::uint32_t>(value);
+            }
         }
 
         std::uint64_t GetUncompressedSize()                      
@@ -423,10 +443,17 @@ namespace MSIX {
             return m_extendedInfo->GetUncompressedSize();
         }
 
-        void SetUncompressedSize(std::uint32_t value)
+        void SetUncompressedSize(std::uint64_t value)
         {
-            // TODO: on-demand create m_extendedInfo?
-            Field<9>().value = value;
+            if (m_isZip64)
+            {   GetExtendedInfo()->SetUncompressedSize(value);
+                Field<9>().value = std::numeric_limits<std::uint32_t>::max();
+                UpdateExtraField();
+            }
+            else
+            {   ThrowErrorIf(Error::ZipCentralDirectoryHeader, (value >= std::numeric_limits<std::uint32_t>::max()), "uncompressed size needs zip64");
+                Field<9>().value = static_cast<std::uint32_t>(value);
+            }
         }
 
         std::uint64_t GetRelativeOffsetOfLocalHeader()
@@ -435,10 +462,17 @@ namespace MSIX {
             return m_extendedInfo->GetRelativeOffset();
         }
 
-        void SetRelativeOffsetOfLocalHeader(std::uint32_t value)
+        void SetRelativeOffsetOfLocalHeader(std::uint64_t value)
         {
-            // TODO: on-demand create m_extendedInfo?
-            Field<16>().value = value;
+            if (m_isZip64)
+            {   GetExtendedInfo()->SetRelativeOffset(value);
+                Field<16>().value = std::numeric_limits<std::uint32_t>::max();
+                UpdateExtraField();
+            }
+            else
+            {   ThrowErrorIf(Error::ZipCentralDirectoryHeader, (value >= std::numeric_limits<std::uint32_t>::max()), "offset needs zip64");
+                Field<16>().value = static_cast<std::uint32_t>(value);
+            }
         }
 
         std::string GetFileName()
@@ -449,9 +483,7 @@ namespace MSIX {
 
         void SetFileName(std::string name)
         {
-            auto data = Field<17>().value;
-            data.resize(name.size());
-            data.assign(name.begin(), name.end());
+            Field<17>().value.assign(name.begin(), name.end());
             SetFileNameLength(static_cast<std::uint16_t>(name.size()));
         }
 
@@ -475,6 +507,27 @@ namespace MSIX {
         void SetInternalFileAttributes(std::uint16_t value) { Field<14>().value = value; }
         void SetExternalFileAttributes(std::uint16_t value) { Field<15>().value = value; }
 
+        // In a zip64 archive the sizes and offset always live in the extended information, the
+        // 32 bit fields are left at 0xFFFFFFFF.
+        Zip64ExtendedInformation* GetExtendedInfo()
+        {
+            if (!m_extendedInfo.get())
+            {   ULARGE_INTEGER start = {0};
+                m_extendedInfo = std::make_unique<Zip64ExtendedInformation>(start, nullptr);
+                SetVersionNeededToExtract(static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
+            }
+            return m_extendedInfo.get();
+        }
+
+        void UpdateExtraField()
+        {
+            auto& bytes = Field<18>().value;
+            bytes.clear();
+            auto vectorStream = ComPtr<IStream>::Make<VectorStream>(&bytes);
+            m_extendedInfo->Write(vectorStream.Get());
+            SetExtraFieldLength(static_cast<std::uint16_t>(bytes.size()));
+        }
+
         std::unique_ptr<Zip64ExtendedInformation> m_extendedInfo;
         IStream* m_stream = nullptr;
         bool     m_isZip64 = false;
@@ -554,6 +607,15 @@ namespace MSIX {
             };
             // 11- file name (variable size)
             // 12- extra field (variable size)
+
+            SetSignature(static_cast<std::uint32_t>(Signatures::LocalFileHeader));
+            SetVersionNeededToExtract(static_cast<std::uint16_t>(m_isZip64 ? ZipVersions::Zip64FormatExtension : ZipVersions::Zip32DefaultVersion));
+            SetLastModFileTime(static_cast<std::uint16_t>(MagicNumbers::FileTime));
+            SetLastModFileDate(static_cast<std::uint16_t>(MagicNumbers::FileDate));
+            SetCrc(0);
+            SetCompressedSize(0);
+            SetUncompressedSize(0);
+            SetExtraFieldLength(0);
         }
 
         bool IsGeneralPurposeBitSet()
@@ -587,6 +649,8 @@ namespace MSIX {
         std::uint16_t GetExtraFieldLength() { return Field<10>().value; }
 
         void SetGeneralPurposeBitFlag(std::uint16_t value)  { Field<2>().value = value;  }
+        void SetCompressionMethod(std::uint16_t value)      { Field<3>().value = value;  }
+        void SetCrc(std::uint32_t value)                    { Field<6>().value = value;  }
         void SetCompressedSize(std::uint32_t value)         { Field<7>().value = value;  }
         void SetUncompressedSize(std::uint32_t value)       { Field<8>().value = value;  }
         void SetFileNameLength(std::uint16_t value)         { Field<9>().value = value;  }
@@ -600,12 +664,15 @@ namespace MSIX {
 
         void SetFileName(std::string name)
         {
-            auto data = Field<11>().value;
-            data.resize(name.size());
-            data.assign(name.begin(), name.end());
+            Field<11>().value.assign(name.begin(), name.end());
             SetFileNameLength(static_cast<std::uint16_t>(name.size()));
         }
     protected:
+        void SetSignature(std::uint32_t value)              { Field<0>().value = value; }
+        void SetVersionNeededToExtract(std::uint16_t value) { Field<1>().value = value; }
+        void SetLastModFileTime(std::uint16_t value)        { Field<4>().value = value; }
+        void SetLastModFileDate(std::uint16_t value)        { Field<5>().value = value; }
+
         bool                                        m_isZip64        = false;
         std::shared_ptr<CentralDirectoryFileHeader> m_directoryEntry = nullptr;
     }; //class LocalFileHeader
@@ -693,6 +760,7 @@ namespace MSIX {
             SetVersionMadeBy(static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
             SetVersionNeededToExtract(static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
             SetNumberOfThisDisk(0);
+            SetNumberOfTheDiskWithStartOfCD(0);
             SetTotalNumberOfEntries(0);
             Field<10>().value.resize(0);
         }
@@ -716,6 +784,7 @@ namespace MSIX {
         void SetVersionMadeBy(std::uint16_t value)          { Field<2>().value = value; }
         void SetVersionNeededToExtract(std::uint16_t value) { Field<3>().value = value; }
         void SetNumberOfThisDisk(std::uint32_t value)       { Field<4>().value = value; }
+        void SetNumberOfTheDiskWithStartOfCD(std::uint32_t value) { Field<5>().value = value; }
 
         IStream* m_stream = nullptr;
     }; //class Zip64EndOfCentralDirectoryRecord
@@ -854,6 +923,14 @@ namespace MSIX {
         bool GetArchiveHasZip64Locator() { return m_archiveHasZip64Locator; }
         bool GetIsZip64()                { return m_isZip64; }
 
+        // A zip64 archive marks the disk numbers, as well as the counts and offsets, as 'see the zip64 record'.
+        void SetIsZip64(bool isZip64)
+        {
+            m_isZip64 = isZip64;
+            SetNumberOfDisk(isZip64 ? std::numeric_limits<std::uint16_t>::max() : 0);
+            SetDiskStart(isZip64 ? std::numeric_limits<std::uint16_t>::max() : 0);
+        }
+
         std::uint64_t GetNumberOfCentralDirectoryEntries()          { return static_cast<std::uint64_t>(Field<3>().value); }
         std::uint64_t GetStartOfCentralDirectory()                  { return static_cast<std::uint64_t>(Field<6>().value); }
 
@@ -873,8 +950,11 @@ namespace MSIX {
         bool m_archiveHasZip64Locator = true;
     };//class EndOfCentralDirectoryRecord
 
-    std::vector<std::string> ZipObject::GetFileNames(FileNameOptions)
+    std::vector<std::string> ZipObject::GetFileNames(FileNameOptions options)
     {
+        if ((options & FileNameOptions::StorageOrder) == FileNameOptions::StorageOrder)
+        {   return m_storageOrder;
+        }
         std::vector<std::string> result;
         std::for_each(m_streams.begin(), m_streams.end(), [&](auto it)
         {
@@ -891,9 +971,87 @@ namespace MSIX {
         return result->second.Get();
     }
 
+    ZipRawFile ZipObject::GetRawFile(const std::string& fileName)
+    {
+        auto result = m_rawFiles.find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (result == m_rawFiles.end()), "file not in archive");
+        return result->second;
+    }
+
+    void ZipObject::ReadRawFile(const ZipRawFile& file, std::uint64_t offset, void* buffer, std::size_t size)
+    {
+        ThrowErrorIf(Error::FileRead, (offset > file.compressedSize || size > file.compressedSize - offset), "read past the end of the file");
+        if (file.memory)
+        {   if (size != 0) { std::memcpy(buffer, file.memory->data() + file.memoryOffset + offset, size); }
+            return;
+        }
+        if (file.archive.Get())
+        {   if (GetArchiveFile(file) && ReadFileAt(m_archiveFile, file.archiveOffset + offset, buffer, size))
+            {   for (const auto& statistics : { file.statistics, file.archiveStatistics })
+                {   statistics->sourceReads.fetch_add(1, std::memory_order_relaxed);
+                    statistics->sourceBytesRead.fetch_add(size, std::memory_order_relaxed);
+                }
+                return;
+            }
+        }
+
+        // The file's stream is also under its regular stream, which expects it to be where it left it.
+        std::lock_guard<std::mutex> lock(m_readLock);
+        LARGE_INTEGER position = {0};
+        ULARGE_INTEGER saved = {0};
+        ThrowHrIfFailed(file.stream->Seek(position, StreamBase::Reference::CURRENT, &saved));
+        position.QuadPart = static_cast<std::int64_t>(offset);
+        ThrowHrIfFailed(file.stream->Seek(position, StreamBase::Reference::START, nullptr));
+        std::size_t total = 0;
+        while (total < size)
+        {
+            ULONG count = static_cast<ULONG>(std::min<std::size_t>(size - total, std::numeric_limits<ULONG>::max()));
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(file.stream->Read(static_cast<std::uint8_t*>(buffer) + total, count, &bytesRead));
+            ThrowErrorIf(Error::FileRead, (bytesRead == 0), "file truncated");
+            total += bytesRead;
+        }
+        position.QuadPart = static_cast<std::int64_t>(saved.QuadPart);
+        ThrowHrIfFailed(file.stream->Seek(position, StreamBase::Reference::START, nullptr));
+    }
+
+    bool ZipObject::CopyRawFile(const ZipRawFile& file, FILE* target)
+    {
+        if (file.memory || !file.archive.Get() || !GetArchiveFile(file)) { return false; }
+        if (!CopyFileRange(m_archiveFile, file.archiveOffset, target, file.compressedSize)) { return false; }
+        for (const auto& statistics : { file.statistics, file.archiveStatistics })
+        {   statistics->sourceReads.fetch_add(1, std::memory_order_relaxed);
+            statistics->sourceBytesRead.fetch_add(file.compressedSize, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    FILE* ZipObject::GetArchiveFile(const ZipRawFile& file)
+    {
+        std::call_once(m_archiveLoaded, [&]()
+        {   ComPtr<IFileBackedStream> archive;
+            if (SUCCEEDED(file.archive->QueryInterface(UuidOfImpl<IFileBackedStream>::iid, reinterpret_cast<void**>(&archive))))
+            {   m_archiveFile = archive->GetFileHandle();
+            }
+        });
+        return m_archiveFile;
+    }
+
+    void ZipObject::SetContentTypes(const std::shared_ptr<ContentTypeTable>& contentTypes)
+    {
+        for (auto& rawFile : m_rawFiles)
+        {   static_cast<ZipFileStream*>(rawFile.second.stream.Get())->SetContentTypes(contentTypes);
+        }
+    }
+
     void ZipObject::RemoveFile(const std::string& fileName)
     {
-        throw Exception(Error::NotImplemented);
+        ThrowErrorIfNot(Error::NotImplemented, m_isUpdating, "files can only be removed from an archive that is updated in place");
+        ThrowErrorIfNot(Error::InvalidState, m_isWriting, "archive is not open for write");
+        ThrowErrorIf(Error::InvalidState, (m_currentFile.get() != nullptr), "a file is still being written");
+        // Its data stays where it is until the archive is compacted.
+        m_centralDirectory.erase(std::remove_if(m_centralDirectory.begin(), m_centralDirectory.end(),
+            [&](const auto& file) { return file->GetFileName() == fileName; }), m_centralDirectory.end());
     }
 
     IStream* ZipObject::OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode)
@@ -903,24 +1061,274 @@ namespace MSIX {
 
     void ZipObject::CommitChanges()
     {
-        throw Exception(Error::NotImplemented);
+        ThrowErrorIfNot(Error::NotImplemented, m_isWriting, "archive was opened for read");
+        ThrowErrorIf(Error::InvalidState, (m_currentFile.get() != nullptr), "a file is still being written");
+        ThrowErrorIf(Error::InvalidState, (m_centralDirectory.empty()), "an archive needs at least one file");
+
+        if (m_isUpdating) { SeekToPosition(); }
+        std::vector<std::uint8_t> bytes;
+        auto vectorStream = ComPtr<IStream>::Make<VectorStream>(&bytes);
+        std::uint64_t startOfCentralDirectory = m_position;
+        for (const auto& centralFileHeader : m_centralDirectory)
+        {   centralFileHeader->Write(vectorStream.Get());
+        }
+        std::uint64_t sizeOfCentralDirectory = bytes.size();
+
+        Zip64EndOfCentralDirectoryRecord zip64EndOfCentralDirectory(nullptr);
+        zip64EndOfCentralDirectory.SetTotalNumberOfEntries(m_centralDirectory.size());
+        zip64EndOfCentralDirectory.SetSizeOfCD(sizeOfCentralDirectory);
+        zip64EndOfCentralDirectory.SetOffsetfStartOfCD(startOfCentralDirectory);
+        zip64EndOfCentralDirectory.Write(vectorStream.Get());
+
+        Zip64EndOfCentralDirectoryLocator zip64Locator(nullptr);
+        zip64Locator.SetRelativeOffset(startOfCentralDirectory + sizeOfCentralDirectory);
+        zip64Locator.Write(vectorStream.Get());
+
+        EndCentralDirectoryRecord endCentralDirectoryRecord;
+        endCentralDirectoryRecord.SetIsZip64(true);
+        endCentralDirectoryRecord.Write(vectorStream.Get());
+
+        WriteBytes(bytes.data(), static_cast<ULONG>(bytes.size()));
+        if (m_isUpdating)
+        {   // whatever was after the new central directory, e.g. the end of the old one, goes.
+            ULARGE_INTEGER size = {0};
+            size.QuadPart = m_position;
+            ThrowHrIfFailed(m_stream->SetSize(size));
+        }
+        m_isWriting = false;
+    }
+
+    std::uint64_t ZipObject::BeginFile(const std::string& fileName, APPX_COMPRESSION_OPTION compressionOption)
+    {
+        ThrowErrorIfNot(Error::InvalidState, m_isWriting, "archive is not open for write");
+        ThrowErrorIf(Error::InvalidState, (m_currentFile.get() != nullptr), "previous file was not ended");
+        ThrowErrorIf(Error::InvalidParameter, (fileName.empty() || fileName.size() > std::numeric_limits<std::uint16_t>::max()), "invalid file name");
+
+        // Sizes and crc go in the data descriptor. The level bits are informational (APPNOTE.TXT 4.4.4).
+        auto flags = GeneralPurposeBitFlags::GeneralPurposeBit;
+        switch (compressionOption)
+        {
+        case APPX_COMPRESSION_OPTION_NONE:
+        case APPX_COMPRESSION_OPTION_NORMAL:
+            break;
+        case APPX_COMPRESSION_OPTION_MAXIMUM:
+            flags = flags | GeneralPurposeBitFlags::Deflate_MaxCompress;
+            break;
+        case APPX_COMPRESSION_OPTION_FAST:
+            flags = flags | GeneralPurposeBitFlags::Deflate_FastCompress;
+            break;
+        case APPX_COMPRESSION_OPTION_SUPERFAST:
+            flags = flags | GeneralPurposeBitFlags::Deflate_MaxCompress | GeneralPurposeBitFlags::Deflate_FastCompress;
+            break;
+        default:
+            throw Exception(Error::InvalidParameter, "unknown compression option");
+        }
+        auto compressionMethod = static_cast<std::uint16_t>((compressionOption == APPX_COMPRESSION_OPTION_NONE) ?
+            CompressionType::Store : CompressionType::Deflate);
+
+        m_currentFile = std::make_shared<CentralDirectoryFileHeader>(true, nullptr);
+        m_currentFile->SetFileName(fileName);
+        m_currentFile->SetGeneralPurposeBitFlags(static_cast<std::uint16_t>(flags));
+        m_currentFile->SetCompressionMethod(compressionMethod);
+        m_currentFile->SetRelativeOffsetOfLocalHeader(m_position);
+        if (m_isUpdating)
+        {   // The archive may have been read in the meantime, through the same stream.
+            m_fileStarts.insert(m_position);
+            SeekToPosition();
+        }
+
+        LocalFileHeader localFileHeader(m_currentFile);
+        localFileHeader.SetGeneralPurposeBitFlag(static_cast<std::uint16_t>(flags));
+        localFileHeader.SetCompressionMethod(compressionMethod);
+        localFileHeader.SetFileName(fileName);
+
+        std::vector<std::uint8_t> bytes;
+        auto vectorStream = ComPtr<IStream>::Make<VectorStream>(&bytes);
+        localFileHeader.Write(vectorStream.Get());
+        WriteBytes(bytes.data(), static_cast<ULONG>(bytes.size()));
+        return bytes.size();
+    }
+
+    void ZipObject::WriteFileData(const void* data, ULONG size)
+    {
+        ThrowErrorIf(Error::InvalidState, (m_currentFile.get() == nullptr), "no file is being written");
+        WriteBytes(data, size);
+    }
+
+    void ZipObject::EndFile(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize)
+    {
+        ThrowErrorIf(Error::InvalidState, (m_currentFile.get() == nullptr), "no file is being written");
+        m_currentFile->SetCrc(crc);
+        m_currentFile->SetCompressedSize(compressedSize);
+        m_currentFile->SetUncompressedSize(uncompressedSize);
+
+        Zip64DataDescriptor dataDescriptor(crc, compressedSize, uncompressedSize);
+        std::vector<std::uint8_t> bytes;
+        auto vectorStream = ComPtr<IStream>::Make<VectorStream>(&bytes);
+        dataDescriptor.Write(vectorStream.Get());
+        WriteBytes(bytes.data(), static_cast<ULONG>(bytes.size()));
+
+        m_centralDirectory.push_back(std::move(m_currentFile));
+    }
+
+    std::uint64_t ZipObject::CopyFile(IZipReader* source, const std::string& fileName,
+        const std::function<void(const std::uint8_t* data, std::size_t size)>& onData)
+    {
+        ThrowErrorIf(Error::InvalidParameter, (source == nullptr), "bad pointer");
+        auto file = source->GetRawFile(fileName);
+        auto localFileHeaderSize = BeginFile(fileName, file.isCompressed ? APPX_COMPRESSION_OPTION_NORMAL : APPX_COMPRESSION_OPTION_NONE);
+
+        Global::Perf::Scope scope(Global::Perf::Counter::PackCopiedFile);
+        scope.AddBytes(file.compressedSize);
+        ComPtr<IFileBackedStream> target;
+        if (onData || FAILED(m_stream->QueryInterface(UuidOfImpl<IFileBackedStream>::iid, reinterpret_cast<void**>(&target))) ||
+            target->GetFileHandle() == nullptr || !source->CopyRawFile(file, target->GetFileHandle()))
+        {   std::vector<std::uint8_t> buffer(static_cast<std::size_t>(std::min(file.compressedSize, CopyBufferSize)));
+            for (std::uint64_t offset = 0; offset < file.compressedSize; offset += buffer.size())
+            {   auto size = static_cast<std::size_t>(std::min<std::uint64_t>(file.compressedSize - offset, buffer.size()));
+                source->ReadRawFile(file, offset, buffer.data(), size);
+                if (onData) { onData(buffer.data(), size); }
+                WriteBytes(buffer.data(), static_cast<ULONG>(size));
+            }
+        }
+        else
+        {   m_position += file.compressedSize;
+        }
+        EndFile(file.crc, file.compressedSize, file.uncompressedSize);
+        return localFileHeaderSize;
+    }
+
+    void ZipObject::Compact()
+    {
+        ThrowErrorIfNot(Error::InvalidState, (m_isWriting && m_isUpdating), "archive is not updated in place");
+        ThrowErrorIf(Error::InvalidState, (m_currentFile.get() != nullptr), "a file is still being written");
+        m_fileStarts.insert(m_position);
+        std::uint64_t target = 0;
+        for (const auto& file : m_centralDirectory)
+        {
+            // Never past the next file that is known of, removed or not, whatever GetFileEnd made of what follows.
+            std::uint64_t start = file->GetRelativeOffsetOfLocalHeader();
+            std::uint64_t end = std::min(GetFileEnd(file), *m_fileStarts.upper_bound(start));
+            if (start != target)
+            {   Global::Perf::Scope scope(Global::Perf::Counter::PackCompactedFile);
+                scope.AddBytes(end - start);
+                MoveBytes(start, target, end - start);
+                file->SetRelativeOffsetOfLocalHeader(target);
+            }
+            target += end - start;
+        }
+
+        m_position = target;
+        m_fileStarts.clear();
+        for (const auto& file : m_centralDirectory) { m_fileStarts.insert(file->GetRelativeOffsetOfLocalHeader()); }
+        SeekToPosition();
+    }
+
+    void ZipObject::SeekToPosition()
+    {
+        LARGE_INTEGER pos = {0};
+        pos.QuadPart = m_position;
+        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+    }
+
+    // Where the local file header, the data and the data descriptor of a file end.  The data descriptor may or may
+    // not start with its signature, and has the sizes in 8 bytes each in zip64 form, in 4 otherwise.  Its compressed
+    // size tells the two forms apart, except for empty files, where this can come out 8 bytes long.
+    std::uint64_t ZipObject::GetFileEnd(const std::shared_ptr<CentralDirectoryFileHeader>& file)
+    {
+        LARGE_INTEGER pos = {0};
+        pos.QuadPart = file->GetRelativeOffsetOfLocalHeader();
+        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+        LocalFileHeader localFileHeader(file);
+        localFileHeader.Read(m_stream.Get());
+        std::uint64_t end = file->GetRelativeOffsetOfLocalHeader() + localFileHeader.Size() + file->GetCompressedSize();
+        if (!file->IsGeneralPurposeBitSet()) { return end; }
+
+        std::uint8_t bytes[24] = {};
+        pos.QuadPart = end;
+        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(m_stream->Read(bytes, sizeof(bytes), &bytesRead));
+        auto Value = [&](std::size_t offset, std::size_t size)
+        {   std::uint64_t value = 0;
+            for (std::size_t i = size; i > 0; i--) { value = (value << 8) | bytes[offset + i - 1]; }
+            return value;
+        };
+        std::size_t signature = (Value(0, 4) == static_cast<std::uint32_t>(Signatures::DataDescriptor)) ? 4 : 0;
+        bool isZip64 = (Value(signature + 4, 8) == file->GetCompressedSize());
+        return end + signature + 4 + (isZip64 ? 16 : 8);
+    }
+
+    // Front to back, so that a file can be moved onto where it partly is already.
+    void ZipObject::MoveBytes(std::uint64_t from, std::uint64_t to, std::uint64_t size)
+    {
+        std::vector<std::uint8_t> buffer(static_cast<std::size_t>(std::min(size, CopyBufferSize)));
+        for (std::uint64_t offset = 0; offset < size; offset += buffer.size())
+        {
+            auto count = static_cast<ULONG>(std::min<std::uint64_t>(size - offset, buffer.size()));
+            LARGE_INTEGER pos = {0};
+            pos.QuadPart = from + offset;
+            ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(m_stream->Read(buffer.data(), count, &bytesRead));
+            ThrowErrorIfNot(Error::FileRead, (bytesRead == count), "archive ends early");
+            pos.QuadPart = to + offset;
+            ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(m_stream->Write(buffer.data(), count, &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == count), "incomplete write");
+        }
+    }
+
+    void ZipObject::WriteBytes(const void* data, ULONG size)
+    {
+        ULONG bytesWritten = 0;
+        ThrowHrIfFailed(m_stream->Write(data, size, &bytesWritten));
+        ThrowErrorIfNot(Error::FileWrite, (bytesWritten == size), "incomplete write");
+        m_position += size;
     }
 
     std::string ZipObject::GetPathSeparator() { return "/"; }
 
-    ZipObject::ZipObject(IMSIXFactory* appxFactory, IStream* stream) : m_factory(appxFactory), m_stream(stream)
+    HRESULT STDMETHODCALLTYPE ZipObject::GetStatistics(MSIX_READ_STATISTICS* statistics)
+    {
+        return ResultOf([&]{
+            ThrowErrorIf(Error::InvalidParameter, (statistics == nullptr), "bad pointer");
+            *statistics = {0};
+            // Source reads by the files are already part of the package totals.
+            m_statistics->AddTo(*statistics);
+            for (const auto& file : m_fileStatistics)
+            {   file.second->AddTo(*statistics, false);
+            }
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE ZipObject::GetFileStatistics(LPCWSTR fileName, MSIX_READ_STATISTICS* statistics)
+    {
+        return ResultOf([&]{
+            ThrowErrorIf(Error::InvalidParameter, (fileName == nullptr || *fileName == '\0' || statistics == nullptr), "bad pointer");
+            auto file = m_fileStatistics.find(utf16_to_utf8(fileName));
+            ThrowErrorIf(Error::FileNotFound, (file == m_fileStatistics.end()), "file not in archive");
+            *statistics = {0};
+            file->second->AddTo(*statistics);
+        });
+    }
+
+    // Reads the central directory of the archive in stream, and returns its entries in the order of their files in
+    // the archive.
+    static std::vector<std::shared_ptr<CentralDirectoryFileHeader>> ReadCentralDirectory(IStream* stream,
+        std::uint64_t& offsetStartOfCD, std::uint64_t& sizeOfCD)
     {
         // Confirm that the file IS the correct format
         EndCentralDirectoryRecord endCentralDirectoryRecord;
         LARGE_INTEGER pos = {0};
         pos.QuadPart = -1 * endCentralDirectoryRecord.Size();
-        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::END, nullptr));
-        endCentralDirectoryRecord.Read(m_stream.Get());
+        ThrowHrIfFailed(stream->Seek(pos, StreamBase::Reference::END, nullptr));
+        endCentralDirectoryRecord.Read(stream);
 
         // find where the zip central directory exists.
-        std::uint64_t offsetStartOfCD = 0;
         std::uint64_t totalNumberOfEntries = 0;
-        Zip64EndOfCentralDirectoryLocator zip64Locator(m_stream.Get());        
+        Zip64EndOfCentralDirectoryLocator zip64Locator(stream);
         if (!endCentralDirectoryRecord.GetArchiveHasZip64Locator())
         {
             offsetStartOfCD      = endCentralDirectoryRecord.GetStartOfCentralDirectory();
@@ -929,14 +1337,14 @@ namespace MSIX {
         else
         {   // Make sure that we have a zip64 end of central directory locator            
             pos.QuadPart = -1*(endCentralDirectoryRecord.Size() + zip64Locator.Size());
-            ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::END, nullptr));
-            zip64Locator.Read(m_stream.Get());
+            ThrowHrIfFailed(stream->Seek(pos, StreamBase::Reference::END, nullptr));
+            zip64Locator.Read(stream);
 
             // now read the end of zip central directory record
-            Zip64EndOfCentralDirectoryRecord zip64EndOfCentralDirectory(m_stream.Get());
+            Zip64EndOfCentralDirectoryRecord zip64EndOfCentralDirectory(stream);
             pos.QuadPart = zip64Locator.GetRelativeOffset();
-            ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
-            zip64EndOfCentralDirectory.Read(m_stream.Get());            
+            ThrowHrIfFailed(stream->Seek(pos, StreamBase::Reference::START, nullptr));
+            zip64EndOfCentralDirectory.Read(stream);
             offsetStartOfCD = zip64EndOfCentralDirectory.GetOffsetStartOfCD();
             totalNumberOfEntries = zip64EndOfCentralDirectory.GetTotalNumberOfEntries();
         }
@@ -944,51 +1352,629 @@ namespace MSIX {
         // read the zip central directory
         std::map<std::string, std::shared_ptr<CentralDirectoryFileHeader>> centralDirectory;
         pos.QuadPart = offsetStartOfCD;
-        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+        ThrowHrIfFailed(stream->Seek(pos, StreamBase::Reference::START, nullptr));
         for (std::uint32_t index = 0; index < totalNumberOfEntries; index++)
         {
-            auto centralFileHeader = std::make_shared<CentralDirectoryFileHeader>(endCentralDirectoryRecord.GetIsZip64(), m_stream.Get());
-            centralFileHeader->Read(m_stream.Get());
+            auto centralFileHeader = std::make_shared<CentralDirectoryFileHeader>(endCentralDirectoryRecord.GetIsZip64(), stream);
+            centralFileHeader->Read(stream);
             // TODO: ensure that there are no collisions on name!
             centralDirectory.insert(std::make_pair(centralFileHeader->GetFileName(), centralFileHeader));
         }
 
+        ULARGE_INTEGER uPos = {0};
+        ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &uPos));
+        sizeOfCD = uPos.QuadPart - offsetStartOfCD;
         if (endCentralDirectoryRecord.GetArchiveHasZip64Locator())
         {   // We should have no data between the end of the last central directory header and the start of the EoCD
-            ULARGE_INTEGER uPos = {0};
-            ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &uPos));
             ThrowErrorIfNot(Error::ZipHiddenData, (uPos.QuadPart == zip64Locator.GetRelativeOffset()), "hidden data unsupported");
         }
 
-        std::map<std::uint64_t, std::shared_ptr<LocalFileHeader>> fileRepository;
+        std::vector<std::shared_ptr<CentralDirectoryFileHeader>> entries;
+        for (const auto& centralFileHeader : centralDirectory) { entries.push_back(centralFileHeader.second); }
+        std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b)
+        {   return a->GetRelativeOffsetOfLocalHeader() < b->GetRelativeOffsetOfLocalHeader();
+        });
+        return entries;
+    }
+
+    ZipObject::ZipObject(IMSIXFactory* appxFactory, IStream* stream) :
+        m_factory(appxFactory),
+        m_statistics(std::make_shared<ReadStatistics>())
+    {
+        Global::Perf::Scope scope(Global::Perf::Counter::CentralDirectoryParse);
+        // All access to the package goes through here so that it can be accounted for.
+        m_stream = ComPtr<IStream>::Make<CountingStream>(stream, m_statistics, CountingStream::Kind::Source);
+        std::uint64_t offsetStartOfCD = 0;
+        std::uint64_t sizeOfCD = 0;
+        auto entries = ReadCentralDirectory(m_stream.Get(), offsetStartOfCD, sizeOfCD);
+        scope.AddBytes(sizeOfCD);
+        LARGE_INTEGER pos = {0};
+
+        auto HeaderEnd = [](const std::shared_ptr<CentralDirectoryFileHeader>& entry)
+        {   return entry->GetRelativeOffsetOfLocalHeader() + LocalFileHeaderFixedSize + entry->GetFileName().size();
+        };
+
         // TODO: change population of m_streams into cache semantics and move into ZipObject::GetFile
         // Read the file repository
-        for (const auto& centralFileHeader : centralDirectory)
+        std::uint64_t retained = 0;
+        for (std::size_t first = 0; first < entries.size(); )
         {
-            pos.QuadPart = centralFileHeader.second->GetRelativeOffsetOfLocalHeader();
-            ThrowHrIfFailed(m_stream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
-            auto localFileHeader = std::make_shared<LocalFileHeader>(centralFileHeader.second);
-            localFileHeader->Read(m_stream.Get());
-            fileRepository.insert(std::make_pair(
-                centralFileHeader.second->GetRelativeOffsetOfLocalHeader(),
-                localFileHeader));
-
-            auto fileStream = ComPtr<IStream>::Make<ZipFileStream>(
-                centralFileHeader.second->GetFileName(),
-                "TODO: Implement", // TODO: put value from content type 
-                m_factory,
-                localFileHeader->GetCompressionType() == CompressionType::Deflate,
-                centralFileHeader.second->GetRelativeOffsetOfLocalHeader() + localFileHeader->Size(),
-                localFileHeader->GetCompressedSize(),                
-                m_stream.Get()
-                );
-
-            if (localFileHeader->GetCompressionType() == CompressionType::Deflate)
+            std::uint64_t runStart = entries[first]->GetRelativeOffsetOfLocalHeader();
+            std::uint64_t runEnd = HeaderEnd(entries[first]);
+            std::uint64_t gap = (retained < CoalesceRetainedSize) ? CoalesceGap : 0;
+            std::size_t last = first + 1;
+            for (; last < entries.size(); last++)
             {
-                fileStream = ComPtr<IStream>::Make<InflateStream>(fileStream.Get(), localFileHeader->GetUncompressedSize());
+                if ((entries[last]->GetRelativeOffsetOfLocalHeader() > runEnd + gap) ||
+                    (HeaderEnd(entries[last]) - runStart > CoalesceReadSize))
+                {   break;
+                }
+                runEnd = std::max(runEnd, HeaderEnd(entries[last]));
             }
 
-            m_streams.insert(std::make_pair(centralFileHeader.second->GetFileName(), std::move(fileStream)));
+            auto run = std::make_shared<std::vector<std::uint8_t>>(static_cast<std::size_t>(runEnd - runStart));
+            pos.QuadPart = runStart;
+            ThrowHrIfFailed(m_stream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(m_stream->Read(run->data(), static_cast<ULONG>(run->size()), &bytesRead));
+            run->resize(bytesRead);
+            auto runStream = ComPtr<IStream>::Make<VectorStream>(run);
+            bool isRetained = false;
+
+            for (std::size_t index = first; index < last; index++)
+            {
+                const auto& centralFileHeader = entries[index];
+                std::uint64_t offset = centralFileHeader->GetRelativeOffsetOfLocalHeader();
+                pos.QuadPart = offset - runStart;
+                ThrowHrIfFailed(runStream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
+                auto localFileHeader = std::make_shared<LocalFileHeader>(centralFileHeader);
+                localFileHeader->Read(runStream.Get());
+                if (offset + localFileHeader->Size() > runStart + run->size())
+                {   // the local header doesn't agree with the central directory about its size, read it on its own.
+                    pos.QuadPart = offset;
+                    ThrowHrIfFailed(m_stream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
+                    localFileHeader = std::make_shared<LocalFileHeader>(centralFileHeader);
+                    localFileHeader->Read(m_stream.Get());
+                }
+
+                std::uint64_t dataOffset = offset + localFileHeader->Size();
+                bool isInRun = (dataOffset + localFileHeader->GetCompressedSize() <= runStart + run->size());
+                isRetained = isRetained || isInRun;
+                AddFile(centralFileHeader->GetFileName(),
+                    localFileHeader->GetCompressionType() == CompressionType::Deflate,
+                    dataOffset,
+                    localFileHeader->GetCompressedSize(),
+                    localFileHeader->GetUncompressedSize(),
+                    centralFileHeader->GetCrc32(),
+                    isInRun ? runStream.Get() : m_stream.Get(),
+                    isInRun ? dataOffset - runStart : dataOffset,
+                    isInRun ? nullptr : stream,
+                    isInRun ? run : nullptr);
+            }
+            if (isRetained) { retained += run->size(); }
+            first = last;
         }
     } // ZipObject::ZipObject
+
+    ZipObject::ZipObject(IMSIXFactory* appxFactory, IStream* stream, PackageIndex& index) :
+        m_factory(appxFactory),
+        m_statistics(std::make_shared<ReadStatistics>())
+    {
+        m_stream = ComPtr<IStream>::Make<CountingStream>(stream, m_statistics, CountingStream::Kind::Source);
+        for (std::uint64_t i = 0; i < index.GetHeader().entryCount; i++)
+        {   const auto& entry = index.GetEntries()[i];
+            AddFile(index.GetName(entry.nameOffset, entry.nameSize), entry.isCompressed != 0, entry.dataOffset,
+                entry.compressedSize, entry.uncompressedSize, entry.crc, m_stream.Get(), entry.dataOffset, stream, nullptr);
+        }
+    }
+
+    void ZipObject::AddFile(const std::string& fileName, bool isCompressed, std::uint64_t dataOffset, std::uint64_t compressedSize,
+        std::uint64_t uncompressedSize, std::uint32_t crc, IStream* source, std::uint64_t sourceOffset, IStream* archive,
+        const std::shared_ptr<std::vector<std::uint8_t>>& run)
+    {
+        auto statistics = std::make_shared<ReadStatistics>();
+        auto counted = ComPtr<IStream>::Make<CountingStream>(source, statistics, CountingStream::Kind::Source);
+        auto fileStream = ComPtr<IStream>::Make<ZipFileStream>(
+            fileName,
+            m_factory,
+            isCompressed,
+            sourceOffset,
+            compressedSize,
+            counted.Get()
+            );
+        m_rawFiles.insert(std::make_pair(fileName, ZipRawFile { fileStream,
+            isCompressed,
+            uncompressedSize,
+            crc,
+            statistics,
+            archive,
+            dataOffset,
+            m_statistics,
+            compressedSize,
+            run,
+            sourceOffset }));
+
+        if (isCompressed)
+        {
+            fileStream = ComPtr<IStream>::Make<InflateStream>(fileStream.Get(), uncompressedSize, statistics);
+        }
+        fileStream = ComPtr<IStream>::Make<CountingStream>(fileStream.Get(), statistics, CountingStream::Kind::Delivered);
+
+        m_storageOrder.push_back(fileName);
+        m_fileStatistics.insert(std::make_pair(fileName, std::move(statistics)));
+        m_streams.insert(std::make_pair(fileName, std::move(fileStream)));
+    }
+
+    ZipObject::ZipObject(IMSIXFactory* appxFactory, IStream* stream, FileStream::Mode mode) :
+        m_factory(appxFactory),
+        m_stream(stream),
+        m_statistics(std::make_shared<ReadStatistics>()),
+        m_isWriting(true)
+    {
+        ThrowErrorIfNot(Error::NotImplemented, (mode == FileStream::Mode::WRITE || mode == FileStream::Mode::READ_UPDATE),
+            "archives can only be created, or updated in place");
+        if (mode == FileStream::Mode::READ_UPDATE)
+        {   // The central directory is written again, in zip64 form, after the files that are added.
+            m_isUpdating = true;
+            std::uint64_t sizeOfCD = 0;
+            for (const auto& entry : ReadCentralDirectory(m_stream.Get(), m_position, sizeOfCD))
+            {   auto file = std::make_shared<CentralDirectoryFileHeader>(true, nullptr);
+                file->SetFileName(entry->GetFileName());
+                file->SetGeneralPurposeBitFlags(static_cast<std::uint16_t>(entry->GetGeneralPurposeBitFlags()));
+                file->SetCompressionMethod(entry->GetCompressionMethod());
+                file->SetCrc(entry->GetCrc32());
+                file->SetCompressedSize(entry->GetCompressedSize());
+                file->SetUncompressedSize(entry->GetUncompressedSize());
+                file->SetRelativeOffsetOfLocalHeader(entry->GetRelativeOffsetOfLocalHeader());
+                m_fileStarts.insert(entry->GetRelativeOffsetOfLocalHeader());
+                m_centralDirectory.push_back(std::move(file));
+            }
+            SeekToPosition();
+        }
+    }
+
+    const std::uint64_t ForwardReadSize = 1024 * 1024;
+
+    // The package stream, read forward only through a buffer that the parser can look ahead into.
+    class ForwardReader
+    {
+    public:
+        ForwardReader(IStream* stream) : m_stream(stream), m_buffer(static_cast<std::size_t>(ForwardReadSize)) {}
+
+        // Makes at least count bytes available, unless the stream ends first, and returns how many are.  Reads
+        // as much as fits in the buffer while it is at it.
+        std::size_t Fill(std::size_t count)
+        {
+            if (Available() >= count || m_isStreamEnd) { return Available(); }
+            if (m_begin + count > m_buffer.size())
+            {   std::memmove(m_buffer.data(), m_buffer.data() + m_begin, Available());
+                m_end -= m_begin;
+                m_begin = 0;
+                if (count > m_buffer.size()) { m_buffer.resize(count); }
+            }
+            while (Available() < count && !m_isStreamEnd)
+            {
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(m_stream->Read(m_buffer.data() + m_end, static_cast<ULONG>(m_buffer.size() - m_end), &bytesRead));
+                m_isStreamEnd = (bytesRead == 0);
+                m_end += bytesRead;
+            }
+            return Available();
+        }
+
+        const std::uint8_t* Data()  { return m_buffer.data() + m_begin; }
+        std::size_t Available()     { return m_end - m_begin; }
+        bool IsStreamEnd()          { return m_isStreamEnd; }
+        void Consume(std::size_t count) { m_begin += count; }
+
+        // Exactly count bytes, which stay valid until the next call.
+        const std::uint8_t* Take(std::size_t count)
+        {
+            ThrowErrorIf(Error::FileRead, (Fill(count) < count), "package truncated");
+            auto result = Data();
+            Consume(count);
+            return result;
+        }
+
+        void Skip(std::uint64_t count)
+        {
+            while (count != 0)
+            {   auto size = static_cast<std::size_t>(std::min<std::uint64_t>(count, m_buffer.size()));
+                Take(size);
+                count -= size;
+            }
+        }
+
+        std::uint32_t PeekSignature()
+        {
+            ThrowErrorIf(Error::FileRead, (Fill(4) < 4), "package truncated");
+            return ReadUInt32(Data());
+        }
+
+        static std::uint16_t ReadUInt16(const std::uint8_t* data)
+        {   return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+        }
+
+        static std::uint32_t ReadUInt32(const std::uint8_t* data)
+        {   return static_cast<std::uint32_t>(ReadUInt16(data)) | (static_cast<std::uint32_t>(ReadUInt16(data + 2)) << 16);
+        }
+
+        static std::uint64_t ReadUInt64(const std::uint8_t* data)
+        {   return static_cast<std::uint64_t>(ReadUInt32(data)) | (static_cast<std::uint64_t>(ReadUInt32(data + 4)) << 32);
+        }
+
+    protected:
+        ComPtr<IStream>           m_stream;
+        std::vector<std::uint8_t> m_buffer;
+        std::size_t               m_begin = 0;
+        std::size_t               m_end = 0;
+        bool                      m_isStreamEnd = false;
+    };
+
+    // Takes the content of a file as it is inflated, writes it to the staged file in 64KB blocks and hashes each
+    // block on the way.
+    class StagingWriter
+    {
+    public:
+        StagingWriter(IStream* target, std::vector<std::vector<std::uint8_t>>& blockHashes) :
+            m_target(target), m_blockHashes(blockHashes)
+        {   m_block.reserve(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+        }
+
+        void Write(const std::uint8_t* data, std::size_t size)
+        {
+            m_size += size;
+            while (size != 0)
+            {
+                auto count = std::min(size, static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE) - m_block.size());
+                m_block.insert(m_block.end(), data, data + count);
+                data += count;
+                size -= count;
+                if (m_block.size() == BLOCKMAP_BLOCK_SIZE) { WriteBlock(); }
+            }
+        }
+
+        void Close()
+        {   if (!m_block.empty()) { WriteBlock(); }
+        }
+
+        std::uint64_t GetSize() { return m_size; }
+
+    protected:
+        void WriteBlock()
+        {
+            std::vector<std::uint8_t> hash;
+            ThrowErrorIfNot(Error::SignatureInvalid, SHA256::ComputeHash(m_block.data(), m_block.size(), hash), "failed computing hash");
+            m_blockHashes.push_back(std::move(hash));
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(m_target->Write(m_block.data(), static_cast<ULONG>(m_block.size()), &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == m_block.size()), "incomplete write");
+            m_block.clear();
+        }
+
+        IStream*                                m_target;
+        std::vector<std::vector<std::uint8_t>>& m_blockHashes;
+        std::vector<std::uint8_t>               m_block;
+        std::uint64_t                           m_size = 0;
+    };
+
+    // A data descriptor may or may not start with its signature, and has 8 byte sizes in zip64 archives.  Returns
+    // how long the first form with the sizes of the file is, or 0 if none do, and the crc it holds.  Like everywhere
+    // else, the crc is only compared with the central directory, the content is checked against the block map.
+    static std::size_t MatchDataDescriptor(const std::uint8_t* data, std::size_t available,
+        std::uint64_t compressedSize, std::uint64_t uncompressedSize, std::uint32_t& crc)
+    {
+        std::size_t start = 0;
+        if (available >= 4 && ForwardReader::ReadUInt32(data) == static_cast<std::uint32_t>(Signatures::DataDescriptor))
+        {   start = 4;
+        }
+        data += start;
+        available -= start;
+        if (available < 12) { return 0; }
+        if (available >= 20 &&
+            ForwardReader::ReadUInt64(data + 4) == compressedSize && ForwardReader::ReadUInt64(data + 12) == uncompressedSize)
+        {   crc = ForwardReader::ReadUInt32(data);
+            return start + 20;
+        }
+        if (ForwardReader::ReadUInt32(data + 4) == compressedSize && ForwardReader::ReadUInt32(data + 8) == uncompressedSize)
+        {   crc = ForwardReader::ReadUInt32(data);
+            return start + 12;
+        }
+        return 0;
+    }
+
+    void ZipStreamObject::ReadFile(ForwardReader& reader)
+    {
+        // Same rules as for the LocalFileHeader of an archive that is read through its central directory.
+        const std::uint8_t* header = reader.Take(static_cast<std::size_t>(LocalFileHeaderFixedSize));
+        auto version          = ForwardReader::ReadUInt16(header + 4);
+        auto flags            = static_cast<GeneralPurposeBitFlags>(ForwardReader::ReadUInt16(header + 6));
+        auto compression      = static_cast<CompressionType>(ForwardReader::ReadUInt16(header + 8));
+        auto crc              = ForwardReader::ReadUInt32(header + 14);
+        auto compressedSize   = static_cast<std::uint64_t>(ForwardReader::ReadUInt32(header + 18));
+        auto uncompressedSize = static_cast<std::uint64_t>(ForwardReader::ReadUInt32(header + 22));
+        auto fileNameLength   = ForwardReader::ReadUInt16(header + 26);
+        auto extraFieldLength = ForwardReader::ReadUInt16(header + 28);
+        bool hasDataDescriptor = ((flags & GeneralPurposeBitFlags::GeneralPurposeBit) == GeneralPurposeBitFlags::GeneralPurposeBit);
+
+        ThrowErrorIfNot(Error::ZipLocalFileHeader,
+            ((version == static_cast<std::uint16_t>(ZipVersions::Zip32DefaultVersion)) ||
+            (version == static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension))),
+            "unsupported version needed to extract");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader,
+            ((static_cast<std::uint16_t>(flags) & static_cast<std::uint16_t>(UnsupportedFlagsMask)) == 0),
+            "unsupported flag(s) specified");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader,
+            ((compression == CompressionType::Store) || (compression == CompressionType::Deflate)),
+            "unsupported compression method");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, (!hasDataDescriptor || (ForwardReader::ReadUInt32(header + 14) == 0)), "Invalid Zip CRC");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, (!hasDataDescriptor || (compressedSize == 0)), "Invalid compressed size");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, (!hasDataDescriptor || (uncompressedSize == 0)), "Invalid uncompressed size");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, (fileNameLength != 0), "unsupported file name size");
+        ThrowErrorIfNot(Error::ZipLocalFileHeader, (extraFieldLength == 0), "unsupported extra field size");
+
+        const std::uint8_t* fileName = reader.Take(fileNameLength);
+        std::string name(fileName, fileName + fileNameLength);
+        ThrowErrorIf(Error::ZipLocalFileHeader, (m_files.find(name) != m_files.end()), "file is in the archive more than once");
+
+        StagedFile file;
+        file.stagedName = std::to_string(m_storageOrder.size());
+        file.statistics = std::make_shared<ReadStatistics>();
+        auto staging = m_staging.As<IStorageObject>();
+        StagingWriter writer(staging->OpenFile(file.stagedName, FileStream::Mode::WRITE), file.blockHashes);
+        std::uint64_t compressed = 0;
+
+        if (compression == CompressionType::Deflate)
+        {
+            Global::Perf::Scope scope(Global::Perf::Counter::Inflate);
+            z_stream zstrm = {0};
+            ThrowErrorIfNot(Error::InflateInitialize, (inflateInit2(&zstrm, -MAX_WBITS) == Z_OK), "inflateInit2 failed");
+            std::unique_ptr<z_stream, decltype(&inflateEnd)> inflater(&zstrm, &inflateEnd);
+            std::vector<std::uint8_t> output(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+            for (int result = Z_OK; result != Z_STREAM_END; )
+            {
+                ThrowErrorIf(Error::InflateCorruptData, (reader.Fill(1) == 0), "package truncated");
+                auto available = static_cast<uInt>(std::min<std::size_t>(reader.Available(), std::numeric_limits<uInt>::max()));
+                zstrm.next_in   = const_cast<Bytef*>(reader.Data());
+                zstrm.avail_in  = available;
+                zstrm.next_out  = output.data();
+                zstrm.avail_out = static_cast<uInt>(output.size());
+                result = inflate(&zstrm, Z_NO_FLUSH);
+                ThrowErrorIfNot(Error::InflateCorruptData, (result == Z_OK || result == Z_STREAM_END), "inflate failed unexpectedly.");
+                reader.Consume(available - zstrm.avail_in);
+                compressed += available - zstrm.avail_in;
+                writer.Write(output.data(), output.size() - zstrm.avail_out);
+            }
+            scope.AddBytes(writer.GetSize());
+            file.statistics->bytesInflated.fetch_add(writer.GetSize(), std::memory_order_relaxed);
+        }
+        else if (!hasDataDescriptor)
+        {
+            for (std::uint64_t remaining = compressedSize; remaining != 0; )
+            {
+                auto count = std::min<std::uint64_t>(reader.Fill(1), remaining);
+                ThrowErrorIf(Error::FileRead, (count == 0), "package truncated");
+                writer.Write(reader.Data(), static_cast<std::size_t>(count));
+                reader.Consume(static_cast<std::size_t>(count));
+                remaining -= count;
+            }
+            compressed = compressedSize;
+        }
+        else
+        {   // Nothing says where a stored file with a data descriptor ends, other than the data descriptor itself.
+            // Look for its signature followed by the size of everything before it.
+            static const std::uint8_t signature[] = { 0x50, 0x4b, 0x07, 0x08 };
+            for (std::size_t length = 0; length == 0; )
+            {
+                std::size_t available = reader.Fill(24);
+                const std::uint8_t* data = reader.Data();
+                auto found = static_cast<std::size_t>(std::search(data, data + available, std::begin(signature), std::end(signature)) - data);
+                std::size_t count = found;
+                if (found == available)
+                {   ThrowErrorIf(Error::ZipLocalFileHeader, reader.IsStreamEnd(), "data descriptor not found");
+                    count = available - 3;  // the signature may start in the last three bytes
+                }
+                else if (found == 0)
+                {   length = MatchDataDescriptor(data, available, writer.GetSize(), writer.GetSize(), crc);
+                    count = (length == 0) ? 1 : 0;
+                }
+                writer.Write(data, count);
+                reader.Consume(count + length);
+            }
+            compressed = writer.GetSize();
+        }
+        writer.Close();
+        staging->CommitChanges();
+
+        if (hasDataDescriptor)
+        {   if (compression == CompressionType::Deflate)
+            {   auto available = reader.Fill(24);
+                auto length = MatchDataDescriptor(reader.Data(), available, compressed, writer.GetSize(), crc);
+                ThrowErrorIf(Error::ZipLocalFileHeader, (length == 0), "data descriptor does not match the file");
+                reader.Consume(length);
+            }
+        }
+        else
+        {   ThrowErrorIfNot(Error::ZipLocalFileHeader,
+                (compressedSize == compressed && uncompressedSize == writer.GetSize()),
+                "local file header does not match the file");
+        }
+
+        file.crc = crc;
+        file.compressedSize = compressed;
+        file.uncompressedSize = writer.GetSize();
+        file.statistics->bytesDelivered.fetch_add(writer.GetSize(), std::memory_order_relaxed);
+        m_statistics->bytesInflated.fetch_add(file.statistics->bytesInflated.load(), std::memory_order_relaxed);
+        m_statistics->bytesDelivered.fetch_add(writer.GetSize(), std::memory_order_relaxed);
+        m_storageOrder.push_back(name);
+        m_files.insert(std::make_pair(std::move(name), std::move(file)));
+    }
+
+    // All that is left to check once the files are in is that the central directory lists exactly the files that
+    // were read, once each, with the same sizes and crc, and that nothing follows the end of central directory record.
+    void ZipStreamObject::ReadCentralDirectory(ForwardReader& reader)
+    {
+        Global::Perf::Scope scope(Global::Perf::Counter::CentralDirectoryParse);
+        std::size_t count = 0;
+        while (reader.PeekSignature() == static_cast<std::uint32_t>(Signatures::CentralFileHeader))
+        {
+            const std::uint8_t* header = reader.Take(46);
+            auto crc              = ForwardReader::ReadUInt32(header + 16);
+            auto compressedSize   = static_cast<std::uint64_t>(ForwardReader::ReadUInt32(header + 20));
+            auto uncompressedSize = static_cast<std::uint64_t>(ForwardReader::ReadUInt32(header + 24));
+            auto fileNameLength   = ForwardReader::ReadUInt16(header + 28);
+            auto extraFieldLength = ForwardReader::ReadUInt16(header + 30);
+            auto commentLength    = ForwardReader::ReadUInt16(header + 32);
+            const std::uint8_t* fileName = reader.Take(fileNameLength);
+            auto file = m_files.find(std::string(fileName, fileName + fileNameLength));
+            ThrowErrorIf(Error::ZipCentralDirectoryHeader, (file == m_files.end()), "file in the central directory has no local file header");
+            ThrowErrorIf(Error::ZipCentralDirectoryHeader, (file->second.inCentralDirectory), "file is in the central directory more than once");
+            file->second.inCentralDirectory = true;
+
+            // Sizes that don't fit in 4 bytes are in the zip64 extended information, in this order.
+            const std::uint8_t* extra = reader.Take(extraFieldLength);
+            for (std::size_t offset = 0; offset + 4 <= extraFieldLength; )
+            {
+                auto id   = ForwardReader::ReadUInt16(extra + offset);
+                auto size = ForwardReader::ReadUInt16(extra + offset + 2);
+                ThrowErrorIf(Error::ZipCentralDirectoryHeader, (offset + 4 + size > extraFieldLength), "extra field is truncated");
+                if (id == 0x0001)
+                {   std::size_t field = offset + 4;
+                    for (auto value : { &uncompressedSize, &compressedSize })
+                    {   if (*value != 0xFFFFFFFF) { continue; }
+                        ThrowErrorIf(Error::ZipCentralDirectoryHeader, (field + 8 > offset + 4 + size), "zip64 extended information is truncated");
+                        *value = ForwardReader::ReadUInt64(extra + field);
+                        field += 8;
+                    }
+                }
+                offset += 4 + size;
+            }
+            ThrowErrorIfNot(Error::ZipCentralDirectoryHeader,
+                (crc == file->second.crc && compressedSize == file->second.compressedSize && uncompressedSize == file->second.uncompressedSize),
+                "central directory does not match the local file header");
+            reader.Skip(commentLength);
+            count++;
+        }
+        ThrowErrorIfNot(Error::ZipCentralDirectoryHeader, (count == m_files.size()), "file missing from the central directory");
+
+        if (reader.PeekSignature() == static_cast<std::uint32_t>(Signatures::Zip64EndOfCD))
+        {   // the size of the record doesn't count its signature and the size itself.
+            reader.Skip(ForwardReader::ReadUInt64(reader.Take(12) + 4));
+        }
+        if (reader.PeekSignature() == static_cast<std::uint32_t>(Signatures::Zip64EndOfCDLocator))
+        {   reader.Skip(20);
+        }
+        ThrowErrorIfNot(Error::ZipEOCDRecord,
+            (reader.PeekSignature() == static_cast<std::uint32_t>(Signatures::EndOfCentralDirectory)),
+            "missing end of central directory record");
+        reader.Skip(ForwardReader::ReadUInt16(reader.Take(22) + 20));
+        ThrowErrorIfNot(Error::ZipHiddenData, (reader.Fill(1) == 0), "data after the end of central directory record");
+    }
+
+    ZipStreamObject::ZipStreamObject(IMSIXFactory* factory, IStream* stream, IDirectoryObject* staging) :
+        m_factory(factory),
+        m_staging(staging),
+        m_statistics(std::make_shared<ReadStatistics>())
+    {
+        try
+        {
+            ForwardReader reader(ComPtr<IStream>::Make<CountingStream>(stream, m_statistics, CountingStream::Kind::Source).Get());
+            while (reader.PeekSignature() == static_cast<std::uint32_t>(Signatures::LocalFileHeader))
+            {   ReadFile(reader);
+            }
+            ReadCentralDirectory(reader);
+        }
+        catch (...)
+        {   try { m_staging->RemoveAll(); } catch (...) {}
+            throw;
+        }
+    }
+
+    ZipStreamObject::~ZipStreamObject()
+    {
+        try { m_staging->RemoveAll(); } catch (...) {}
+    }
+
+    std::string ZipStreamObject::GetPathSeparator() { return "/"; }
+
+    std::vector<std::string> ZipStreamObject::GetFileNames(FileNameOptions options)
+    {
+        return m_storageOrder;
+    }
+
+    IStream* ZipStreamObject::GetFile(const std::string& fileName)
+    {
+        auto file = m_files.find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (file == m_files.end()), "file not in archive");
+        return m_staging.As<IStorageObject>()->GetFile(file->second.stagedName);
+    }
+
+    void ZipStreamObject::RemoveFile(const std::string& fileName)
+    {
+        throw Exception(Error::NotImplemented);
+    }
+
+    IStream* ZipStreamObject::OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode)
+    {
+        throw Exception(Error::NotImplemented);
+    }
+
+    void ZipStreamObject::CommitChanges()
+    {
+        throw Exception(Error::NotImplemented);
+    }
+
+    HRESULT STDMETHODCALLTYPE ZipStreamObject::GetStatistics(MSIX_READ_STATISTICS* statistics)
+    {
+        return ResultOf([&]{
+            ThrowErrorIf(Error::InvalidParameter, (statistics == nullptr), "bad pointer");
+            *statistics = {0};
+            m_statistics->AddTo(*statistics);
+        });
+    }
+
+    HRESULT STDMETHODCALLTYPE ZipStreamObject::GetFileStatistics(LPCWSTR fileName, MSIX_READ_STATISTICS* statistics)
+    {
+        return ResultOf([&]{
+            ThrowErrorIf(Error::InvalidParameter, (fileName == nullptr || *fileName == '\0' || statistics == nullptr), "bad pointer");
+            auto file = m_files.find(utf16_to_utf8(fileName));
+            ThrowErrorIf(Error::FileNotFound, (file == m_files.end()), "file not in archive");
+            *statistics = {0};
+            file->second.statistics->AddTo(*statistics);
+        });
+    }
+
+    const std::vector<std::vector<std::uint8_t>>& ZipStreamObject::GetBlockHashes(const std::string& fileName)
+    {
+        auto file = m_files.find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (file == m_files.end()), "file not in archive");
+        return file->second.blockHashes;
+    }
+
+    void ZipStreamObject::CommitFile(const std::string& fileName, IStorageObject* to, const std::string& targetName)
+    {
+        auto file = m_files.find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (file == m_files.end()), "file not in archive");
+        ComPtr<IDirectoryObject> directory;
+        if (SUCCEEDED(to->QueryInterface(UuidOfImpl<IDirectoryObject>::iid, reinterpret_cast<void**>(&directory))))
+        {   directory->MoveFileFrom(m_staging.Get(), file->second.stagedName, targetName);
+            return;
+        }
+        // Not a directory that the file can be moved into, copy it.
+        auto source = GetFile(fileName);
+        auto target = to->OpenFile(targetName, FileStream::Mode::WRITE_UPDATE);
+        LARGE_INTEGER li{0};
+        ThrowHrIfFailed(source->Seek(li, StreamBase::Reference::START, nullptr));
+        std::vector<std::uint8_t> buffer(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+        for (;;)
+        {
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(source->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+            if (bytesRead == 0) { break; }
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(target->Write(buffer.data(), bytesRead, &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == bytesRead), "incomplete write");
+        }
+        to->CommitChanges();
+    }
 } // namespace MSIX
\ No newline at end of file
@@ -12,14 +12,24 @@
 #include "ComHelper.hpp"
 #include "AppxPackaging.hpp"
 #include "AppxPackageObject.hpp"
+#include "AppxPackageWriter.hpp"
 #include "AppxFactory.hpp"
+#include "ContentType.hpp"
 #include "Log.hpp"
+#include "Perf.hpp"
+#include "PackageDiff.hpp"
 
 #include <string>
 #include <memory>
+#include <algorithm>
 #include <cstdlib>
 #include <functional>
 
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
 #ifndef WIN32
 // on non-win32 platforms, compile with -fvisibility=hidden
 #undef MSIX_API
@@ -42,32 +52,302 @@ static void finalizer(void) {
 LPVOID STDMETHODCALLTYPE InternalAllocate(SIZE_T cb)  { return std::malloc(cb); }
 void STDMETHODCALLTYPE InternalFree(LPVOID pv)        { std::free(pv); }
 
+static void Unpack(MSIX_PACKUNPACK_OPTION packUnpackOptions, MSIX::ComPtr<IAppxPackageReader>& reader, char* utf8Destination,
+    const MSIX::ContentGroupCallback& onContentGroup)
+{
+    auto to = MSIX::ComPtr<IStorageObject>::Make<MSIX::DirectoryObject>(utf8Destination);
+    reader.As<IPackage>()->Unpack(packUnpackOptions, to.Get(), onContentGroup);
+
+    if (MSIX::Global::Perf::IsEnabled())
+    {   // Fold this reader's I/O accounting into the global counters.
+        using MSIX::Global::Perf::Counter;
+        MSIX_READ_STATISTICS statistics = {0};
+        ThrowHrIfFailed(reader.As<IMSIXReadStatistics>()->GetStatistics(&statistics));
+        MSIX::Global::Perf::Add(Counter::PackageRead,       statistics.sourceReads, statistics.sourceBytesRead);
+        MSIX::Global::Perf::Add(Counter::PackageSeek,       statistics.sourceSeeks, 0);
+        MSIX::Global::Perf::Add(Counter::PackageDelivered,  0, statistics.bytesDelivered);
+        MSIX::Global::Perf::Add(Counter::PackageReinflated, 0, statistics.bytesReinflated);
+    }
+}
+
+static void UnpackFromStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    const MSIX::ContentGroupCallback& onContentGroup)
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, (stream != nullptr && utf8Destination != nullptr), "Invalid parameters");
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+    auto self = factory.As<IMSIXFactory>();
+
+    // Next to the destination rather than in it, so that it is on the same volume without being somewhere
+    // that a file in the package could also be.  The name is made unique, as whatever is there is removed
+    // along with the ZipStreamObject.
+    std::string destination = utf8Destination;
+    while (destination.size() > 1 && (destination.back() == '/' || destination.back() == '\\')) { destination.pop_back(); }
+    auto staging = MSIX::DirectoryObject::CreateUnique(destination + ".staging-");
+
+    auto zip = MSIX::ComPtr<IStorageObject>::Make<MSIX::ZipStreamObject>(self.Get(), stream, staging.Get());
+    auto reader = MSIX::ComPtr<IAppxPackageReader>::Make<MSIX::AppxPackageObject>(self.Get(), validationOption, zip.Get());
+    Unpack(packUnpackOptions, reader, utf8Destination, onContentGroup);
+}
+
+static void UnpackFromFile(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    const MSIX::ContentGroupCallback& onContentGroup)
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
+        (utf8SourcePackage != nullptr && utf8Destination != nullptr), 
+        "Invalid parameters"
+    );
+
+    if (std::string(utf8SourcePackage) == "-")
+    {   // Standard input is left open when the stream goes away.
+        #ifdef WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+        #endif
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(stdin);
+        UnpackFromStream(packUnpackOptions, validationOption, stream.Get(), utf8Destination, onContentGroup);
+        return;
+    }
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    // We don't need to use the caller's heap here because we're not marshalling any strings
+    // out to the caller.  So default to new / delete[] and be done with it!
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+
+    MSIX::ComPtr<IAppxPackageReader> reader;
+    ThrowHrIfFailed(factory->CreatePackageReader(stream.Get(), &reader));
+    Unpack(packUnpackOptions, reader, utf8Destination, onContentGroup);
+}
 
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackage(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
     char* utf8SourcePackage,
     char* utf8Destination)
+{
+    return MSIX::ResultOf([&]() {
+        UnpackFromFile(packUnpackOptions, validationOption, utf8SourcePackage, utf8Destination, nullptr);
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageByContentGroup(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    MSIX_CONTENT_GROUP_CALLBACK* callback,
+    void* context)
+{
+    return MSIX::ResultOf([&]() {
+        ThrowErrorIfNot(MSIX::Error::InvalidParameter, (callback != nullptr), "Invalid parameters");
+        UnpackFromFile(packUnpackOptions, validationOption, utf8SourcePackage, utf8Destination,
+            [callback, context](const std::string& groupName, bool isRequired)
+            {   callback(groupName.c_str(), isRequired ? TRUE : FALSE, context);
+            });
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination)
+{
+    return MSIX::ResultOf([&]() {
+        UnpackFromStream(packUnpackOptions, validationOption, stream, utf8Destination, nullptr);
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackage(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourceDirectory,
+    char* utf8Destination)
 {
     return MSIX::ResultOf([&]() {
         ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
-            (utf8SourcePackage != nullptr && utf8Destination != nullptr), 
+            (utf8SourceDirectory != nullptr && utf8Destination != nullptr), 
             "Invalid parameters"
         );
+        ThrowErrorIf(MSIX::Error::NotImplemented,
+            (packUnpackOptions & MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER),
+            "package subfolder is an unpack option"
+        );
 
         MSIX::ComPtr<IAppxFactory> factory;
-        // We don't need to use the caller's heap here because we're not marshalling any strings
-        // out to the caller.  So default to new / delete[] and be done with it!
         ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
 
+        auto from = MSIX::ComPtr<IStorageObject>::Make<MSIX::DirectoryObject>(utf8SourceDirectory);
+        auto fileNames = from->GetFileNames(FileNameOptions::All);
+        ThrowErrorIf(MSIX::Error::MissingAppxManifestXML,
+            (std::find(fileNames.begin(), fileNames.end(), APPXMANIFEST_XML) == fileNames.end()),
+            "AppxManifest.xml not in source directory!"
+        );
+
         MSIX::ComPtr<IStream> stream;
-        ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+        ThrowHrIfFailed(CreateStreamOnFile(utf8Destination, false, &stream));
+
+        MSIX::ComPtr<IAppxPackageWriter> writer;
+        ThrowHrIfFailed(factory->CreatePackageWriter(stream.Get(), nullptr, &writer));
+
+        // The writer generates the block map and content types, and a signature would not match the new package.
+        for (const auto& fileName : fileNames)
+        {
+            if (fileName == APPXMANIFEST_XML  || fileName == APPXBLOCKMAP_XML  || fileName == CONTENT_TYPES_XML ||
+                fileName == APPXSIGNATURE_P7X || fileName == CODEINTEGRITY_CAT)
+            {   continue;
+            }
+            ThrowHrIfFailed(writer->AddPayloadFile(
+                MSIX::utf8_to_utf16(fileName).c_str(),
+                MSIX::utf8_to_utf16(MSIX::GetContentTypeByExtension(fileName)).c_str(),
+                APPX_COMPRESSION_OPTION_NORMAL,
+                from->GetFile(fileName)
+            ));
+        }
+        ThrowHrIfFailed(writer->Close(from->GetFile(APPXMANIFEST_XML)));
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE RepackPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 excludedFilesCount,
+    char** utf8ExcludedFiles,
+    BOOL verify)
+{
+    return MSIX::ResultOf([&]() {
+        ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+            (utf8SourcePackage != nullptr && utf8Destination != nullptr && (excludedFilesCount == 0 || utf8ExcludedFiles != nullptr)),
+            "Invalid parameters"
+        );
+        // The code integrity catalog goes with the signature, which the new package doesn't have.
+        std::vector<std::string> excluded { CODEINTEGRITY_CAT };
+        for (UINT32 i = 0; i < excludedFilesCount; i++)
+        {   ThrowErrorIf(MSIX::Error::InvalidParameter, (utf8ExcludedFiles[i] == nullptr), "Invalid parameters");
+            excluded.push_back(utf8ExcludedFiles[i]);
+        }
+        // as the block map names them
+        for (auto& name : excluded) { std::replace(name.begin(), name.end(), '/', '\\'); }
+
+        MSIX::ComPtr<IAppxFactory> factory;
+        ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
 
+        MSIX::ComPtr<IStream> input;
+        ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &input));
         MSIX::ComPtr<IAppxPackageReader> reader;
-        ThrowHrIfFailed(factory->CreatePackageReader(stream.Get(), &reader));
+        ThrowHrIfFailed(factory->CreatePackageReader(input.Get(), &reader));
+        MSIX::ComPtr<IAppxBlockMapReader> blockMap;
+        ThrowHrIfFailed(reader->GetBlockMap(&blockMap));
+        MSIX::ComPtr<IAppxFile> manifest;
+        ThrowHrIfFailed(reader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_MANIFEST, &manifest));
+        MSIX::ComPtr<IStream> manifestStream;
+        ThrowHrIfFailed(manifest->GetStream(&manifestStream));
+
+        MSIX::ComPtr<IStream> output;
+        ThrowHrIfFailed(CreateStreamOnFile(utf8Destination, false, &output));
+        MSIX::ComPtr<IAppxPackageWriter> writer;
+        ThrowHrIfFailed(factory->CreatePackageWriter(output.Get(), nullptr, &writer));
+        auto packageWriter = writer.As<IMSIXPackageWriter>();
+
+        for (const auto& fileName : blockMap.As<IStorageObject>()->GetFileNames(FileNameOptions::PayloadOnly))
+        {
+            if (fileName == APPXMANIFEST_XML || std::find(excluded.begin(), excluded.end(), fileName) != excluded.end())
+            {   continue;
+            }
+            ThrowHrIfFailed(packageWriter->AddPayloadFileFromPackage(reader.Get(), MSIX::utf8_to_utf16(fileName).c_str(), verify));
+        }
+        ThrowHrIfFailed(writer->Close(manifestStream.Get()));
+    });
+}
 
-        auto to = MSIX::ComPtr<IStorageObject>::Make<MSIX::DirectoryObject>(utf8Destination);
-        reader.As<IPackage>()->Unpack(packUnpackOptions, to.Get());
+MSIX_API HRESULT STDMETHODCALLTYPE EditPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8Package,
+    char* utf8SourceDirectory,
+    UINT32 removedFilesCount,
+    char** utf8RemovedFiles,
+    BOOL compact)
+{
+    return MSIX::ResultOf([&]() {
+        ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+            (utf8Package != nullptr && (removedFilesCount == 0 || utf8RemovedFiles != nullptr)),
+            "Invalid parameters"
+        );
+        MSIX::ComPtr<IAppxFactory> factory;
+        ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+        MSIX::ComPtr<IMSIXPackageEditor> editor;
+        ThrowHrIfFailed(CreatePackageEditor(factory.Get(), utf8Package, &editor));
+
+        for (UINT32 i = 0; i < removedFilesCount; i++)
+        {   ThrowErrorIf(MSIX::Error::InvalidParameter, (utf8RemovedFiles[i] == nullptr), "Invalid parameters");
+            ThrowHrIfFailed(editor->RemovePayloadFile(MSIX::utf8_to_utf16(utf8RemovedFiles[i]).c_str()));
+        }
+
+        if (utf8SourceDirectory != nullptr)
+        {   auto from = MSIX::ComPtr<IStorageObject>::Make<MSIX::DirectoryObject>(utf8SourceDirectory);
+            for (const auto& fileName : from->GetFileNames(FileNameOptions::All))
+            {
+                if (fileName == APPXMANIFEST_XML  || fileName == APPXBLOCKMAP_XML  || fileName == CONTENT_TYPES_XML ||
+                    fileName == APPXSIGNATURE_P7X || fileName == CODEINTEGRITY_CAT)
+                {   continue;
+                }
+                ThrowHrIfFailed(editor->AddPayloadFile(
+                    MSIX::utf8_to_utf16(fileName).c_str(),
+                    MSIX::utf8_to_utf16(MSIX::GetContentTypeByExtension(fileName)).c_str(),
+                    APPX_COMPRESSION_OPTION_NORMAL,
+                    from->GetFile(fileName)
+                ));
+            }
+        }
+        ThrowHrIfFailed(editor->Commit(compact));
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE DiffPackages(
+    IAppxPackageReader* oldPackage,
+    IAppxPackageReader* newPackage,
+    IMSIXPackageDiff** diff)
+{
+    return MSIX::ResultOf([&]() {
+        ThrowErrorIf(MSIX::Error::InvalidParameter,
+            (oldPackage == nullptr || newPackage == nullptr || diff == nullptr || *diff != nullptr), "Invalid parameters");
+        auto GetBlockMap = [](IAppxPackageReader* package)
+        {   MSIX::ComPtr<IAppxBlockMapReader> blockMap;
+            ThrowHrIfFailed(package->GetBlockMap(&blockMap));
+            return blockMap.As<IAppxBlockMapInternal>();
+        };
+        *diff = MSIX::ComPtr<IMSIXPackageDiff>::Make<MSIX::PackageDiff>(
+            GetBlockMap(oldPackage).Get(), GetBlockMap(newPackage).Get()).Detach();
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreatePackageEditor(
+    IAppxFactory* factory,
+    char* utf8Package,
+    IMSIXPackageEditor** editor)
+{
+    return MSIX::ResultOf([&]() {
+        ThrowErrorIf(MSIX::Error::InvalidParameter,
+            (factory == nullptr || utf8Package == nullptr || editor == nullptr || *editor != nullptr), "Invalid parameters");
+        // One stream, read and written, so that the package is opened only once.
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(utf8Package, MSIX::FileStream::Mode::READ_UPDATE);
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(factory->CreatePackageReader(stream.Get(), &reader));
+        MSIX::ComPtr<IAppxFactory> appxFactory(factory);
+        *editor = MSIX::ComPtr<IMSIXPackageEditor>::Make<MSIX::AppxPackageWriter>(
+            appxFactory.As<IMSIXFactory>().Get(), stream.Get(), reader.Get()).Detach();
     });
 }
 
@@ -75,14 +355,79 @@ MSIX_API HRESULT STDMETHODCALLTYPE GetLogTextUTF8(COTASKMEMALLOC* memalloc, char
 {
     return MSIX::ResultOf([&](){        
         ThrowErrorIf(MSIX::Error::InvalidParameter, (logText == nullptr || *logText != nullptr), "bad pointer" );
-        std::size_t countBytes = sizeof(char)*(MSIX::Global::Log::Text().size()+1);
+        auto text = MSIX::Global::Log::Take();
+        std::size_t countBytes = sizeof(char)*(text.size()+1);
         *logText = reinterpret_cast<char*>(memalloc(countBytes));
         ThrowErrorIfNot(MSIX::Error::OutOfMemory, (*logText), "Allocation failed!");
         std::memset(reinterpret_cast<void*>(*logText), 0, countBytes);
-        std::memcpy(reinterpret_cast<void*>(*logText),
-                    reinterpret_cast<void*>(const_cast<char*>(MSIX::Global::Log::Text().c_str())),
-                    countBytes - sizeof(char));
-        MSIX::Global::Log::Clear();
+        std::memcpy(reinterpret_cast<void*>(*logText), text.c_str(), countBytes - sizeof(char));
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE SetLogLevel(MSIX_LOG_LEVEL level)
+{
+    return MSIX::ResultOf([&](){
+        ThrowErrorIf(MSIX::Error::InvalidParameter,
+            (level < MSIX_LOG_LEVEL_ERROR || level > MSIX_LOG_LEVEL_VERBOSE), "unknown level");
+        MSIX::Global::Log::SetLevel(static_cast<MSIX::Global::Log::Level>(level));
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE SetLogCallback(MSIX_LOG_CALLBACK* callback, void* context)
+{
+    return MSIX::ResultOf([&](){
+        if (callback == nullptr)
+        {   MSIX::Global::Log::SetSink(nullptr);
+            return;
+        }
+        MSIX::Global::Log::SetSink([callback, context](const MSIX::Global::Log::Entry& entry)
+        {   MSIX_LOG_ENTRY result = { static_cast<MSIX_LOG_LEVEL>(entry.level), static_cast<HRESULT>(entry.code),
+                entry.timestamp, entry.thread, entry.message.c_str() };
+            callback(&result, context);
+        });
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE SetPerformanceOptions(MSIX_PERFORMANCE_OPTION options)
+{
+    return MSIX::ResultOf([&](){
+        ThrowErrorIf(MSIX::Error::InvalidParameter,
+            (options & ~(MSIX_PERFORMANCE_OPTION_COUNTERS | MSIX_PERFORMANCE_OPTION_TRACE)), "unknown option");
+        MSIX::Global::Perf::SetOptions(static_cast<std::uint32_t>(options));
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE GetPerformanceCounters(UINT32* countersCount, MSIX_PERFORMANCE_COUNTER* counters)
+{
+    return MSIX::ResultOf([&](){
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (countersCount == nullptr), "bad pointer");
+        const auto available = static_cast<UINT32>(MSIX::Global::Perf::Counter::Max);
+        if (counters != nullptr)
+        {
+            ThrowErrorIf(MSIX::Error::InvalidParameter, (*countersCount < available), "buffer too small");
+            for (UINT32 index = 0; index < available; index++)
+            {
+                auto counter = static_cast<MSIX::Global::Perf::Counter>(index);
+                auto data = MSIX::Global::Perf::Get(counter);
+                counters[index].name        = MSIX::Global::Perf::Name(counter);
+                counters[index].count       = data.count;
+                counters[index].bytes       = data.bytes;
+                counters[index].nanoseconds = data.nanoseconds;
+            }
+        }
+        *countersCount = available;
+    });
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE GetPerformanceTraceUTF8(COTASKMEMALLOC* memalloc, char** traceText)
+{
+    return MSIX::ResultOf([&](){
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (traceText == nullptr || *traceText != nullptr), "bad pointer" );
+        auto text = MSIX::Global::Perf::TraceText();
+        std::size_t countBytes = sizeof(char)*(text.size()+1);
+        *traceText = reinterpret_cast<char*>(memalloc(countBytes));
+        ThrowErrorIfNot(MSIX::Error::OutOfMemory, (*traceText), "Allocation failed!");
+        std::memcpy(reinterpret_cast<void*>(*traceText), reinterpret_cast<const void*>(text.c_str()), countBytes);
     });
 }
 
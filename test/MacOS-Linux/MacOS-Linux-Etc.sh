@@ -47,6 +47,356 @@ function RunTest {
     fi
 }
 
+# Unpacks with -stats and fails if more than 110% of the package was read from it.
+function RunReadAmplificationTest {
+    CleanupUnpackFolder
+    local PACKAGE="$1"
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix unpack -d ./../unpack -p $PACKAGE -ss -stats
+    echo "------------------------------------------------------"
+    local SIZE=$(wc -c < $PACKAGE)
+    local READ=$($BINDIR/makemsix unpack -d ./../unpack -p $PACKAGE -ss -stats | awk '$1 == "package.read" { print $3 }')
+    echo "package size: "$SIZE", bytes read: "$READ
+    if [ -n "$READ" ] && [ $(( READ * 10 )) -le $(( SIZE * 11 )) ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Unpacks with -stats and -trace and fails unless the counters on the package stream stay within bounds, and the
+# trace has one stream.read event for every read that the stream.read counter counted.  The bounds leave room for
+# changes to how packages are read: at most 110% of the package read from it, and at most 8 seeks for each file
+# unpacked, and 16 more for finding the central directory and the footprint files.
+function RunStatisticsTest {
+    CleanupUnpackFolder
+    local PACKAGE="$1"
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix unpack -d ./../unpack/files -p $PACKAGE -ss -stats -trace ./../unpack/trace.json
+    echo "------------------------------------------------------"
+    $BINDIR/makemsix unpack -d ./../unpack/files -p $PACKAGE -ss -stats -trace ./../unpack/trace.json > ./../unpack/stats.txt
+    local RESULT=$?
+    local SIZE=$(wc -c < $PACKAGE)
+    local FILES=$(find ./../unpack/files -type f | wc -l)
+    local READS=$(awk '$1 == "package.read" { print $2 }' ./../unpack/stats.txt)
+    local BYTES=$(awk '$1 == "package.read" { print $3 }' ./../unpack/stats.txt)
+    local SEEKS=$(awk '$1 == "package.seek" { print $2 }' ./../unpack/stats.txt)
+    local STREAMREADS=$(awk '$1 == "stream.read" { print $2 }' ./../unpack/stats.txt)
+    local EVENTS=$(grep -c '"name":"stream.read"' ./../unpack/trace.json 2>/dev/null)
+    echo "package size: "$SIZE", files: "$FILES", got: "$RESULT" "$READS" "$BYTES" "$SEEKS
+    echo "stream.read count: "$STREAMREADS", trace events: "$EVENTS
+    if [ $RESULT -eq 0 ] && [ -n "$READS" ] && [ -n "$BYTES" ] && [ -n "$SEEKS" ] && [ $READS -gt 0 ] &&
+       [ $(( BYTES * 10 )) -le $(( SIZE * 11 )) ] && [ $SEEKS -le $(( FILES * 8 + 16 )) ] &&
+       [ -n "$EVENTS" ] && [ "$STREAMREADS" == "$EVENTS" ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Unpacks a package, packs the files again and fails unless unpacking the new package gives back the same files.
+# The block map, content types and signature files are regenerated or dropped, so they are not compared.
+function RunPackTest {
+    CleanupUnpackFolder
+    local PACKAGE="$1"
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix pack -d ./../unpack/source -p ./../unpack/repacked.appx
+    echo "------------------------------------------------------"
+    $BINDIR/makemsix unpack -d ./../unpack/source -p $PACKAGE -ss > /dev/null &&
+    $BINDIR/makemsix pack -d ./../unpack/source -p ./../unpack/repacked.appx &&
+    $BINDIR/makemsix unpack -d ./../unpack/repacked -p ./../unpack/repacked.appx -ss > /dev/null &&
+    diff -r -x AppxBlockMap.xml -x "\[Content_Types\].xml" -x AppxSignature.p7x -x AppxMetadata ./../unpack/source ./../unpack/repacked
+    local RESULT=$?
+    echo "expect: 0, got: "$RESULT
+    if [ $RESULT -eq 0 ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Unpacks a package piped through standard input.  A package that unpacks must give the same files as unpacking
+# it from disk, one that doesn't must fail with the expected code and leave nothing behind.  Either way the staging
+# directory goes away, and a directory that happens to have the name it used to have is left alone.
+function RunStreamTest {
+    CleanupUnpackFolder
+    local SUCCESS="$1"
+    local PACKAGE="$2"
+    local ARGS="$3"
+    mkdir -p ./../unpack/stream.staging && echo keep > ./../unpack/stream.staging/keep
+    echo "------------------------------------------------------"
+    echo cat $PACKAGE "|" $BINDIR/makemsix unpack -d ./../unpack/stream -p - $ARGS
+    echo "------------------------------------------------------"
+    cat $PACKAGE | $BINDIR/makemsix unpack -d ./../unpack/stream -p - $ARGS > /dev/null
+    local RESULT=$?
+    if [ $RESULT -eq 0 ]
+    then
+        $BINDIR/makemsix unpack -d ./../unpack/file -p $PACKAGE $ARGS > /dev/null &&
+        diff -r ./../unpack/file ./../unpack/stream
+        RESULT=$?
+    elif [ -e ./../unpack/stream ]
+    then
+        echo "output left behind after a failed unpack"
+        RESULT=-1
+    fi
+    if ls -d ./../unpack/stream.staging-* > /dev/null 2>&1 || [ "$(cat ./../unpack/stream.staging/keep 2>/dev/null)" != "keep" ]
+    then
+        echo "staging directory left behind, or ./../unpack/stream.staging removed"
+        RESULT=-1
+    fi
+    echo "expect: "$SUCCESS", got: "$RESULT
+    if [ $RESULT -eq $SUCCESS ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Packs a package with a content group map and unpacks it by content group.  Fails unless the required group is
+# reported first, then the automatic groups in the order of the map, and the files are the same as the ones packed.
+function RunContentGroupTest {
+    CleanupUnpackFolder
+    local PACKAGE="$1"
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix unpack -d ./../unpack/groups -p ./../unpack/groups.appx -ss -cg
+    echo "------------------------------------------------------"
+    $BINDIR/makemsix unpack -d ./../unpack/source -p $PACKAGE -ss > /dev/null &&
+    mkdir -p ./../unpack/source/AppxMetadata &&
+    cat > ./../unpack/source/AppxMetadata/AppxContentGroupMap.xml <<EOF
+<?xml version="1.0" encoding="utf-8"?>
+<ContentGroupMap xmlns="http://schemas.microsoft.com/appx/2016/contentgroupmap">
+  <Required>
+    <ContentGroup Name="Launch">
+      <File Name="run.html"/>
+      <File Name="assets\StoreLogo.png"/>
+    </ContentGroup>
+  </Required>
+  <Automatic>
+    <ContentGroup Name="Images">
+      <File Name="cloth.png"/>
+      <File Name="dress.png"/>
+    </ContentGroup>
+    <ContentGroup Name="Scripts">
+      <File Name="office.js"/>
+    </ContentGroup>
+  </Automatic>
+</ContentGroupMap>
+EOF
+    $BINDIR/makemsix pack -d ./../unpack/source -p ./../unpack/groups.appx > /dev/null &&
+    $BINDIR/makemsix unpack -d ./../unpack/groups -p ./../unpack/groups.appx -ss -cg > ./../unpack/groups.txt &&
+    diff -r -x AppxBlockMap.xml -x "\[Content_Types\].xml" ./../unpack/source ./../unpack/groups
+    local RESULT=$?
+    local UNPACKED=$(grep "^Content group" ./../unpack/groups.txt | tr '\n' ';')
+    echo "groups: "$UNPACKED
+    if [ $RESULT -eq 0 ] && [ "$UNPACKED" != "Content group Launch (required) unpacked;Content group Images unpacked;Content group Scripts unpacked;" ]
+    then
+        RESULT=-1
+    fi
+    echo "expect: 0, got: "$RESULT
+    if [ $RESULT -eq 0 ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Packs the files of the package, and the same files with one changed, one removed and one added, and fails
+# unless diff lists exactly those three.
+function RunDiffTest {
+    CleanupUnpackFolder
+    local PACKAGE="$1"
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix diff -b ./../unpack/base.appx -p ./../unpack/update.appx -ss
+    echo "------------------------------------------------------"
+    $BINDIR/makemsix unpack -d ./../unpack/base -p $PACKAGE -ss > /dev/null &&
+    cp -r ./../unpack/base ./../unpack/update &&
+    echo "// update" >> ./../unpack/update/office.js &&
+    rm ./../unpack/update/cloth.png &&
+    echo "added" > ./../unpack/update/added.txt &&
+    $BINDIR/makemsix pack -d ./../unpack/base -p ./../unpack/base.appx > /dev/null &&
+    $BINDIR/makemsix pack -d ./../unpack/update -p ./../unpack/update.appx > /dev/null &&
+    $BINDIR/makemsix diff -b ./../unpack/base.appx -p ./../unpack/update.appx -ss > ./../unpack/diff.txt
+    local RESULT=$?
+    local FILES=$(grep "^    \(Changed\|Added\|Removed\)" ./../unpack/diff.txt | awk '{print $1" "$2}' | tr '\n' ';')
+    echo "files: "$FILES
+    if [ $RESULT -eq 0 ] && [ "$FILES" != "Added added.txt;Removed cloth.png;Changed office.js;" ]
+    then
+        RESULT=-1
+    fi
+    echo "expect: 0, got: "$RESULT
+    if [ $RESULT -eq 0 ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Repacks the package without one of its files, checking every block as it is copied, and fails unless the
+# result unpacks to the same files less that one.
+function RunRepackTest {
+    CleanupUnpackFolder
+    local PACKAGE="$1"
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix repack -s $PACKAGE -p ./../unpack/repack.appx -x cloth.png -v -ss
+    echo "------------------------------------------------------"
+    $BINDIR/makemsix unpack -d ./../unpack/base -p $PACKAGE -ss > /dev/null &&
+    rm -f ./../unpack/base/cloth.png ./../unpack/base/AppxSignature.p7x ./../unpack/base/AppxMetadata/CodeIntegrity.cat &&
+    $BINDIR/makemsix repack -s $PACKAGE -p ./../unpack/repack.appx -x cloth.png -v -ss > /dev/null &&
+    $BINDIR/makemsix unpack -d ./../unpack/repack -p ./../unpack/repack.appx -ss > /dev/null &&
+    diff -r -x AppxBlockMap.xml -x "\[Content_Types\].xml" ./../unpack/base ./../unpack/repack
+    local RESULT=$?
+    echo "expect: 0, got: "$RESULT
+    if [ $RESULT -eq 0 ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Edits a copy of the package in place, replacing one file, adding one and removing another, then compacts it,
+# and fails unless it unpacks to the same files as the package with those changes made.
+function RunEditTest {
+    CleanupUnpackFolder
+    local PACKAGE="$1"
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix edit -p ./../unpack/edit.appx -d ./../unpack/add -r cloth.png -ss
+    echo "------------------------------------------------------"
+    $BINDIR/makemsix unpack -d ./../unpack/base -p $PACKAGE -ss > /dev/null &&
+    rm -f ./../unpack/base/cloth.png ./../unpack/base/AppxSignature.p7x ./../unpack/base/AppxMetadata/CodeIntegrity.cat &&
+    mkdir -p ./../unpack/add && echo "edited" > ./../unpack/add/office.js && echo "added" > ./../unpack/add/added.txt &&
+    cp ./../unpack/add/office.js ./../unpack/add/added.txt ./../unpack/base &&
+    cp $PACKAGE ./../unpack/edit.appx &&
+    $BINDIR/makemsix edit -p ./../unpack/edit.appx -d ./../unpack/add -r cloth.png -ss > /dev/null &&
+    $BINDIR/makemsix edit -p ./../unpack/edit.appx -compact -ss > /dev/null &&
+    $BINDIR/makemsix unpack -d ./../unpack/edit -p ./../unpack/edit.appx -ss > /dev/null &&
+    diff -r -x AppxBlockMap.xml -x "\[Content_Types\].xml" ./../unpack/base ./../unpack/edit
+    local RESULT=$?
+    echo "expect: 0, got: "$RESULT
+    if [ $RESULT -eq 0 ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Runs the msixbench checks, and with packages in $@ the checks of reopening them.
+function RunBenchChecksTest {
+    if [ ! -e "$BINDIR/msixbench" ]
+    then
+        echo "skipping msixbench checks, build msixbench to run them"
+        return
+    fi
+    CleanupUnpackFolder
+    echo "------------------------------------------------------"
+    echo $BINDIR/msixbench -check -d ./../unpack/bench $@
+    echo "------------------------------------------------------"
+    $BINDIR/msixbench -check -d ./../unpack/bench $@
+    local RESULT=$?
+    echo "expect: 0, got: "$RESULT
+    if [ $RESULT -eq 0 ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Unpacks the package through msixbench a few times with an index directory, which the first open fills and the
+# later ones read from, and fails if any of them does or no index was written.
+function RunBenchIndexTest {
+    if [ ! -e "$BINDIR/msixbench" ]
+    then
+        echo "skipping indexed unpacks of $1, build msixbench to run them"
+        return
+    fi
+    CleanupUnpackFolder
+    mkdir -p ./../unpack/index
+    echo "------------------------------------------------------"
+    echo $BINDIR/msixbench -p $1 -i 3 -f reader.unpack -d ./../unpack/bench -index ./../unpack/index $2
+    echo "------------------------------------------------------"
+    local ERRORS=$($BINDIR/msixbench -p $1 -i 3 -f reader.unpack -d ./../unpack/bench -index ./../unpack/index $2 2>&1 > /dev/null | grep "FAILED")
+    local INDEXES=$(ls ./../unpack/index/*.msixindex 2>/dev/null | wc -l)
+    echo "expect: 1 index, got: "$INDEXES
+    if [ -z "$ERRORS" ] && [ $INDEXES -eq 1 ]
+    then
+        echo "succeeded"
+    else
+        echo "$ERRORS"
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Reads every payload file of the package at offsets and by blocks through msixbench, and fails if any of
+# the reads does.
+function RunPayloadReadTest {
+    if [ ! -e "$BINDIR/msixbench" ]
+    then
+        echo "skipping payload reads of $1, build msixbench to run them"
+        return
+    fi
+    CleanupUnpackFolder
+    echo "------------------------------------------------------"
+    echo $BINDIR/msixbench -p $1 -i 1 -f payload -d ./../unpack/bench $2
+    echo "------------------------------------------------------"
+    local ERRORS=$($BINDIR/msixbench -p $1 -i 1 -f payload -d ./../unpack/bench $2 2>&1 > /dev/null | grep "FAILED")
+    if [ -z "$ERRORS" ]
+    then
+        echo "succeeded"
+    else
+        echo "$ERRORS"
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
+# Generates a package with a stored payload file larger than 4GB, so that sizes and offsets only fit in
+# the zip64 fields, and fails unless it unpacks to a file of the same size.  Every block is still checked
+# against the block map on the way out.  Needs msixgen and about 10GB of disk, so it only runs when
+# MSIX_LARGE_PACKAGE_TESTS is set.
+function RunLargePackageTest {
+    if [ -z "$MSIX_LARGE_PACKAGE_TESTS" ] || [ ! -e "$BINDIR/msixgen" ]
+    then
+        echo "skipping large package test, set MSIX_LARGE_PACKAGE_TESTS and build msixgen to run it"
+        return
+    fi
+    CleanupUnpackFolder
+    local SIZE=4718592000
+    echo "------------------------------------------------------"
+    echo $BINDIR/makemsix unpack -d ./../unpack/large -p ./../unpack/large.appx -ss
+    echo "------------------------------------------------------"
+    $BINDIR/msixgen -o ./../unpack/large.appx -n 1 -size $SIZE -stored 100 -c 100 -depth 0 &&
+    $BINDIR/makemsix unpack -d ./../unpack/large -p ./../unpack/large.appx -ss > /dev/null
+    local RESULT=$?
+    local UNPACKED=$(wc -c < ./../unpack/large/file0.dat 2>/dev/null)
+    rm -f ./../unpack/large.appx ./../unpack/large/file0.dat
+    echo "expect: 0 "$SIZE", got: "$RESULT" "$UNPACKED
+    if [ $RESULT -eq 0 ] && [ "$UNPACKED" == "$SIZE" ]
+    then
+        echo "succeeded"
+    else
+        echo "FAILED"
+        TESTFAILED=1
+    fi
+}
+
 FindBinFolder
 # return code is last two digits, but in decimal, not hex.  e.g. 0x8bad0002 == 2, 0x8bad0041 == 65, etc...
 # common codes:
@@ -64,6 +414,7 @@ RunTest 66 ./../appx/SignedUntrustedCert-CERT_E_CHAINING.appx
 RunTest 0  ./../appx/StoreSigned_Desktop_x64_MoviesTV.appx
 RunTest 0 ./../appx/TestAppxPackage_Win32.appx -ss
 RunTest 0 ./../appx/TestAppxPackage_x64.appx -ss
+RunTest 0 ./../appx/ChainedBlocks.appx -ss
 RunTest 18 ./../appx/UnsignedZip64WithCI-APPX_E_MISSING_REQUIRED_FILE.appx
 RunTest 1 ./../appx/FileDoesNotExist.appx -ss
 RunTest 81 ./../appx/BlockMap/Missing_Manifest_in_blockmap.appx -ss
@@ -76,6 +427,29 @@ RunTest 81 ./../appx/BlockMap/File_missing_from_blockmap.appx -ss
 RunTest 2 ./../appx/BlockMap/No_blockmap.appx -ss
 RunTest 3 ./../appx/BlockMap/Bad_Namespace_Blockmap.appx -ss
 RunTest 81 ./../appx/BlockMap/Duplicate_file_in_blockmap.appx -ss
+RunStatisticsTest ./../appx/HelloWorld.appx
+RunStatisticsTest ./../appx/StoreSigned_Desktop_x64_MoviesTV.appx
+RunReadAmplificationTest ./../appx/HelloWorld.appx
+RunReadAmplificationTest ./../appx/StoreSigned_Desktop_x64_MoviesTV.appx
+RunPackTest ./../appx/HelloWorld.appx
+RunPackTest ./../appx/StoreSigned_Desktop_x64_MoviesTV.appx
+RunStreamTest 0 ./../appx/HelloWorld.appx -ss
+RunStreamTest 0 ./../appx/TestAppxPackage_x64.appx -ss
+RunStreamTest 65 ./../appx/BlockMap/Invalid_Bad_Block.appx -ss
+RunStreamTest 17 ./../appx/StreamCDDuplicateFile.appx -ss
+RunStreamTest 17 ./../appx/StreamCDMismatchedCrc.appx -ss
+RunStreamTest 17 ./../appx/StreamCDMismatchedSize.appx -ss
+RunContentGroupTest ./../appx/HelloWorld.appx
+RunDiffTest ./../appx/HelloWorld.appx
+RunRepackTest ./../appx/HelloWorld.appx
+RunEditTest ./../appx/HelloWorld.appx
+RunBenchChecksTest -p ./../appx/HelloWorld.appx -p ./../appx/ChainedBlocks.appx -ss
+RunBenchChecksTest -p ./../appx/StoreSigned_Desktop_x64_MoviesTV.appx
+RunBenchIndexTest ./../appx/HelloWorld.appx -ss
+RunBenchIndexTest ./../appx/ChainedBlocks.appx -ss
+RunPayloadReadTest ./../appx/HelloWorld.appx -ss
+RunPayloadReadTest ./../appx/ChainedBlocks.appx -ss
+RunLargePackageTest
 
     echo "-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-="
 if [ $TESTFAILED -ne 0 ]
@@ -66,6 +66,31 @@ function RunTest([int] $SUCCESSCODE, [string] $PACKAGE, [string] $OPT) {
     }
 }
 
+# Unpacks with -stats and fails if more than 110% of the package was read from it.
+function RunReadAmplificationTest([string] $PACKAGE) {
+    CleanupUnpackFolder
+    $OPTIONS = "unpack -d .\..\unpack -p $PACKAGE -ss -stats"
+    write-host  "------------------------------------------------------"
+    write-host  "$BINDIR\makemsix.exe $OPTIONS"
+    write-host  "------------------------------------------------------"
+
+    $SIZE = (Get-Item $PACKAGE).Length
+    $READ = & $BINDIR\makemsix.exe unpack -d .\..\unpack -p $PACKAGE -ss -stats | ForEach-Object {
+        $fields = $_.Trim() -split '\s+'
+        if ($fields[0] -eq "package.read") { [int64]$fields[2] }
+    }
+    write-host  "package size: $SIZE, bytes read: $READ"
+    if ( $READ -and ($READ * 10 -le $SIZE * 11) )
+    {
+        write-host  "succeeded"
+    }
+    else
+    {
+        write-host  "FAILED"
+        $global:TESTFAILED=1
+    }
+}
+
 FindBinFolder
 RunTest 0x8bad0002 .\..\appx\Empty.appx "-sv"
 RunTest 0x00000000 .\..\appx\HelloWorld.appx "-ss"
@@ -92,6 +117,9 @@ RunTest 0x8bad0051 .\..\appx\BlockMap\File_missing_from_blockmap.appx "-ss"
 RunTest 0x80070002 .\..\appx\BlockMap\No_blockmap.appx "-ss"
 RunTest 0x8bad1003 .\..\appx\BlockMap\Bad_Namespace_Blockmap.appx "-ss"
 RunTest 0x8bad0051 .\..\appx\BlockMap\Duplicate_file_in_blockmap.appx "-ss"
+RunTest 0x00000000 .\..\appx\HelloWorld.appx "-ss -stats -trace .\..\unpack\trace.json"
+RunReadAmplificationTest .\..\appx\HelloWorld.appx
+RunReadAmplificationTest .\..\appx\StoreSigned_Desktop_x64_MoviesTV.appx
 
 CleanupUnpackFolder
 
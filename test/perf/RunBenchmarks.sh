@@ -0,0 +1,48 @@
+#!/bin/bash
+# Runs msixbench against the package corpus under test/appx and writes the results as JSON.
+# If msixgen has been built, synthetic packages with many small files and with a few large
+# files are generated and benchmarked as well.
+# usage: RunBenchmarks.sh [output.json] [iterations]
+OUTPUT=${1:-benchmarks.json}
+ITERATIONS=${2:-5}
+
+function FindBinFolder {
+    echo "Searching under" $PWD
+    #look in .vs/bin first
+    if [ -e "../../.vs/bin/msixbench" ]
+    then
+        BINDIR="../../.vs/bin"
+    elif [ -e "../../.vscode/bin/msixbench" ]
+    then
+        BINDIR="../../.vscode/bin"
+    elif [ -e "../../build/bin/msixbench" ]
+    then
+        BINDIR="../../build/bin"
+    else
+        echo "ERROR: Could not find msixbench, build it with 'make msixbench'"
+        exit 2
+    fi
+}
+
+FindBinFolder
+
+PACKAGES=""
+for PACKAGE in HelloWorld.appx TestAppxPackage_Win32.appx TestAppxPackage_x64.appx StoreSigned_Desktop_x64_MoviesTV.appx
+do
+    PACKAGES="$PACKAGES -p ./../appx/$PACKAGE"
+done
+
+SYNTHETIC=./../synthetic
+if [ -e "$BINDIR/msixgen" ]
+then
+    mkdir -p $SYNTHETIC
+    $BINDIR/msixgen -o $SYNTHETIC/ManySmallFiles.appx -n 5000 -size 0:16k -depth 3 -fanout 6 || exit $?
+    $BINDIR/msixgen -o $SYNTHETIC/FewLargeFiles.appx -n 8 -size 8m:32m -dist uniform -c 30 || exit $?
+    PACKAGES="$PACKAGES -p $SYNTHETIC/ManySmallFiles.appx -p $SYNTHETIC/FewLargeFiles.appx"
+fi
+
+rm -f -r ./../unpack/*
+$BINDIR/msixbench $PACKAGES -ss -i $ITERATIONS -d ./../unpack -o $OUTPUT
+RESULT=$?
+rm -f -r ./../unpack/* $SYNTHETIC
+exit $RESULT
@@ -0,0 +1,1302 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// Micro and end-to-end benchmarks for the read/validate/unpack pipeline.  Each benchmark is run
+// a number of times against every package given on the command line and the results are written
+// as JSON so they can be tracked across changes.
+#include "MSIXWindows.hpp"
+#include "AppxPackaging.hpp"
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+#include "StreamBase.hpp"
+#include "FileStream.hpp"
+#include "VectorStream.hpp"
+#include "HashStream.hpp"
+#include "ZipObject.hpp"
+#include "XmlObject.hpp"
+#include "AppxBlockMapObject.hpp"
+#include "AppxSignature.hpp"
+#include "AppxFactory.hpp"
+#include "AppxPackageObject.hpp"
+#include "DirectoryObject.hpp"
+#include "SHA256.hpp"
+#include "UnicodeConversion.hpp"
+#include "Log.hpp"
+#include "FileCopy.hpp"
+#include "ValidatedStore.hpp"
+#include "PackageIndex.hpp"
+#include "HmacKey.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <numeric>
+#include <vector>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+// defined by the library alongside AppxPackageObject
+extern std::map<std::string, std::string> contentTypesSchema;
+
+namespace {
+
+const std::uint32_t BLOCK_SIZE = 65536;
+
+LPVOID STDMETHODCALLTYPE BenchAllocate(SIZE_T cb)  { return std::malloc(cb); }
+void STDMETHODCALLTYPE BenchFree(LPVOID pv)        { std::free(pv); }
+
+struct Settings
+{
+    std::vector<std::string> packages;
+    std::string              outputFile;
+    std::string              unpackDirectory = "msixbench_unpack";
+    std::string              filter;
+    std::string              indexDirectory;
+    std::uint64_t            cacheBudget = 0;
+    std::string              trustDirectory;
+    std::uint32_t            iterations = 5;
+    MSIX_VALIDATION_OPTION   validation = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL;
+    bool                     check = false;
+};
+
+struct Result
+{
+    std::string         name;
+    std::string         package;
+    std::uint64_t       bytes = 0;
+    std::vector<double> samples; // nanoseconds
+    std::string         error;
+};
+
+std::string JsonEscape(const std::string& value)
+{
+    std::ostringstream result;
+    for (auto c : value)
+    {
+        switch (c)
+        {
+        case '"':  result << "\\\""; break;
+        case '\\': result << "\\\\"; break;
+        case '\n': result << "\\n";  break;
+        case '\r': result << "\\r";  break;
+        case '\t': result << "\\t";  break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {   result << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+            }
+            else
+            {   result << c;
+            }
+        }
+    }
+    return result.str();
+}
+
+class Runner
+{
+public:
+    Runner(const Settings& settings) : m_settings(settings) {}
+
+    // Runs a benchmark.  The callback returns the number of bytes it processed, which is used to compute
+    // throughput.  A benchmark that throws is recorded with its error and not retried.
+    void Run(const std::string& name, const std::string& package, std::function<std::uint64_t()> benchmark)
+    {
+        if (!m_settings.filter.empty() && name.find(m_settings.filter) == std::string::npos) { return; }
+
+        Result result;
+        result.name = name;
+        result.package = package;
+        try
+        {
+            for (std::uint32_t i = 0; i < m_settings.iterations; i++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                result.bytes = benchmark();
+                auto end = std::chrono::steady_clock::now();
+                result.samples.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+            }
+        }
+        catch (MSIX::Exception& e)
+        {
+            std::ostringstream error;
+            error << "0x" << std::hex << e.Code() << " " << e.Message();
+            result.error = error.str();
+        }
+        catch (std::exception& e)
+        {
+            result.error = e.what();
+        }
+        std::cerr << std::left << std::setw(24) << name << " " << package << (result.error.empty() ? "" : " FAILED: ") << result.error << std::endl;
+        m_results.push_back(std::move(result));
+    }
+
+    void WriteJson(std::ostream& out)
+    {
+        out << "{" << std::endl << "  \"iterations\": " << m_settings.iterations << "," << std::endl;
+        out << "  \"benchmarks\": [" << std::endl;
+        for (std::size_t i = 0; i < m_results.size(); i++)
+        {
+            auto& result = m_results[i];
+            out << "    { \"name\": \"" << JsonEscape(result.name) << "\", \"package\": \"" << JsonEscape(result.package) << "\"";
+            if (result.error.empty())
+            {
+                std::vector<double> samples(result.samples);
+                std::sort(samples.begin(), samples.end());
+                double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+                double median = samples[samples.size() / 2];
+                out << std::fixed << std::setprecision(0);
+                out << ", \"bytes\": " << result.bytes;
+                out << ", \"min_ns\": " << samples.front();
+                out << ", \"median_ns\": " << median;
+                out << ", \"mean_ns\": " << mean;
+                out << ", \"max_ns\": " << samples.back();
+                out << std::setprecision(2);
+                out << ", \"mb_per_s\": " << ((median > 0) ? (result.bytes / (1024.0 * 1024.0)) / (median / 1e9) : 0.0);
+            }
+            else
+            {   out << ", \"error\": \"" << JsonEscape(result.error) << "\"";
+            }
+            out << " }" << ((i + 1 < m_results.size()) ? "," : "") << std::endl;
+        }
+        out << "  ]" << std::endl << "}" << std::endl;
+    }
+
+protected:
+    const Settings&     m_settings;
+    std::vector<Result> m_results;
+};
+
+std::uint64_t ReadToEnd(IStream* stream, std::vector<std::uint8_t>& buffer)
+{
+    std::uint64_t total = 0;
+    ULONG bytesRead = 0;
+    ThrowHrIfFailed(stream->Seek({0}, MSIX::StreamBase::Reference::START, nullptr));
+    do
+    {
+        ThrowHrIfFailed(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+        total += bytesRead;
+    } while (bytesRead != 0);
+    return total;
+}
+
+std::uint64_t GetSize(IStream* stream)
+{
+    ULARGE_INTEGER size = {0};
+    ThrowHrIfFailed(stream->Seek({0}, MSIX::StreamBase::Reference::END, &size));
+    ThrowHrIfFailed(stream->Seek({0}, MSIX::StreamBase::Reference::START, nullptr));
+    return size.QuadPart;
+}
+
+// Copies a file out of the container so that parse benchmarks don't measure inflate.
+std::vector<std::uint8_t> ReadFile(IStorageObject* container, const std::string& name)
+{
+    std::vector<std::uint8_t> result;
+    auto fileNames = container->GetFileNames(FileNameOptions::All);
+    if (std::find(fileNames.begin(), fileNames.end(), name) == fileNames.end()) { return result; }
+    auto stream = container->GetFile(name);
+    result.resize(static_cast<std::size_t>(GetSize(stream)));
+    ULONG bytesRead = 0;
+    ThrowHrIfFailed(stream->Read(result.data(), static_cast<ULONG>(result.size()), &bytesRead));
+    ThrowErrorIf(MSIX::Error::FileRead, (bytesRead != result.size()), "read failed");
+    return result;
+}
+
+bool IsCompressed(IStream* stream)
+{
+    MSIX::ComPtr<IStream> file(stream);
+    APPX_COMPRESSION_OPTION compression;
+    ThrowHrIfFailed(file.As<IAppxFile>()->GetCompressionOption(&compression));
+    return compression != APPX_COMPRESSION_OPTION_NONE;
+}
+
+// Benchmarks that do not depend on a package.
+void RunSyntheticBenchmarks(Runner& runner)
+{
+    // Mildly compressible, deterministic content.
+    std::vector<std::uint8_t> data(16 * BLOCK_SIZE);
+    std::uint32_t seed = 0x2545F491;
+    for (auto& byte : data)
+    {   seed = seed * 1664525 + 1013904223;
+        byte = static_cast<std::uint8_t>((seed >> 24) & 0x3F);
+    }
+
+    runner.Run("sha256.compute", "synthetic", [&]() {
+        std::vector<std::uint8_t> hash;
+        for (std::size_t offset = 0; offset < data.size(); offset += BLOCK_SIZE)
+        {   MSIX::SHA256::ComputeHash(data.data() + offset, BLOCK_SIZE, hash);
+        }
+        return static_cast<std::uint64_t>(data.size());
+    });
+
+    std::vector<std::uint8_t> block(data.begin(), data.begin() + BLOCK_SIZE);
+    std::vector<std::uint8_t> expected;
+    MSIX::SHA256::ComputeHash(block.data(), static_cast<std::uint32_t>(block.size()), expected);
+    runner.Run("hashstream.validate", "synthetic", [&]() {
+        std::vector<std::uint8_t> buffer(4096);
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < data.size() / BLOCK_SIZE; i++)
+        {   auto source = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&block);
+            auto hashStream = MSIX::ComPtr<IStream>::Make<MSIX::HashStream>(source.Get(), expected);
+            total += ReadToEnd(hashStream.Get(), buffer);
+        }
+        return total;
+    });
+
+    // Package names are mostly ASCII, with the odd localized one.
+    std::vector<std::string> names;
+    for (std::uint32_t index = 0; index < 4096; index++)
+    {   std::ostringstream name;
+        name << "Assets\\Images\\Square" << index << ((index % 16 == 0) ? "\xC3\xA9t\xC3\xA9" : "") << ".scale-200.png";
+        names.push_back(name.str());
+    }
+    runner.Run("utf.roundtrip", "synthetic", [&]() {
+        std::uint64_t total = 0;
+        for (const auto& name : names)
+        {   auto converted = MSIX::utf16_to_utf8(MSIX::utf8_to_utf16(name));
+            ThrowErrorIf(MSIX::Error::Unexpected, (converted != name), "round trip failed");
+            total += name.size();
+        }
+        return total;
+    });
+
+    // What a verbose message costs while verbose messages are off, and while they are kept.
+    for (auto level : { MSIX::Global::Log::Level::Error, MSIX::Global::Log::Level::Verbose })
+    {   MSIX::Global::Log::SetLevel(level);
+        runner.Run((level == MSIX::Global::Log::Level::Verbose) ? "log.verbose.on" : "log.verbose.off", "synthetic", [&]() {
+            std::uint64_t total = 0;
+            for (const auto& name : names)
+            {   MSIX::Global::Log::Verbose(name.c_str());
+                total += name.size();
+            }
+            return total;
+        });
+    }
+    MSIX::Global::Log::SetLevel(MSIX::Global::Log::Level::Error);
+    MSIX::Global::Log::Clear();
+}
+
+void RunPackageBenchmarks(Runner& runner, const Settings& settings, IMSIXFactory* factory, const std::string& package)
+{
+    auto packageStream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(package, MSIX::FileStream::Mode::READ);
+    std::uint64_t packageSize = GetSize(packageStream.Get());
+
+    // What a reader costs to create, which is most of what it costs when only a few files are read.
+    runner.Run("package.open", package, [&]() {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(package, MSIX::FileStream::Mode::READ);
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(MSIX::ComPtr<IMSIXFactory>(factory).As<IAppxFactory>()->CreatePackageReader(stream.Get(), &reader));
+        return packageSize;
+    });
+
+    // The same back-to-front reads as inflate.seek, through IMSIXPayloadFile, which only inflates the blocks it needs.
+    runner.Run("payload.readat", package, [&]() {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(package, MSIX::FileStream::Mode::READ);
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(MSIX::ComPtr<IMSIXFactory>(factory).As<IAppxFactory>()->CreatePackageReader(stream.Get(), &reader));
+        MSIX::ComPtr<IAppxFilesEnumerator> files;
+        ThrowHrIfFailed(reader->GetPayloadFiles(&files));
+        std::vector<std::uint8_t> buffer(4096);
+        std::uint64_t total = 0;
+        BOOL hasCurrent = FALSE;
+        ThrowHrIfFailed(files->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {   MSIX::ComPtr<IAppxFile> file;
+            ThrowHrIfFailed(files->GetCurrent(&file));
+            UINT64 size = 0;
+            ThrowHrIfFailed(file->GetSize(&size));
+            auto payloadFile = file.As<IMSIXPayloadFile>();
+            for (int slice = 7; slice >= 0; slice--)
+            {   ULONG bytesRead = 0;
+                ThrowHrIfFailed(payloadFile->ReadAt((size / 8) * slice, buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+                total += bytesRead;
+            }
+            ThrowHrIfFailed(files->MoveNext(&hasCurrent));
+        }
+        return total;
+    });
+
+    // Every block of every payload file, a file at a time, inflated and checked on all cores.
+    runner.Run("payload.readblocks", package, [&]() {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(package, MSIX::FileStream::Mode::READ);
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(MSIX::ComPtr<IMSIXFactory>(factory).As<IAppxFactory>()->CreatePackageReader(stream.Get(), &reader));
+        MSIX::ComPtr<IAppxFilesEnumerator> files;
+        ThrowHrIfFailed(reader->GetPayloadFiles(&files));
+        std::uint64_t total = 0;
+        BOOL hasCurrent = FALSE;
+        ThrowHrIfFailed(files->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {   MSIX::ComPtr<IAppxFile> file;
+            ThrowHrIfFailed(files->GetCurrent(&file));
+            UINT64 size = 0;
+            ThrowHrIfFailed(file->GetSize(&size));
+            std::vector<UINT32> indices(static_cast<std::size_t>((size + BLOCK_SIZE - 1) / BLOCK_SIZE));
+            std::iota(indices.begin(), indices.end(), 0);
+            MSIX::ComPtr<IMSIXPayloadBlocks> blocks;
+            ThrowHrIfFailed(file.As<IMSIXPayloadFile>()->ReadBlocks(static_cast<UINT32>(indices.size()), indices.data(), &blocks));
+            for (UINT32 position = 0; position < indices.size(); position++)
+            {   UINT32 blockSize = 0;
+                ThrowHrIfFailed(blocks->GetBlock(position, nullptr, nullptr, &blockSize, nullptr, nullptr));
+                total += blockSize;
+            }
+            ThrowHrIfFailed(files->MoveNext(&hasCurrent));
+        }
+        return total;
+    });
+
+    // Each payload file read front to back through its stream on one thread while another ReadAts it back to front;
+    // neither may see the other's position, which is what fails if ReadAt borrows the stream.
+    runner.Run("payload.shared", package, [&]() {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(package, MSIX::FileStream::Mode::READ);
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(MSIX::ComPtr<IMSIXFactory>(factory).As<IAppxFactory>()->CreatePackageReader(stream.Get(), &reader));
+        MSIX::ComPtr<IAppxFilesEnumerator> files;
+        ThrowHrIfFailed(reader->GetPayloadFiles(&files));
+        std::uint64_t total = 0;
+        BOOL hasCurrent = FALSE;
+        ThrowHrIfFailed(files->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {   MSIX::ComPtr<IAppxFile> file;
+            ThrowHrIfFailed(files->GetCurrent(&file));
+            MSIX::ComPtr<IStream> fileStream;
+            ThrowHrIfFailed(file->GetStream(&fileStream));
+            std::vector<std::uint8_t> expected;
+            std::vector<std::uint8_t> buffer(4096);
+            ULONG bytesRead = 0;
+            do
+            {   ThrowHrIfFailed(fileStream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+                expected.insert(expected.end(), buffer.begin(), buffer.begin() + bytesRead);
+            } while (bytesRead != 0);
+
+            std::exception_ptr streamError;
+            std::thread streamReader([&]() {
+                try
+                {   std::vector<std::uint8_t> chunk(4096);
+                    std::uint64_t position = 0;
+                    ULONG chunkRead = 0;
+                    ThrowHrIfFailed(fileStream->Seek({0}, MSIX::StreamBase::Reference::START, nullptr));
+                    do
+                    {   ThrowHrIfFailed(fileStream->Read(chunk.data(), static_cast<ULONG>(chunk.size()), &chunkRead));
+                        ThrowErrorIf(MSIX::Error::Unexpected, position + chunkRead > expected.size() ||
+                            !std::equal(chunk.begin(), chunk.begin() + chunkRead, expected.begin() + position), "stream read the wrong bytes");
+                        position += chunkRead;
+                    } while (chunkRead != 0);
+                    ThrowErrorIf(MSIX::Error::Unexpected, position != expected.size(), "stream stopped short");
+                }
+                catch (...)
+                {   streamError = std::current_exception();
+                }
+            });
+            try
+            {   auto payloadFile = file.As<IMSIXPayloadFile>();
+                std::uint64_t size = expected.size();
+                for (int slice = 7; slice >= 0; slice--)
+                {   std::uint64_t offset = (size / 8) * slice;
+                    ThrowHrIfFailed(payloadFile->ReadAt(offset, buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+                    ThrowErrorIf(MSIX::Error::Unexpected, bytesRead != std::min<std::uint64_t>(buffer.size(), size - offset) ||
+                        !std::equal(buffer.begin(), buffer.begin() + bytesRead, expected.begin() + offset), "ReadAt read the wrong bytes");
+                }
+            }
+            catch (...)
+            {   streamReader.join();
+                throw;
+            }
+            streamReader.join();
+            if (streamError) { std::rethrow_exception(streamError); }
+            total += expected.size();
+            ThrowHrIfFailed(files->MoveNext(&hasCurrent));
+        }
+        return total;
+    });
+
+    runner.Run("zip.open", package, [&]() {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(package, MSIX::FileStream::Mode::READ);
+        auto zip = MSIX::ComPtr<IStorageObject>::Make<MSIX::ZipObject>(factory, stream.Get());
+        return packageSize;
+    });
+
+    MSIX::ComPtr<IStorageObject> zip;
+    try
+    {   zip = MSIX::ComPtr<IStorageObject>::Make<MSIX::ZipObject>(factory, packageStream.Get());
+    }
+    catch (std::exception&)
+    {   // Already reported by zip.open; only the end-to-end benchmark makes sense for a broken archive.
+    }
+
+    if (zip.Get() != nullptr)
+    {
+        auto fileNames = zip->GetFileNames(FileNameOptions::All);
+        std::vector<IStream*> compressed;
+        for (const auto& name : fileNames)
+        {   auto stream = zip->GetFile(name);
+            if (IsCompressed(stream)) { compressed.push_back(stream); }
+        }
+
+        runner.Run("inflate.sequential", package, [&]() {
+            std::vector<std::uint8_t> buffer(BLOCK_SIZE);
+            std::uint64_t total = 0;
+            for (auto stream : compressed) { total += ReadToEnd(stream, buffer); }
+            return total;
+        });
+
+        // Reads small chunks back-to-front, which is the worst case for a forward-only decoder.
+        runner.Run("inflate.seek", package, [&]() {
+            std::vector<std::uint8_t> buffer(4096);
+            std::uint64_t total = 0;
+            for (auto stream : compressed)
+            {   std::uint64_t size = GetSize(stream);
+                for (int slice = 7; slice >= 0; slice--)
+                {   LARGE_INTEGER position = {0};
+                    position.QuadPart = static_cast<std::int64_t>((size / 8) * slice);
+                    ThrowHrIfFailed(stream->Seek(position, MSIX::StreamBase::Reference::START, nullptr));
+                    ULONG bytesRead = 0;
+                    ThrowHrIfFailed(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+                    total += bytesRead;
+                }
+            }
+            return total;
+        });
+
+        auto contentTypes = ReadFile(zip.Get(), CONTENT_TYPES_XML);
+        if (!contentTypes.empty())
+        {   runner.Run("xml.contenttypes", package, [&]() {
+                MSIX::ComPtr<IStream> stream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&contentTypes);
+                auto xml = MSIX::ComPtr<IVerifierObject>::Make<MSIX::XmlObject>(stream, &contentTypesSchema);
+                return static_cast<std::uint64_t>(contentTypes.size());
+            });
+
+            // What GetContentType costs per file once the document was gone through.
+            MSIX::ComPtr<IStream> stream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&contentTypes);
+            MSIX::ContentTypeTable table(stream.Get());
+            table.Find(CONTENT_TYPES_XML);
+            runner.Run("contenttype.lookup", package, [&]() {
+                std::uint64_t total = 0;
+                for (const auto& name : fileNames)
+                {   if (table.Find(name) != nullptr) { total += name.size(); }
+                }
+                return total;
+            });
+        }
+
+        auto blockMap = ReadFile(zip.Get(), APPXBLOCKMAP_XML);
+        if (!blockMap.empty())
+        {   runner.Run("xml.blockmap", package, [&]() {
+                MSIX::ComPtr<IStream> stream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&blockMap);
+                auto appxBlockMap = MSIX::ComPtr<IVerifierObject>::Make<MSIX::AppxBlockMapObject>(factory, stream);
+                return static_cast<std::uint64_t>(blockMap.size());
+            });
+        }
+
+        auto signature = ReadFile(zip.Get(), APPXSIGNATURE_P7X);
+        if (!signature.empty() && (settings.validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) == 0)
+        {   runner.Run("signature.validate", package, [&]() {
+                auto stream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&signature);
+                auto appxSignature = MSIX::ComPtr<IVerifierObject>::Make<MSIX::AppxSignatureObject>(settings.validation, stream.Get());
+                return static_cast<std::uint64_t>(signature.size());
+            });
+        }
+    }
+
+    // Repacks the payload into memory, so that only the writer is measured.
+    if (zip.Get() != nullptr)
+    {
+        std::vector<std::pair<std::string, std::vector<std::uint8_t>>> payload;
+        std::uint64_t payloadSize = 0;
+        for (const auto& name : zip->GetFileNames(FileNameOptions::All))
+        {   if (name == CONTENT_TYPES_XML || name == APPXBLOCKMAP_XML || name == APPXSIGNATURE_P7X ||
+                name == APPXMANIFEST_XML || name == CODEINTEGRITY_CAT) { continue; }
+            payload.push_back(std::make_pair(name, ReadFile(zip.Get(), name)));
+            payloadSize += payload.back().second.size();
+        }
+        auto manifest = ReadFile(zip.Get(), APPXMANIFEST_XML);
+        if (!payload.empty() && !manifest.empty())
+        {   runner.Run("pack.full", package, [&]() {
+                std::vector<std::uint8_t> output;
+                auto outputStream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&output);
+                MSIX::ComPtr<IAppxPackageWriter> writer;
+                ThrowHrIfFailed(MSIX::ComPtr<IMSIXFactory>(factory).As<IAppxFactory>()->CreatePackageWriter(outputStream.Get(), nullptr, &writer));
+                for (auto& file : payload)
+                {   auto stream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&file.second);
+                    ThrowHrIfFailed(writer->AddPayloadFile(MSIX::utf8_to_utf16(file.first).c_str(), L"application/octet-stream",
+                        APPX_COMPRESSION_OPTION_NORMAL, stream.Get()));
+                }
+                auto manifestStream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&manifest);
+                ThrowHrIfFailed(writer->Close(manifestStream.Get()));
+                return payloadSize + manifest.size();
+            });
+        }
+    }
+
+    runner.Run("unpack.full", package, [&]() {
+        ThrowHrIfFailed(UnpackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE, settings.validation,
+            const_cast<char*>(package.c_str()), const_cast<char*>(settings.unpackDirectory.c_str())));
+        return packageSize;
+    });
+
+    // The same unpack through this factory, which is the one -index, -cache and -trust apply to.
+    runner.Run("reader.unpack", package, [&]() {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(package, MSIX::FileStream::Mode::READ);
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(MSIX::ComPtr<IMSIXFactory>(factory).As<IAppxFactory>()->CreatePackageReader(stream.Get(), &reader));
+        auto to = MSIX::ComPtr<IStorageObject>::Make<MSIX::DirectoryObject>(settings.unpackDirectory);
+        reader.As<IPackage>()->Unpack(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE, to.Get(), nullptr);
+        return packageSize;
+    });
+}
+
+// Correctness checks for the utf8 and utf16 conversions, which convert ASCII 16 characters at a time and the
+// rest one code point at a time.  Failures are printed, and the number of them is returned.
+class UnicodeChecks
+{
+public:
+    int Run()
+    {
+        CheckAsciiRuns();
+        CheckCodePoints();
+        CheckInvalidUtf8();
+        CheckInvalidUtf16();
+        std::cerr << "utf: " << m_checks << " checks, " << m_failures << " failed" << std::endl;
+        return m_failures;
+    }
+
+private:
+    // Guard bytes after every allocation MarshalOutString makes, so that writing past the buffer is caught.
+    static const std::size_t GUARD = 16;
+    static std::size_t s_lastSize;
+    static int s_outstanding;
+
+    static LPVOID STDMETHODCALLTYPE CheckAllocate(SIZE_T cb)
+    {   auto buffer = static_cast<std::uint8_t*>(std::malloc(cb + GUARD));
+        if (buffer != nullptr)
+        {   std::memset(buffer, 0xCD, cb + GUARD);
+            s_lastSize = cb;
+            s_outstanding++;
+        }
+        return buffer;
+    }
+    static void STDMETHODCALLTYPE CheckFree(LPVOID pv)
+    {   if (pv != nullptr) { s_outstanding--; }
+        std::free(pv);
+    }
+
+    void Check(bool condition, const std::string& what)
+    {
+        m_checks++;
+        if (!condition)
+        {   m_failures++;
+            std::cerr << "utf FAILED: " << what << std::endl;
+        }
+    }
+
+    static std::string Hex(const std::string& value)
+    {   std::ostringstream result;
+        for (auto c : value) { result << std::hex << std::setw(2) << std::setfill('0') << (static_cast<unsigned>(c) & 0xFF); }
+        return result.str();
+    }
+
+    // Converts utf8 to utf16 through both overloads and MarshalOutString, and back through both overloads.
+    void CheckRoundTrip(const std::string& utf8, const std::wstring& utf16)
+    {
+        auto what = "round trip of " + Hex(utf8);
+        try
+        {   Check(MSIX::utf8_to_utf16(utf8) == utf16, what + " to utf16");
+            std::vector<wchar_t> buffer(utf8.size() + 1, L'\x5A5A');
+            std::size_t count = MSIX::utf8_to_utf16(utf8, buffer.data());
+            Check(count == utf16.size() && std::wstring(buffer.data(), count) == utf16 && buffer[count] == L'\x5A5A',
+                what + " to a utf16 buffer");
+            Check(MSIX::utf16_to_utf8(utf16) == utf8, what + " back to utf8");
+            Check(MSIX::utf16_to_utf8(utf16.c_str()) == utf8, what + " back to utf8 from a terminated string");
+
+            LPWSTR result = nullptr;
+            Check(SUCCEEDED(m_factory->MarshalOutString(utf8, &result)) && result != nullptr, what + " through MarshalOutString");
+            if (result != nullptr)
+            {   Check(std::wstring(result) == utf16, what + " through MarshalOutString, contents");
+                auto guard = reinterpret_cast<std::uint8_t*>(result) + s_lastSize;
+                Check(std::all_of(guard, guard + GUARD, [](std::uint8_t byte) { return byte == 0xCD; }),
+                    what + " through MarshalOutString, wrote past the buffer");
+                CheckFree(result);
+            }
+        }
+        catch (MSIX::Exception& e)
+        {   Check(false, what + " threw " + e.Message());
+        }
+    }
+
+    void CheckRejected(const std::string& utf8)
+    {
+        auto what = "rejecting utf8 " + Hex(utf8);
+        bool rejected = false;
+        try { MSIX::utf8_to_utf16(utf8); }
+        catch (MSIX::Exception& e) { rejected = (e.Code() == static_cast<std::uint32_t>(MSIX::Error::InvalidParameter)); }
+        Check(rejected, what);
+
+        int outstanding = s_outstanding;
+        LPWSTR result = nullptr;
+        Check(FAILED(m_factory->MarshalOutString(utf8, &result)) && result == nullptr && s_outstanding == outstanding,
+            what + " through MarshalOutString");
+    }
+
+    void CheckRejected(const std::wstring& utf16)
+    {
+        std::ostringstream what;
+        what << "rejecting utf16";
+        for (auto unit : utf16) { what << " " << std::hex << static_cast<std::uint32_t>(unit); }
+        for (int overload = 0; overload < 2; overload++)
+        {   bool rejected = false;
+            try { (overload == 0) ? MSIX::utf16_to_utf8(utf16) : MSIX::utf16_to_utf8(utf16.c_str()); }
+            catch (MSIX::Exception& e) { rejected = (e.Code() == static_cast<std::uint32_t>(MSIX::Error::InvalidParameter)); }
+            Check(rejected, what.str());
+        }
+    }
+
+    // Every length across the 16 character boundary, with and without a non-ASCII character at every offset.
+    void CheckAsciiRuns()
+    {
+        for (std::size_t length = 0; length <= 48; length++)
+        {   std::string ascii;
+            for (std::size_t index = 0; index < length; index++) { ascii.push_back(static_cast<char>(' ' + (index * 7) % 95)); }
+            std::wstring wide(ascii.begin(), ascii.end());
+            CheckRoundTrip(ascii, wide);
+            for (std::size_t offset = 0; offset <= length; offset++)
+            {   CheckRoundTrip(std::string(ascii).insert(offset, "\xC3\xA9"), std::wstring(wide).insert(offset, 1, L'\xE9'));
+            }
+        }
+    }
+
+    // Both ends of every encoded length, and a mix of BMP characters and surrogate pairs.
+    void CheckCodePoints()
+    {
+        CheckRoundTrip("\x7F", L"\x7F");
+        CheckRoundTrip("\xC2\x80", L"\x80");
+        CheckRoundTrip("\xDF\xBF", L"\x7FF");
+        CheckRoundTrip("\xE0\xA0\x80", L"\x800");
+        CheckRoundTrip("\xED\x9F\xBF", L"\xD7FF");
+        CheckRoundTrip("\xEE\x80\x80", L"\xE000");
+        CheckRoundTrip("\xEF\xBF\xBF", L"\xFFFF");
+        CheckRoundTrip("\xF0\x90\x80\x80", std::wstring{ static_cast<wchar_t>(0xD800), static_cast<wchar_t>(0xDC00) });
+        CheckRoundTrip("\xF4\x8F\xBF\xBF", std::wstring{ static_cast<wchar_t>(0xDBFF), static_cast<wchar_t>(0xDFFF) });
+
+        std::string mixed = "Assets\\\xC3\xA9t\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80.png";
+        std::wstring expected = L"Assets\\\xE9t\xE9\x4E2D";
+        expected.append({ static_cast<wchar_t>(0xD83D), static_cast<wchar_t>(0xDE00) });
+        expected.append(L".png");
+        CheckRoundTrip(mixed, expected);
+        CheckRoundTrip(mixed + mixed + mixed, expected + expected + expected);
+    }
+
+    // Overlong, out of range, surrogate and truncated sequences, alone and after a run of ASCII.
+    void CheckInvalidUtf8()
+    {
+        for (const std::string prefix : { "", "0123456789abcdefghij" })
+        {   for (const char* invalid : { "\x80", "\xBF", "\xF8\x88\x80\x80\x80", "\xFF", // lead bytes
+                                         "\xC0\xAF", "\xC1\xBF", "\xE0\x80\xAF", "\xE0\x9F\xBF", "\xF0\x80\x80\xAF", "\xF0\x8F\xBF\xBF", // overlong
+                                         "\xF4\x90\x80\x80", "\xED\xA0\x80", "\xED\xBF\xBF", "\xED\xA0\xBD\xED\xB8\x80", // out of range and surrogates
+                                         "\xC3", "\xE4\xB8", "\xF0\x9F\x98", "\xE4\xB8z", "\xC3\xC3\xA9" }) // truncated
+            {   CheckRejected(prefix + invalid);
+                CheckRejected(prefix + invalid + "klmnopqrstuvwxyz");
+            }
+        }
+    }
+
+    // Lone high and low surrogates, at the end, before ASCII and reversed.
+    void CheckInvalidUtf16()
+    {
+        const wchar_t high = static_cast<wchar_t>(0xD83D);
+        const wchar_t low  = static_cast<wchar_t>(0xDE00);
+        for (const std::wstring prefix : { L"", L"0123456789abcdefghij" })
+        {   CheckRejected(prefix + std::wstring{ high });
+            CheckRejected(prefix + std::wstring{ low });
+            CheckRejected(prefix + std::wstring{ high } + L"klmnopqrstuvwxyz");
+            CheckRejected(prefix + std::wstring{ low } + L"klmnopqrstuvwxyz");
+            CheckRejected(prefix + std::wstring{ high, high, low });
+            CheckRejected(prefix + std::wstring{ low, high });
+            CheckRejected(prefix + std::wstring{ high, L'\xE9' });
+        }
+    }
+
+    MSIX::ComPtr<IMSIXFactory> m_factory = MSIX::ComPtr<IMSIXFactory>::Make<MSIX::AppxFactory>(
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL, CheckAllocate, CheckFree);
+    int m_checks = 0;
+    int m_failures = 0;
+};
+
+std::size_t UnicodeChecks::s_lastSize = 0;
+int UnicodeChecks::s_outstanding = 0;
+
+// Checks that a stream too large for HashStream to cache is served as validated, and that a change to it after
+// it was validated fails the read that serves the last byte.  Returns the number of failures.
+int CheckHashStream()
+{
+    std::vector<std::uint8_t> data(5 * 1024 * 1024 + 123);
+    for (std::size_t index = 0; index < data.size(); index++) { data[index] = static_cast<std::uint8_t>(index * 31 + (index >> 12)); }
+    std::vector<std::uint8_t> digest;
+    MSIX::SHA256::ComputeHash(data.data(), data.size(), digest);
+
+    // Reads the stream to the end from offset, after reading the first few bytes, and returns what failed.
+    auto readFrom = [&](std::uint64_t offset, bool change) -> std::string {
+        auto copy = data;
+        auto source = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&copy);
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::HashStream>(source.Get(), digest);
+        std::vector<std::uint8_t> buffer(100000);
+        ULONG read = 0;
+        if (FAILED(stream->Read(buffer.data(), 16, &read)) || read != 16) { return "first read"; }
+        if (change) { copy[copy.size() / 2] ^= 1; }
+        LARGE_INTEGER li;
+        li.QuadPart = static_cast<LONGLONG>(offset);
+        if (FAILED(stream->Seek(li, MSIX::StreamBase::Reference::START, nullptr))) { return "seek"; }
+        for (std::uint64_t position = offset; position < data.size(); position += read)
+        {   if (FAILED(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read)) || read == 0) { return "read at " + std::to_string(position); }
+            if (!change && std::memcmp(buffer.data(), data.data() + position, read) != 0) { return "contents at " + std::to_string(position); }
+        }
+        return "";
+    };
+
+    int failures = 0;
+    for (std::uint64_t offset : { 0, 16, 3, 4 * 1024 * 1024 })
+    {   auto failed = readFrom(offset, false);
+        if (!failed.empty())
+        {   std::cerr << "hashstream FAILED: reading from " << offset << ", " << failed << std::endl;
+            failures++;
+        }
+        if (readFrom(offset, true).compare(0, 7, "read at") != 0)
+        {   std::cerr << "hashstream FAILED: a change after validation wasn't caught reading from " << offset << std::endl;
+            failures++;
+        }
+    }
+    std::cerr << "hashstream: " << failures << " failed" << std::endl;
+    return failures;
+}
+
+struct LogContext
+{
+    std::atomic<bool> isReplaced;
+    std::atomic<int>  calls;
+    std::atomic<int>  callsAfterReplaced;
+};
+
+void STDMETHODCALLTYPE CheckLogCall(const MSIX_LOG_ENTRY*, void* context)
+{
+    auto self = static_cast<LogContext*>(context);
+    if (self->isReplaced) { self->callsAfterReplaced++; }
+    self->calls++;
+}
+
+void STDMETHODCALLTYPE CheckLogCallOnce(const MSIX_LOG_ENTRY*, void* context)
+{
+    static_cast<LogContext*>(context)->calls++;
+    SetLogCallback(nullptr, nullptr);
+}
+
+// Checks that a log callback that SetLogCallback replaced is never called once it returns, while other threads
+// log, and that a callback can replace itself.  Returns the number of failures.
+int CheckLogCallback()
+{
+    MSIX::Global::Log::SetLevel(MSIX::Global::Log::Level::Verbose);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> loggers;
+    for (int thread = 0; thread < 4; thread++)
+    {   loggers.emplace_back([&]() { while (!stop) { MSIX::Global::Log::Verbose("log check"); } });
+    }
+    std::vector<std::unique_ptr<LogContext>> contexts;
+    for (int replace = 0; replace < 2000; replace++)
+    {   contexts.push_back(std::unique_ptr<LogContext>(new LogContext { {false}, {0}, {0} }));
+        SetLogCallback(CheckLogCall, contexts.back().get());
+        if (contexts.size() > 1) { contexts[contexts.size() - 2]->isReplaced = true; }
+        if (replace % 100 == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+    }
+    SetLogCallback(nullptr, nullptr);
+    contexts.back()->isReplaced = true;
+    stop = true;
+    for (auto& logger : loggers) { logger.join(); }
+
+    // A callback that stops the calls from inside one of them.
+    LogContext last { {false}, {0}, {0} };
+    SetLogCallback(CheckLogCallOnce, &last);
+    MSIX::Global::Log::Verbose("log check");
+    MSIX::Global::Log::Verbose("log check");
+    MSIX::Global::Log::SetLevel(MSIX::Global::Log::Level::Error);
+    MSIX::Global::Log::Clear();
+
+    int failures = 0;
+    int calls = 0;
+    for (const auto& context : contexts)
+    {   calls += context->calls;
+        if (context->callsAfterReplaced != 0)
+        {   std::cerr << "log FAILED: a callback was called " << context->callsAfterReplaced << " times after it was replaced" << std::endl;
+            failures++;
+        }
+    }
+    if (calls == 0) { std::cerr << "log FAILED: no callback was called" << std::endl; failures++; }
+    if (last.calls != 1) { std::cerr << "log FAILED: a callback that replaced itself was called " << last.calls << " times" << std::endl; failures++; }
+    std::cerr << "log: " << failures << " failed" << std::endl;
+    return failures;
+}
+
+// Checks of how the factory opens a package again: from a reader cache, from an index and from a store of validated
+// packages.
+// Each runs against its own factories and directories, under a scratch directory that is removed at the end.
+class PackageChecks
+{
+public:
+    PackageChecks(const Settings& settings, const std::string& package) :
+        m_package(package),
+        m_validation(settings.validation),
+        m_scratch(MSIX::DirectoryObject::CreateUnique(settings.unpackDirectory + "/check-"))
+    {}
+
+    int Run()
+    {
+        MSIX::Global::Log::SetLevel(MSIX::Global::Log::Level::Verbose);
+        SetLogCallback(Append, this);
+        try
+        {   CheckReaderCache();
+            CheckPackageIndex();
+            CheckValidatedStore();
+        }
+        catch (MSIX::Exception& e)
+        {   Check(false, "error 0x" + ToHex(e.Code()) + " " + e.Message());
+        }
+        SetLogCallback(nullptr, nullptr);
+        MSIX::Global::Log::SetLevel(MSIX::Global::Log::Level::Error);
+        MSIX::Global::Log::Clear();
+        m_scratch->RemoveAll();
+        std::cerr << "package " << m_package << ": " << m_checks << " checks, " << m_failures << " failed" << std::endl;
+        return m_failures;
+    }
+
+private:
+    static void STDMETHODCALLTYPE Append(const MSIX_LOG_ENTRY* entry, void* context)
+    {
+        auto self = static_cast<PackageChecks*>(context);
+        std::lock_guard<std::mutex> lock(self->m_logLock);
+        self->m_log.push_back(entry->message);
+    }
+
+    static std::string ToHex(std::uint32_t value)
+    {   std::ostringstream result;
+        result << std::hex << value;
+        return result.str();
+    }
+
+    static std::string ToOctal(std::uint32_t value)
+    {   std::ostringstream result;
+        result << "0" << std::oct << value;
+        return result.str();
+    }
+
+    void Check(bool condition, const std::string& what)
+    {
+        m_checks++;
+        if (!condition)
+        {   m_failures++;
+            std::cerr << "package FAILED: " << m_package << ": " << what << std::endl;
+        }
+    }
+
+    MSIX::ComPtr<IMSIXFactory> MakeFactory()
+    {   return MSIX::ComPtr<IMSIXFactory>::Make<MSIX::AppxFactory>(m_validation, BenchAllocate, BenchFree);
+    }
+
+    // Opens the package through factory over stream, and returns what the factory logged about how.
+    std::vector<std::string> Open(IMSIXFactory* factory, IStream* stream, MSIX::ComPtr<IAppxPackageReader>& reader)
+    {
+        {   std::lock_guard<std::mutex> lock(m_logLock);
+            m_log.clear();
+        }
+        ThrowHrIfFailed(MSIX::ComPtr<IMSIXFactory>(factory).As<IAppxFactory>()->CreatePackageReader(stream, &reader));
+        std::lock_guard<std::mutex> lock(m_logLock);
+        return m_log;
+    }
+
+    static bool Has(const std::vector<std::string>& log, const std::string& message)
+    {   return std::find(log.begin(), log.end(), message) != log.end();
+    }
+
+    // A new, empty directory under the scratch directory.
+    std::string NewDirectory(const std::string& prefix)
+    {   return MSIX::DirectoryObject::CreateUnique(m_scratch->GetRoot() + "/" + prefix)->GetRoot();
+    }
+
+    static MSIX::FileIdentity GetIdentity(const std::string& path)
+    {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(path, MSIX::FileStream::Mode::READ);
+        MSIX::FileIdentity result = {0};
+        ThrowErrorIfNot(MSIX::Error::FileRead, MSIX::GetFileIdentity(stream.As<IFileBackedStream>()->GetFileHandle(), result), "no file identity");
+        return result;
+    }
+
+    static std::vector<std::uint8_t> ReadBytes(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        ThrowErrorIfNot(MSIX::Error::FileOpen, file.good(), path.c_str());
+        return std::vector<std::uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    static void WriteBytes(const std::string& path, const std::vector<std::uint8_t>& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        ThrowErrorIfNot(MSIX::Error::FileWrite, file.good(), path.c_str());
+    }
+
+    static bool Exists(const std::string& path)
+    {   return std::ifstream(path).good();
+    }
+
+    // Reads both streams to the end, a little of one and then a little of the other, and returns whether they
+    // read the same bytes and as many as there are.
+    static bool ReadSideBySide(IStream* first, IStream* second)
+    {
+        std::uint64_t size = GetSize(first);
+        std::vector<std::uint8_t> firstData;
+        std::vector<std::uint8_t> secondData;
+        std::vector<std::uint8_t> buffer(97);
+        ULONG firstRead = 0;
+        ULONG secondRead = 0;
+        do
+        {   ThrowHrIfFailed(first->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &firstRead));
+            firstData.insert(firstData.end(), buffer.begin(), buffer.begin() + firstRead);
+            ThrowHrIfFailed(second->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &secondRead));
+            secondData.insert(secondData.end(), buffer.begin(), buffer.begin() + secondRead);
+        } while (firstRead != 0 || secondRead != 0);
+        return firstData.size() == size && firstData == secondData;
+    }
+
+    // Opens the package twice through a reader cache, which makes the second reader from what the first one
+    // validated, and reads the footprint files of both side by side.  Neither reader may move the streams of the
+    // other, and the cache may not hold on to the first one's package once it is released.
+    void CheckReaderCache()
+    {
+        auto factory = MakeFactory();
+        ThrowHrIfFailed(factory.As<IMSIXFactoryOptions>()->SetReaderCacheBudget(std::uint64_t(1) << 30));
+        auto firstPackage = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(m_package, MSIX::FileStream::Mode::READ);
+        auto secondPackage = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(m_package, MSIX::FileStream::Mode::READ);
+        MSIX::ComPtr<IAppxPackageReader> second;
+        {
+            MSIX::ComPtr<IAppxPackageReader> first;
+            Open(factory.Get(), firstPackage.Get(), first);
+            Check(Has(Open(factory.Get(), secondPackage.Get(), second), "package reader: reused from the reader cache"),
+                "the second reader wasn't made from the reader cache");
+
+            MSIX::ComPtr<IAppxBlockMapReader> firstBlockMap;
+            MSIX::ComPtr<IAppxBlockMapReader> secondBlockMap;
+            ThrowHrIfFailed(first->GetBlockMap(&firstBlockMap));
+            ThrowHrIfFailed(second->GetBlockMap(&secondBlockMap));
+            MSIX::ComPtr<IStream> firstStream;
+            MSIX::ComPtr<IStream> secondStream;
+            ThrowHrIfFailed(firstBlockMap->GetStream(&firstStream));
+            ThrowHrIfFailed(secondBlockMap->GetStream(&secondStream));
+            Check(firstStream.Get() != secondStream.Get(), "both readers have the same block map stream");
+            Check(ReadSideBySide(firstStream.Get(), secondStream.Get()), "the block map streams of the readers moved each other");
+
+            for (auto type : { APPX_FOOTPRINT_FILE_TYPE_MANIFEST, APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP })
+            {   MSIX::ComPtr<IAppxFile> firstFile;
+                MSIX::ComPtr<IAppxFile> secondFile;
+                ThrowHrIfFailed(first->GetFootprintFile(type, &firstFile));
+                ThrowHrIfFailed(second->GetFootprintFile(type, &secondFile));
+                MSIX::ComPtr<IStream> firstFileStream;
+                MSIX::ComPtr<IStream> secondFileStream;
+                ThrowHrIfFailed(firstFile->GetStream(&firstFileStream));
+                ThrowHrIfFailed(secondFile->GetStream(&secondFileStream));
+                ThrowHrIfFailed(firstFileStream->Seek({0}, MSIX::StreamBase::Reference::START, nullptr));
+                ThrowHrIfFailed(secondFileStream->Seek({0}, MSIX::StreamBase::Reference::START, nullptr));
+                Check(ReadSideBySide(firstFileStream.Get(), secondFileStream.Get()),
+                    "footprint file " + std::to_string(type) + " of the readers moved each other");
+            }
+        }
+        // Only this function still has the first package's stream.
+        firstPackage->AddRef();
+        Check(firstPackage->Release() == 1, "the reader cache kept the first reader's package stream");
+
+        MSIX::ComPtr<IAppxBlockMapReader> blockMap;
+        ThrowHrIfFailed(second->GetBlockMap(&blockMap));
+        MSIX::ComPtr<IStream> stream;
+        ThrowHrIfFailed(blockMap->GetStream(&stream));
+        std::vector<std::uint8_t> buffer(4096);
+        Check(ReadToEnd(stream.Get(), buffer) == GetSize(stream.Get()), "the second reader's block map can't be read without the first reader");
+    }
+
+    // An index is only loaded when it is whole, sealed with the key of its directory and made from the package as
+    // it is now.  Through a factory, the index written by the first open is used by the next one, and one that
+    // doesn't load only costs that open its time: the package is opened in full and indexed again.
+    void CheckPackageIndex()
+    {
+        const std::string fromIndex = "package reader: opened from its index";
+        auto directory = NewDirectory("index-");
+        auto factory = MakeFactory();
+        ThrowHrIfFailed(factory.As<IMSIXFactoryOptions>()->SetIndexDirectory(directory.c_str()));
+        auto OpenThrough = [&](IMSIXFactory* through)
+        {   auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(m_package, MSIX::FileStream::Mode::READ);
+            MSIX::ComPtr<IAppxPackageReader> reader;
+            return Open(through, stream.Get(), reader);
+        };
+        Check(!Has(OpenThrough(factory.Get()), fromIndex), "a package was opened from an index that wasn't there");
+        Check(Has(OpenThrough(factory.Get()), fromIndex), "the second open didn't use the index");
+
+        auto package = GetIdentity(m_package);
+        auto path = MSIX::PackageIndex::GetPath(directory, package);
+        MSIX::HmacKey key(MSIX::PackageIndex::GetKeyPath(directory));
+        Check(MSIX::PackageIndex::Load(path, package, key) != nullptr, "a valid index doesn't load");
+        auto index = ReadBytes(path);
+
+        // The whole header, and bytes all over the rest.
+        std::vector<std::size_t> offsets;
+        for (std::size_t offset = 0; offset < sizeof(MSIX::PackageIndex::Header); offset++) { offsets.push_back(offset); }
+        for (std::size_t offset = sizeof(MSIX::PackageIndex::Header); offset < index.size(); offset += index.size() / 61 + 1) { offsets.push_back(offset); }
+        offsets.push_back(index.size() - 1);
+        int loaded = 0;
+        for (auto offset : offsets)
+        {   auto edited = index;
+            edited[offset] ^= 0x01;
+            WriteBytes(path, edited);
+            if (MSIX::PackageIndex::Load(path, package, key)) { loaded++; }
+        }
+        Check(loaded == 0, std::to_string(loaded) + " of " + std::to_string(offsets.size()) + " indexes with a byte flipped load");
+
+        for (std::size_t size : { std::size_t(0), sizeof(MSIX::PackageIndex::Header) - 1, sizeof(MSIX::PackageIndex::Header), index.size() / 2, index.size() - 1 })
+        {   WriteBytes(path, std::vector<std::uint8_t>(index.begin(), index.begin() + size));
+            Check(MSIX::PackageIndex::Load(path, package, key) == nullptr, "an index cut off at " + std::to_string(size) + " bytes loads");
+        }
+        auto longer = index;
+        longer.push_back(0);
+        WriteBytes(path, longer);
+        Check(MSIX::PackageIndex::Load(path, package, key) == nullptr, "an index with a byte after it loads");
+
+        WriteBytes(path, index);
+        auto changed = package;
+        changed.size++;
+        Check(MSIX::PackageIndex::Load(path, changed, key) == nullptr, "an index loads after the package changed size");
+        changed = package;
+        changed.modified++;
+        Check(MSIX::PackageIndex::Load(path, changed, key) == nullptr, "an index loads after the package was written");
+        changed = package;
+        changed.inode++;
+        Check(MSIX::PackageIndex::Load(path, changed, key) == nullptr, "an index loads for another file");
+
+        MSIX::HmacKey otherKey(MSIX::PackageIndex::GetKeyPath(NewDirectory("index-")));
+        Check(MSIX::PackageIndex::Load(path, package, otherKey) == nullptr, "an index sealed with another key loads");
+
+        auto edited = index;
+        edited[edited.size() / 2] ^= 0x01;
+        WriteBytes(path, edited);
+        Check(!Has(OpenThrough(factory.Get()), fromIndex), "a package was opened from a damaged index");
+        Check(Has(OpenThrough(factory.Get()), fromIndex), "the package wasn't indexed again after its index was damaged");
+    }
+
+    // Says where it keeps the record of a package.
+    class RecordStore : public MSIX::ValidatedStore
+    {
+    public:
+        RecordStore(const std::string& directory) : MSIX::ValidatedStore(directory) {}
+        using MSIX::ValidatedStore::GetPath;
+    };
+
+    // Opens the package through factory, unpacks it and returns what the factory logged about how it opened it.
+    std::vector<std::string> OpenAndUnpack(IMSIXFactory* factory, const std::string& to)
+    {
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(m_package, MSIX::FileStream::Mode::READ);
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        auto log = Open(factory, stream.Get(), reader);
+        auto directory = MSIX::ComPtr<IStorageObject>::Make<MSIX::DirectoryObject>(to);
+        reader.As<IPackage>()->Unpack(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE, directory.Get(), nullptr);
+        return log;
+    }
+
+    // A record is only trusted for the package as it was when it was recorded, with the same options and block
+    // map, whole and sealed with the key of its store, and a key that others can read is refused.  Through a
+    // factory, a package is recorded once an unpack has checked all of it, if its signature was checked, and a
+    // record that isn't trusted only costs the next unpack its hashing.
+    void CheckValidatedStore()
+    {
+        auto package = GetIdentity(m_package);
+        std::vector<std::uint8_t> digest(MSIX::HASH_BYTES);
+        std::iota(digest.begin(), digest.end(), static_cast<std::uint8_t>(1));
+        RecordStore store(NewDirectory("store-"));
+        store.Record(package, m_validation, digest);
+        Check(store.IsValidated(package, m_validation, digest), "a record isn't trusted");
+        auto changed = package;
+        changed.size++;
+        Check(!store.IsValidated(changed, m_validation, digest), "a record is trusted after the package changed size");
+        changed = package;
+        changed.modified++;
+        Check(!store.IsValidated(changed, m_validation, digest), "a record is trusted after the package was written");
+        auto otherValidation = static_cast<MSIX_VALIDATION_OPTION>(m_validation ^ MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN);
+        Check(!store.IsValidated(package, otherValidation, digest), "a record is trusted for other validation options");
+        auto otherDigest = digest;
+        otherDigest[0] ^= 1;
+        Check(!store.IsValidated(package, m_validation, otherDigest), "a record is trusted for another block map");
+
+        auto path = store.GetPath(package);
+        auto record = ReadBytes(path);
+        int trusted = 0;
+        for (std::size_t offset = 0; offset < record.size(); offset++)
+        {   auto edited = record;
+            edited[offset] ^= 0x20;
+            WriteBytes(path, edited);
+            if (store.IsValidated(package, m_validation, digest)) { trusted++; }
+        }
+        Check(trusted == 0, std::to_string(trusted) + " records with a byte changed are trusted");
+        WriteBytes(path, std::vector<std::uint8_t>(record.begin(), record.end() - 1));
+        Check(!store.IsValidated(package, m_validation, digest), "a truncated record is trusted");
+
+        RecordStore otherStore(NewDirectory("store-"));
+        WriteBytes(otherStore.GetPath(package), record);
+        Check(!otherStore.IsValidated(package, m_validation, digest), "a record sealed with another key is trusted");
+
+        #ifndef WIN32
+        for (mode_t mode : { 0640, 0604, 0660, 0606 })
+        {   auto directory = NewDirectory("store-");
+            { RecordStore created(directory); }
+            ThrowErrorIf(MSIX::Error::FileWrite, (chmod((directory + "/validated.key").c_str(), mode) != 0), "chmod failed");
+            bool isRefused = false;
+            try { RecordStore opened(directory); }
+            catch (MSIX::Exception& e) { isRefused = (e.Code() == static_cast<std::uint32_t>(MSIX::Error::FileOpen)); }
+            Check(isRefused, "a key with mode " + ToOctal(mode) + " is used");
+            auto factory = MakeFactory();
+            Check(FAILED(factory.As<IMSIXFactoryOptions>()->SetValidatedStateDirectory(directory.c_str())),
+                "a factory uses a key with mode " + ToOctal(mode));
+        }
+        #endif
+
+        const std::string isTrusted = "package reader: validated before, payload blocks aren't hashed";
+        bool isSigned = (m_validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) == 0;
+        auto directory = NewDirectory("store-");
+        auto unpacked = NewDirectory("unpack-");
+        auto factory = MakeFactory();
+        ThrowHrIfFailed(factory.As<IMSIXFactoryOptions>()->SetValidatedStateDirectory(directory.c_str()));
+        path = RecordStore(directory).GetPath(package);
+        Check(!Has(OpenAndUnpack(factory.Get(), unpacked), isTrusted), "a package that wasn't recorded is trusted");
+        if (!isSigned)
+        {   Check(!Exists(path), "a package whose signature wasn't checked is recorded");
+            return;
+        }
+        Check(Exists(path), "a signed package isn't recorded after an unpack");
+        Check(Has(OpenAndUnpack(factory.Get(), unpacked), isTrusted), "a recorded package isn't trusted");
+
+        record = ReadBytes(path);
+        auto edited = record;
+        edited[edited.size() / 2] ^= 1;
+        WriteBytes(path, edited);
+        Check(!Has(OpenAndUnpack(factory.Get(), unpacked), isTrusted), "an edited record is trusted");
+        Check(Has(OpenAndUnpack(factory.Get(), unpacked), isTrusted), "the package isn't recorded again after it was hashed again");
+
+        auto otherDirectory = NewDirectory("store-");
+        auto otherFactory = MakeFactory();
+        ThrowHrIfFailed(otherFactory.As<IMSIXFactoryOptions>()->SetValidatedStateDirectory(otherDirectory.c_str()));
+        WriteBytes(RecordStore(otherDirectory).GetPath(package), ReadBytes(path));
+        Check(!Has(OpenAndUnpack(otherFactory.Get(), unpacked), isTrusted), "a record sealed with another key is trusted");
+        Check(Has(OpenAndUnpack(otherFactory.Get(), unpacked), isTrusted), "the package isn't recorded again under the other key");
+    }
+
+    std::string                      m_package;
+    MSIX_VALIDATION_OPTION           m_validation;
+    MSIX::ComPtr<IDirectoryObject>   m_scratch;
+    std::mutex                       m_logLock;
+    std::vector<std::string>         m_log;
+    int                              m_checks = 0;
+    int                              m_failures = 0;
+};
+
+int Usage(char* toolName)
+{
+    std::cout << "Usage: " << toolName << " -p <package> [-p <package> ...] [options]" << std::endl;
+    std::cout << "       " << toolName << " -check [-p <package> ...] [-ss]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "    -p <package>   : package to benchmark, may be repeated." << std::endl;
+    std::cout << "    -i <count>     : iterations per benchmark, default is 5." << std::endl;
+    std::cout << "    -o <file>      : write JSON results to <file> instead of stdout." << std::endl;
+    std::cout << "    -d <directory> : scratch directory for unpack.full and reader.unpack, default is ./msixbench_unpack." << std::endl;
+    std::cout << "    -f <filter>    : only run benchmarks whose name contains <filter>." << std::endl;
+    std::cout << "    -index <dir>   : keep package indexes in <dir>, so that package.open uses them after the first iteration." << std::endl;
+    std::cout << "    -cache <bytes> : keep up to <bytes> of opened packages, so that package.open reuses them after the first iteration." << std::endl;
+    std::cout << "    -trust <dir>   : record validated packages in <dir>, so that reader.unpack skips hashing after the first iteration." << std::endl;
+    std::cout << "    -sv            : skips signature origin validation." << std::endl;
+    std::cout << "    -ss            : skips enforcement of signed packages." << std::endl;
+    std::cout << "    -check         : runs the utf conversion, HashStream and log callback checks instead of benchmarking, and fails if any fail." << std::endl;
+    std::cout << "                     With packages, also checks reopening each of them through a reader cache, an index and a" << std::endl;
+    std::cout << "                     store of validated packages, which only records packages whose signature is checked." << std::endl;
+    return -1;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    for (int index = 1; index < argc; index++)
+    {
+        std::string option = argv[index];
+        bool hasValue = (index + 1 < argc);
+        if      (option == "-p" && hasValue) { settings.packages.push_back(argv[++index]); }
+        else if (option == "-o" && hasValue) { settings.outputFile = argv[++index]; }
+        else if (option == "-d" && hasValue) { settings.unpackDirectory = argv[++index]; }
+        else if (option == "-f" && hasValue) { settings.filter = argv[++index]; }
+        else if (option == "-index" && hasValue) { settings.indexDirectory = argv[++index]; }
+        else if (option == "-cache" && hasValue) { settings.cacheBudget = std::strtoull(argv[++index], nullptr, 10); }
+        else if (option == "-trust" && hasValue) { settings.trustDirectory = argv[++index]; }
+        else if (option == "-i" && hasValue) { settings.iterations = std::max(1, std::atoi(argv[++index])); }
+        else if (option == "-sv") { settings.validation = static_cast<MSIX_VALIDATION_OPTION>(settings.validation | MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN); }
+        else if (option == "-ss") { settings.validation = static_cast<MSIX_VALIDATION_OPTION>(settings.validation | MSIX_VALIDATION_OPTION_SKIPSIGNATURE); }
+        else if (option == "-check") { settings.check = true; }
+        else { return Usage(argv[0]); }
+    }
+    if (settings.check)
+    {   int failures = UnicodeChecks().Run() + CheckHashStream() + CheckLogCallback();
+        for (const auto& package : settings.packages)
+        {   failures += PackageChecks(settings, package).Run();
+        }
+        return (failures == 0) ? 0 : -1;
+    }
+    if (settings.packages.empty()) { return Usage(argv[0]); }
+
+    Runner runner(settings);
+    try
+    {
+        // The factory initializes xerces for the lifetime of the run.
+        auto factory = MSIX::ComPtr<IMSIXFactory>::Make<MSIX::AppxFactory>(settings.validation, BenchAllocate, BenchFree);
+        if (!settings.indexDirectory.empty())
+        {   ThrowHrIfFailed(factory.As<IMSIXFactoryOptions>()->SetIndexDirectory(settings.indexDirectory.c_str()));
+        }
+        if (settings.cacheBudget != 0)
+        {   ThrowHrIfFailed(factory.As<IMSIXFactoryOptions>()->SetReaderCacheBudget(settings.cacheBudget));
+        }
+        if (!settings.trustDirectory.empty())
+        {   ThrowHrIfFailed(factory.As<IMSIXFactoryOptions>()->SetValidatedStateDirectory(settings.trustDirectory.c_str()));
+        }
+        RunSyntheticBenchmarks(runner);
+        for (const auto& package : settings.packages)
+        {   RunPackageBenchmarks(runner, settings, factory.Get(), package);
+        }
+    }
+    catch (MSIX::Exception& e)
+    {
+        std::cerr << "error: 0x" << std::hex << e.Code() << " " << e.Message() << std::endl;
+        return -1;
+    }
+
+    if (settings.outputFile.empty())
+    {   runner.WriteJson(std::cout);
+    }
+    else
+    {   std::ofstream out(settings.outputFile);
+        runner.WriteJson(out);
+    }
+    return 0;
+}
@@ -0,0 +1,519 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// Generates synthetic, unsigned packages for scale and performance testing.  The output follows the
+// layout written by the Windows packaging tools: every local file header uses a data descriptor, the
+// central directory always carries zip64 extended information, and deflated files are flushed at each
+// 64KB block boundary so that the compressed size of every block can be recorded in AppxBlockMap.xml.
+// Since the packages are not signed, unpack them with 'makemsix unpack -ss'.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <cctype>
+#include <cerrno>
+#include <limits>
+
+#include "Base64.hpp"
+#include "SHA256.hpp"
+#include "zlib.h"
+
+namespace {
+
+const std::uint32_t BLOCK_SIZE = 65536;
+
+const std::uint32_t LOCAL_FILE_HEADER_SIGNATURE   = 0x04034b50;
+const std::uint32_t DATA_DESCRIPTOR_SIGNATURE     = 0x08074b50;
+const std::uint32_t CENTRAL_FILE_HEADER_SIGNATURE = 0x02014b50;
+const std::uint32_t ZIP64_EOCD_SIGNATURE          = 0x06064b50;
+const std::uint32_t ZIP64_EOCD_LOCATOR_SIGNATURE  = 0x07064b50;
+const std::uint32_t EOCD_SIGNATURE                = 0x06054b50;
+const std::uint16_t ZIP64_VERSION                 = 45;
+const std::uint16_t DATA_DESCRIPTOR_FLAG          = 0x0008;
+const std::uint16_t COMPRESSION_STORE             = 0;
+const std::uint16_t COMPRESSION_DEFLATE           = 8;
+const std::uint16_t FILE_TIME                     = 0x6B60;
+const std::uint16_t FILE_DATE                     = 0xA2B1;
+const std::uint32_t LOCAL_FILE_HEADER_SIZE        = 30;
+
+struct Extension
+{
+    const char* name;
+    const char* contentType;
+};
+
+const Extension extensions[] = {
+    { "dat",  "application/octet-stream" },
+    { "txt",  "text/plain" },
+    { "json", "application/json" },
+    { "png",  "image/png" },
+    { "dll",  "application/x-msdownload" },
+};
+
+struct Settings
+{
+    std::string   output;
+    std::uint64_t fileCount      = 100;
+    std::uint64_t minSize        = 1024;
+    std::uint64_t maxSize        = 256 * 1024;
+    bool          logDistribution = true;
+    std::uint32_t compressibility = 50;  // percent of content that is repetitive text
+    std::uint32_t storedPercent   = 20;  // percent of files that are stored instead of deflated
+    std::uint32_t depth           = 2;   // directories between the root and each file
+    std::uint32_t fanout          = 8;   // subdirectories per directory
+    std::uint64_t seed            = 0x5EED;
+};
+
+// xorshift64*, used instead of <random> so the same seed produces the same package on every platform.
+class Random
+{
+public:
+    Random(std::uint64_t seed) : m_state(seed ? seed : 0x9E3779B97F4A7C15ull) {}
+
+    std::uint64_t Next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 0x2545F4914F6CDD1Dull;
+    }
+
+    // [0, bound)
+    std::uint64_t Next(std::uint64_t bound) { return (bound == 0) ? 0 : Next() % bound; }
+
+    double NextDouble() { return static_cast<double>(Next() >> 11) / static_cast<double>(1ull << 53); }
+
+protected:
+    std::uint64_t m_state;
+};
+
+// Produces the content of a file one block at a time.  Each 64 byte chunk is either taken from a
+// repeating text or is random, in the proportion given by the compressibility setting.
+class ContentSource
+{
+public:
+    ContentSource(std::uint64_t seed, std::uint32_t compressibility) : m_random(seed), m_compressibility(compressibility) {}
+
+    void Fill(std::uint8_t* buffer, std::size_t size)
+    {
+        static const char text[] =
+            "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs. "
+            "How vexingly quick daft zebras jump! Sphinx of black quartz, judge my vow. ";
+        const std::size_t textSize = sizeof(text) - 1;
+        const std::size_t chunk = 64;
+        for (std::size_t offset = 0; offset < size; offset += chunk)
+        {
+            std::size_t count = std::min(chunk, size - offset);
+            if (m_random.Next(100) < m_compressibility)
+            {   for (std::size_t i = 0; i < count; i++)
+                {   buffer[offset + i] = static_cast<std::uint8_t>(text[m_textPosition++ % textSize]);
+                }
+            }
+            else
+            {   for (std::size_t i = 0; i < count; i += sizeof(std::uint64_t))
+                {   std::uint64_t value = m_random.Next();
+                    std::memcpy(buffer + offset + i, &value, std::min(sizeof(value), count - i));
+                }
+            }
+        }
+    }
+
+protected:
+    Random        m_random;
+    std::uint32_t m_compressibility;
+    std::size_t   m_textPosition = 0;
+};
+
+struct BlockInfo
+{
+    std::vector<std::uint8_t> hash;
+    std::uint64_t             compressedSize;
+};
+
+struct Entry
+{
+    std::string            name;        // name in the zip archive, '/' separated
+    bool                   isCompressed = false;
+    std::uint32_t          crc = 0;
+    std::uint64_t          offset = 0;  // of the local file header
+    std::uint64_t          compressedSize = 0;
+    std::uint64_t          uncompressedSize = 0;
+    std::vector<BlockInfo> blocks;
+};
+
+// Minimal forward-only zip writer that keeps track of its own offset so it never needs to seek.
+class ZipWriter
+{
+public:
+    ZipWriter(const std::string& path) : m_file(path, std::ios::binary | std::ios::trunc)
+    {
+        if (!m_file) { throw std::runtime_error("unable to create " + path); }
+    }
+
+    std::uint64_t Offset() { return m_offset; }
+
+    void Write(const void* data, std::size_t size)
+    {
+        m_file.write(reinterpret_cast<const char*>(data), size);
+        if (!m_file) { throw std::runtime_error("write failed"); }
+        m_offset += size;
+    }
+
+    void Write16(std::uint16_t value) { std::uint8_t b[] = { U8(value), U8(value >> 8) }; Write(b, sizeof(b)); }
+    void Write32(std::uint32_t value) { Write16(static_cast<std::uint16_t>(value)); Write16(static_cast<std::uint16_t>(value >> 16)); }
+    void Write64(std::uint64_t value) { Write32(static_cast<std::uint32_t>(value)); Write32(static_cast<std::uint32_t>(value >> 32)); }
+
+    // Writes a file produced by fill() in 64KB blocks, hashing each uncompressed block and, for
+    // deflated files, fully flushing the compressor at each block boundary.
+    template <class Fill>
+    Entry WriteFile(const std::string& name, bool isCompressed, std::uint64_t size, Fill fill)
+    {
+        Entry entry;
+        entry.name = name;
+        entry.isCompressed = isCompressed;
+        entry.offset = m_offset;
+        entry.uncompressedSize = size;
+
+        Write32(LOCAL_FILE_HEADER_SIGNATURE);
+        Write16(ZIP64_VERSION);
+        Write16(DATA_DESCRIPTOR_FLAG);
+        Write16(isCompressed ? COMPRESSION_DEFLATE : COMPRESSION_STORE);
+        Write16(FILE_TIME);
+        Write16(FILE_DATE);
+        Write32(0); // crc, compressed and uncompressed sizes are in the data descriptor
+        Write32(0);
+        Write32(0);
+        Write16(static_cast<std::uint16_t>(name.size()));
+        Write16(0);
+        Write(name.data(), name.size());
+
+        z_stream zstrm = {0};
+        if (isCompressed && (deflateInit2(&zstrm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK))
+        {   throw std::runtime_error("deflateInit2 failed");
+        }
+
+        std::vector<std::uint8_t> block(BLOCK_SIZE);
+        std::vector<std::uint8_t> compressed(deflateBound(&zstrm, BLOCK_SIZE) + 64);
+        std::uint32_t crc = crc32(0, Z_NULL, 0);
+        std::uint64_t remaining = size;
+        do
+        {
+            std::uint32_t count = static_cast<std::uint32_t>(std::min<std::uint64_t>(remaining, BLOCK_SIZE));
+            remaining -= count;
+            fill(block.data(), count);
+            crc = crc32(crc, block.data(), count);
+
+            BlockInfo info;
+            if (count != 0 || size == 0)
+            {   MSIX::SHA256::ComputeHash(block.data(), count, info.hash);
+            }
+            if (isCompressed)
+            {
+                zstrm.next_in = block.data();
+                zstrm.avail_in = count;
+                int flush = (remaining == 0) ? Z_FINISH : Z_FULL_FLUSH;
+                info.compressedSize = 0;
+                do
+                {
+                    zstrm.next_out = compressed.data();
+                    zstrm.avail_out = static_cast<uInt>(compressed.size());
+                    int ret = deflate(&zstrm, flush);
+                    if (ret == Z_STREAM_ERROR) { throw std::runtime_error("deflate failed"); }
+                    std::size_t produced = compressed.size() - zstrm.avail_out;
+                    Write(compressed.data(), produced);
+                    info.compressedSize += produced;
+                } while (zstrm.avail_out == 0 || zstrm.avail_in != 0);
+                entry.compressedSize += info.compressedSize;
+            }
+            else
+            {
+                Write(block.data(), count);
+                info.compressedSize = count;
+                entry.compressedSize += count;
+            }
+            // An empty file has no blocks.
+            if (count != 0) { entry.blocks.push_back(std::move(info)); }
+        } while (remaining != 0);
+
+        if (isCompressed) { deflateEnd(&zstrm); }
+        entry.crc = crc;
+
+        Write32(DATA_DESCRIPTOR_SIGNATURE);
+        Write32(entry.crc);
+        Write64(entry.compressedSize);
+        Write64(entry.uncompressedSize);
+        return entry;
+    }
+
+    void WriteCentralDirectory(const std::vector<Entry>& entries)
+    {
+        std::uint64_t startOfCentralDirectory = m_offset;
+        for (const auto& entry : entries)
+        {
+            Write32(CENTRAL_FILE_HEADER_SIGNATURE);
+            Write16(ZIP64_VERSION);                 // version made by
+            Write16(ZIP64_VERSION);                 // version needed to extract
+            Write16(DATA_DESCRIPTOR_FLAG);
+            Write16(entry.isCompressed ? COMPRESSION_DEFLATE : COMPRESSION_STORE);
+            Write16(FILE_TIME);
+            Write16(FILE_DATE);
+            Write32(entry.crc);
+            Write32(0xFFFFFFFF);                    // compressed size, in the zip64 extended information
+            Write32(0xFFFFFFFF);                    // uncompressed size, in the zip64 extended information
+            Write16(static_cast<std::uint16_t>(entry.name.size()));
+            Write16(28);                            // extra field length
+            Write16(0);                             // file comment length
+            Write16(0);                             // disk number start
+            Write16(0);                             // internal file attributes
+            Write32(0);                             // external file attributes
+            Write32(0xFFFFFFFF);                    // relative offset, in the zip64 extended information
+            Write(entry.name.data(), entry.name.size());
+            Write16(0x0001);                        // zip64 extended information
+            Write16(24);
+            Write64(entry.uncompressedSize);
+            Write64(entry.compressedSize);
+            Write64(entry.offset);
+        }
+        std::uint64_t sizeOfCentralDirectory = m_offset - startOfCentralDirectory;
+
+        std::uint64_t startOfZip64EndOfCentralDirectory = m_offset;
+        Write32(ZIP64_EOCD_SIGNATURE);
+        Write64(44);                                // size of the remaining record
+        Write16(ZIP64_VERSION);
+        Write16(ZIP64_VERSION);
+        Write32(0);                                 // number of this disk
+        Write32(0);                                 // disk with the start of the central directory
+        Write64(entries.size());
+        Write64(entries.size());
+        Write64(sizeOfCentralDirectory);
+        Write64(startOfCentralDirectory);
+
+        Write32(ZIP64_EOCD_LOCATOR_SIGNATURE);
+        Write32(0);
+        Write64(startOfZip64EndOfCentralDirectory);
+        Write32(1);
+
+        Write32(EOCD_SIGNATURE);
+        Write16(0xFFFF);
+        Write16(0xFFFF);
+        Write16(0xFFFF);
+        Write16(0xFFFF);
+        Write32(0xFFFFFFFF);
+        Write32(0xFFFFFFFF);
+        Write16(0);
+    }
+
+protected:
+    static std::uint8_t U8(std::uint32_t value) { return static_cast<std::uint8_t>(value & 0xFF); }
+
+    std::ofstream m_file;
+    std::uint64_t m_offset = 0;
+};
+
+std::string BlockMapName(std::string name)
+{
+    std::replace(name.begin(), name.end(), '/', '\\');
+    return name;
+}
+
+std::string CreateBlockMap(const std::vector<Entry>& entries)
+{
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>" << std::endl;
+    xml << "<BlockMap xmlns=\"http://schemas.microsoft.com/appx/2010/blockmap\" HashMethod=\"http://www.w3.org/2001/04/xmlenc#sha256\">";
+    for (const auto& entry : entries)
+    {
+        xml << "<File Name=\"" << BlockMapName(entry.name) << "\" Size=\"" << entry.uncompressedSize
+            << "\" LfhSize=\"" << (LOCAL_FILE_HEADER_SIZE + entry.name.size()) << "\">";
+        for (const auto& block : entry.blocks)
+        {
+            xml << "<Block Hash=\"" << MSIX::Base64Encode(block.hash) << "\"";
+            if (entry.isCompressed) { xml << " Size=\"" << block.compressedSize << "\""; }
+            xml << "/>";
+        }
+        xml << "</File>";
+    }
+    xml << "</BlockMap>";
+    return xml.str();
+}
+
+std::string CreateContentTypes()
+{
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+    xml << "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">";
+    for (const auto& extension : extensions)
+    {   xml << "<Default Extension=\"" << extension.name << "\" ContentType=\"" << extension.contentType << "\"/>";
+    }
+    xml << "<Default Extension=\"xml\" ContentType=\"text/xml\"/>";
+    xml << "<Override PartName=\"/AppxManifest.xml\" ContentType=\"application/vnd.ms-appx.manifest+xml\"/>";
+    xml << "<Override PartName=\"/AppxBlockMap.xml\" ContentType=\"application/vnd.ms-appx.blockmap+xml\"/>";
+    xml << "</Types>";
+    return xml.str();
+}
+
+std::string CreateManifest()
+{
+    std::ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"utf-8\"?>" << std::endl;
+    xml << "<Package xmlns=\"http://schemas.microsoft.com/appx/manifest/foundation/windows10\">" << std::endl;
+    xml << "  <Identity Name=\"MSIX.Synthetic.Package\" Publisher=\"CN=MSIX Synthetic\" Version=\"1.0.0.0\" ProcessorArchitecture=\"neutral\"/>" << std::endl;
+    xml << "  <Properties>" << std::endl;
+    xml << "    <DisplayName>Synthetic package</DisplayName>" << std::endl;
+    xml << "    <PublisherDisplayName>MSIX Synthetic</PublisherDisplayName>" << std::endl;
+    xml << "    <Logo>logo.png</Logo>" << std::endl;
+    xml << "  </Properties>" << std::endl;
+    xml << "</Package>" << std::endl;
+    return xml.str();
+}
+
+// Names files so that they spread over a tree 'depth' directories deep with 'fanout' subdirectories each.
+std::string FileName(const Settings& settings, std::uint64_t index)
+{
+    std::ostringstream name;
+    std::uint64_t path = index;
+    for (std::uint32_t level = 0; level < settings.depth; level++)
+    {   name << "dir" << (path % settings.fanout) << "/";
+        path /= settings.fanout;
+    }
+    name << "file" << index << "." << extensions[index % (sizeof(extensions) / sizeof(extensions[0]))].name;
+    return name.str();
+}
+
+std::uint64_t FileSize(const Settings& settings, Random& random)
+{
+    if (settings.maxSize <= settings.minSize) { return settings.minSize; }
+    if (!settings.logDistribution)
+    {   return settings.minSize + random.Next(settings.maxSize - settings.minSize + 1);
+    }
+    // log-uniform: many small files, a few large ones.
+    double low = std::log(static_cast<double>(std::max<std::uint64_t>(settings.minSize, 1)));
+    double high = std::log(static_cast<double>(settings.maxSize));
+    auto size = static_cast<std::uint64_t>(std::exp(low + (high - low) * random.NextDouble()));
+    return std::min(std::max(size, settings.minSize), settings.maxSize);
+}
+
+// Fails for anything that isn't a plain decimal number with an optional suffix, or that doesn't fit in 64 bits.
+bool ParseSize(const std::string& value, std::uint64_t& result)
+{
+    if (value.empty() || !std::isdigit(static_cast<unsigned char>(value[0]))) { return false; }
+    char* end = nullptr;
+    errno = 0;
+    result = std::strtoull(value.c_str(), &end, 10);
+    if (errno == ERANGE) { return false; }
+    std::uint64_t multiplier = 1;
+    switch (*end)
+    {
+    case '\0':           return true;
+    case 'k': case 'K':  multiplier = 1024ull; break;
+    case 'm': case 'M':  multiplier = 1024ull * 1024; break;
+    case 'g': case 'G':  multiplier = 1024ull * 1024 * 1024; break;
+    default:             return false;
+    }
+    if (result > std::numeric_limits<std::uint64_t>::max() / multiplier) { return false; }
+    result *= multiplier;
+    return *(end + 1) == '\0';
+}
+
+int Usage(char* toolName)
+{
+    std::cout << "Usage: " << toolName << " -o <package> [options]" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Writes an unsigned package with synthetic payload files.  Use 'makemsix unpack -ss' to unpack it." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "    -o <package>       : REQUIRED, output package name." << std::endl;
+    std::cout << "    -n <count>         : number of payload files, default is 100." << std::endl;
+    std::cout << "    -size <min>[:<max>]: payload file size range, k/m/g suffixes allowed, default is 1k:256k." << std::endl;
+    std::cout << "    -dist <uniform|log>: file size distribution within the range, default is log." << std::endl;
+    std::cout << "    -c <percent>       : compressibility of the content, default is 50." << std::endl;
+    std::cout << "    -stored <percent>  : percent of payload files that are stored instead of deflated, default is 20." << std::endl;
+    std::cout << "    -depth <count>     : directory depth of the payload files, default is 2." << std::endl;
+    std::cout << "    -fanout <count>    : subdirectories per directory, default is 8." << std::endl;
+    std::cout << "    -seed <value>      : seed for the generated content, default is 24301." << std::endl;
+    return -1;
+}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    Settings settings;
+    for (int index = 1; index < argc; index++)
+    {
+        std::string option = argv[index];
+        if (index + 1 == argc) { return Usage(argv[0]); }
+        std::string value = argv[++index];
+        if (option == "-o") { settings.output = value; }
+        else if (option == "-n") { settings.fileCount = std::strtoull(value.c_str(), nullptr, 10); }
+        else if (option == "-size")
+        {
+            auto separator = value.find(':');
+            if (!ParseSize(value.substr(0, separator), settings.minSize)) { return Usage(argv[0]); }
+            settings.maxSize = settings.minSize;
+            if (separator != std::string::npos && !ParseSize(value.substr(separator + 1), settings.maxSize)) { return Usage(argv[0]); }
+        }
+        else if (option == "-dist")
+        {
+            if (value != "log" && value != "uniform") { return Usage(argv[0]); }
+            settings.logDistribution = (value == "log");
+        }
+        else if (option == "-c")      { settings.compressibility = std::min(100, std::atoi(value.c_str())); }
+        else if (option == "-stored") { settings.storedPercent = std::min(100, std::atoi(value.c_str())); }
+        else if (option == "-depth")  { settings.depth = static_cast<std::uint32_t>(std::atoi(value.c_str())); }
+        else if (option == "-fanout") { settings.fanout = std::max(1, std::atoi(value.c_str())); }
+        else if (option == "-seed")   { settings.seed = std::strtoull(value.c_str(), nullptr, 10); }
+        else { return Usage(argv[0]); }
+    }
+    if (settings.output.empty()) { return Usage(argv[0]); }
+
+    try
+    {
+        Random random(settings.seed);
+        ZipWriter zip(settings.output);
+        std::vector<Entry> entries;
+        std::uint64_t payloadSize = 0;
+        for (std::uint64_t index = 0; index < settings.fileCount; index++)
+        {
+            std::uint64_t size = FileSize(settings, random);
+            bool isCompressed = random.Next(100) >= settings.storedPercent;
+            ContentSource content(random.Next(), settings.compressibility);
+            entries.push_back(zip.WriteFile(FileName(settings, index), isCompressed, size,
+                [&](std::uint8_t* buffer, std::size_t count) { content.Fill(buffer, count); }));
+            payloadSize += size;
+        }
+
+        auto WriteText = [&](const std::string& name, const std::string& text) {
+            std::size_t position = 0;
+            return zip.WriteFile(name, true, text.size(), [&](std::uint8_t* buffer, std::size_t count) {
+                std::memcpy(buffer, text.data() + position, count);
+                position += count;
+            });
+        };
+
+        // The block map covers the payload and the manifest, but neither itself nor [Content_Types].xml
+        entries.push_back(WriteText("AppxManifest.xml", CreateManifest()));
+        auto blockMap = WriteText("AppxBlockMap.xml", CreateBlockMap(entries));
+        auto contentTypes = WriteText("[Content_Types].xml", CreateContentTypes());
+        entries.push_back(std::move(blockMap));
+        entries.push_back(std::move(contentTypes));
+        zip.WriteCentralDirectory(entries);
+
+        std::cout << settings.output << ": " << settings.fileCount << " payload files, " << payloadSize
+                  << " payload bytes, " << zip.Offset() << " package bytes" << std::endl;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}